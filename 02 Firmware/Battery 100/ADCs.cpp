@@ -13,22 +13,26 @@
 void updateAverage(unsigned int _ADC_value, char _i) {
 	// Gives a bit of "inertia" to the cell voltage readings.
 	// Each new reading is 1 of 32 samples for a new average
-	// each time.
+	// each time (2^averageShift, fewer with enableSyncedADC).
 	// 31 of those samples are the last value.
-	av_ADC_values[_i] *= 31;
+	av_ADC_values[_i] *= (1 << averageShift) - 1;
 	// The last sample is the new value.
 	av_ADC_values[_i] += _ADC_value;
 	// Add the previous cycle's dropped bits; better than a remainder! (see "Rolling average problem.xlsx")
 	av_ADC_values[_i] += dropped_bits[_i];
 	// Save the bits that are about to be dropped in this cycle, for adding on again next cycle
-	dropped_bits[_i] = av_ADC_values[_i] & 0b11111;
+	dropped_bits[_i] = av_ADC_values[_i] & ((1 << averageShift) - 1);
 	// Drop the bits to complete the division
-	av_ADC_values[_i] = av_ADC_values[_i] >> 5;
+	av_ADC_values[_i] = av_ADC_values[_i] >> averageShift;
 }
 
 void backToSleep(void) {
 	// Shutdown ADC (in case it's not done automatically)
 	ADC10CTL0 = 0;
+#ifdef enableWakeScheduling
+	// Pick how long to sleep for (this changes the watchdog period)
+	setSleepPeriod();
+#endif
 	// Pat watchdog
 	patWatchdog();
 	// Enter Low Power Mode 3 (turns off CPU and stops code
@@ -59,12 +63,24 @@ void checkPV(void) {
 	// we need to enable a 30us delay to allow the internal reference
 	// voltage to settle
 	// __delay_cycles(250); // Disabled to see if we can get away without it!! It's only supposed to be rough after all...
+#ifdef enableWakeScheduling
+	// Count the time we've been asleep
+	countSleepTime();
+#endif
+#ifdef enableDailyStats
+	// Count the wake-up
+	statsAtWake();
+#endif
 
 	// Read PV ADC channel and quickly compare to PV minimum threshold
 	// to decide whether or not to go back to sleep.
 	if( readADCChannel(PV) < lowPV_uncalib)		// We are using an uncalibrated version of lowPV here, to minimise time spent awake, but it's only meant to be rough anyway!
 		backToSleep();
 
+#ifdef enableWakeScheduling
+	// Learn how long the night was
+	wakeAtDawn();
+#endif
 	// Otherwise return to main and wake-up fully!
 }
 
@@ -75,15 +91,26 @@ void refreshADCs(void) {
 	// Reinitialise max/min cell values
 	minCell = 0;
 	maxCell = 0;
+#ifdef enableSyncedADC
+	// Convert all the channels at once, in step with the PWM
+	unsigned int synced[syncedChannels];
+	bool isSynced = syncADCs(synced);
+#endif
 	// Start looping through the channels
 	for (char i = 0; i < 6; i++) {
+		// Read the ADC channel (corrected with the divider calibration, if there is one)
+#ifdef enableSyncedADC
+		unsigned int reading = correctADC(isSynced ? synced[7 - ADC_CH_numbers[i]] : readADCChannel(ADC_CH_numbers[i]), i);
+#else
+		unsigned int reading = correctADC(readADCChannel(ADC_CH_numbers[i]), i);
+#endif
 		// If it's a battery cell channel, then:
 		// - calculate the rolling average
 		// - update cell values as relevant
 		// - determine which is min and max cell
 		if (i < 4) {
-			// Read the ADC channel and update the rolling average
-			updateAverage(readADCChannel(ADC_CH_numbers[i]), i);
+			// Update the rolling average
+			updateAverage(reading, i);
 			// Now calculate cell value as relevant
 			// and also determine max/min cell
 			av_cell_values[i] = av_ADC_values[i];
@@ -99,10 +126,15 @@ void refreshADCs(void) {
 		// save the value for later (without rolling average
 		// because we need a faster response.
 		else {
-			av_ADC_values[i] = readADCChannel(ADC_CH_numbers[i]);
+			av_ADC_values[i] = reading;
 		}
 	}
 
+// Read the temperature sensor along with everything else, placed in "refreshADCs()", in ADCs.cpp
+#ifdef enableTempCompensation
+	sampleTemp();
+#endif
+
 // Code for getting temperature and comparing with max version, placed in "refreshADCs()", in ADCs.cpp
 #ifdef enableMaxTempLog
 	logTemp();
@@ -0,0 +1,77 @@
+/*
+ * Optional ADC noise measurement, for the bench. The rolling averages and
+ * the threshold margins were set by feel ("if we can get ADC channels to be
+ * more stable"), so this measures how much each channel really moves with
+ * its input held still, at each sample time and reference:
+ *  - a few samples find the centre, and the rest are measured from it, so
+ *    the sums stay small enough for a long (there's no hardware multiplier,
+ *    but there's no hurry here either)
+ *  - the mean and variance come from the sum and the sum of squares, and
+ *    the histogram is of the distance from the centre
+ *  - the ENOB, and how much averaging that calls for, are worked out on a
+ *    PC with "02 Firmware/Tools/noiseDecode.cpp"
+ */
+
+#include <msp430.h>
+#include "header.h"
+
+// Where the debugger stops to dump noiseReport (kept out of line, so there's somewhere to put the breakpoint)
+#pragma FUNC_CANNOT_INLINE
+void noiseReportReady(void) {
+	__no_operation();
+}
+
+// Set the ADC up as in initialiseADC(), but with the given setting's sample time and reference
+// (see noiseSettings), and give the reference time to settle
+void setNoiseSetting(char setting) {
+	ADC10CTL0 = ADC10ON + REFON + SREF_1 + ( (setting & BIT2) ? 0 : REF2_5V ) + ( (unsigned int) (setting & 3) << 11 );
+	__delay_cycles(400);						// The reference needs 30us, this is 50us at 8MHz
+}
+
+// Sample a channel (index into av_ADC_values) at the current setting, and work out its figures
+void measureChannelNoise(char i, struct NoiseResult *result) {
+	unsigned int centre = 0;
+	long sum = 0;
+	unsigned long sumSquares = 0;
+	for (char b = 0; b < noiseBins; b++)
+		result->histogram[b] = 0;
+	for (char j = 0; j < (1 << noiseCentreShift); j++)
+		centre += readADCChannel(ADC_CH_numbers[i]);
+	centre = ( centre + (1 << (noiseCentreShift - 1)) ) >> noiseCentreShift;
+	for (unsigned int j = 0; j < (1 << noiseSampleShift); j++) {
+		int offset = (int) readADCChannel(ADC_CH_numbers[i]) - (int) centre;
+		sum += offset;
+		sumSquares += (long) offset * offset;
+		char bin = ( (offset < -3) || (offset > 3) ) ? noiseBins - 1 : offset + 3;
+		if (result->histogram[bin] != 0xFF)
+			result->histogram[bin]++;
+	}
+	patWatchdog();
+	// mean = centre + sum / n, and variance = sumSquares / n - (sum / n)^2, both in 1/16ths
+	result->mean = (centre << 4) + (int) ( sum >> (noiseSampleShift - 4) );
+	unsigned long variance = 0xFFFF;
+	if ( (sum < 0x10000) && (sum > -0x10000) ) {
+		unsigned long size = (sum < 0) ? -sum : sum;
+		variance = ( sumSquares >> (noiseSampleShift - 4) ) - ( (size * size) >> (2 * noiseSampleShift - 4) );
+	}
+	result->variance = (variance > 0xFFFF) ? 0xFFFF : variance;
+}
+
+// Called from initialiseFull(), and never returns: sweep the settings over and over, stopping at
+// noiseReportReady() after each one. The gate's left open, so this is for a supply or a charged battery.
+void measureNoise(void) {
+	setLEDs(2);
+	openGate();
+	noiseReport.magic = noiseMagic;
+	noiseReport.sweep = 0;
+	while (1) {
+		for (char setting = 0; setting < noiseSettings; setting++) {
+			setNoiseSetting(setting);
+			noiseReport.setting = setting;
+			for (char i = 0; i < 6; i++)
+				measureChannelNoise(i, &noiseReport.results[i]);
+			noiseReportReady();
+		}
+		noiseReport.sweep++;
+	}
+}
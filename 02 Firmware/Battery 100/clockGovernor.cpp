@@ -0,0 +1,104 @@
+/*
+ * Optional clock speed governor. Picks one of the calibrated DCO
+ * settings (1, 8 or 16MHz) depending on how much regulating there is
+ * to do, and rescales everything that depends on the clock speed so
+ * that the rest of the code needn't care. Snooze mode is left alone,
+ * it sets its own (slowest) clock.
+ */
+
+#include <msp430.h>
+#include "header.h"
+
+// Clock speed in MHz for each clockSpeed, for waitTicks()
+const char clockMHz[3] = {1, 8, 16};
+
+// Busy-wait for at least the given number of 8us ticks, whatever speed the
+// clock is running at (for delays that are really about time, like letting
+// the ADC reference settle). Loop overheads make it longer at 1MHz.
+void waitTicks(unsigned int ticks) {
+	while (ticks--)
+		for (char i = 0; i < clockMHz[clockSpeed]; i++)
+			__delay_cycles(8);
+}
+
+void setClockSpeed(char speed) {
+#ifndef enableDitheredPWM
+	char newShift = (speed == CLOCK_1MHZ) ? 3 : 0;
+#endif
+	// Stop Timer_A while the PWM is rescaled, so it can't overrun TACCR0
+	TACTL = MC_0;
+	// When speeding up to 16MHz, divide SMCLK before the DCO gets there,
+	// so that Timer_A never sees more than 8MHz
+	if (speed == CLOCK_16MHZ)
+		BCSCTL2 = DIVS_1;
+	// Change the DCO. Zeroing DCOCTL first stops it overshooting while
+	// RSEL changes (as in TI's examples)
+	DCOCTL = 0;
+	switch (speed) {
+	case CLOCK_1MHZ:
+		BCSCTL1 = (BCSCTL1 & ~0x0f) | (0x0f & CALBC1_1MHZ);
+		DCOCTL = CALDCO_1MHZ;
+		break;
+	case CLOCK_8MHZ:
+		BCSCTL1 = BCSCTL1_setting;
+		DCOCTL = DCOCTL_setting;
+		break;
+	case CLOCK_16MHZ:
+		BCSCTL1 = (BCSCTL1 & ~0x0f) | (0x0f & CALBC1_16MHZ);
+		DCOCTL = CALDCO_16MHZ;
+		break;
+	}
+	if (speed != CLOCK_16MHZ)
+		BCSCTL2 = DIVS_0;
+	// The ADC is clocked from MCLK, so halve its clock at 16MHz
+	// (ENC is always clear between readings, so this is allowed)
+	ADC10CTL1 = (ADC10CTL1 & ~ADC10DIV_7) | ((speed == CLOCK_16MHZ) ? ADC10DIV_1 : ADC10DIV_0);
+#ifdef enableMaxTempLog
+	// Keep the flash timing generator between 257kHz and 476kHz (MCLK / 3, 27 or 54)
+	FCTL2 = FWKEY + FSSEL_1 + ((speed == CLOCK_1MHZ) ? 3 - 1 : (speed == CLOCK_8MHZ) ? 27 - 1 : 54 - 1);
+#endif
+#ifndef enableDitheredPWM
+	// At 1MHz the PWM can only keep its frequency (and so keep nudging) with
+	// a shorter period, so scale the period and duty cycle down together
+	// (the dithered PWM is fast enough at any speed, so is left alone)
+	TACCR1 = (TACCR1 << PWMshift) >> newShift;
+	TACCR0 = PWMperiod >> newShift;
+	PWMshift = newShift;
+#endif
+	clockSpeed = speed;
+	// Restart Timer_A, unless we're snoozing (when it should stay off)
+	if (P2SEL != 0)
+		TACTL = TASSEL_2 + MC_1 + TACLR;
+}
+
+void governClock(void) {
+	char wanted;
+	// Snooze mode has its own clock settings
+	if (P2SEL == 0)
+		return;
+	// Nothing to regulate if the battery is full, or PV is so weak (or
+	// cells so high) that the nudge voltage is throttled right back
+	// (refreshCharge() leaves the duty wobbling by one count at maxDuty)
+	if ( (batteryStatus == 1) || (nudgeDuty + 1 >= ((unsigned int) maxDuty >> PWMshift)) )
+		wanted = CLOCK_1MHZ;
+	// Actively tracking the PV maximum power point, so go as fast as we can
+	else if (nudgeDuty != 0)
+		wanted = CLOCK_16MHZ;
+	// Charging flat out (duty at 0), so just keep watch at the usual speed
+	else
+		wanted = CLOCK_8MHZ;
+	// Speed up straight away, but only slow down once the lower speed has
+	// been wanted for a while, so we don't keep switching
+	if (wanted > clockSpeed) {
+		setClockSpeed(wanted);
+		governorHold = 0;
+	}
+	else if (wanted < clockSpeed) {
+		if (++governorHold >= governorHoldLoops) {
+			setClockSpeed(wanted);
+			governorHold = 0;
+		}
+	}
+	else
+		governorHold = 0;
+}
@@ -29,6 +29,30 @@ void goToSleep(void) {
 	ADC10CTL0 = 0;
 	// Discharge MOSFET is already shut (it's a condition of being here!)
 	// so don't need to worry about that.
+#ifdef enableEventTrace
+	traceEvent(EV_SLEEP, batteryStatus);
+#endif
+#ifdef enableTempCompensation
+	// Put the thresholds back as calibrated (they're compensated again once we're awake, and
+	// the warm boot mustn't keep the compensation without the temperature it was for)
+	setTempCompensation(0, 0);
+#endif
+#ifdef enableWarmBoot
+	// Keep calibration and averages for when we wake up again
+	saveWarmState();
+#endif
+#ifdef enableWakeScheduling
+	// Pick how long to sleep for (this changes the watchdog period)
+	setSleepPeriod();
+#endif
+#ifdef enableDailyStats
+	// Keep the day's statistics for when we wake up again
+	sealStats();
+#endif
+#ifdef enableStateOfHealth
+	// Keep the state of health figures, if they've changed
+	saveHealth();
+#endif
 	// Pat watchdog
 	patWatchdog();
 	// Enter Low Power Mode 3 (turns off CPU and stops code
@@ -39,11 +63,24 @@ void goToSleep(void) {
 // This method slows down the MCU to conserve energy when not charging.
 // Also used in some flashing loops.
 void goToSnooze(void) {
+#ifdef enableEventTrace
+	traceEvent(EV_SNOOZE, av_ADC_values[4]);
+#endif
+#ifdef enableClockGovernor
+	// Back to the usual 8MHz settings first (SMCLK and ADC dividers, PWM period),
+	// so that wakeUpFromSnooze() only has to restore the DCO
+	setClockSpeed(CLOCK_8MHZ);
+#endif
 	// Disable PWM output pin (should then become a digital output, set high
 	// which will disable charging)
 	P2SEL = 0;
+#ifdef enableWakeScheduling
+	// Leave Timer_A counting ACLK (the VLO) instead, as the clock for the wake schedule
+	TACTL = TASSEL_1 + MC_2;
+#else
 	// Shutdown Timer_A
 	TACTL = MC_0;
+#endif
 	// Set PWM pin to high-impedance input, to prevent current drain.
 	P2DIR &= ~BIT6;
 	// Slow DCO, and ACLK down to min speed
@@ -53,12 +90,15 @@ void goToSnooze(void) {
 	ADC10CTL0 |= ADC10SHT_3 + ADC10SR;
 	ADC10CTL1 |= ADC10DIV_7;
 	// Initialise counter for keeping track of how long the unit has been snoozing
-	timeSinceLastCharge = maxSnoozeTime;
+	timeSinceLastCharge = snoozeLimit;
 }
 
 // This method speeds up the MCU when charging, to ensure max loop stability.
 // Also used in some flashing loops.
 void wakeUpFromSnooze(void) {
+#ifdef enableEventTrace
+	traceEvent(EV_WAKE, av_ADC_values[4]);
+#endif
 	// Set PWM port back to a digital output (set high) to immediately
 	// disable charging.
 	P2DIR |= BIT6;
@@ -66,7 +106,11 @@ void wakeUpFromSnooze(void) {
 	DCOCTL = DCOCTL_setting;
 	BCSCTL1 = BCSCTL1_setting;
 	// Turn on Timer_A (same settings as in initialisation)
+#ifdef enableWakeScheduling
+	TACTL = TASSEL_2 + MC_1 + TACLR;	// TAR has been counting ACLK, so start the period again
+#else
 	TACTL = TASSEL_2 + MC_1;
+#endif
 	// Enable PWM output
 	P2SEL = BIT6;
 	// Put ADC into fast mode
@@ -84,7 +128,18 @@ void considerSnooze(void) {
 	// see if we're already snoozing and then this
 	// can be skipped
 	if ( (P2SEL == BIT6) && (av_ADC_values[4] < lowPV) ) {
+#ifdef enableDailyStats
+		// Save the day, while the clock's still fast enough for the flash
+		statsAtDusk();
+#endif
+#ifdef enableStateOfHealth
+		// And the state of health figures, if they've changed
+		saveHealth();
+#endif
 		goToSnooze();
+#ifdef enableWakeScheduling
+		wakeAtDusk();
+#endif
 	}
 	// If snoozing, count a cycle since last charge, and check to see
 	// if we've been snoozing for too long.
@@ -92,17 +147,34 @@ void considerSnooze(void) {
 	// re-enable PWM. Check PWM output pin function byte to see
 	// if we're already awake and then this can be skipped.
 	if (P2SEL == 0) {
+#ifdef enableWakeScheduling
+		// Keep the wake schedule's clock, which may cut timeSinceLastCharge short on a dark day
+		countSnoozeTime();
+#endif
 		timeSinceLastCharge--;
 		if (timeSinceLastCharge == 0)
 			goToSleep();
-		if (av_ADC_values[4] >= lowPV)
+		if (av_ADC_values[4] >= lowPV) {
 			wakeUpFromSnooze();
+#ifdef enableWakeScheduling
+			wakeAtDawn();
+#endif
+		}
 	}
 }
 
 void considerSleep(void) {
 	// Go to sleep if:
 	// - No solar power AND Discharge is currently off due to the battery being empty
-	if ( (av_ADC_values[4] < lowPV) && (batteryStatus == 2) )
+	if ( (av_ADC_values[4] < lowPV) && (batteryStatus == 2) ) {
+#ifdef enableDailyStats
+		// Save the day, if we weren't already snoozing
+		statsAtDusk();
+#endif
+#ifdef enableWakeScheduling
+		// Start the wake schedule's clock, if we weren't already snoozing
+		wakeAtDusk();
+#endif
 		goToSleep();
+	}
 }
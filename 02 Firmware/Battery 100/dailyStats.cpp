@@ -0,0 +1,248 @@
+/*
+ *
+ * Daily statistics: so that a unit back from the field (or under warranty) has a history
+ * of how it's been used, not just its maximum temperature:
+ *  - the day so far is kept in dayStats, in uninitialised RAM so that it survives the
+ *    watchdog wake-ups, checked as warmState is. Anything but a wake-up from sleep starts
+ *    the day again, with STATS_RESET set
+ *  - on each loop, a counter is counted down (faster while snoozing), and only when it runs
+ *    out is the state sampled: PV, full, empty, bleeding, and the lowest and highest cells.
+ *    Short circuits are counted as they happen, and wake-ups from sleep in checkPV()
+ *  - at dusk the day is saved to info segment C, as a record of 3 words, if there's been
+ *    enough PV for it to have been a day. The cell voltages and temperature are deltas
+ *    from the record before, clamped, so a big change takes more than a day to show
+ *  - when the segment is full it's erased, and the newest statsKeepDays records are written
+ *    back, after a new base for their deltas. maxTemp_FLASH is written back too, so it's
+ *    only brought up to date here, rather than erasing the segment every time it goes up
+ *  - read back the information memory with the programmer, and decode it with
+ *    "02 Firmware/Tools/historyDecode.cpp"
+ *
+ */
+
+#include <msp430.h>
+#include "header.h"
+
+// What the temperature in the records is, for the decoder
+#if !defined(enableMaxTempLog)
+#define statsFormat						(statsVersion | STATS_NOTEMP)
+#elif defined(enableTempCompensation)
+#define statsFormat						(statsVersion | STATS_TEMP25)
+#else
+#define statsFormat						statsVersion
+#endif
+
+// Simple sum of all the words in dayStats before the checksum
+unsigned int dayStatsChecksum(void) {
+	unsigned int checksum = statsMagic;
+	unsigned int *word = (unsigned int *) &dayStats;
+	for (char i = 0; i < (sizeof(struct DayStats) / sizeof(unsigned int)) - 1; i++)
+		checksum += word[i];
+	return checksum;
+}
+
+// Start a new day (the first sample is a period in, once the averages have settled)
+void clearStats(char flags) {
+	dayStats.loops = statsPeriodLoops;
+	dayStats.harvest = 0;
+	dayStats.full = 0;
+	dayStats.empty = 0;
+	dayStats.bleed = 0;
+	dayStats.wakes = 0;
+	dayStats.peakTemp = 0;
+	dayStats.minCell = 0xFF;
+	dayStats.maxCell = 0;
+	dayStats.shorts = 0;
+	dayStats.flags = flags;
+}
+
+// Called by goToSleep() before entering LPM3, so that the day survives the wake-up
+void sealStats(void) {
+	dayStats.checksum = dayStatsChecksum();
+}
+
+// Called by checkPV() on every wake-up (so from _system_pre_init() with the warm boot:
+// nothing here may use a global variable but dayStats). Counts the wake-up, or starts
+// the day again if that wasn't a wake-up from sleep.
+void statsAtWake(void) {
+	if ( !(IFG1 & WDTIFG) || (IFG1 & (PORIFG + RSTIFG)) || (dayStats.checksum != dayStatsChecksum()) )
+		clearStats(STATS_RESET);
+	else if (dayStats.wakes != 0xFFFF)
+		dayStats.wakes++;
+	sealStats();
+}
+
+void countPeriod(unsigned int *count) {
+	if (*count != 0xFFFF)
+		(*count)++;
+}
+
+// Sample the state, once a period
+void sampleStats(void) {
+	bool bleeding = false;
+	if (P2SEL != 0)
+		countPeriod(&dayStats.harvest);
+	if (batteryStatus == 1)
+		countPeriod(&dayStats.full);
+	else if (batteryStatus == 2)
+		countPeriod(&dayStats.empty);
+	for (char i = 0; i < 4; i++) {
+		char cell = (av_cell_values[i] > 0xFF) ? 0xFF : av_cell_values[i];
+		if (cell < dayStats.minCell)
+			dayStats.minCell = cell;
+		if (cell > dayStats.maxCell)
+			dayStats.maxCell = cell;
+		bleeding |= cell_bleedingOn[i];
+	}
+	if (bleeding)
+		countPeriod(&dayStats.bleed);
+#ifdef enableMaxTempLog
+	if (av_tempADC > dayStats.peakTemp)
+		dayStats.peakTemp = av_tempADC;
+#endif
+}
+
+// Called by main() on every loop, so kept short: the state is only sampled once a period
+void countStats(void) {
+	unsigned int weight = (P2SEL == 0) ? statsSnoozeWeight : 1;
+	if (dayStats.loops >= weight) {
+		dayStats.loops -= weight;
+		return;
+	}
+	dayStats.loops += statsPeriodLoops - weight;
+	sampleStats();
+}
+
+// A count of periods or wake-ups, in the 6 bits of a record
+unsigned int quantise(unsigned int count, char shift) {
+	count >>= shift;
+	return (count > 63) ? 63 : count;
+}
+
+// The change from the last record, clamped to a signed field of so many bits
+int clampDelta(int delta, char bits) {
+	int limit = 1 << (bits - 1);
+	if (delta >= limit)
+		return limit - 1;
+	if (delta < -limit)
+		return -limit;
+	return delta;
+}
+
+// A signed field of a record word
+int deltaField(unsigned int word, char shift, char bits) {
+	int delta = (word >> shift) & ((1 << bits) - 1);
+	if (delta & (1 << (bits - 1)))
+		delta -= 1 << bits;
+	return delta;
+}
+
+// Add today's record to segment C, erasing it first if it's full (or not ours yet).
+// The record's bit in unused is written last, so a record that's only half written
+// (the power going, say) isn't there.
+void saveDay(void) {
+	struct DayHistory *history = dayHistory;
+	unsigned int kept[statsKeepDays][3];
+	unsigned int record[3], unused;
+	char days = 0;
+	char keep = 0;
+	bool erase = (history->format != statsFormat);
+	// Where the deltas are from: the base for the first record kept, and the last record's
+	// values. With no records yet, both are today's.
+	int baseLowest = dayStats.minCell, baseHighest = dayStats.maxCell, baseTemp = dayStats.peakTemp >> statsTempShift;
+	int lowest = baseLowest, highest = baseHighest, temp = baseTemp;
+	int lowestDelta, highestDelta, tempDelta;
+	if (!erase) {
+		while ( (days < statsDays) && !(history->unused & (1 << days)) )
+			days++;
+		if (days == statsDays)
+			erase = true;
+	}
+#ifdef enableMaxTempLog
+	// Bring maxTemp_FLASH up to date, which needs an erase unless it's only clearing bits. maxTemp_RAM
+	// starts again from maxTemp_FLASH after a reset, so the day's peak (which survives) is taken too
+	unsigned int maxTemp = *maxTemp_FLASH;
+	unsigned int peak = (dayStats.peakTemp > maxTemp_RAM) ? dayStats.peakTemp : maxTemp_RAM;
+	if (peak > maxTemp) {
+		if ( (maxTemp & peak) != peak )
+			erase = true;
+		maxTemp = peak;
+	}
+#endif
+	if (erase)
+		keep = (days < statsKeepDays) ? days : statsKeepDays;
+	if (days) {
+		lowest = history->baseMinCell;
+		highest = history->baseMaxCell;
+		temp = history->baseTemp;
+		for (char i = 0; i < days; i++) {
+			if (i == days - keep) {
+				baseLowest = lowest;
+				baseHighest = highest;
+				baseTemp = temp;
+			}
+			lowest += deltaField(history->records[i][2], 0, 5);
+			highest += deltaField(history->records[i][2], 5, 5);
+			temp += deltaField(history->records[i][1], 12, 4);
+		}
+	}
+	lowestDelta = clampDelta(dayStats.minCell - lowest, 5);
+	highestDelta = clampDelta(dayStats.maxCell - highest, 5);
+	tempDelta = clampDelta((dayStats.peakTemp >> statsTempShift) - temp, 4);
+	for (char i = 0; i < keep; i++)
+		for (char j = 0; j < 3; j++)
+			kept[i][j] = history->records[days - keep + i][j];
+
+	record[0] = quantise(dayStats.harvest, statsPeriodShift) | (quantise(dayStats.full, statsPeriodShift) << 6)
+			| ((unsigned int) ((dayStats.shorts > 7) ? 7 : dayStats.shorts) << 12) | ((dayStats.flags & STATS_RESET) ? 0x8000 : 0);
+	record[1] = quantise(dayStats.empty, statsPeriodShift) | (quantise(dayStats.bleed, statsPeriodShift) << 6)
+			| ((unsigned int) (tempDelta & 0x0F) << 12);
+	record[2] = (lowestDelta & 0x1F) | ((highestDelta & 0x1F) << 5) | (quantise(dayStats.wakes, statsWakeShift) << 10);
+
+	FCTL2 = FWKEY + FSSEL_1 + (27 - 1);			// Flash timing generator from MCLK (8MHz here) / 27, in case it hasn't been set up yet
+	if (erase) {
+		char base[4] = {(char) baseLowest, (char) baseHighest, (char) baseTemp, statsFormat};
+		writeInfoSegment((char *) history, base, sizeof(base), true);
+		writeInfoSegment((char *) history->records, (char *) kept, keep * sizeof(kept[0]), false);
+		days = keep;
+	}
+#ifdef enableMaxTempLog
+	if (maxTemp != *maxTemp_FLASH)
+		writeInfoSegment((char *) maxTemp_FLASH, (char *) &maxTemp, sizeof(maxTemp), false);	// Only clears bits, see above
+#endif
+	writeInfoSegment((char *) history->records[days], (char *) record, sizeof(record), false);
+	unused = ~((2 << days) - 1);				// Clears the bits of all the records so far
+	writeInfoSegment((char *) &history->unused, (char *) &unused, sizeof(unused), false);
+}
+
+#ifdef enableMaxTempLog
+// Called by logTemp() on a thermal shutdown, as the day might never be saved, and by checkReboot() when
+// maxTemp_FLASH is still erased: write maxTemp_RAM to maxTemp_FLASH now, if it only clears bits (an erase
+// would lose the history, so that waits for saveDay())
+void saveMaxTemp(void) {
+	unsigned int maxTemp = *maxTemp_FLASH;
+	if ( (maxTemp_RAM == maxTemp) || ((maxTemp & maxTemp_RAM) != maxTemp_RAM) )
+		return;
+#ifdef enableClockGovernor
+	// The flash timing generator's set for 8MHz
+	setClockSpeed(CLOCK_8MHZ);
+#endif
+	FCTL2 = FWKEY + FSSEL_1 + (27 - 1);			// Flash timing generator from MCLK (8MHz here) / 27, in case it hasn't been set up yet
+	writeInfoSegment((char *) maxTemp_FLASH, (char *) &maxTemp_RAM, sizeof(maxTemp_RAM), false);	// Only clears bits, see above
+}
+#endif
+
+// Called when PV goes while awake (so not from sleep): saves the day, if it was one
+void statsAtDusk(void) {
+	// Already snoozing, so the day's been saved
+	if (P2SEL == 0)
+		return;
+	// Not a day, so it'll be added to the next
+	if (dayStats.harvest < statsMinHarvest)
+		return;
+#ifdef enableClockGovernor
+	// The flash timing generator's set for 8MHz (and goToSnooze() would go back to 8MHz anyway)
+	setClockSpeed(CLOCK_8MHZ);
+#endif
+	saveDay();
+	clearStats(0);
+}
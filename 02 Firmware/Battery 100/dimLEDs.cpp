@@ -0,0 +1,37 @@
+/*
+ * Optional LED dimming. Rather than leave the LEDs on all night,
+ * only light them for part of the time, counted in main loops so
+ * that it costs nothing more than the refreshLEDs() call that's
+ * made every loop anyway.
+ */
+
+#include <msp430.h>
+#include "header.h"
+
+// Returns the colour to show this loop: the given colour, or off
+char dimLEDs(char colour) {
+	unsigned int period = 1;
+	unsigned int onLoops = 1;
+	// Snoozing (P2SEL cleared, see considerSnooze()) means no PV,
+	// so it's night, or near enough: just flash now and then
+	if (P2SEL == 0) {
+		period = LEDnightPeriod;
+		onLoops = LEDnightOnLoops;
+	}
+#ifdef LEDblinkWhenLow
+	// Low battery: don't waste what's left on a red light, blink it instead
+	if (colour == 1) {
+		if (P2SEL == 0) {
+			period = LEDlowNightPeriod;
+			onLoops = LEDnightOnLoops;
+		}
+		else {
+			period = LEDlowDayPeriod;
+			onLoops = LEDlowDayOnLoops;
+		}
+	}
+#endif
+	if (++LEDPhase >= period)
+		LEDPhase = 0;
+	return (LEDPhase < onLoops) ? colour : 0;
+}
@@ -0,0 +1,64 @@
+/*
+ * Optional fast nudge voltage PWM. The PWM period is only
+ * 2^ditherPeriodBits counts, which is too coarse on its own, so the
+ * 16-bit duty cycle in nudgeDuty is split into the counts it covers
+ * and a remainder, and the remainders are accumulated each period
+ * (sigma-delta) to add an extra count now and then. Averaged over
+ * 2^(16 - ditherPeriodBits) periods the duty is exactly nudgeDuty.
+ *
+ * The output uses "set/reset" (high from TACCR1 to TACCR0, i.e. at
+ * the end of the period) rather than "reset/set", so that the new
+ * TACCR1, written at the start of each period by the interrupt, is
+ * always still ahead of the counter for the duties we use (below 50%).
+ */
+
+#include <msp430.h>
+#include "header.h"
+
+#define ditherPeriod		(1u << ditherPeriodBits)
+#define ditherFractionBits	(16 - ditherPeriodBits)
+#define ditherFractionMask	((1u << ditherFractionBits) - 1)
+
+// Set TACCR1 for the next period. Counts high is counted back from TACCR0.
+inline void loadDutyCycle(unsigned int counts) {
+	// 0 counts: put TACCR1 out of reach, so the output is never set
+	if (counts == 0)
+		TACCR1 = ditherPeriod;
+	else if (counts >= ditherPeriod)
+		TACCR1 = 0;
+	else
+		TACCR1 = (ditherPeriod - 1) - counts;
+}
+
+void initialiseDitheredPWM(void) {
+	// Start at max voltage PWM to nudge charging voltage downwards (as in initialiseTimer())
+	nudgeDuty = maxDuty;
+	ditherAccumulator = 0;
+	/* Timer Capture/Compare Control Register settings:
+	 * OUTMOD_3			- "Output mode", set to "set/reset" (see above) */
+	TACCTL1 = OUTMOD_3;
+	TACCR0 = ditherPeriod - 1;
+	loadDutyCycle(maxDuty >> ditherFractionBits);
+	/* CCIE on CCR0 	- interrupt at the end of each period, to load the next duty cycle */
+	TACCTL0 = CCIE;
+	/* Timer_A Control Register settings (as in initialiseTimer()) */
+	TACTL = TASSEL_2 + MC_1;
+	// Interrupts were never needed before this, so weren't enabled
+	__enable_interrupt();
+}
+
+// Once per PWM period. Kept short: about 30 cycles, plus 11 to get in and out.
+#pragma vector = TIMER0_A0_VECTOR
+__interrupt void ditherPWM(void) {
+	markInterruptEntry();
+	unsigned int duty = nudgeDuty;
+	unsigned int counts = duty >> ditherFractionBits;
+	// Carry the remainder over, and when it adds up to a whole count, add that count
+	ditherAccumulator += duty & ditherFractionMask;
+	if (ditherAccumulator > ditherFractionMask) {
+		ditherAccumulator -= ditherFractionMask + 1;
+		counts++;
+	}
+	loadDutyCycle(counts);
+	markInterruptExit();
+}
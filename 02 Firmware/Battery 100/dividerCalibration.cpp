@@ -0,0 +1,144 @@
+/*
+ * Optional per-unit calibration of the potential dividers. The ADC
+ * calibration in info segment A (CALADC_x) only covers the ADC itself, so
+ * the resistor tolerances go straight into the cell voltages, and add up
+ * going up the stack. Here each channel is measured at two known voltages
+ * from a production jig, and given its own gain and offset (kept in info
+ * segment D) which correct its readings to what the nominal dividers
+ * would give. See header.h for the jig voltages.
+ */
+
+#include <msp430.h>
+#include "header.h"
+
+// Check that the calibration in flash is there and intact
+void initialiseDividerCalibration(void) {
+	unsigned int check = dividerCalCheckSeed;
+	for (char i = 0; i < calChannels; i++)
+		check -= dividerCal->gain[i] + dividerCal->offset[i];
+	dividersCalibrated = (check == dividerCal->check);
+}
+
+// Correct a reading from the given channel (index into av_ADC_values) with its
+// gain and offset, rounding to the nearest ADC unit. Done in long, as there's no
+// hardware multiplier, but readings are only 10 bits and the gain is close to 1.
+unsigned int correctADC(unsigned int reading, char i) {
+	if (!dividersCalibrated)
+		return reading;
+	long corrected = (long) reading * dividerCal->gain[i];
+	corrected += (long) dividerCal->offset[i] << (15 - calSampleShift);
+	corrected = (corrected + 16384) >> 15;
+	if (corrected < 0)
+		return 0;
+	return corrected;
+}
+
+// Write the calibration to information memory segment D
+void writeDividerCal(struct DividerCal *cal) {
+	FCTL2 = FWKEY + FSSEL_1 + (27 - 1);			// Flash timing generator from MCLK (8MHz here) / 27, in case it hasn't been set up yet
+	writeInfoSegment((char *) dividerCal, (char *) cal, sizeof(struct DividerCal), true);
+}
+
+// Wait for the given number of ms (at 8MHz), patting the watchdog
+void calDelay(unsigned int ms) {
+	while (ms--) {
+		__delay_cycles(8000);
+		patWatchdog();
+	}
+}
+
+// Take 2^calSampleShift raw readings of every channel, a ms apart, and
+// save their sums (i.e. in 1/64ths of ADC units, for some extra resolution)
+void measureChannels(unsigned int *sums) {
+	for (char i = 0; i < calChannels; i++)
+		sums[i] = 0;
+	for (char j = 0; j < (1 << calSampleShift); j++) {
+		for (char i = 0; i < calChannels; i++)
+			sums[i] += readADCChannel(ADC_CH_numbers[i]);
+		calDelay(1);
+	}
+}
+
+// What the given channel should read (summed as in measureChannels()) with the
+// nominal dividers, for the given cell and PV voltages (cV), rounded
+unsigned int idealReading(char i, unsigned int cellV, unsigned int PVV) {
+	if (i == 4)
+		return ( ((unsigned long) PVV << calSampleShift) * C_DENOMINATOR + C_PV_NUMERATOR / 2 ) / C_PV_NUMERATOR;
+	// The cells are stacked, and the fuse sees the whole battery (with the gate open)
+	return ( ((unsigned long) ( (i < 4) ? i + 1 : 4 ) * cellV << calSampleShift) * C_DENOMINATOR + C_CELL_NUMERATOR / 2 ) / C_CELL_NUMERATOR;
+}
+
+// Are the first given number of channels close enough to their ideal readings for the given voltages?
+bool nearIdeal(unsigned int *sums, char channels, unsigned int cellV, unsigned int PVV) {
+	for (char i = 0; i < channels; i++) {
+		unsigned int ideal = idealReading(i, cellV, PVV);
+		unsigned int margin = ideal / 100 * calJigTolerance;
+		if ( (sums[i] > ideal + margin) || (sums[i] < ideal - margin) )
+			return false;
+	}
+	return true;
+}
+
+// The production calibration, run when there's no calibration in flash. Nothing
+// happens unless the cell and PV readings look like the jig's lower voltages, so
+// uncalibrated units in the field just carry on, without the gate ever being opened
+// (the battery may well be empty). Otherwise wait for the jig to step up to its
+// higher voltages, then work out the gain and offset of each channel from the two
+// measurements. If they're sensible they're written to flash and dividersCalibrated
+// is set (the thresholds then need recalibrating). The LEDs flash green if it's
+// worked, red if not (power cycle on the jig to try again).
+void calibrateDividers(void) {
+	unsigned int low[calChannels];
+	unsigned int high[calChannels];
+	struct DividerCal cal;
+	// Look for the jig with the gate closed, on the cells and PV only
+	measureChannels(low);
+	if ( !nearIdeal(low, calJigChannels, calRefCellLow, calRefPVLow) )
+		return;
+	// It's the jig, so now the fuse channel can have the gate open to see the battery (nothing's connected
+	// to the output on the jig), and everything's measured again like that
+	openGate();
+	measureChannels(low);
+	if ( !nearIdeal(low, calChannels, calRefCellLow, calRefPVLow) ) {
+		closeGate();
+		flashLED(1,0,calBlinkDuration,calBlinkDuration,calBlinkNumber);
+		return;
+	}
+	// Show that we're waiting for the jig to step up, and look out for the battery voltage passing halfway
+	setLEDs(2);
+	unsigned int halfway = ( idealReading(3, calRefCellLow, calRefPVLow) + idealReading(3, calRefCellHigh, calRefPVHigh) ) >> (calSampleShift + 1);
+	unsigned int t;
+	for (t = 0; t < calStepTimeout; t++) {
+		if (readADCChannel(ADC_CH_numbers[3]) > halfway)
+			break;
+		calDelay(1);
+	}
+	calDelay(calSettleTime);
+	measureChannels(high);
+	closeGate();
+	bool good = (t < calStepTimeout) && nearIdeal(high, calChannels, calRefCellHigh, calRefPVHigh);
+	// Now the straight line through the two points for each channel
+	cal.check = dividerCalCheckSeed;
+	for (char i = 0; i < calChannels; i++) {
+		unsigned int idealLow = idealReading(i, calRefCellLow, calRefPVLow);
+		unsigned int idealHigh = idealReading(i, calRefCellHigh, calRefPVHigh);
+		if ( !good || (high[i] <= low[i]) ) {
+			good = false;
+			break;
+		}
+		unsigned long gain = ( (unsigned long) (idealHigh - idealLow) << 15 ) / (high[i] - low[i]);
+		long offset = (long) idealLow - (long) ( (gain * low[i] + 16384) >> 15 );
+		if ( (gain > 32768 + calMaxGainError) || (gain < 32768 - calMaxGainError) || (offset > calMaxOffset) || (offset < -calMaxOffset) )
+			good = false;
+		cal.gain[i] = gain;
+		cal.offset[i] = offset;
+		cal.check -= cal.gain[i] + cal.offset[i];
+	}
+	if (good) {
+		writeDividerCal(&cal);
+		dividersCalibrated = true;
+		flashLED(3,0,calBlinkDuration,calBlinkDuration,calBlinkNumber);
+	}
+	else
+		flashLED(1,0,calBlinkDuration,calBlinkDuration,calBlinkNumber);
+}
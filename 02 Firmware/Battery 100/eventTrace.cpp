@@ -0,0 +1,52 @@
+/*
+ *
+ * The event trace keeps a ring of the last few things that happened to the unit
+ * (state transitions, gate and bleeding changes, snoozing, faults...), so that when a
+ * unit comes back from the field we've got more to go on than an LED colour:
+ *  - traceLog sits in RAM that the C start-up code doesn't touch, so it survives
+ *    watchdog resets (but not a power-up, which is when magic won't match)
+ *  - each entry is two words: event ID and a 12-bit timestamp in the first, and a
+ *    16-bit payload in the second
+ *  - the timestamp is the main loop counter, divided down. When the counter wraps
+ *    an EV_EPOCH entry is written before the next event so the decoder can unwrap it
+ *  - read it back with the debugger and decode it with "02 Firmware/Tools/traceDecode.cpp"
+ *
+ */
+
+#include <msp430.h>
+#include "header.h"
+
+// Make sure the trace is valid, otherwise start a new one. Then log the wake-up.
+void initialiseTrace(void) {
+	if (traceLog.magic != traceMagic) {
+		traceLog.head = 0;
+		traceLog.ticks = 0;
+		traceLog.epoch = 0;
+		traceLog.loggedEpoch = 0;
+		for (char i = 0; i < traceLength; i++) {
+			traceLog.entries[i][0] = (unsigned int) EV_EMPTY << 12;
+			traceLog.entries[i][1] = 0;
+		}
+		traceLog.magic = traceMagic;
+		// Start with an epoch entry, so the decoder knows where it is from the beginning
+		traceEvent(EV_EPOCH, 0);
+	}
+	// Log the reset cause (the flags are cleared at the end of initialiseFull())
+	traceEvent(EV_BOOT, IFG1);
+}
+
+// Called only on transitions, so kept as short as possible: two word writes and a
+// masked increment. The head is masked on every write, so a corrupted head can't
+// send us writing outside the ring.
+void traceEvent(char id, unsigned int payload) {
+	unsigned int head;
+	// If the loop counter has wrapped since the last event, say so first
+	if (traceLog.epoch != traceLog.loggedEpoch) {
+		traceLog.loggedEpoch = traceLog.epoch;
+		traceEvent(EV_EPOCH, traceLog.epoch);
+	}
+	head = traceLog.head & (traceLength - 1);
+	traceLog.entries[head][0] = ((unsigned int) id << 12) | (traceLog.ticks >> traceStampShift);
+	traceLog.entries[head][1] = payload;
+	traceLog.head = (head + 1) & (traceLength - 1);
+}
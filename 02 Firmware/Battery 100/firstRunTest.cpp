@@ -1,85 +1,131 @@
 #include <msp430.h>
 #include "header.h"
 
-// Method to write to the testResult char in Flash, so initialise can detect: (i) that a first run test
-// has been carried out and (ii) what were the results of that test. The code is as follows:
-// result 0: good test
-// result 1: possible bad battery?
-// result 2: possible bad solar panel?
-// result 3: possible bad PCB?
-void writeTestResult(char result) {
-	FCTL1 = FWKEY + ERASE;                    // Set Erase bit
-	FCTL3 = FWKEY;                            // Clear Lock bit
-	*testResult = 0;                       	  // Dummy write to erase Flash segment
-	FCTL1 = FWKEY + WRT;                      // Set WRT bit for write operation
-	*testResult = result;            	      // Write value to flash
-	FCTL1 = FWKEY;                            // Clear WRT bit
-	FCTL3 = FWKEY + LOCK;                     // Set LOCK bit
+// Method to write the test record to information memory segment B, so initialise can detect: (i) that a
+// first run test has been carried out and (ii) what were the results of that test (the result is the first
+// byte, testResult). The result is 0 for a good test, otherwise it's made of TEST_FAIL_x bits, see header.h
+// With enableStateOfHealth the rest of the segment is the health log, which is written back after the erase
+// (as saveHealth() does with the test record), so that a unit that's tested again keeps its history
+void writeTestResult(struct TestRecord *record) {
+#ifdef enableStateOfHealth
+	struct HealthLog log = *healthLog;
+#endif
+	// The test runs at 8MHz, and the flash timing generator is only set up by initialiseFull() with enableMaxTempLog
+	FCTL2 = FWKEY + FSSEL_1 + (27 - 1);
+	writeInfoSegment(testResult, (char *) record, sizeof(struct TestRecord), true);
+#ifdef enableStateOfHealth
+	writeInfoSegment((char *) healthLog, (char *) &log, sizeof(struct HealthLog), false);
+#endif
 }
 
-// Use the existing functions to get a nice average value
-// for the cell voltages and the PV voltage. Not much use
-// to test output because the gate's not open yet. But we'll do that later.
-// Return the baseline battery voltage value
-unsigned int acquireBaselines(void) {
-	for (unsigned int j = 0; j < acquireBaselinesLoops; j++) {
-		for (char i = 0; i < 5; i++) {
-			// Read the ADC channel and update average
-			updateAverage(readADCChannel(ADC_CH_numbers[i]), i);
-			// If it's a battery cell channel, then:
-			// - update cell values as relevant
-			if (i < 4) {
-				av_cell_values[i] = av_ADC_values[i];
-				if (i != 0)
-					av_cell_values[i] -= av_ADC_values[i - 1];			// Subtract previous absolute value to cell value
+// Use the existing functions to get nice average values for the given
+// channels (bits of channelMask are indices into av_ADC_values), and
+// stop as soon as they've settled, i.e. none of them has moved by more
+// than settleTolerance over the last settleWindow samples (or after
+// acquireBaselinesLoops, whatever happens).
+// Return the number of samples it took
+unsigned int settleAverages(char channelMask, bool slow) {
+	unsigned int reference[6];
+	unsigned int j;
+	unsigned int windowStart = 0;
+	for (char i = 0; i < 6; i++)
+		reference[i] = av_ADC_values[i];
+	for (j = 1; j <= acquireBaselinesLoops; j++) {
+		bool moved = false;
+		for (char i = 0; i < 6; i++) {
+			if (channelMask & (1 << i)) {
+				// Read the ADC channel and update average
+				updateAverage(correctADC(readADCChannel(ADC_CH_numbers[i]), i), i);
+				// Note whether it's wandered off since the start of the window
+				if ( (av_ADC_values[i] > reference[i] + settleTolerance) || (av_ADC_values[i] + settleTolerance < reference[i]) )
+					moved = true;
 			}
 		}
+		if (slow)
+			__delay_cycles(2000);
 		patWatchdog();
+		// If anything moved, start the window again from here
+		if (moved) {
+			for (char i = 0; i < 6; i++)
+				reference[i] = av_ADC_values[i];
+			windowStart = j;
+		}
+		// Otherwise see if it's been still for long enough
+		else if (j - windowStart >= settleWindow)
+			break;
 	}
+	return j;
+}
+
+// Get nice averages for the cell voltages and the PV voltage. Not much use
+// to test output because the gate's not open yet. But we'll do that later.
+// Return the baseline battery voltage value
+unsigned int acquireBaselines(struct TestRecord *record) {
+	record->baselineLoops = settleAverages(0x1F, false);	// Cells and PV
+	// Update cell values
+	for (char i = 0; i < 4; i++) {
+		av_cell_values[i] = av_ADC_values[i];
+		if (i != 0)
+			av_cell_values[i] -= av_ADC_values[i - 1];			// Subtract previous absolute value to cell value
+		record->cellV[i] = av_cell_values[i];
+	}
+	record->PVV = av_ADC_values[4];
 	// Return the averaged full battery voltage value
 	return av_ADC_values[3];
 }
 
 // Make sure cell voltages and PV voltage are within prescribed limits
-// Returns true if failed
-bool testBaselines(void) {
+// Returns true if failed (with the reasons in the record)
+bool testBaselines(struct TestRecord *record) {
 	// First for cell voltages
 	for (char i = 0; i < 4; i++) {
 		if (av_cell_values[i] < minCellV || av_cell_values[i] > maxCellV) {
-			// Problem with cell readings, so write error number 4.
-			writeTestResult(4);
-			return true;
+			// Problem with cell readings
+			record->result |= TEST_FAIL_CELLS;
 		}
 	}
 	// Now for the PV voltage
 	if (av_ADC_values[4] < (PVmax - PVtolerance) || av_ADC_values[4] > (PVmax + PVtolerance) ) {
-		// PV voltage not detected correctly, so write error number 3.
-		writeTestResult(3);
-		return true;
+		// PV voltage not detected correctly
+		record->result |= TEST_FAIL_PV;
 	}
-	// If we made it here then so far so good!
-	return false;
+	// If nothing's been flagged then so far so good!
+	return record->result != 0;
 }
 
-// Here we charge the battery for a bit using the power available to us
-// and after a set period we check the battery voltage.
-// If it's not increased then we fail the test by returning true.
-bool testCharge(unsigned int _baselineBattV) {
-	for (unsigned long j = 0; j < chargeTestLoops; j++) {
+// Here we charge the battery using the power available to us, checking the
+// battery voltage every chargeSlopeWindow loops. As soon as it's risen by
+// testChargeMargin, and kept rising (or at least not fallen back) for
+// chargeConfirmWindows checks in a row, the test is passed. If that hasn't
+// happened after chargeTestLoops, we fail the test by returning true.
+bool testCharge(unsigned int _baselineBattV, struct TestRecord *record) {
+	unsigned long j;
+	char confirmed = 0;
+	unsigned int lastBattV = _baselineBattV;
+	for (j = 1; j <= chargeTestLoops; j++) {
 		// Run basic operations for charging with this prototype main loop
     	patWatchdog();
         refreshADCs();
         refreshCharge();
+        // Check the slope
+        if (j % chargeSlopeWindow == 0) {
+        	if ( (av_ADC_values[3] >= _baselineBattV + testChargeMargin) && (av_ADC_values[3] >= lastBattV) ) {
+        		if (++confirmed >= chargeConfirmWindows)
+        			break;
+        	}
+        	else
+        		confirmed = 0;
+        	lastBattV = av_ADC_values[3];
+        }
 	}
 	// Now disable charging (no need to worry about re-enabling charging
 	// as we're going to reset before ever needing to charge again
 	P2SEL = 0;
-	// Check net change in cell diff. If the battery voltage has not increased
-	// by a minimum amount as a result of the charging then fail the test.
-	if ( av_ADC_values[3] < _baselineBattV + testChargeMargin )  {
+	record->chargeRise = av_ADC_values[3] - _baselineBattV;
+	record->chargeLoops = j;		// chargeTestLoops + 1 if it never saw the rise
+	if (confirmed < chargeConfirmWindows)  {
 		// Possible problem with PCB as seems to be not charging... but could also be solar panel
-		// so write error code 5
-		writeTestResult(5);
+		record->result |= TEST_FAIL_CHARGE;
 		return true;
 	}
 	// Otherwise, we're all good - so pass the test
@@ -89,22 +135,19 @@ bool testCharge(unsigned int _baselineBattV) {
 
 // Open the discharge gate and check that the fuse voltage is there!
 // Otherwise fail the test by returning true.
-bool testDischarge(void) {
+bool testDischarge(struct TestRecord *record) {
 	openGate();
-	// Get some new voltage averages
-	for (int i = 0; i < acquireBaselinesLoops; i++) {
-		updateAverage(readADCChannel(ADC_CH_numbers[3]), 3);
-		updateAverage(readADCChannel(ADC_CH_numbers[5]), 5);
-		__delay_cycles(2000);
-		patWatchdog();
-	}
+	// Get some new voltage averages (battery and fuse)
+	record->dischargeLoops = settleAverages(0x28, true);
+	record->battV = av_ADC_values[3];
+	record->fuseV = av_ADC_values[5];
 	// Test to make sure the voltage drop across the fuse isn't too big
 	// during discharge
 	if (av_ADC_values[3] > av_ADC_values[5] + maxFuseDrop ) {
 		// Failed test, so close the gate
 		closeGate();
-		// Probably problem with PCB, so write error code 7
-		writeTestResult(7);
+		// Probably problem with PCB
+		record->result |= TEST_FAIL_DISCHARGE;
 		return true;
 	}
 	// If we passed, then that's basically the end of the test, so leave the gate open
@@ -113,34 +156,35 @@ bool testDischarge(void) {
 	return false;
 }
 
-// A series of tests are run. Any test can conclude a fail, which will write this to Flash
-// before going to sleep. If we reach the end of this function without fail, then
-// the test will be passed. It will go into an inactive loop for 10 mins, to give the tester
-// a chance to remove the power supply, then it will go into the usual "sleep" with PV checks.
+// A series of tests are run, each stopping as soon as it has a clear answer. A failed baseline
+// ends the test (there's no point charging), but the charge and discharge tests are both run
+// either way, to narrow down the cause. Everything measured is written to Flash with the result
+// before returning. If there are no failures, the test is passed, and initialise goes into an
+// inactive loop for 10 mins, to give the tester a chance to remove the power supply, then it
+// will go into the usual "sleep" with PV checks.
 void firstRunTest(void) {
+	struct TestRecord record;
+	// Anything that isn't measured (a test that's skipped) is written as 0
+	for (char i = 0; i < sizeof(struct TestRecord); i++)
+		((char *) &record)[i] = 0;
 	// Turn on green LED to show that the test has started
 	setLEDs(3);
 	// Get the voltage baselines for the cells and the solar panel
 	// Save the baseline battery voltage separately as we'll use
 	// it later.
-	unsigned int baselineBattV = acquireBaselines();		// This is instead of creating another global variable just for this purpose.
-	// Test the voltage baselines and exit if we've already failed
-	if ( testBaselines() )
-		return;
-	// Change LED colour to yellow to show we've moved to the next stage
-	setLEDs(2);
-	// Now do some charging and make sure cell voltages are increasing
-	// Exit if we've already failed
-	if ( testCharge(baselineBattV) )
-		return;
-	// Change LED colour to red to show we've moved to the next stage
-	setLEDs(1);
-	// Finally, open the discharge gate and check that we've got a discharge
-	// voltage. Also, deduce exit voltage drop to make sure not too high
-	// Exit if we've already failed
-	if ( testDischarge() )
-		return;
-	// That's it! The test is over. Write success result to flash and return
-	writeTestResult(0);
+	unsigned int baselineBattV = acquireBaselines(&record);		// This is instead of creating another global variable just for this purpose.
+	// Test the voltage baselines
+	if ( !testBaselines(&record) ) {
+		// Change LED colour to yellow to show we've moved to the next stage
+		setLEDs(2);
+		// Now do some charging and make sure cell voltages are increasing
+		testCharge(baselineBattV, &record);
+		// Change LED colour to red to show we've moved to the next stage
+		setLEDs(1);
+		// Finally, open the discharge gate and check that we've got a discharge
+		// voltage. Also, deduce exit voltage drop to make sure not too high
+		testDischarge(&record);
+	}
+	// That's it! The test is over. Write the result to flash and return
+	writeTestResult(&record);
 }
-
@@ -40,6 +40,10 @@
 // Values -> centivolts (cV) inverse coefficients for conversion
 #define C_CELL	2.688172 	// (1+0.1/0.1)*250/1023	<- ( Total pot. resistance / sensed resistance) * V_ref(cV) / ADC divisions
 #define C_PV	3.910068	// (33+2.2/2.2)*250/1023
+// The same as fractions (numerator / C_DENOMINATOR), so that the MCU can do without the float library
+#define C_CELL_NUMERATOR	2750
+#define C_PV_NUMERATOR		4000
+#define C_DENOMINATOR		1023
 
 // Analog pin numbers (A.x)
 #define CELL1		3		// Cell 1 terminal
@@ -92,9 +96,10 @@ void refreshLEDs(void);			// refreshLEDs.cpp
 void setLEDs(char);				// refreshLEDs.cpp
 void flashLED(char, char, char, char, unsigned int);			// refreshLEDs.cpp
 void considerSnooze(void);		// considerSleep.cpp
-// These are used in both the optional logTemp function and the optional firstRunTest function,
+// These are used by several of the optional functions (logTemp, firstRunTest and the ones that write to information memory),
 // so rather than have nested ifdef's, let's just declare them no matter what
 unsigned int readADCChannel(char); // ADCs.cpp
+void writeInfoSegment(char *, const char *, char, bool);	// initialise.cpp
 void openGate(void);			// refreshDischarge.cpp
 void closeGate(void);			// refreshDischarge.cpp
 
@@ -102,7 +107,9 @@ void closeGate(void);			// refreshDischarge.cpp
 
 // Declaration of some things to help with logging and using the interal temperature sensor, placed in header.h
 // Also have to remember to include or not include logTemp.cpp!
-// Costs 486 bytes in code space to include (--opt_level = off, --opt_for_speed = 1)
+// Costs 486 bytes in code space to include (--opt_level = off, --opt_for_speed = 1). With the float library gone (see V2.16
+// in main.cpp) it should fit alongside enableFirstRunTest, but that hasn't been built and measured yet: make the budget
+// with "02 Firmware/Tools/msp430Sim/sizeBudget.sh -u" (it checks the two together) to find out.
 #define enableMaxTempLog   // Comment this out to remove all the relevant code and variables throughout the project
 #define shutdownTemp_uncalib		75			// Max temp before shutdown in degrees celcius
 #define tempShutdownBlinkNumber		150			// Number of blinks to carry out on thermal shutdown
@@ -124,8 +131,12 @@ void closeGate(void);			// refreshDischarge.cpp
 // Declaration of some things to help with running a "first run" test, placed in header.h
 // Also have to remember to include or not include firstRunTest.cpp!
 //#define enableFirstRunTest				// Comment this out to remove all the relevant code and variables throughout the project
-#define acquireBaselinesLoops			20000u		// Number of samples to take to get a nice baseline of the internal cell voltages
-#define chargeTestLoops					40000ul	    // Normal loop does 4300Hz, so assume this for now to calculate length of prototype loop
+#define acquireBaselinesLoops			20000u		// Most samples to take to get a nice baseline of the internal cell voltages (fewer once the averages have settled, see below)
+#define settleWindow					128			// Averages are settled once they move no more than settleTolerance over this many samples (4 time constants of the rolling average)
+#define settleTolerance					2			// ADC units
+#define chargeTestLoops					40000ul	    // Most loops to charge for before failing the charge test (normal loop does 4300Hz)
+#define chargeSlopeWindow				1024		// Loops between checks of the battery voltage rise during the charge test
+#define chargeConfirmWindows			2			// Number of checks in a row that must see the rise (without falling back) to pass early
 #define testFailBlinkNumber				15			// Number of blinks to carry out after test failure - has to be short to not keep tester waiting...
 #define testSuccessBlinkNumber			300			// Number of blinks to carry out after test success - has to be long to permit testing of output sockets!
 #define testBlinkDuration				8			// Nice slow blinking (approx. 1s on, 1s off)
@@ -133,6 +144,25 @@ void closeGate(void);			// refreshDischarge.cpp
 #define PVtolerance						38 			// How far off can PVmax be from the ideal? (quite large to allow for higher panel temperatures)
 #define testChargeMargin				1			// Battery voltage must increase by this amount during the test charge to pass the test
 #define maxFuseDrop						20			// Maximum voltage drop across the fuse permissable during discharge test
+// Test result bits, in testResult (0: passed, 0xFF: erased flash, i.e. not tested yet)
+#define TEST_FAIL_CELLS					BIT0		// A cell voltage is out of range (bad battery?)
+#define TEST_FAIL_PV					BIT1		// PV voltage is out of range (bad solar panel?)
+#define TEST_FAIL_CHARGE				BIT2		// Battery voltage didn't rise whilst charging (bad PCB or solar panel?)
+#define TEST_FAIL_DISCHARGE				BIT3		// Too much voltage drop across the fuse (bad PCB?)
+// The result is saved in information memory segment B (0x1080) along with what was measured, for
+// reading back with the debugger. The result comes first, so testResult still points to it.
+struct TestRecord {
+	char result;								// TEST_FAIL_x bits
+	char reserved;
+	unsigned int cellV[4];						// Baseline cell voltages (ADC)
+	unsigned int PVV;							// Baseline PV voltage (ADC)
+	unsigned int baselineLoops;					// Samples taken for the baseline averages to settle
+	unsigned int chargeRise;					// Battery voltage rise during the charge test (ADC, signed)
+	unsigned int chargeLoops;					// Loops charged for
+	unsigned int battV;							// Battery and fuse voltages with the gate open (ADC)
+	unsigned int fuseV;
+	unsigned int dischargeLoops;				// Samples taken for those averages to settle
+};
 extern char *testResult;
 void initialiseFull(void);					// initialise.cpp
 void goToSleep(void);						// considerSleep.cpp
@@ -140,5 +170,522 @@ void updateAverage(unsigned int, char);		// ADCs.cpp
 void firstRunTest(void);					// firstRunTest.cpp
 
 
+// Declaration of some things to help with keeping a trace of recent events in RAM, placed in header.h
+// Also have to remember to include or not include eventTrace.cpp!
+// The trace lives in uninitialised RAM so that it survives watchdog resets, and can be read back through the
+// debugger with a memory dump of the traceLog symbol (or the whole of RAM), then decoded on a PC with
+// "02 Firmware/Tools/traceDecode.cpp". Each entry costs 4 bytes of RAM (out of 256!).
+//#define enableEventTrace				// Comment this out to remove all the relevant code and variables throughout the project
+#define traceLength						32			// Number of entries in the trace ring, must be a power of 2
+#define traceMagic						0x7ACE		// Marks the trace as valid, otherwise it's cleared on boot (e.g. after a power-up, when RAM is random)
+#define traceStampShift					4			// Loop counter is divided by 2^traceStampShift to fit into the 12-bit timestamp of each entry
+// Event IDs, saved in the top 4 bits of the timestamp word of each entry. Payload word meanings are in brackets.
+#define EV_BOOT							0			// Woken up fully after a reset (IFG1, i.e. reset cause flags)
+#define EV_BATTERYSTATUS				1			// batteryStatus has changed (old status << 8 | new status)
+#define EV_LEDSTATUS					2			// LEDStatus has changed (old status << 8 | new status)
+#define EV_GATEOPEN						3			// Discharge gate has opened (lowest cell voltage)
+#define EV_GATECLOSE					4			// Discharge gate has closed (lowest cell voltage)
+#define EV_BLEEDON						5			// Cell bleeding switched on (cell index << 8 | cell voltage)
+#define EV_BLEEDOFF						6			// Cell bleeding switched off (cell index << 8 | cell voltage)
+#define EV_SNOOZE						7			// Gone into snooze mode (PV voltage)
+#define EV_WAKE							8			// Woken up from snooze mode (PV voltage)
+#define EV_SLEEP						9			// Going to sleep (batteryStatus)
+#define EV_THERMALSHUTDOWN				10			// Thermal shutdown (average temperature ADC reading)
+#define EV_FAULT						11			// Short-circuit/over-current detected (fuse voltage)
+#define EV_EPOCH						14			// Loop counter has wrapped since the last event (number of wraps)
+#define EV_EMPTY						15			// Unused entry
+struct TraceLog {
+	unsigned int magic;							// traceMagic if the contents are valid
+	unsigned int head;							// Index of the next entry to write, i.e. of the oldest entry
+	unsigned int ticks;							// Loop counter, for timestamps
+	unsigned int epoch;							// Number of times ticks has wrapped
+	unsigned int loggedEpoch;					// Value of epoch when the last EV_EPOCH entry was written
+	unsigned int entries[traceLength][2];		// (event ID << 12 | ticks >> traceStampShift), payload
+};
+extern struct TraceLog traceLog;
+void initialiseTrace(void);						// eventTrace.cpp
+void traceEvent(char, unsigned int);			// eventTrace.cpp
+
+
+// Declaration of some things to help with warm boots after a watchdog wake-up, placed in header.h
+// Also have to remember to include or not include warmBoot.cpp!
+// With this enabled the PV check is done in _system_pre_init(), before the C start-up code initialises
+// RAM, so a wake-up that finds no PV goes straight back to sleep. The calibrated thresholds and the
+// cell voltage averages are saved in uninitialised RAM before sleeping, and restored on the next full
+// wake-up if it was caused by the watchdog and the checksum is good (otherwise it's a cold boot).
+//#define enableWarmBoot					// Comment this out to remove all the relevant code and variables throughout the project
+#define warmStateMagic					0xB007		// Seeds the checksum, so that all-zero RAM doesn't pass
+struct WarmState {
+	unsigned int PVmpp;							// Calibrated thresholds (see calibrateThresholds())
+	unsigned int lowPV;
+	char maxCellV;
+	char minCellV;
+	char minFuse;
+	char minBleedV;
+	char stopChargeV;
+	char restartChargeV;
+	char restartDischV;
+	char LEDthresh1;
+	char LEDthresh2;
+	char LEDthreshHyst;
+	unsigned int av_ADC_values[4];				// Cell voltage rolling averages, and their dropped bits (see updateAverage())
+	char dropped_bits[4];
+	unsigned int irRatio;						// Learned cell resistance (see irDrop.cpp, unused without enableIRCompensation)
+	unsigned int checksum;						// Must be last
+};
+extern struct WarmState warmState;
+void saveWarmState(void);						// warmBoot.cpp
+bool restoreWarmState(void);					// warmBoot.cpp
+
+
+// Declaration of some things to help with scaling the clock speed to the regulation demand, placed in header.h
+// Also have to remember to include or not include clockGovernor.cpp!
+// Outside of snooze, the clock runs at 16MHz while the nudge voltage is actively tracking PV (nudgeDuty neither
+// at 0 nor at maxDuty), 1MHz when there's nothing to regulate (battery full, or fully throttled), and 8MHz
+// otherwise. SMCLK is divided down at 16MHz so that Timer_A still sees 8MHz; at 1MHz the PWM period and duty
+// are scaled down instead (by PWMshift). The ADC clock and the flash timing generator are kept in spec too.
+// Note that 16MHz needs Vcc of at least 3.3V (see the datasheet).
+//#define enableClockGovernor				// Comment this out to remove all the relevant code and variables throughout the project
+#define CLOCK_1MHZ						0			// clockSpeed values
+#define CLOCK_8MHZ						1
+#define CLOCK_16MHZ						2
+#define governorHoldLoops				2000		// Loops that a lower clock speed must be wanted for before slowing down (speeding up is immediate)
+extern char clockSpeed;
+extern char PWMshift;							// Timer_A counts are scaled down by 2^PWMshift from those at 8MHz
+extern unsigned int governorHold;
+void governClock(void);							// clockGovernor.cpp
+void setClockSpeed(char);						// clockGovernor.cpp
+void waitTicks(unsigned int);					// clockGovernor.cpp
+
+
+// Declaration of some things to help with a fast, dithered, nudge voltage PWM, placed in header.h
+// Also have to remember to include or not include ditheredPWM.cpp!
+// The PWM period is cut to 2^ditherPeriodBits counts (7.8kHz at 8MHz, rather than 122Hz), so the Vnudge filter
+// can be much smaller and faster. The duty cycle keeps its 16-bit resolution (in 1/65536ths, same as before), with
+// the bits below the short period's resolution dithered (first order sigma-delta) by the CCR0 interrupt, once per
+// period. The interrupt costs about 3% of the CPU at 8MHz. Everything else changes the duty through nudgeDuty,
+// which without this option is just TACCR1.
+//#define enableDitheredPWM				// Comment this out to remove all the relevant code and variables throughout the project
+#define ditherPeriodBits				10			// PWM period is 2^ditherPeriodBits SMCLK counts
+#ifdef enableDitheredPWM
+extern volatile unsigned int nudgeDuty;			// Duty cycle, in 1/65536ths of the PWM period
+extern unsigned int ditherAccumulator;
+void initialiseDitheredPWM(void);				// ditheredPWM.cpp
+#else
+#define nudgeDuty						TACCR1
+#endif
+
+
+// Declaration of some things to help with sampling in step with the PWM, placed in header.h
+// Also have to remember to include or not include syncedADC.cpp! Needs enableDitheredPWM too.
+// refreshADCs() converts all the channels in one sequence (A7 down to A0, about 17us at 8MHz, stored by the DTC)
+// started by Timer_A (SHS_1, the nudge PWM output TA0.1) rather than whenever the loop gets there, so every loop
+// sees the same point of the PWM ripple instead of aliasing with it: the falling edge at the end of the period, and
+// with syncBothEdges the rising edge too, the two averaged to the middle of the ripple. With less jitter in the
+// readings the cell averages are cut from 1/32 to 1/2^syncedAverageShift. With the output not switching (duty 0, or
+// snoozing) there's no ripple, and the channels are read one by one straight away as usual, as they are if the edge
+// doesn't come within syncTimeout polls (a dithered period is at most about 410 polls, at 16MHz).
+//#define enableSyncedADC					// Comment this out to remove all the relevant code and variables throughout the project
+//#define syncBothEdges						// Also sample on the rising edge, and average
+#define syncedAverageShift				3			// Cell averages take 1/8 of each new reading (rather than 1/32)
+#define syncTimeout						512			// Polls of ADC10IFG to wait for the edge (about 5 cycles each)
+#define syncedChannels					8			// A7 down to A0, so a channel's reading is at [7 - channel]
+#ifdef enableSyncedADC
+#define averageShift					syncedAverageShift
+bool syncADCs(unsigned int *);					// syncedADC.cpp
+#else
+#define averageShift					5			// 1/32
+#endif
+
+
+// Declaration of some things to help with dimming the indicator LEDs at night, placed in header.h
+// Also have to remember to include or not include dimLEDs.cpp!
+// The LEDs are strobed from refreshLEDs(), so it costs no extra wake-ups, and the timing is in main loops: awake
+// (PV present, about 4300 loops/s at 8MHz) the LEDs are fully on; snoozing (no PV, about 17 loops/s) they're only lit
+// for one loop in every LEDnightPeriod, a short flash every couple of seconds. With LEDblinkWhenLow, red (low
+// battery) is only ever a short blink, day and night.
+//#define enableLEDDimming				// Comment this out to remove all the relevant code and variables throughout the project
+//#define LEDblinkWhenLow					// Also comment this out to keep red on (or flashing, at night) as above
+#define LEDnightPeriod					34			// Snoozing loops per flash (about 2s)
+#define LEDnightOnLoops					1			// Snoozing loops lit per flash (about 60ms)
+#define LEDlowNightPeriod				85			// With LEDblinkWhenLow, snoozing loops per red blink (about 5s)
+#define LEDlowDayPeriod					21500u		// With LEDblinkWhenLow, awake loops per red blink (about 5s at 8MHz)
+#define LEDlowDayOnLoops				1075		// With LEDblinkWhenLow, awake loops lit per red blink (about 0.25s at 8MHz)
+extern unsigned int LEDPhase;
+char dimLEDs(char);								// dimLEDs.cpp
+
+
+// Declaration of some things to help with calibrating each unit's potential dividers, placed in header.h
+// Also have to remember to include or not include dividerCalibration.cpp!
+// The cell voltages are differences between stacked readings, so the divider tolerances add up going up the stack.
+// At production, with info segment D erased, the unit is powered from a jig giving 2.40V per cell and 12.00V PV,
+// which is then stepped up to 3.60V per cell and 20.00V PV. The jig is recognised by the lower point, so that's one
+// a plant in the field can't give: the cells are well below minCellV, where the loads are cut off and a LiFePO4
+// cell recovers from to 3V or more at rest, and calJigTolerance is tight enough to keep them apart (with 3.00V and
+// 10%, a field pack resting at 3.2-3.3V with a panel at dawn looked just like the jig). Each channel's reading at
+// the two points gives it a gain and offset (stored in info segment D), which are applied in fixed point to every
+// reading before the averages and the cell subtraction, correcting it to the ideal reading for the nominal
+// dividers (C_CELL, C_PV).
+// The thresholds then need no calibration, and stopChargeV and minCellV are given less margin. Without a jig
+// (no calibration in flash), it all carries on as before. Costs a software multiply per channel per loop.
+//#define enableDividerCalibration			// Comment this out to remove all the relevant code and variables throughout the project
+#define calChannels						6			// Channels calibrated, the indices of av_ADC_values (the fuse is read with the gate open)
+#define calJigChannels					5			// Channels that recognise the jig, with the gate still closed (the cells and PV, not the fuse)
+#define calRefCellLow					240			// Jig cell voltages (cV)
+#define calRefCellHigh					360
+#define calRefPVLow						1200		// Jig PV voltages (cV)
+#define calRefPVHigh					2000
+#define calSampleShift					6			// 2^calSampleShift readings are summed for each measurement (so in 1/64ths of ADC units)
+#define calJigTolerance					4			// Percent that the readings can be off their ideal values for the jig to be recognised (the dividers' and reference's tolerances, uncalibrated)
+#define calMaxGainError					3277		// Largest gain error accepted (Q15, i.e. 10%)
+#define calMaxOffset					(10 << calSampleShift)	// Largest offset accepted (10 ADC units)
+#define calStepTimeout					30000		// ms to wait for the jig to step up
+#define calSettleTime					500			// ms to let the readings settle after the step
+#define calBlinkNumber					10			// Number of blinks after the calibration
+#define calBlinkDuration				4			// 1/8ths of a second
+#define calibratedStopChargeV			132			// ADC equivalent to 3.55V - stopChargeV_uncalib once calibrated
+#define calibratedMinCellV				100			// ADC equivalent to 2.70V - minCellV_uncalib once calibrated
+#define dividerCalCheckSeed				0xCA1B		// Seeds the check word, so that erased flash doesn't pass
+struct DividerCal {
+	unsigned int gain[calChannels];				// Q15, i.e. 32768 is 1
+	int offset[calChannels];					// In 1/64ths of ADC units
+	unsigned int check;							// dividerCalCheckSeed minus the sum of the above, must be last
+};
+#ifdef enableDividerCalibration
+extern struct DividerCal *dividerCal;
+extern bool dividersCalibrated;
+void initialiseDividerCalibration(void);		// dividerCalibration.cpp
+void calibrateDividers(void);					// dividerCalibration.cpp
+unsigned int correctADC(unsigned int, char);	// dividerCalibration.cpp
+#else
+#define correctADC(reading, i)			(reading)
+#endif
+
+
+// Declaration of some things to help with temperature compensation of the cell thresholds, placed in header.h
+// Also have to remember to include or not include tempCompensation.cpp! Needs enableMaxTempLog too.
+// The internal temperature sensor is read every tempSamplePeriod loops as part of refreshADCs(), at the usual
+// 2.5V reference (so there's nothing to settle, unlike getAvTemp(), which isn't used with this) and from the ADC's
+// own oscillator for the sensor's long sample time. av_tempADC is then always up to date (in 2.5V reference units,
+// so maxTemp_FLASH is too), and every tempCompPeriod loops it's converted to tempC, which sets how far maxCellV,
+// stopChargeV and minCellV come down in the cold. Below freezing, charging is throttled right back.
+//#define enableTempCompensation			// Comment this out to remove all the relevant code and variables throughout the project
+#define tempSamplePeriod				16			// Loops between temperature readings (power of 2)
+#define tempCompPeriod					1024		// Loops between updates of tempC and the thresholds (power of 2)
+#define tempCompKneeC					15			// Below this temperature (C) the thresholds start coming down
+#define tempCompChargeStepC				5			// maxCellV and stopChargeV come down an ADC unit (27mV) for every this many C below the knee
+#define tempCompMinCellStepC			10			// minCellV comes down an ADC unit for every this many C below the knee
+#define tempCompMaxSteps				3			// But by no more than this many ADC units
+#define freezeC							0			// Below this temperature (C) charging is stopped
+#define freezeHystC						3			// Until it's this much warmer again
+#ifdef enableTempCompensation
+extern unsigned int *CALADC_25T85;
+extern unsigned int *CALADC_25T30;
+extern unsigned int tempLoops;
+extern int tempC;
+extern char tempCompCharge;						// ADC units currently taken off maxCellV and stopChargeV
+extern char tempCompMinCell;					// ADC units currently taken off minCellV
+extern bool tooColdToCharge;
+void sampleTemp(void);							// tempCompensation.cpp
+void setTempCompensation(char, char);			// tempCompensation.cpp
+#else
+#define tooColdToCharge					false
+#endif
+
+
+// Declaration of some things to help with compensating the low voltage cut-off for IR drop, placed in header.h
+// Also have to remember to include or not include irDrop.cpp!
+// The load current is estimated from the drop across the PTC fuse (battery voltage, CELL4, less the fuse voltage,
+// DISCURRENT), averaged like the cell voltages and zeroed whenever the gate is closed. The cells' resistance is
+// learned as a ratio to the fuse's, from the steps in battery voltage as loads are switched at night (when there's
+// no charge current to confuse it), and kept over warm boots. The resulting IR drop, up to irMaxSag, is added back
+// on to the lowest cell before it's compared with minCellV, so a big load doesn't cut the battery off early.
+// With enableStateOfHealth the ratio isn't learned here, but is the average of the cells' (sohRatio), which are
+// learned from the same load steps, and the state of health takes its load from irDrop rather than filtering its own.
+//#define enableIRCompensation				// Comment this out to remove all the relevant code and variables throughout the project
+#define irFilterShift					averageShift	// Fuse voltage is averaged over 2^irFilterShift loops, as the cell voltages are (so it tracks them with enableSyncedADC too)
+#define irLearnPeriod					64			// Loops between looking for load steps to learn from (power of 2)
+#define irLearnMinStep					3			// ADC units that the fuse drop must step by to learn from
+#define irRatioDefault					64			// Cell to fuse resistance ratio (Q8, i.e. 256 is the same) until learned
+#define irMaxRatio						1024		// Largest ratio believed
+#define irMaxSag						8			// Most that the lowest cell is credited with (ADC units, about 0.2V)
+#ifdef enableIRCompensation
+extern int irFuse;								// Filtered fuse voltage (1/16ths of ADC units)
+extern int irDrop;								// Fuse drop (1/16ths of ADC units)
+extern int irZero;								// irDrop with the gate closed
+extern int irLastDrop;							// irDrop and battery voltage when last looked for a step (not with enableStateOfHealth)
+extern unsigned int irLastBattV;
+extern unsigned int irRatio;
+extern char irLoops;
+extern char irSag;								// IR drop of each cell (ADC units)
+void refreshIRDrop(void);						// irDrop.cpp
+#else
+#define irSag							0
+#endif
+
+
+// Declaration of some things to help with scheduling the wake-ups from sleep around the learned night, placed in header.h
+// Also have to remember to include or not include wakeSchedule.cpp!
+// From dusk to dawn, time is kept in ticks of the usual watchdog period (32768 VLO counts, about 2.7s at 12kHz), in
+// uninitialised RAM: asleep it's counted in wake-ups, snoozing from Timer_A, which is left counting ACLK. The length of
+// the night is learned in those ticks, so the VLO's error doesn't matter. Until the dawn window (the learned night /
+// 2^wakeWindowShift before the expected dawn), ACLK is divided by wakeDeepTicks while asleep, so there are that many
+// times fewer wake-ups; then they're every tick, as without this. No dawn by half a night late is a dark day, and while
+// snoozing that cuts what's left of maxSnoozeTime to wakeSnoozeGrace loops for each dark day of the last 8, plus one.
+//#define enableWakeScheduling				// Comment this out to remove all the relevant code and variables throughout the project
+#define wakeDeepDIVA					DIVA_3		// ACLK divider deep in the night...
+#define wakeDeepTicks					8			// ...and the ticks each wake-up then counts for (must match)
+#define wakeWindowShift					3			// Dawn window is the learned night / 2^wakeWindowShift before the expected dawn
+#define wakeLearnShift					2			// Each night moves the learned night 1 / 2^wakeLearnShift of the way
+#define wakeMinNight					2637		// Ticks a night must last to be learned (2 hours at 12kHz), shorter is a cloud
+#define wakeSnoozeGrace					(snoozeLimit / 8)	// Snooze loops (6 hours by default) per dark day
+#define wakeScheduleMagic				0xDA1E		// Seeds the checksum, so that all-zero RAM doesn't pass
+#define WS_DARK							0x01		// flags: PV has gone, the clock is running
+#define WS_DARKDAY						0x02		// flags: and it's already counted as a dark day
+struct WakeSchedule {
+	unsigned int sinceDusk;						// Ticks since dusk (saturates)
+	unsigned int night;							// Learned night (ticks, 0 until learned)
+	unsigned int TARhalf;						// Top bit of TAR at the last tick, while snoozing
+	unsigned int sleepTicks;					// Ticks the current sleep lasts (see setSleepPeriod())
+	char darkDays;								// One bit per day, newest in bit 0, set if it was dark
+	char flags;
+	unsigned int checksum;						// Must be last
+};
+#ifdef enableWakeScheduling
+extern struct WakeSchedule wakeSchedule;
+void countSleepTime(void);						// wakeSchedule.cpp
+void setSleepPeriod(void);						// wakeSchedule.cpp
+void wakeAtDusk(void);							// wakeSchedule.cpp
+void wakeAtDawn(void);							// wakeSchedule.cpp
+void countSnoozeTime(void);						// wakeSchedule.cpp
+#endif
+
+// Declaration of some things to help with a parameter block in flash, placed in header.h
+// Also have to remember to include or not include paramBlock.cpp!
+// So that a unit can be retuned without a new build, the thresholds, blink numbers and snooze time can be given in a
+// parameter block in the second half of info segment D (the first half is the divider calibration, and the jig
+// calibration erases the whole segment, so write the block after that). The thresholds in it are already calibrated
+// for this unit's ADC (or for the divider calibrated readings, with PARAM_DIVIDERCAL), so on a full wake-up loading it
+// is just the CRC and a copy, with no float calibration. If it's missing (erased), for another version, for the other
+// kind of readings, or fails its CRC, the defines above are used as usual. The block is made from volts and the unit's
+// own calibration by "02 Firmware/Tools/paramBlock/paramBlock.cpp", and written with the programmer.
+//#define enableParamBlock					// Comment this out to remove all the relevant code and variables throughout the project
+#define paramVersion					1			// Bump when ParamBlock changes
+#define PARAM_DIVIDERCAL				BIT0		// flags: the thresholds are for readings corrected by the divider calibration
+struct ParamBlock {
+	char version;								// paramVersion
+	char flags;									// PARAM_x bits
+	unsigned int PVmpp;							// Calibrated thresholds (see calibrateThresholds())
+	unsigned int lowPV;
+	char maxCellV;
+	char minCellV;
+	char minFuse;
+	char minBleedV;
+	char stopChargeV;
+	char restartChargeV;
+	char restartDischV;
+	char LEDthresh1;
+	char LEDthresh2;
+	char LEDthreshHyst;
+	char blinkCount;							// standardBlinkNumber
+	char lowBattBlink;							// lowBattBlinkDuration
+	char shortCircuitBlink;						// shortCircuitBlinkDuration
+	char reserved;
+	unsigned long snoozeLimit;					// maxSnoozeTime
+	unsigned int crc;							// CRC-16-CCITT (0x1021, from 0xFFFF) of the above, must be last
+};
+#ifdef enableParamBlock
+extern struct ParamBlock *paramBlock;
+extern bool paramsLoaded;
+extern char blinkCount;
+extern char lowBattBlink;
+extern char shortCircuitBlink;
+extern unsigned long snoozeLimit;
+void loadParams(void);							// paramBlock.cpp
+#else
+#define blinkCount						standardBlinkNumber
+#define lowBattBlink					lowBattBlinkDuration
+#define shortCircuitBlink				shortCircuitBlinkDuration
+#define snoozeLimit						maxSnoozeTime
+#endif
+
+
+// Declaration of some things to help with keeping a history of daily statistics, placed in header.h
+// Also have to remember to include or not include dailyStats.cpp!
+// The day's statistics are kept in uninitialised RAM (checked as warmState is, so they survive sleep), counted in
+// periods: every statsPeriodLoops loops, with snoozing loops counting statsSnoozeWeight (so a period is about 15s awake
+// at 8MHz or snoozing), the state is sampled. That's all there is on each loop. Wake-ups from sleep are counted in
+// checkPV(). At dusk (PV gone while awake), if there's been at least statsMinHarvest of PV, the day is saved as a
+// 6 byte record in info segment C, after maxTemp_FLASH (so a day without much PV is added to the next). The cell
+// voltages and temperature are saved as deltas from the record before, the rest in about quarter hours. There's room
+// for statsDays records; when they're all used, the segment is erased and the newest statsKeepDays written back. So
+// that the history isn't erased every time the maximum temperature goes up, maxTemp_FLASH is then only written with
+// the day's record (with the higher of maxTemp_RAM and the day's peak, as maxTemp_RAM starts again after a reset), or
+// straight away on a thermal shutdown if that only clears bits. Read back with the programmer and decoded with "02 Firmware/Tools/historyDecode.cpp".
+//#define enableDailyStats					// Comment this out to remove all the relevant code and variables throughout the project
+#define statsPeriodLoops				64000u		// Loops per period (about 15s at 8MHz)
+#define statsSnoozeWeight				256			// Loops that a snoozing loop counts for (about 4300 / 17 loops/s)
+#define statsMinHarvest					240			// Periods of PV to count as a day (about an hour)
+#define statsPeriodShift				6			// Periods are saved in units of 2^statsPeriodShift (about 16 minutes)
+#define statsWakeShift					9			// Wake-ups are saved in units of 2^statsWakeShift (about 23 minutes)
+#define statsTempShift					2			// Temperature is saved in units of 2^statsTempShift ADC units
+#define statsDays						9			// Records in segment C
+#define statsKeepDays					4			// Records kept when the segment is erased
+#define statsVersion					1			// Bump when the record layout changes
+#define statsMagic						0x57A7		// Seeds the checksum, so that all-zero RAM doesn't pass
+#define STATS_RESET						BIT0		// flags: the day was started again by a reset (power-up, reset pin, or a hang)
+#define STATS_TEMP25					BIT4		// format: the temperature is at the 2.5V reference (enableTempCompensation)
+#define STATS_NOTEMP					BIT5		// format: there's no temperature (no enableMaxTempLog)
+struct DayStats {
+	unsigned int loops;							// Counts loops, a period every time it wraps
+	unsigned int harvest;						// Periods with PV (not snoozing)
+	unsigned int full;							// Periods with batteryStatus 1
+	unsigned int empty;							// Periods with batteryStatus 2
+	unsigned int bleed;							// Periods with a cell bleeding
+	unsigned int wakes;							// Watchdog wake-ups
+	unsigned int peakTemp;						// Highest av_tempADC
+	char minCell;								// Lowest and highest cell voltage (ADC)
+	char maxCell;
+	char shorts;								// Short circuits
+	char flags;									// STATS_x bits
+	unsigned int checksum;						// Must be last
+};
+// Record words: 0: harvest | full << 6 | shorts << 12 (3 bits) | reset << 15
+//               1: empty | bleed << 6 | temperature delta << 12 (4 bits, signed)
+//               2: lowest cell delta | highest cell delta << 5 (5 bits each, signed) | wakes << 10
+struct DayHistory {
+	char baseMinCell;							// Values the first record's deltas are from
+	char baseMaxCell;
+	char baseTemp;
+	char format;								// statsVersion | STATS_x bits
+	unsigned int records[statsDays][3];			// Oldest first
+	unsigned int unused;						// Bit n is cleared once records[n] is written
+};
+#ifdef enableDailyStats
+extern struct DayStats dayStats;
+extern struct DayHistory *dayHistory;
+void statsAtWake(void);							// dailyStats.cpp
+void sealStats(void);							// dailyStats.cpp
+void countStats(void);							// dailyStats.cpp
+void statsAtDusk(void);							// dailyStats.cpp
+void saveMaxTemp(void);							// dailyStats.cpp
+#endif
+
+
+// Declaration of some things to help with estimating the battery's state of health, placed in header.h
+// Also have to remember to include or not include stateOfHealth.cpp!
+// Each cell's internal resistance is learned, as a ratio to the PTC fuse's (as irRatio, see enableIRCompensation):
+// from how far each cell moves when the load steps (the gate opening or closing, or loads switched), against the fuse
+// drop, while the charge current isn't also changing; and how the cells share a step in the charge current when the
+// nudge duty steps, which only says which cells have more of the resistance than the others. The capacity is counted
+// from full (batteryStatus 1) to empty (batteryStatus 2) without charging in between, as the fuse drop added up
+// every period (as statsPeriodLoops), so it's in fuse drop (ADC units) x periods, and only means anything compared
+// with the first one measured: the fade. The figures are kept in info segment B after the first run test record,
+// as sohSlots records of 8 bytes; when they're all used the segment is erased and the test record written back with
+// the newest. They're saved going to sleep or snooze, if a cycle's been measured or a cell's resistance has moved.
+// Loaded on a full wake-up, for other modules to use (with enableIRCompensation, irRatio is their average),
+// and decoded from an information memory dump with "02 Firmware/Tools/historyDecode.cpp", which flags a weak pack.
+//#define enableStateOfHealth				// Comment this out to remove all the relevant code and variables throughout the project
+#define sohFilterShift					averageShift	// Fuse voltage is averaged over 2^sohFilterShift loops, as the cell voltages are (so it tracks them with enableSyncedADC too)
+#define sohStepLoops					256			// Loops between looking for steps to learn from (power of 2, long enough for the averages to settle)
+#define sohLoadMinStep					3			// ADC units that the fuse drop must step by to learn the cells' resistance
+#define sohDutyMinStep					2048		// nudgeDuty step (1/65536ths) to learn the cells' shares of it from
+#define sohDutySteady					256			// nudgeDuty moving less than this counts as the charge current not changing
+#define sohShareMinStep					4			// ADC units that the cells must move by between them to learn shares from
+#define sohRatioDefault					64			// Cell to fuse resistance ratio (Q8) until learned, as irRatioDefault
+#define sohMaxRatio						1020		// Largest ratio believed (saved in 1/64ths, so a char)
+#define sohSaveDelta					2			// 1/64ths that a cell's ratio must move by to be saved again
+#define sohPeriodLoops					64000u		// Loops per period that the load is added up (about 15s at 8MHz), as statsPeriodLoops
+#define sohSnoozeWeight					256			// Loops that a snoozing loop counts for, as statsSnoozeWeight
+#define sohMinCapacity					64			// Smallest full to empty believed (fuse drop x periods)
+#define sohSlots						4			// Records in segment B
+#define sohNoSnapshot					0x7FFF		// sohLastLoad before there's anything to compare with
+struct HealthRecord {
+	unsigned int capacity;						// Full to empty (fuse drop x periods), filtered, 0 if not measured yet
+	unsigned int cycles;						// Full to empty cycles measured
+	unsigned char cellR[4];						// Cell to fuse resistance ratio, in 1/64ths
+};
+struct HealthLog {
+	unsigned int firstCapacity;					// The first full to empty, which the fade is from
+	struct HealthRecord records[sohSlots];		// Oldest first
+	unsigned int unused;						// Bit n is cleared once records[n] is written
+};
+#ifdef enableStateOfHealth
+extern struct HealthLog *healthLog;
+extern struct TestRecord *testRecord_FLASH;
+#ifndef enableIRCompensation					// Otherwise the load is irDrop - irZero
+extern int sohFuse;								// Filtered fuse voltage (1/16ths of ADC units)
+extern int sohZero;								// Fuse drop with the gate closed
+#endif
+extern int sohLastLoad;							// Load, cells and duty when last looked for a step
+extern char sohLastCell[4];
+extern unsigned int sohLastDuty;
+extern unsigned int sohRatio[4];				// Cell to fuse resistance ratio (Q8)
+extern unsigned int sohCapacity;
+extern unsigned int sohCycles;
+extern unsigned long sohCharge;					// Load added up since full (1/16ths)
+extern unsigned int sohPeriod;					// Counts down to the next period
+extern char sohLoops;
+extern bool sohCounting;						// Full, and not charged since
+extern bool sohChanged;							// A cycle's been measured since the figures were saved
+void initialiseHealth(void);					// stateOfHealth.cpp
+void refreshHealth(void);						// stateOfHealth.cpp
+void saveHealth(void);							// stateOfHealth.cpp
+#endif
+
+// Declaration of some things to help with timing the loop on the target with a logic analyser, placed in header.h
+// Two unused pins are driven as markers: the stage pin (P2.0) toggles at every stage boundary of main()'s loop, and
+// the event pin (P1.5) is high for the whole of an interrupt. The start of the loop is a stage pin toggle while the
+// event pin is high, and a fault (short circuit) is two. So on a capture, an event pin pulse with no stage pin edges
+// in it is an interrupt, an odd number is the start of a loop, and two or more is a fault. The markers are a single
+// instruction each (three for markLoop()), so there's no call overhead in what's being timed.
+// Capture both pins (sigrok/PulseView CSV or VCD) and analyse with "02 Firmware/Tools/markerTiming.cpp -f battery",
+// which knows the stages in the order they're marked in main().
+//#define enableTimingMarkers				// Comment this out to remove all the relevant code and variables throughout the project
+#ifdef enableTimingMarkers
+#define markStage()						(P2OUT ^= BIT0)
+#define markLoop()						do {P1OUT |= BIT5; P2OUT ^= BIT0; P1OUT &= ~BIT5;} while (0)
+#define markFault()						do {P1OUT |= BIT5; P2OUT ^= BIT0; P2OUT ^= BIT0; P1OUT &= ~BIT5;} while (0)
+// The event pin is put back as it was, in case the interrupt came in the middle of markLoop()
+#define markInterruptEntry()			char eventMarked = P1OUT & BIT5; P1OUT |= BIT5
+#define markInterruptExit()				if (!eventMarked) P1OUT &= ~BIT5
+#else
+#define markStage()
+#define markLoop()
+#define markFault()
+#define markInterruptEntry()
+#define markInterruptExit()
+#endif
+
+
+// Declaration of some things to help with measuring the noise on the ADC channels, placed in header.h
+// Also have to remember to include or not include adcNoise.cpp!
+// A bench diagnostic, for finding out how much averaging is really needed and how tight the thresholds can be. On a full
+// wake-up the unit goes into this mode instead of running (yellow LED), and sweeps the settings over and over: the four
+// sample times (ADC10SHT_x) with the 2.5V and then the 1.5V reference. At each setting every channel is sampled
+// 2^noiseSampleShift times (with the gate open, as the fuse channel only sees the battery then), and its mean, variance and
+// a histogram are worked out as the samples come in, into noiseReport. Then noiseReportReady() is called: put a breakpoint
+// on it, dump noiseReport each time it stops, and work out the ENOB of each channel from the dumps with
+// "02 Firmware/Tools/noiseDecode.cpp". Costs 76 bytes of RAM.
+//#define enableADCNoise					// Comment this out to remove all the relevant code and variables throughout the project
+#define noiseSampleShift				8			// 2^noiseSampleShift samples per channel per setting (no more than 8, or the sums can overflow)
+#define noiseCentreShift				4			// 2^noiseCentreShift samples first, to find the centre the rest are measured from
+#define noiseSettings					8			// Setting numbers: bits 0-1 are the sample time (ADC10SHT_x), bit 2 set for the 1.5V reference
+#define noiseBins						8			// Histogram bins: the centre -3 to +3 ADC units, then everything further out
+#define noiseMagic						0x0153		// Marks the report, for finding it in a dump of the whole of RAM
+struct NoiseResult {
+	unsigned int mean;							// ADC units, in 1/16ths
+	unsigned int variance;						// ADC units squared, in 1/16ths (0xFFFF if it's more than that can hold)
+	unsigned char histogram[noiseBins];			// Samples in each bin (255 at most, so one can be full)
+};
+struct NoiseReport {
+	unsigned int magic;							// noiseMagic
+	char setting;								// The setting these results are for (see noiseSettings)
+	char sweep;									// Counts the sweeps through all the settings
+	struct NoiseResult results[6];				// Indices of av_ADC_values
+};
+extern struct NoiseReport noiseReport;
+void measureNoise(void);						// adcNoise.cpp
+
 
 #endif /* HEADER_FILE_H */
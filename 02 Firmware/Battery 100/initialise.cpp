@@ -113,8 +113,19 @@ void initialiseIO(void) {
 	// Set port directions (1 means output, 0 means input), high-impedance digital outputs stay defined as inputs
 	P1DIR = BIT6;
 	P2DIR = BIT1 + BIT3 + BIT6 + BIT7;
+#ifdef enableTimingMarkers
+	// Unless the unused P1.5 and P2.0 are driving the timing markers (see header.h)
+	P1REN &= ~BIT5;
+	P2REN &= ~BIT0;
+	P1DIR |= BIT5;
+	P2DIR |= BIT0;
+#endif
 }
 void initialiseTimer(void) {
+#ifdef enableDitheredPWM
+	// Short PWM period, with the duty cycle dithered by the CCR0 interrupt (see ditheredPWM.cpp)
+	initialiseDitheredPWM();
+#else
 	// Mode configuration for PWM taken from code example in
 	// MSP430Ware, "MSP430G2xx2 Demo - Timer_A, PWM TA1, Up Mode, 32kHz ACLK"
 
@@ -134,6 +145,7 @@ void initialiseTimer(void) {
 	 * TASSEL_2			- "Source select", selects clock source of timer as SMCLK
 	 * MC_1				- "Mode control", set to continuous up mode - counting up to TACCR0. Set to MC_0 to stop timer and save power when going to sleep. */
 	TACTL = TASSEL_2 + MC_1;
+#endif
 }
 
 void initialiseGlobals(void) {
@@ -148,32 +160,39 @@ void initialiseGlobals(void) {
 
 // Calibrate the voltage thresholds so that the ADC readings can be directly compared with
 // no further calibration. See "Voltage threshold calibration.doc"
-unsigned int secondStageCalibration(unsigned int uncalibratedThreshold, float _ADC_coeff) {
+unsigned int secondStageCalibration(unsigned int uncalibratedThreshold, unsigned long _ADC_coeff) {
+#ifdef enableDividerCalibration
+	// The readings are already corrected to what they should be for the nominal dividers
+	// (the ADC errors included), so the thresholds can be used as they are
+	if (dividersCalibrated)
+		return uncalibratedThreshold;
+#endif
 	// Let's create a variable to hold our ongoing work on the calibrated threshold,
 	// and start by subtracting the offset calibration (supposed to be careful with the sign of
 	// *CALADC_OFFSET, but a bit of experimentation on codepad.org shows that the below simply
 	// works as expected)
 	unsigned int calibratedThreshold = uncalibratedThreshold - *CALADC_OFFSET;
-	// Now simply "float multiply" by the product coefficient calculated in the parent method.
-	// Adding 0.5 to the result is just a trick to ensure that the conversion to int results
-	// in rounding the float, rather than just truncating the numbers after the decimal place.
-	calibratedThreshold = (unsigned int) (calibratedThreshold * _ADC_coeff) + 0.5;
-	// That's it. Now return the unsigned int.
-	return calibratedThreshold;
+	// Now multiply by the product coefficient calculated in the parent method (in 1/65536ths),
+	// truncating as the float version always did (its 0.5 was added after the conversion to int)
+	return (calibratedThreshold * _ADC_coeff) >> 16;
 }
 
 // There are two steps in using the calibration data in information memory to calibrate
-// the voltage thresholds. The first is to calculate the two factor (float) coefficients, to avoid
-// doing this float division too many times. Then multiply them together to get a net factor and
-// avoid doing this float multiplication too many times. The second step is to float multiply this
-// coefficients with each threshold, after applying the offset calibration.
+// the voltage thresholds. The first is to calculate the net factor of the two coefficients, once.
+// The second step is to multiply each threshold by it, after applying the offset calibration.
+// This used to be in floats, but that brought in the float library, which took up more of the
+// 4kB than anything else: the coefficient is now a fixed point number (1/65536ths) instead.
 void calibrateThresholds(void) {
-	// Firstly calculate the two "factor" calibration coefficients. The division must be "float
-	// division", so the numerators are cast as such.
-	float ADC_coeff1 = (float) 32768 / *CALADC_25VREF_FACTOR;
-	float ADC_coeff2 = (float) 32768 / *CALADC_GAIN_FACTOR;
-	// Now "float multiply" them together to get a single float coefficient
-	float ADC_coeff_product = ADC_coeff1 * ADC_coeff2;
+#ifdef enableParamBlock
+	// The parameter block's thresholds were calibrated when it was made
+	if (paramsLoaded)
+		return;
+#endif
+	// Firstly calculate the reference factor coefficient, 32768 / *CALADC_25VREF_FACTOR, in 1/65536ths
+	unsigned long ADC_coeff1 = 0x80000000ul / *CALADC_25VREF_FACTOR;
+	// Now multiply that by the gain factor coefficient, 32768 / *CALADC_GAIN_FACTOR (rounded, as the factors
+	// are close to 32768 the coefficients are close to 1, so this doesn't overflow)
+	unsigned long ADC_coeff_product = ( (ADC_coeff1 << 15) + (*CALADC_GAIN_FACTOR >> 1) ) / *CALADC_GAIN_FACTOR;
 	// Now the second multiplication is applied to each threshold separately
 	// Plenty of truncation going on here, but it's all checked and safe
 	PVmpp = secondStageCalibration(PVmpp_uncalib, ADC_coeff_product);
@@ -188,7 +207,32 @@ void calibrateThresholds(void) {
 	LEDthresh1 = secondStageCalibration(LEDthresh1_uncalib, ADC_coeff_product);
 	LEDthresh2 = secondStageCalibration(LEDthresh2_uncalib, ADC_coeff_product);
 	LEDthreshHyst = secondStageCalibration(LEDthreshHyst_uncalib, ADC_coeff_product);
+#ifdef enableDividerCalibration
+	// With the dividers calibrated there's less error to allow for, so use more of the battery
+	if (dividersCalibrated) {
+		stopChargeV = calibratedStopChargeV;
+		minCellV = calibratedMinCellV;
+	}
+#endif
+}
+
+#if defined(enableMaxTempLog) || defined(enableFirstRunTest) || defined(enableDividerCalibration) || defined(enableDailyStats) || defined(enableStateOfHealth)
+// Write length bytes from source to destination in information memory, first erasing the segment it's in
+// if erase is set (otherwise a write can only clear bits). Everything that writes to information memory
+// goes through here, rather than each having its own copy. The flash timing generator must be set up.
+void writeInfoSegment(char *destination, const char *source, char length, bool erase) {
+	FCTL3 = FWKEY;                            // Clear Lock bit
+	if (erase) {
+		FCTL1 = FWKEY + ERASE;                // Set Erase bit
+		*destination = 0;                     // Dummy write to erase Flash segment
+	}
+	FCTL1 = FWKEY + WRT;                      // Set WRT bit for write operation
+	for (char i = 0; i < length; i++)
+		destination[i] = source[i];           // Write values to flash
+	FCTL1 = FWKEY;                            // Clear WRT bit
+	FCTL3 = FWKEY + LOCK;                     // Set LOCK bit
 }
+#endif
 
 // This routine initialises the bare minimum needed
 // to take an ADC reading of the PV voltage.
@@ -200,11 +244,55 @@ void initialisePre(void) {
 // Now we've decided to stay awake, this will initialise
 // the rest.
 void initialiseFull(void) {
+// See whether there's a divider calibration in flash, before the thresholds are calibrated.
+// This is located in "initialiseFull()" in initialise.cpp
+#ifdef enableDividerCalibration
+	initialiseDividerCalibration();
+#endif
+// Load the parameter block, if there's a good one (it depends on the divider calibration, so after that).
+// This is located in "initialiseFull()" in initialise.cpp
+#ifdef enableParamBlock
+	loadParams();
+#endif
+#ifdef enableWarmBoot
+	// If we've been woken up by the watchdog, and the state from before
+	// sleeping is still good, use that instead of recalibrating
+	if ( !restoreWarmState() )
+		calibrateThresholds();
+#else
 	calibrateThresholds();
+#endif
 	initialiseGlobals();
 	initialiseIO();
 	initialiseTimer();
 
+// Check the event trace survived, and log that we've woken up.
+// This is located in "initialiseFull()" in initialise.cpp
+#ifdef enableEventTrace
+	initialiseTrace();
+#endif
+
+// The clock has just been set to 8MHz by initialiseClock(), with the PWM at full scale.
+// This is located in "initialiseFull()" in initialise.cpp
+#ifdef enableClockGovernor
+	clockSpeed = CLOCK_8MHZ;
+	PWMshift = 0;
+	governorHold = 0;
+#endif
+
+// Load the state of health figures (whose average is the IR drop compensation's cell resistance, see
+// refreshIRDrop()). This is located in "initialiseFull()" in initialise.cpp
+#ifdef enableStateOfHealth
+	initialiseHealth();
+#endif
+
+// Start with the default cell resistance, unless one's been learned and kept over a warm boot.
+// This is located in "initialiseFull()" in initialise.cpp
+#ifdef enableIRCompensation
+	if (irRatio == 0)
+		irRatio = irRatioDefault;
+#endif
+
 // Initialise variables needed for temperature logging and use.
 // This is located in "initialiseFull()" in initialise.cpp
 #ifdef enableMaxTempLog
@@ -216,10 +304,31 @@ void initialiseFull(void) {
 	// We don't bother with this if we're snoozing, so no need to worry
 	// about other clock speeds.
 	FCTL2 = FWKEY + FSSEL_1 + (27 - 1);
-	// Calculate the maximum shutdown temperature as an ADC reading (adding 0.5 at the end to ensure rounding instead of truncation)
-	shutdownTemp = ( (float) shutdownTemp_uncalib - 30 ) * ( *CALADC_15T85 - *CALADC_15T30 ) / ( 85 - 30 ) + *CALADC_15T30 + 0.5;
+	// Calculate the maximum shutdown temperature as an ADC reading (adding half the divisor before dividing to ensure rounding instead of truncation)
+#ifdef enableTempCompensation
+	// (sampleTemp() reads the sensor at the 2.5V reference)
+	shutdownTemp = ( (shutdownTemp_uncalib - 30) * ( *CALADC_25T85 - *CALADC_25T30 ) + (85 - 30) / 2 ) / ( 85 - 30 ) + *CALADC_25T30;
+#else
+	shutdownTemp = ( (shutdownTemp_uncalib - 30) * ( *CALADC_15T85 - *CALADC_15T30 ) + (85 - 30) / 2 ) / ( 85 - 30 ) + *CALADC_15T30;
+#endif
 #endif  // enableMaxTempLog
 
+// If there's no divider calibration yet, see whether we're on the production jig and calibrate if so
+// (before the first run test, so that it's testing calibrated readings).
+// This is located in "initialiseFull()" in initialise.cpp
+#ifdef enableDividerCalibration
+	if (!dividersCalibrated) {
+		calibrateDividers();
+		if (dividersCalibrated) {
+#ifdef enableParamBlock
+			// Segment D has just been erased and rewritten, so there's no parameter block now
+			loadParams();
+#endif
+			calibrateThresholds();
+		}
+	}
+#endif
+
 // This tests the unit to see whether it's had it's had a good test.
 // Located in initialise.cpp.
 #ifdef enableFirstRunTest
@@ -229,41 +338,42 @@ void initialiseFull(void) {
 		firstRunTest(); // This method will run the "first run" test, and assign a value to test result
 		// Now we're guaranteed a result, so let's check it.
 		// In each case we display LEDs, but with different "codes" to show failure mode.
-		// The code numbers are chosen to match those used in the quality control flow charts
-		switch (*testResult) {
-		case 0:
+		// The codes are the same as those used in the quality control flow charts. If there's more than
+		// one failure, the first in this list is shown (the rest can be read from the record in flash).
+		if (*testResult == 0) {
 			// Successful test result, display green led flash, and then go to sleep.
 			// Next time we wake up the test will not be run.
 			flashLED(3,0,testBlinkDuration,testBlinkDuration,testSuccessBlinkNumber);
-			goToSleep();
-			break;
-		case 3:
-			// Bad solar panel possibility, display red and green to suggest change of solar panel, then go to sleep
-			// Next time we wake up the test will be rerun
-			flashLED(1,3,testBlinkDuration,testBlinkDuration,testFailBlinkNumber);
-			goToSleep();
-			break;
-		case 4:
+		}
+		// Otherwise next time we wake up the test will be rerun
+		else if (*testResult & TEST_FAIL_CELLS) {
 			// Bad battery possibility, flash red to suggest change of battery, then go to sleep
-			// Next time we wake up the test will be rerun
 			flashLED(1,0,testBlinkDuration,testBlinkDuration,testFailBlinkNumber);
-			goToSleep();
-			break;
-		case 5:
+		}
+		else if (*testResult & TEST_FAIL_PV) {
+			// Bad solar panel possibility, display red and green to suggest change of solar panel, then go to sleep
+			flashLED(1,3,testBlinkDuration,testBlinkDuration,testFailBlinkNumber);
+		}
+		else if (*testResult & TEST_FAIL_CHARGE) {
 			// Bad PCB or solar panel, display long red flash, with short pulses off to suggest change of PCB or solar panel, then go to sleep
-			// Next time we wake up the test will be rerun
 			flashLED(1,0, testBlinkDuration * 2, testBlinkDuration / 2, testFailBlinkNumber);
-			goToSleep();
-			break;
-		case 7:
-			// Probably bad PCB, display long red flash, with short pulses of green to suggest change of PCB, then go to sleep
-			// Next time we wake up the test will be rerun
+		}
+		else {
+			// Probably bad PCB (TEST_FAIL_DISCHARGE), display long red flash, with short pulses of green to suggest change of PCB, then go to sleep
 			flashLED(1,3, testBlinkDuration * 2, testBlinkDuration / 2, testFailBlinkNumber);
-			goToSleep();
-			break;
 		}
+		goToSleep();
 	}
 
 #endif // enableFirstRunTest
 
+// Go into the ADC noise measurement instead of running (it never returns).
+// This is located in "initialiseFull()" in initialise.cpp
+#ifdef enableADCNoise
+	measureNoise();
+#endif
+
+	// Clear the reset cause flags, so that the next reset's cause is clear
+	// (used by the optional event trace and warm boot)
+	IFG1 &= ~(WDTIFG + PORIFG + RSTIFG);
 }
@@ -0,0 +1,56 @@
+/*
+ * Optional IR drop compensation for the low voltage cut-off. Under a big
+ * load the cells sag by their internal resistance times the current, so
+ * the lowest cell can look empty while there's still charge left. The
+ * PTC fuse is in series with the load, so its voltage drop gives us the
+ * current, and the cells' resistance is learned relative to the fuse's
+ * from how far the battery voltage moves when the load changes.
+ */
+
+#include <msp430.h>
+#include "header.h"
+
+// Called from refreshBatteryStatus() every loop to update irSag
+void refreshIRDrop(void) {
+	// Average the fuse voltage the same way as the battery voltage (so the drop doesn't jump about
+	// while one catches up with the other), in 1/16ths of ADC units for some resolution. Start it
+	// from the battery voltage average, as that may be starting from zero, or from a warm boot
+	if (irFuse == 0)
+		irFuse = av_ADC_values[3] << 4;
+	irFuse += ( (int) (av_ADC_values[5] << 4) - irFuse ) >> irFilterShift;
+	irDrop = (int) (av_ADC_values[3] << 4) - irFuse;
+	// With the gate closed there's no load, so whatever's left is the channels' offset
+	if ( !(P2OUT & BIT3) )
+		irZero = irDrop;
+	int load = irDrop - irZero;
+	if (load < 0)
+		load = 0;
+#ifdef enableStateOfHealth
+	// refreshHealth() learns each cell's resistance from the same load steps (taking its load from irDrop), so
+	// use their average rather than learning it again here
+	irRatio = (sohRatio[0] + sohRatio[1] + sohRatio[2] + sohRatio[3]) >> 2;
+#endif
+	// Each cell drops irRatio / 256 times as much as the fuse
+	unsigned int sag = ( (unsigned long) load * irRatio ) >> 12;
+	irSag = (sag > irMaxSag) ? irMaxSag : sag;
+
+#ifndef enableStateOfHealth
+	// Every irLearnPeriod loops, see if the load has stepped since last time
+	if (++irLoops & (irLearnPeriod - 1))
+		return;
+	// Only learn at night with the gate open, as the charge current would move the battery voltage too
+	if ( (av_ADC_values[4] < lowPV) && (P2OUT & BIT3) ) {
+		int step = irDrop - irLastDrop;
+		if ( (step >= (irLearnMinStep << 4)) || (step <= -(irLearnMinStep << 4)) ) {
+			// The battery voltage drops by 4 cells' worth for the fuse's one, so in Q8:
+			// ratio = (battery step / 4) * 256 / (fuse step / 16)
+			long ratio = ( (long) ((int) irLastBattV - (int) av_ADC_values[3]) << 10 ) / step;
+			// Move a little way towards it, as each step is only a rough measurement
+			if ( (ratio > 0) && (ratio <= irMaxRatio) )
+				irRatio += ( (int) ratio - (int) irRatio ) / 8;
+		}
+	}
+	irLastDrop = irDrop;
+	irLastBattV = av_ADC_values[3];
+#endif
+}
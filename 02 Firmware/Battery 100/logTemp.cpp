@@ -11,15 +11,11 @@
 #include <msp430.h>
 #include "header.h"
 
+#ifndef enableDailyStats	// Otherwise maxTemp_FLASH is written by saveDay() and saveMaxTemp(), without erasing the history of days
 void flashWriteMaxTemp(unsigned int value) {
-	FCTL1 = FWKEY + ERASE;                    // Set Erase bit
-	FCTL3 = FWKEY;                            // Clear Lock bit
-	*maxTemp_FLASH = 0;                       // Dummy write to erase Flash segment
-	FCTL1 = FWKEY + WRT;                      // Set WRT bit for write operation
-	*maxTemp_FLASH = value;            	      // Write value to flash
-	FCTL1 = FWKEY;                            // Clear WRT bit
-	FCTL3 = FWKEY + LOCK;                     // Set LOCK bit
+	writeInfoSegment((char *) maxTemp_FLASH, (char *) &value, sizeof(value), true);
 }
+#endif
 
 void checkReboot(void) {
 	// If we haven't got a copy of the highest temp recorded in RAM
@@ -34,11 +30,17 @@ void checkReboot(void) {
 			// Write to RAM version first (easy)
 			maxTemp_RAM = 1;
 			// Now write to Flash version
+#ifdef enableDailyStats
+			// ...which only clears bits, so it's done without erasing segment C (and the history of days)
+			saveMaxTemp();
+#else
 			flashWriteMaxTemp(1);
+#endif
 		}
 	}
 }
 
+#ifndef enableTempCompensation	// Otherwise av_tempADC is kept up to date by sampleTemp(), see tempCompensation.cpp
 void getAvTemp(void) {
 	// Slow down the ADC to bring the sampling time within the 30us limit.
 	// Easiest way is simply to change the ADC clock source to ACLK (12kHz VLO).
@@ -51,14 +53,22 @@ void getAvTemp(void) {
 	ADC10CTL0 &= ~REF2_5V;
 	ADC10CTL1 = (ADC10CTL1 & ~0b11000) | ADC10SSEL_1;
 	// Give voltage reference at least 30us to settle
+#ifdef enableClockGovernor
+	waitTicks(4);
+#else
 	__delay_cycles(250);
+#endif
 	// Get the ADC reading from internal temperature sensor
 	unsigned int tempADC = readADCChannel(10);  // Channel 10 is the internal temperature sensor
 	// Great, now that's done put the ADC settings back to how they were
 	ADC10CTL0 = ADC10CTL0_current;
 	ADC10CTL1 = ADC10CTL1_current;
 	// Give voltage reference at least 30us to settle
+#ifdef enableClockGovernor
+	waitTicks(4);
+#else
 	__delay_cycles(250);
+#endif
 	// Get the rolling average for the tempADC reading
 	// (see updateAverages() in ADCs.cpp for explanation)
 	av_tempADC *= 3;
@@ -68,6 +78,7 @@ void getAvTemp(void) {
 	av_tempADC = av_tempADC >> 2;
 
 }
+#endif
 
 void logTemp(void) {
 	// Only check max temp every time the counter is reset
@@ -82,7 +93,9 @@ void logTemp(void) {
 		checkReboot();
 
 		// Get the average temperature
+#ifndef enableTempCompensation
 		getAvTemp();
+#endif
 
 		// Now compare the current average with the maximum average
 		// value in RAM
@@ -90,11 +103,22 @@ void logTemp(void) {
 			// Then update maxTemp, first in RAM
 			maxTemp_RAM = av_tempADC;
 			// And secondly in Flash (so that it survives a reset/sleep)
+#ifdef enableDailyStats
+			// ...which is done with the day's statistics (or on a thermal shutdown, below), see dailyStats.cpp
+#else
 			flashWriteMaxTemp(av_tempADC);
+#endif
 		}
 
 		// Finally, check if the temp is so high that we need to do a shutdown!
 		if (av_tempADC >= shutdownTemp) {
+#ifdef enableEventTrace
+			traceEvent(EV_THERMALSHUTDOWN, av_tempADC);
+#endif
+#ifdef enableDailyStats
+			// Keep the temperature that caused it, in case the day's never saved
+			saveMaxTemp();
+#endif
 			// Start by slowing down the CPU to save battery during this shutdown
 			// and to force stop charging.
 			goToSnooze();
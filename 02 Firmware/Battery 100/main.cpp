@@ -44,6 +44,36 @@
  *		- TODO: can we use a hardware multiplier?
  *		- TODO: check out strange behaviour on initiasation of nudge voltage pin: when it is set as an output with HIGH voltage, it doesn't go high, allowing PV current to rush in. Only a problem during debugging really... but worth understanding what's going on. Could be that P2SEL should be set only after configuring the timer?
  *		- TODO: digital ports are only initialised if they should be high, if they should be unitialised they are not touched. But the user guide says that they will not be automatically initialised to LOW. Rather, they retain their previous value. So need to double check if failing to reset a HIGH to LOW at the start could cause problems.
+ *V2.01 - Implemented optional event trace: a ring of recent events in uninitialised RAM that survives watchdog resets, for post-mortem analysis of units from the field (decoded with Tools/traceDecode.cpp)
+ *		- Fixed cell bleeding check in balanceCells() using "~" instead of "!" on a bool, which meant bleedOn() was being called on every loop
+ *V2.02 - Implemented optional warm boot: the PV check on wake-up is done before the C start-up code initialises RAM, and calibrated thresholds and cell averages survive sleep in uninitialised RAM (checksummed), so they don't need redoing/resettling after a watchdog wake-up
+ *V2.03 - Implemented optional clock governor: 16MHz while the nudge voltage is tracking PV, 1MHz when there's nothing to regulate, 8MHz otherwise. Timer_A (PWM period and duty), the ADC clock, the flash timing generator and the ADC reference settling delays are all rescaled to match. At 1MHz the PWM period is shortened to keep the PWM frequency up, which is presumably why nudging didn't work at 1MHz before (see V1.0 notes)
+ *		- TODO: check nudging stability at 1MHz and 16MHz on a board, and that Vcc is high enough for 16MHz
+ *V2.04 - Implemented optional dithered PWM: the nudge PWM runs at 7.8kHz instead of 122Hz, keeping its 16-bit duty resolution by dithering the low bits in the Timer_A CCR0 interrupt (the first interrupt in the firmware, so GIE is now set once the timer is running)
+ *		- TODO: try a much smaller Vnudge capacitor with this enabled (see V2.00 TODO), and check low-batt charging stability
+ *V2.05 - Implemented optional LED dimming (see V1.0 notes): LEDs fully on while there's PV, but only a short flash every couple of seconds at night (while snoozing), and optionally only a blink when the battery is low. Strobed from refreshLEDs(), so no extra wake-ups
+ *V2.06 - Sped up the first run test: baselines and discharge readings stop as soon as their averages have settled, and the charge test passes as soon as the battery voltage is seen to rise (rather than always doing 20000/40000/20000 loops)
+ *		- First run test result is now a bitmask of failure causes (the charge and discharge tests are both run to narrow it down), saved in info segment B along with the measured values
+ *V2.07 - Implemented optional per-unit divider calibration: a two-point calibration on a production jig gives each ADC channel a gain and offset (saved in info segment D), applied to every reading before the cell voltages are worked out, so divider tolerances no longer add up going up the stack. Calibrated units charge to 3.55V instead of 3.50V and discharge down to 2.70V instead of 2.80V
+ *		- TODO: check the jig voltages are stiff enough with the unit charging from PV, and the fuse reading with the gate open on the jig
+ *V2.08 - Implemented optional temperature compensation: the internal temperature sensor is read every 16 loops at the 2.5V reference as part of refreshADCs() (no more reference swapping and settling stalls in logTemp()), and the filtered temperature brings maxCellV, stopChargeV and minCellV down in the cold. Charging is stopped below freezing
+ *		- With this enabled, maxTemp_FLASH is in 2.5V reference ADC units rather than 1.5V
+ *V2.09 - Implemented optional IR drop compensation of the low voltage cut-off: load current is estimated from the fuse drop, the cells' resistance (relative to the fuse's) is learned from load steps at night, and the lowest cell is credited with its IR drop before comparing with minCellV, so big loads don't cut off the battery with charge left
+ *		- TODO: check the PTC fuse resistance is steady enough over temperature for this (it's the current sense)
+ *V2.10 - Implemented optional wake scheduling: the length of the night is learned in VLO ticks (counted in wake-ups asleep, and from Timer_A left running on ACLK while snoozing), and asleep the watchdog period is stretched 8 times (ACLK divided by 8) until shortly before the expected dawn. A dawn that doesn't come is a dark day, and snoozing through one goes to sleep sooner than maxSnoozeTime if the last week has been mostly bright
+ *		- Note that the watchdog period is about 2.7s, not 11s (ACLK is the VLO undivided, DIVA_0, see initialiseClock())
+ *V2.11 - Implemented optional parameter block: the thresholds, blink numbers and snooze time can be given in a CRC checked block in info segment D (made with Tools/paramBlock from volts and the unit's own calibration), loaded on a full wake-up in place of the defines and the float calibration
+ *V2.12 - Implemented optional daily statistics: PV time, time full, empty and bleeding, the lowest and highest cells, peak temperature, short circuits and wake-ups from sleep are kept for the day (sampled about every 15s, so only a countdown on each loop), and saved at dusk as a 6 byte record in info segment C after maxTemp_FLASH, for the last 5 to 9 days (decoded with Tools/historyDecode.cpp)
+ *		- With this enabled, maxTemp_FLASH is only updated once a day, with the day's record, so that the history isn't erased every time it goes up
+ *V2.13 - Implemented optional PWM-synchronised ADC sampling: refreshADCs() conversions are triggered by the nudge PWM output (Timer_A OUT1) at the end of each dithered period, optionally at both edges averaged, so the readings no longer alias with the PWM ripple, and the cell averages are cut from 1/32 to 1/8
+ *V2.14 - Implemented optional state of health estimation: each cell's resistance is learned (relative to the PTC fuse's) from load steps and its share of charge current steps, and the capacity is counted from full to empty as the fuse drop added up, and kept in info segment B after the first run test record, for the fade and weak cells to be read from the field (decoded with Tools/historyDecode.cpp)
+ *		- With enableIRCompensation too, the state of health takes its load from irDrop rather than filtering the fuse voltage again, and irRatio is the average of the cells' ratios rather than being learned separately from the same load steps
+ *V2.15 - Implemented optional timing markers: two unused pins toggled at the start of the loop, after each stage, in the interrupt and on a fault, for timing on the target with a logic analyser (analysed with Tools/markerTiming.cpp)
+ *V2.16 - Size-optimised so that both enableMaxTempLog and enableFirstRunTest should fit on the 4kB chip (not yet built and measured, there's no budget file until sizeBudget.sh -u is run):
+ *		- The threshold calibration, the shutdown temperature and the divider calibration's ideal readings are worked out in integers (fixed point) instead of floats, so the float library isn't linked at all. The thresholds can come out 1 ADC unit lower than before in rare cases (the float version truncated too)
+ *		- Everything that writes to information memory (flashWriteMaxTemp(), writeTestResult(), writeDividerCal(), saveDay(), saveMaxTemp() and saveHealth()) shares writeInfoSegment(), rather than each having its own erase and write sequence, and the first run test now sets up the flash timing generator itself (it was only set up with enableMaxTempLog)
+ *		- Tools/msp430Sim/sizeBudget.sh builds the size profile (msp430-gcc -Os with link time optimisation, and both diagnostics) and fails if there's less than 256 bytes of flash left, or (once a budget's been made with -u) if any function has grown past its budget
+ *V2.17 - Implemented optional ADC noise measurement: a bench mode that samples every channel 256 times at each sample time with each reference, over and over, working out the mean, variance and a histogram with integer sums into a report in RAM for the debugger to dump, so that the averaging and the threshold margins can be set from the ENOB (worked out with Tools/noiseDecode.cpp)
  */
 
 
@@ -101,7 +131,121 @@ int *CALADC_OFFSET = (int *) 0x10DE;
 	char *testResult = (char *) 0x1080;
 #endif //enableFirstRunTest
 
+// The event trace, placed in global space of main.cpp. NOINIT stops the C start-up code
+// zeroing it, so that it survives watchdog resets (C++ form of the pragma: applies to the next declaration).
+#ifdef enableEventTrace
+	#pragma NOINIT
+	struct TraceLog traceLog;
+#endif //enableEventTrace
+
+// State kept over sleep for warm boots, placed in global space of main.cpp (also NOINIT, see above)
+#ifdef enableWarmBoot
+	#pragma NOINIT
+	struct WarmState warmState;
+#endif //enableWarmBoot
+
+// Wake schedule, placed in global space of main.cpp (also NOINIT, see above)
+#ifdef enableWakeScheduling
+	#pragma NOINIT
+	struct WakeSchedule wakeSchedule;
+#endif //enableWakeScheduling
+
+// Statistics for the day so far (also NOINIT, see above), and the history of days in information memory segment C
+// (after maxTemp_FLASH), placed in global space of main.cpp
+#ifdef enableDailyStats
+	#pragma NOINIT
+	struct DayStats dayStats;
+	struct DayHistory *dayHistory = (struct DayHistory *) 0x1042;
+#endif //enableDailyStats
+
+// Parameter block in information memory segment D, and the parameters that aren't thresholds, placed in global space of main.cpp
+#ifdef enableParamBlock
+	struct ParamBlock *paramBlock = (struct ParamBlock *) 0x1020;
+	bool paramsLoaded;
+	char blinkCount;
+	char lowBattBlink;
+	char shortCircuitBlink;
+	unsigned long snoozeLimit;
+#endif //enableParamBlock
+
+// Clock governor state, placed in global space of main.cpp
+#ifdef enableClockGovernor
+	char clockSpeed;
+	char PWMshift;
+	unsigned int governorHold;
+#endif //enableClockGovernor
+
+// Dithered PWM duty and accumulator, placed in global space of main.cpp
+#ifdef enableDitheredPWM
+	volatile unsigned int nudgeDuty;
+	unsigned int ditherAccumulator;
+#endif //enableDitheredPWM
+
+// LED strobe phase, placed in global space of main.cpp
+#ifdef enableLEDDimming
+	unsigned int LEDPhase;
+#endif //enableLEDDimming
+
+// Divider calibration in information memory segment D, placed in global space of main.cpp
+#ifdef enableDividerCalibration
+	struct DividerCal *dividerCal = (struct DividerCal *) 0x1000;
+	bool dividersCalibrated;
+#endif //enableDividerCalibration
+
+// Temperature compensation state, placed in global space of main.cpp
+#ifdef enableTempCompensation
+	unsigned int *CALADC_25T85 = (unsigned int *) 0x10EA;
+	unsigned int *CALADC_25T30 = (unsigned int *) 0x10E8;
+	unsigned int tempLoops;
+	int tempC;
+	char tempCompCharge;
+	char tempCompMinCell;
+	bool tooColdToCharge;
+#endif //enableTempCompensation
+
+// IR drop estimation state, placed in global space of main.cpp
+#ifdef enableIRCompensation
+	int irFuse;
+	int irDrop;
+	int irZero;
+#ifndef enableStateOfHealth
+	int irLastDrop;
+	unsigned int irLastBattV;
+	char irLoops;
+#endif
+	unsigned int irRatio;
+	char irSag;
+#endif //enableIRCompensation
+
+// State of health figures in information memory segment B (after the first run test record), and the
+// learning and counting of them, placed in global space of main.cpp
+#ifdef enableStateOfHealth
+	struct HealthLog *healthLog = (struct HealthLog *) 0x1098;
+	struct TestRecord *testRecord_FLASH = (struct TestRecord *) 0x1080;
+#ifndef enableIRCompensation
+	int sohFuse;
+	int sohZero;
+#endif
+	int sohLastLoad;
+	char sohLastCell[4];
+	unsigned int sohLastDuty;
+	unsigned int sohRatio[4];
+	unsigned int sohCapacity;
+	unsigned int sohCycles;
+	unsigned long sohCharge;
+	unsigned int sohPeriod;
+	char sohLoops;
+	bool sohCounting;
+	bool sohChanged;
+#endif //enableStateOfHealth
+
+// The results of the ADC noise measurement, for the debugger to dump, placed in global space of main.cpp
+#ifdef enableADCNoise
+	struct NoiseReport noiseReport;
+#endif //enableADCNoise
+
 int main(void) {
+#ifndef enableWarmBoot	// Otherwise this has already been done in _system_pre_init(), see warmBoot.cpp
 	// Just woken up, chances are by the watchdog timer after
 	// having been sent to sleep for a few seconds.
 	// First things first - reset the watchdog timer and slow
@@ -114,21 +258,39 @@ int main(void) {
 	// (which will eventually reboot MCU). Otherwise lets wake
     // up and go to main loop
     checkPV();   // If this is disabled for debugging, note that average cell voltages will not get enough time to come up, and unit will be put to sleep by considerSleep() immediately.
+#endif
     // We've reached here, so must be ready to wake up. Let's initialise
     // the remaining things we need, and also check for firstBoot.
     initialiseFull();
 
     // Begin main loop
     for (;;) {
+    	// Mark the start of the loop, and after each stage, for timing with a logic analyser (enableTimingMarkers)
+    	markLoop();
     	// "Pat" the watchdog: let it know we're not asleep so
     	// it won't reset the MCU.
     	patWatchdog();
+#ifdef enableEventTrace
+    	// Count loops for the event trace timestamps
+    	if (++traceLog.ticks == 0)
+    		traceLog.epoch++;
+#endif
+#ifdef enableDailyStats
+    	// Count loops for the daily statistics (the state's only sampled every so often)
+    	countStats();
+#endif
     	// Refresh all voltage inputs: cell voltages, PV voltage,
     	// and fuse (discharge current) voltage
         refreshADCs();
+        markStage();
         // Analyse the battery voltages to determine what "state"
         // the battery is in
         refreshBatteryStatus();
+#ifdef enableStateOfHealth
+        // Learn the cells' resistance and count the capacity
+        refreshHealth();
+#endif
+        markStage();
         // Enable/disable discharge based on cell voltages and
         // fuse status. If cell voltage is too low here then
         // discharge will be switched off. Also checks fuse voltage
@@ -136,14 +298,17 @@ int main(void) {
         // will stop charging and freeze here (flashing lights)
         // until it disappears.
         refreshDischarge();
+        markStage();
         // Refresh charging parameters based on PV and battery
         // voltages (assuming PV voltage present). Also handles
         // cell balancing. Stops charging if cell voltages are
         // too high, and restarts charging if they fall low again.
         refreshCharge();
+        markStage();
         // Refresh indicator LED colours to give user a feel for battery charge
         // remaining.
         refreshLEDs();
+        markStage();
         // If discharge is disabled (due to low cell voltage, not due to
         // short circuit) AND there's
         // no PV voltage, then unit will go to sleep, to be eventually
@@ -153,6 +318,11 @@ int main(void) {
         // slow things down to save battery. If PV voltage returns, then we
         // should make sure to speed things up again to ensure stable charging.
         considerSnooze();
+        markStage();
+#ifdef enableClockGovernor
+        // Pick the clock speed for how much regulating there is to do
+        governClock();
+#endif
     }
     return 0;
 }
@@ -0,0 +1,63 @@
+/*
+ * Optional parameter block in info segment D (after the divider calibration),
+ * so that a unit can be retuned for a different panel or battery without a
+ * new build. The block is made on a PC (Tools/paramBlock), where the unit's
+ * ADC calibration has already been applied to the thresholds, so loading it
+ * here is only a CRC check and a copy. See header.h.
+ */
+
+#include <msp430.h>
+#include <stddef.h>
+#include "header.h"
+
+// CRC-16-CCITT (polynomial 0x1021, starting from 0xFFFF), a bit at a time as
+// there's no room for a table. About 2000 cycles for the block.
+unsigned int paramCRC(const char *data, char length) {
+	unsigned int crc = 0xFFFF;
+	while (length--) {
+		crc ^= (unsigned int) *data++ << 8;
+		for (char bit = 0; bit < 8; bit++) {
+			if (crc & 0x8000)
+				crc = (crc << 1) ^ 0x1021;
+			else
+				crc <<= 1;
+		}
+	}
+	return crc;
+}
+
+// Load the parameter block, if it's there and good, otherwise the defaults from
+// header.h. The thresholds are only loaded from the block: calibrateThresholds()
+// does the defaults, and is skipped if paramsLoaded.
+void loadParams(void) {
+	paramsLoaded = (paramBlock->version == paramVersion)
+#ifdef enableDividerCalibration
+			&& ( ((paramBlock->flags & PARAM_DIVIDERCAL) != 0) == dividersCalibrated )
+#else
+			&& !(paramBlock->flags & PARAM_DIVIDERCAL)
+#endif
+			&& (paramCRC((const char *) paramBlock, offsetof(struct ParamBlock, crc)) == paramBlock->crc);
+	if (!paramsLoaded) {
+		blinkCount = standardBlinkNumber;
+		lowBattBlink = lowBattBlinkDuration;
+		shortCircuitBlink = shortCircuitBlinkDuration;
+		snoozeLimit = maxSnoozeTime;
+		return;
+	}
+	PVmpp = paramBlock->PVmpp;
+	lowPV = paramBlock->lowPV;
+	maxCellV = paramBlock->maxCellV;
+	minCellV = paramBlock->minCellV;
+	minFuse = paramBlock->minFuse;
+	minBleedV = paramBlock->minBleedV;
+	stopChargeV = paramBlock->stopChargeV;
+	restartChargeV = paramBlock->restartChargeV;
+	restartDischV = paramBlock->restartDischV;
+	LEDthresh1 = paramBlock->LEDthresh1;
+	LEDthresh2 = paramBlock->LEDthresh2;
+	LEDthreshHyst = paramBlock->LEDthreshHyst;
+	blinkCount = paramBlock->blinkCount;
+	lowBattBlink = paramBlock->lowBattBlink;
+	shortCircuitBlink = paramBlock->shortCircuitBlink;
+	snoozeLimit = paramBlock->snoozeLimit;
+}
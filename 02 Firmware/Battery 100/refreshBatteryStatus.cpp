@@ -3,9 +3,16 @@
 
 // Use average cell voltages to avoid accidental triggering!
 void refreshBatteryStatus(void) {
+#ifdef enableEventTrace
+	char oldStatus = batteryStatus;
+#endif
+#ifdef enableIRCompensation
+	// Work out how much the cells are sagging under load
+	refreshIRDrop();
+#endif
 	// Check if battery has run out, i.e. lowest cell is
-	// lower than minCellV
-	if ( av_cell_values[minCell] <= minCellV )
+	// lower than minCellV (allowing for the IR drop under load, if enabled)
+	if ( av_cell_values[minCell] + irSag <= minCellV )
 		batteryStatus = 2;  // empty battery!
 	// If - after battery has run out - charging or rest brings
 	// up the minimum cell voltage again then allow discharging to return
@@ -21,6 +28,10 @@ void refreshBatteryStatus(void) {
 	// Check for short-circuit/over-current condition.
 	if ( av_ADC_values[5] < minFuse)
 		batteryStatus = 3;  // short-circuited!
+#ifdef enableEventTrace
+	if (batteryStatus != oldStatus)
+		traceEvent(EV_BATTERYSTATUS, (oldStatus << 8) | batteryStatus);
+#endif
 }
 
 
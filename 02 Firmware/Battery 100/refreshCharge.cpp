@@ -48,9 +48,12 @@ void balanceCells(void) {
 		// - cell is not currently being bled AND...
 		// - PV voltage is present AND...
 		// - cell voltage is too high
-		if ( ~cell_bleedingOn[i] && (av_cell_values[i] >= maxCellV) && (av_ADC_values[4] >= lowPV) ) {
+		if ( !cell_bleedingOn[i] && (av_cell_values[i] >= maxCellV) && (av_ADC_values[4] >= lowPV) ) {
 			bleedOn(i);
 			cell_bleedingOn[i] = true;
+#ifdef enableEventTrace
+			traceEvent(EV_BLEEDON, (i << 8) | av_cell_values[i]);
+#endif
 		}
 		// Also check if it is appropriate to stop
 		// bleeding them, i.e.:
@@ -61,21 +64,29 @@ void balanceCells(void) {
 		if ( cell_bleedingOn[i] && ((av_cell_values[i] < minBleedV) || (av_ADC_values[4] < lowPV) || batteryStatus == 1) ) {
 			bleedOff(i);
 			cell_bleedingOn[i] = false;
+#ifdef enableEventTrace
+			traceEvent(EV_BLEEDOFF, (i << 8) | av_cell_values[i]);
+#endif
 		}
 	}
 }
 
 void refreshCharge(void) {
 	// If cell voltages are too high or PV voltage is too low, or battery is full
-	// then increase duty cycle to throttle voltage!
+	// (or too cold to charge, see tempCompensation.cpp) then increase duty cycle to throttle voltage!
 	// (Unless we have already hit the highest permissable duty cycle already, if so then skip...)
-	if ( ((av_cell_values[maxCell] >= maxCellV) || (av_ADC_values[4] < PVmpp) || (batteryStatus == 1) ) && (TACCR1 < maxDuty) ) {
-		TACCR1++;
+#ifdef enableClockGovernor
+	// (maxDuty is in Timer_A counts at 8MHz, so scale it to the current clock speed)
+	if ( ((av_cell_values[maxCell] >= maxCellV) || (av_ADC_values[4] < PVmpp) || (batteryStatus == 1) || tooColdToCharge ) && (nudgeDuty < ((unsigned int) maxDuty >> PWMshift)) ) {
+#else
+	if ( ((av_cell_values[maxCell] >= maxCellV) || (av_ADC_values[4] < PVmpp) || (batteryStatus == 1) || tooColdToCharge ) && (nudgeDuty < maxDuty) ) {
+#endif
+		nudgeDuty++;
 	}
 	// Otherwise (as long as we have not already hit duty cycle == 0)
 	// decrease duty cycle to increase voltage!
-	else if (TACCR1 != 0) {
-		TACCR1--;
+	else if (nudgeDuty != 0) {
+		nudgeDuty--;
 	}
 	// Now bleed some current out of fully charged cells if required
 	balanceCells();
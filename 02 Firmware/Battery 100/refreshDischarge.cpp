@@ -4,8 +4,22 @@
 
 // Commands to open and close the discharge gate
 // (P2.3 - Check initialise file for changes)
+#ifdef enableEventTrace
+// These are called on every loop, so only log actual changes
+void openGate(void) {
+	if (!(P2OUT & BIT3))
+		traceEvent(EV_GATEOPEN, av_cell_values[minCell]);
+	P2OUT |= BIT3;
+}
+void closeGate(void) {
+	if (P2OUT & BIT3)
+		traceEvent(EV_GATECLOSE, av_cell_values[minCell]);
+	P2OUT &= ~BIT3;
+}
+#else
 void openGate(void) {P2OUT |= BIT3;}
 void closeGate(void) {P2OUT &= ~BIT3;}
+#endif
 
 void refreshDischarge(void) {
 	switch (batteryStatus) {
@@ -33,14 +47,26 @@ void refreshDischarge(void) {
 		// No, actually, don't do it. It might just result in repeated current
 		// surges if PTC fuse break causes load to disconnect, in turn causing
 		// PTC fuse to recover again, causing wildly oscillating currents.
+		markFault();
+#ifdef enableEventTrace
+		traceEvent(EV_FAULT, av_ADC_values[5]);
+#endif
+#ifdef enableDailyStats
+		if (dayStats.shorts != 0xFF)
+			dayStats.shorts++;
+#endif
 		closeGate();
-		TACCR1 = maxDuty;
+#ifdef enableClockGovernor
+		nudgeDuty = maxDuty >> PWMshift;
+#else
+		nudgeDuty = maxDuty;
+#endif
 		// Flashing is handled here instead of in refreshLEDs()
 		// because that function is already quite complicated to
 		// account for state transitions and hysteresis - so it does
 		// not need the possibility of a short at any time, in any
 		// state to make it more so!
-		flashLED(1,0,lowBattBlinkDuration,lowBattBlinkDuration,standardBlinkNumber);
+		flashLED(1,0,lowBattBlink,lowBattBlink,blinkCount);
 		batteryStatus = 0;
 		openGate();
 		break;
@@ -62,6 +62,9 @@ void flashLED(char colour_on, char colour_off, char blinkDuration_on, char blink
 }
 
 void refreshLEDs(void) {
+#ifdef enableEventTrace
+	char oldStatus = LEDStatus;
+#endif
 	// Consider LED colour depending on current LEDStatus
 	// 0: off, 1: red, 2: yellow, 3: green
 	switch (LEDStatus) {
@@ -77,7 +80,7 @@ void refreshLEDs(void) {
 		// If discharge gate has shut due to low-batt voltage
 		// again then do some red/off flashing and downgrade to off
 		if ( batteryStatus == 2 ) {
-			flashLED(1,0,shortCircuitBlinkDuration,shortCircuitBlinkDuration,standardBlinkNumber);
+			flashLED(1,0,shortCircuitBlink,shortCircuitBlink,blinkCount);
 			LEDStatus--;
 		}
 		break;
@@ -95,7 +98,16 @@ void refreshLEDs(void) {
 			LEDStatus--;
 		break;
 	}
+#ifdef enableEventTrace
+	if (LEDStatus != oldStatus)
+		traceEvent(EV_LEDSTATUS, (oldStatus << 8) | LEDStatus);
+#endif
 	// Now change LED colour according to LED status
+#ifdef enableLEDDimming
+	// (only lit for part of the time, depending on PV and battery, see dimLEDs.cpp)
+	setLEDs(dimLEDs(LEDStatus));
+#else
 	setLEDs(LEDStatus);
+#endif
 }
 
@@ -0,0 +1,196 @@
+/*
+ * Optional state of health estimation. As the cells wear, their
+ * resistance goes up and their capacity goes down, which nothing else
+ * keeps track of. The PTC fuse is in series with the load, so its drop
+ * is the measure of current (as in irDrop.cpp):
+ *  - a cell's resistance, relative to the fuse's, is how far it moves
+ *    when the load steps, over how far the fuse drop steps
+ *  - the charge current isn't measured, but when it steps (with the
+ *    nudge duty) the cells move in proportion to their resistances, so
+ *    that shares out what's been learned between them
+ *  - the capacity is the fuse drop added up from full to empty
+ * Read back the information memory with the programmer, and decode it
+ * with "02 Firmware/Tools/historyDecode.cpp".
+ */
+
+#include <msp430.h>
+#include "header.h"
+
+// How many of the records have been written
+char healthRecords(void) {
+	char slot = 0;
+	while ( (slot < sohSlots) && !(healthLog->unused & (1 << slot)) )
+		slot++;
+	return slot;
+}
+
+// Called from initialiseFull(): pick up the figures from the newest record, and start counting afresh
+// (a full to empty can't span a sleep, as the gate's closed while asleep)
+void initialiseHealth(void) {
+	char slot = healthRecords();
+	for (char i = 0; i < 4; i++)
+		sohRatio[i] = slot ? (healthLog->records[slot - 1].cellR[i] << 2) : sohRatioDefault;
+	sohCapacity = slot ? healthLog->records[slot - 1].capacity : 0;
+	sohCycles = slot ? healthLog->records[slot - 1].cycles : 0;
+#ifndef enableIRCompensation
+	sohFuse = 0;
+	sohZero = 0;
+#endif
+	sohLastLoad = sohNoSnapshot;
+	sohCharge = 0;
+	sohPeriod = sohPeriodLoops;
+	sohLoops = 0;
+	sohCounting = false;
+	sohChanged = false;
+}
+
+// Move a cell's ratio an eighth of the way towards what this step says
+void nudgeRatio(char i, long ratio) {
+	if ( (ratio <= 0) || (ratio > sohMaxRatio) )
+		return;
+	sohRatio[i] += ( (int) ratio - (int) sohRatio[i] ) / 8;
+}
+
+// Every sohStepLoops, compare with last time for a step in the load or the charge current
+void learnFromSteps(int load) {
+	int cellStep[4];
+	int sum = 0;
+	unsigned int duty = nudgeDuty;
+	int loadStep = load - sohLastLoad;
+	int dutyStep = (int) duty - (int) sohLastDuty;
+	bool steadyCharge = (av_ADC_values[4] < lowPV) || ( (dutyStep < sohDutySteady) && (dutyStep > -sohDutySteady) );
+	for (char i = 0; i < 4; i++) {
+		cellStep[i] = (int) sohLastCell[i] - (int) av_cell_values[i];		// Positive if it's dropped
+		sum += cellStep[i];
+	}
+	if (sohLastLoad != sohNoSnapshot) {
+		// The load's stepped, and nothing else: each cell drops by its resistance times the current, as the
+		// fuse does, so in Q8: ratio = cell step * 256 / (fuse step / 16)
+		if ( steadyCharge && ((loadStep >= (sohLoadMinStep << 4)) || (loadStep <= -(sohLoadMinStep << 4))) ) {
+			for (char i = 0; i < 4; i++)
+				nudgeRatio(i, ((long) cellStep[i] << 12) / loadStep);
+		}
+		// The charge current's stepped, and the load hasn't: share the total out as the cells moved
+		else if ( ((dutyStep >= sohDutyMinStep) || (dutyStep <= -sohDutyMinStep)) && (loadStep < (sohLoadMinStep << 3)) && (loadStep > -(sohLoadMinStep << 3))
+				&& ((sum >= sohShareMinStep) || (sum <= -sohShareMinStep)) ) {
+			long total = sohRatio[0] + sohRatio[1] + sohRatio[2] + sohRatio[3];
+			for (char i = 0; i < 4; i++)
+				nudgeRatio(i, (cellStep[i] * total) / sum);
+		}
+	}
+	sohLastLoad = load;
+	sohLastDuty = duty;
+	for (char i = 0; i < 4; i++)
+		sohLastCell[i] = (av_cell_values[i] > 0xFF) ? 0xFF : av_cell_values[i];
+}
+
+// Reached empty from full without charging: that's the capacity
+void endCycle(void) {
+	unsigned long measured = sohCharge >> 4;
+	sohCounting = false;
+	if (measured < sohMinCapacity)
+		return;
+	if (measured > 0xFFFF)
+		measured = 0xFFFF;
+	if (sohCapacity == 0)
+		sohCapacity = measured;
+	else
+		sohCapacity += ( (long) measured - (long) sohCapacity ) >> 2;
+	if (sohCycles != 0xFFFF)
+		sohCycles++;
+	sohChanged = true;
+}
+
+// Called by main() on every loop
+void refreshHealth(void) {
+#ifdef enableIRCompensation
+	// The load, from the fuse drop, already filtered and zeroed by refreshIRDrop() (in refreshBatteryStatus())
+	int load = irDrop - irZero;
+#else
+	// The load, from the fuse drop, averaged the same way as the battery voltage (as in refreshIRDrop())
+	if (sohFuse == 0)
+		sohFuse = av_ADC_values[3] << 4;
+	sohFuse += ( (int) (av_ADC_values[5] << 4) - sohFuse ) >> sohFilterShift;
+	int load = (int) (av_ADC_values[3] << 4) - sohFuse;
+	// With the gate closed there's no load, so whatever's left is the channels' offset
+	if ( !(P2OUT & BIT3) )
+		sohZero = load;
+	load -= sohZero;
+#endif
+
+	// Full to empty, without charging in between (below full with PV is charging)
+	if (batteryStatus == 1) {
+		sohCharge = 0;
+		sohCounting = true;
+	}
+	else if ( (batteryStatus == 0) && (av_ADC_values[4] >= lowPV) )
+		sohCounting = false;
+	else if ( (batteryStatus == 2) && sohCounting )
+		endCycle();
+	// Add up the load once a period (snoozing loops count for more, as in countStats())
+	unsigned int weight = (P2SEL == 0) ? sohSnoozeWeight : 1;
+	if (sohPeriod >= weight)
+		sohPeriod -= weight;
+	else {
+		sohPeriod += sohPeriodLoops - weight;
+		if ( sohCounting && (load > 0) )
+			sohCharge += load;
+	}
+
+	if ( !(++sohLoops & (sohStepLoops - 1)) )
+		learnFromSteps(load);
+}
+
+// Whether there's anything worth writing: a new capacity, or a cell's resistance moved
+bool healthChanged(char slot) {
+	if (sohChanged)
+		return true;
+	for (char i = 0; i < 4; i++) {
+		int saved = slot ? healthLog->records[slot - 1].cellR[i] : (sohRatioDefault >> 2);
+		int moved = (int) (sohRatio[i] >> 2) - saved;
+		if ( (moved >= sohSaveDelta) || (moved <= -sohSaveDelta) )
+			return true;
+	}
+	return false;
+}
+
+// Called by goToSleep() and considerSnooze(): add the figures to segment B, if they've changed,
+// erasing it first (and writing the first run test record back) if it's full. The record's bit
+// in unused is written last, so a record that's only half written isn't there.
+void saveHealth(void) {
+	struct HealthLog *log = healthLog;
+	char slot = healthRecords();
+	if (!healthChanged(slot))
+		return;
+	struct TestRecord test = *testRecord_FLASH;
+	unsigned int firstCapacity = log->firstCapacity;
+	if ( (firstCapacity == 0xFFFF) && (sohCapacity != 0) )
+		firstCapacity = sohCapacity;
+	struct HealthRecord record;
+	unsigned int unused;
+	record.capacity = sohCapacity;
+	record.cycles = sohCycles;
+	for (char i = 0; i < 4; i++)
+		record.cellR[i] = sohRatio[i] >> 2;
+	// The flash timing generator needs MCLK at 8MHz (/27), and we may be snoozing or at another clock speed
+	char DCO = DCOCTL, BCS1 = BCSCTL1;
+	unsigned int FTG = FCTL2 & 0xFF;
+	DCOCTL = 0;
+	BCSCTL1 = BCSCTL1_setting;
+	DCOCTL = DCOCTL_setting;
+	FCTL2 = FWKEY + FSSEL_1 + (27 - 1);
+	if (slot == sohSlots) {
+		writeInfoSegment((char *) testRecord_FLASH, (char *) &test, sizeof(test), true);
+		slot = 0;
+	}
+	if (log->firstCapacity != firstCapacity)
+		writeInfoSegment((char *) &log->firstCapacity, (char *) &firstCapacity, sizeof(firstCapacity), false);	// Only ever written over 0xFFFF
+	writeInfoSegment((char *) &log->records[slot], (char *) &record, sizeof(record), false);
+	unused = ~((2 << slot) - 1);				// Clears the bits of all the records so far
+	writeInfoSegment((char *) &log->unused, (char *) &unused, sizeof(unused), false);
+	FCTL2 = FWKEY + FTG;
+	DCOCTL = 0;
+	BCSCTL1 = BCS1;
+	DCOCTL = DCO;
+	sohChanged = false;
+}
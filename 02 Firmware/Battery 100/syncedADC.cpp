@@ -0,0 +1,61 @@
+/*
+ * Optional PWM-synchronised ADC sampling. The nudge PWM puts a ripple
+ * on the readings, and conversions started whenever the loop gets to
+ * them land anywhere on it, so the averages have had to be long.
+ * Instead, one sequence of conversions (A7 down to A0) is started by
+ * an edge of the PWM output itself (TA0.1 is the ADC10's SHS_1), so
+ * every loop sees the same point of the ripple.
+ *
+ * The dithered PWM (see ditheredPWM.cpp) is "set/reset": its falling
+ * edge is at the end of the period, always at the same time, and its
+ * rising edge is wherever the duty puts it. ISSH inverts the trigger,
+ * so that it's the falling edge that starts the sequence.
+ *
+ * The sequence is 8 conversions of 17 ADC clocks, which is too quick
+ * to read ADC10MEM in between, so the DTC stores them.
+ */
+
+#include <msp430.h>
+#include <stddef.h>
+#include "header.h"
+
+// Convert A7 down to A0 into readings[], on the given edge of TA0.1 (ISSH for the falling edge,
+// otherwise 0). False if the edge didn't come in time, and then readings[] is left alone.
+bool convertOnEdge(unsigned int *readings, unsigned int edge) {
+	unsigned int polls = syncTimeout;
+	// All of these can only be changed with ENC clear, as it always is between readings
+	ADC10CTL1 = (ADC10CTL1 & ~(0xf000 + SHS_3 + ISSH + CONSEQ_3)) | (INCH_7 + SHS_1 + edge + CONSEQ_1);
+	ADC10DTC1 = syncedChannels;
+	ADC10SA = (size_t) readings;			// (size_t so that it also builds on a PC, see Tools/Host)
+	// Arm it. MSC makes the conversions after the first follow on without another edge.
+	ADC10CTL0 = (ADC10CTL0 & ~ADC10IFG) | (MSC + ENC);
+	// ADC10IFG is set once the DTC has stored the whole block
+	while ( !(ADC10CTL0 & ADC10IFG) && --polls );
+	// Back to one channel at a time, started by ADC10SC, for readADCChannel()
+	ADC10CTL0 &= ~(ENC + MSC);
+	while (ADC10CTL1 & ADC10BUSY);
+	ADC10CTL1 &= ~(SHS_3 + ISSH + CONSEQ_3);
+	ADC10DTC1 = 0;
+	return polls != 0;
+}
+
+// Called by refreshADCs(): fills readings[] (syncedChannels of them, channel n at [7 - n]) in
+// step with the PWM, or returns false to have the channels read one by one as usual.
+bool syncADCs(unsigned int *readings) {
+#ifdef syncBothEdges
+	unsigned int rising[syncedChannels];
+#endif
+	// No ripple to keep in step with: snoozing (the PWM's off, and Timer_A is
+	// stopped or counting ACLK), or the output isn't switching (see loadDutyCycle())
+	if ( (P2SEL == 0) || (TACCR1 > TACCR0) )
+		return false;
+	if (!convertOnEdge(readings, ISSH))
+		return false;
+#ifdef syncBothEdges
+	// The rising edge is in the next period, so the two are a period apart at most
+	if (convertOnEdge(rising, 0))
+		for (char i = 0; i < syncedChannels; i++)
+			readings[i] = (readings[i] + rising[i] + 1) >> 1;
+#endif
+	return true;
+}
@@ -0,0 +1,72 @@
+/*
+ * Optional temperature compensation of the cell voltage thresholds.
+ * The internal temperature sensor is read a little at a time as part of
+ * refreshADCs(), so there's always a filtered temperature to hand, and
+ * every so often it's used to bring the charging thresholds down in the
+ * cold (and the minimum cell voltage too, as cold cells sag more under
+ * load). Below freezing, charging is stopped altogether.
+ */
+
+#include <msp430.h>
+#include "header.h"
+
+// Take the compensation off the thresholds and put the new one on (ADC units taken
+// off maxCellV and stopChargeV, and off minCellV)
+void setTempCompensation(char charge, char minCell) {
+	maxCellV += tempCompCharge - charge;
+	stopChargeV += tempCompCharge - charge;
+	minCellV += tempCompMinCell - minCell;
+	tempCompCharge = charge;
+	tempCompMinCell = minCell;
+}
+
+// Work out tempC from av_tempADC, and update the compensation to match
+void compensateThresholds(void) {
+	tempC = (int) (av_tempADC - *CALADC_25T30) * (85 - 30) / (int) (*CALADC_25T85 - *CALADC_25T30) + 30;
+	char charge = 0;
+	char minCell = 0;
+	if (tempC < tempCompKneeC) {
+		charge = (tempCompKneeC - tempC) / tempCompChargeStepC;
+		if (charge > tempCompMaxSteps)
+			charge = tempCompMaxSteps;
+		minCell = (tempCompKneeC - tempC) / tempCompMinCellStepC;
+		if (minCell > tempCompMaxSteps)
+			minCell = tempCompMaxSteps;
+	}
+	setTempCompensation(charge, minCell);
+	// Stop charging below freezing, with some hysteresis
+	if (tempC < freezeC)
+		tooColdToCharge = true;
+	else if (tempC >= freezeC + freezeHystC)
+		tooColdToCharge = false;
+}
+
+// Called from refreshADCs() every loop. Every tempSamplePeriod loops the temperature
+// sensor is read and averaged into av_tempADC, and every tempCompPeriod loops the
+// thresholds are updated.
+void sampleTemp(void) {
+	tempLoops++;
+	if (tempLoops & (tempSamplePeriod - 1))
+		return;
+	// The sensor needs at least 30us of sample time. Rather than slow down the ADC clock
+	// (which depends on the clock speed), run it from its own oscillator (ADC10OSC, about
+	// 5MHz) divided by 3, and sample for 64 clocks. The reference stays at 2.5V.
+	unsigned int ADC10CTL0_current = ADC10CTL0;
+	unsigned int ADC10CTL1_current = ADC10CTL1;
+	ADC10CTL0 |= ADC10SHT_3;
+	ADC10CTL1 = (ADC10CTL1 & ~(ADC10DIV_7 + ADC10SSEL_3)) | ADC10DIV_2 | ADC10SSEL_0;
+	unsigned int tempADC = readADCChannel(10);  // Channel 10 is the internal temperature sensor
+	ADC10CTL0 = ADC10CTL0_current;
+	ADC10CTL1 = ADC10CTL1_current;
+	// Start the average from the first reading, otherwise it would look freezing for a while
+	if (av_tempADC == 0)
+		av_tempADC = tempADC;
+	// Rolling average over 16 readings (see updateAverage() in ADCs.cpp for explanation)
+	av_tempADC *= 15;
+	av_tempADC += tempADC;
+	av_tempADC += temp_dropped_bits;
+	temp_dropped_bits = av_tempADC & 0b1111;
+	av_tempADC = av_tempADC >> 4;
+	if ( (tempLoops & (tempCompPeriod - 1)) == 0 )
+		compensateThresholds();
+}
@@ -0,0 +1,141 @@
+/*
+ *
+ * Wake scheduling: asleep at night, the watchdog wakes us up every period to look for PV
+ * that won't be there for hours yet. So the length of the night is learned, and the
+ * wake-ups are stretched out until it's nearly over:
+ *  - the clock only runs while it's dark, from dusk (PV gone while awake), in ticks of the
+ *    usual watchdog period (32768 ACLK counts). Asleep, each wake-up adds the ticks that
+ *    sleep was set to last. Snoozing, Timer_A is left counting ACLK, and every time the top
+ *    bit of TAR changes is a tick
+ *  - it's all the VLO, so however far out that is (anywhere from 4 to 20kHz, and it drifts
+ *    with temperature), the learned night is in the same ticks as the clock it's compared with
+ *  - at dawn (PV back), a night long enough not to be a passing cloud (or the PV average
+ *    settling after a boot) is learned from, moving the learned length part of the way
+ *  - until the dawn window, ACLK is divided by wakeDeepTicks while asleep, so there are that
+ *    many times fewer wake-ups. From then until PV is seen, they're every tick as usual
+ *  - no dawn by half a night after it was due makes it a dark day. The last 8 days are kept,
+ *    and a unit snoozing through a dark day goes to sleep wakeSnoozeGrace loops later for
+ *    each dark day: soon if the weather's been good (the panel's probably covered or been
+ *    disconnected), later if it's been dull, but never later than maxSnoozeTime as before
+ *  - it all lives in uninitialised RAM to survive the wake-ups, checked as warmState is.
+ *    Anything but a watchdog reset starts the learning again
+ *
+ */
+
+#include <msp430.h>
+#include "header.h"
+
+// Simple sum of all the words in wakeSchedule before the checksum
+unsigned int wakeScheduleChecksum(void) {
+	unsigned int checksum = wakeScheduleMagic;
+	unsigned int *word = (unsigned int *) &wakeSchedule;
+	for (char i = 0; i < (sizeof(struct WakeSchedule) / sizeof(unsigned int)) - 1; i++)
+		checksum += word[i];
+	return checksum;
+}
+
+// Number of dark days in the last 8
+char darkDayCount(void) {
+	char count = 0;
+	for (char days = wakeSchedule.darkDays; days; days >>= 1)
+		count += days & 1;
+	return count;
+}
+
+// Add some ticks of darkness. Returns true if that's made it a dark day.
+bool addDarkTicks(unsigned int ticks) {
+	if (wakeSchedule.sinceDusk > 0xFFFF - ticks)
+		wakeSchedule.sinceDusk = 0xFFFF;
+	else
+		wakeSchedule.sinceDusk += ticks;
+	if ( !wakeSchedule.night || (wakeSchedule.flags & WS_DARKDAY) )
+		return false;
+	if (wakeSchedule.sinceDusk <= (unsigned long) wakeSchedule.night + (wakeSchedule.night >> 1))
+		return false;
+	wakeSchedule.flags |= WS_DARKDAY;
+	wakeSchedule.darkDays = (wakeSchedule.darkDays << 1) | 1;
+	return true;
+}
+
+// Called by checkPV() on every wake-up, before looking at PV (so from _system_pre_init()
+// with the warm boot: nothing here may use a global variable but wakeSchedule).
+// Counts the sleep just had, or starts again if that wasn't a watchdog wake-up.
+void countSleepTime(void) {
+	if ( !(IFG1 & WDTIFG) || (IFG1 & (PORIFG + RSTIFG)) || (wakeSchedule.checksum != wakeScheduleChecksum()) ) {
+		wakeSchedule.sinceDusk = 0;
+		wakeSchedule.night = 0;
+		wakeSchedule.TARhalf = 0;
+		wakeSchedule.sleepTicks = 0;
+		wakeSchedule.darkDays = 0;
+		wakeSchedule.flags = 0;
+		return;
+	}
+	if (wakeSchedule.flags & WS_DARK)
+		addDarkTicks(wakeSchedule.sleepTicks);
+	wakeSchedule.sleepTicks = 0;
+}
+
+// Called by backToSleep() and goToSleep() before patting the watchdog for the last time:
+// sets ACLK's divider, and so how long until the watchdog wakes us up
+void setSleepPeriod(void) {
+	unsigned int night = wakeSchedule.night;
+	// Deep in the night: the stretched sleep must still end before the dawn window
+	if ( (wakeSchedule.flags & WS_DARK) && night
+			&& (unsigned long) wakeSchedule.sinceDusk + wakeDeepTicks <= night - (night >> wakeWindowShift) ) {
+		BCSCTL1 |= wakeDeepDIVA;
+		wakeSchedule.sleepTicks = wakeDeepTicks;
+	}
+	else {
+		BCSCTL1 &= ~DIVA_3;
+		wakeSchedule.sleepTicks = 1;
+	}
+	wakeSchedule.checksum = wakeScheduleChecksum();
+}
+
+// Called when PV goes while awake (so not from sleep): starts the clock
+void wakeAtDusk(void) {
+	if (wakeSchedule.flags & WS_DARK)
+		return;
+	wakeSchedule.flags = WS_DARK;
+	wakeSchedule.sinceDusk = 0;
+	wakeSchedule.TARhalf = TAR & 0x8000;
+}
+
+// Called when PV is seen after dusk, asleep or snoozing: learns the night, if it was one
+void wakeAtDawn(void) {
+	unsigned int night = wakeSchedule.night;
+	unsigned int sinceDusk = wakeSchedule.sinceDusk;
+	if ( !(wakeSchedule.flags & WS_DARK) )
+		return;
+	// Not a cloud, and not after a dark day (which addDarkTicks() has already counted)
+	if ( (sinceDusk >= wakeMinNight) && !(wakeSchedule.flags & WS_DARKDAY) ) {
+		if (night)
+			wakeSchedule.night = night - (night >> wakeLearnShift) + (sinceDusk >> wakeLearnShift);
+		else
+			wakeSchedule.night = sinceDusk;
+		wakeSchedule.darkDays <<= 1;
+	}
+	wakeSchedule.flags = 0;
+}
+
+// Called by considerSnooze() on every loop while snoozing
+void countSnoozeTime(void) {
+	unsigned int now;
+	if ( !(wakeSchedule.flags & WS_DARK) )
+		return;
+	// Timer_A runs from ACLK, not MCLK, so read it until two readings agree
+	do
+		now = TAR;
+	while (now != TAR);
+	// The top bit changes every 32768 counts, a tick. We're here many times a second, so
+	// there's no missing one.
+	if ( (now ^ wakeSchedule.TARhalf) & 0x8000 ) {
+		wakeSchedule.TARhalf ^= 0x8000;
+		if ( addDarkTicks(1) ) {
+			// Don't snooze through the rest of a dark day for longer than the weather suggests
+			unsigned long grace = wakeSnoozeGrace * (darkDayCount() + 1);
+			if (timeSinceLastCharge > grace)
+				timeSinceLastCharge = grace;
+		}
+	}
+}
@@ -0,0 +1,90 @@
+/*
+ *
+ * Warm boots: most resets are the watchdog waking us up from sleep, usually at night
+ * when there's no PV and we're going straight back to sleep again. So:
+ *  - _system_pre_init() is run by the compiler's start-up code before it initialises
+ *    global variables, so the PV check is done there and, if there's no PV, we go back
+ *    to sleep without paying for the RAM initialisation at all
+ *  - before going to sleep, goToSleep() saves the calibrated thresholds and the cell
+ *    voltage averages in warmState, which is in uninitialised RAM
+ *  - on a full wake-up after a watchdog reset, if warmState's checksum is good, it's
+ *    restored instead of redoing the float calibration, and the averages start from
+ *    where they left off instead of from zero
+ *
+ */
+
+#include <msp430.h>
+#include "header.h"
+
+// Simple sum of all the words in warmState before the checksum
+unsigned int warmStateChecksum(void) {
+	unsigned int checksum = warmStateMagic;
+	unsigned int *word = (unsigned int *) &warmState;
+	for (char i = 0; i < (sizeof(struct WarmState) / sizeof(unsigned int)) - 1; i++)
+		checksum += word[i];
+	return checksum;
+}
+
+// Called by goToSleep() just before entering LPM3
+void saveWarmState(void) {
+	warmState.PVmpp = PVmpp;
+	warmState.lowPV = lowPV;
+	warmState.maxCellV = maxCellV;
+	warmState.minCellV = minCellV;
+	warmState.minFuse = minFuse;
+	warmState.minBleedV = minBleedV;
+	warmState.stopChargeV = stopChargeV;
+	warmState.restartChargeV = restartChargeV;
+	warmState.restartDischV = restartDischV;
+	warmState.LEDthresh1 = LEDthresh1;
+	warmState.LEDthresh2 = LEDthresh2;
+	warmState.LEDthreshHyst = LEDthreshHyst;
+	for (char i = 0; i < 4; i++) {
+		warmState.av_ADC_values[i] = av_ADC_values[i];
+		warmState.dropped_bits[i] = dropped_bits[i];
+	}
+#ifdef enableIRCompensation
+	warmState.irRatio = irRatio;
+#endif
+	warmState.checksum = warmStateChecksum();
+}
+
+// Returns true if this was a watchdog reset and warmState was good enough to restore,
+// otherwise false, in which case it's a cold boot and everything needs initialising.
+bool restoreWarmState(void) {
+	// Only the watchdog leaves RAM alone: a power-up leaves it random, and it's best not
+	// to trust it after a reset pin reset (e.g. reprogramming) either.
+	if ( !(IFG1 & WDTIFG) || (IFG1 & (PORIFG + RSTIFG)) || (warmState.checksum != warmStateChecksum()) )
+		return false;
+	PVmpp = warmState.PVmpp;
+	lowPV = warmState.lowPV;
+	maxCellV = warmState.maxCellV;
+	minCellV = warmState.minCellV;
+	minFuse = warmState.minFuse;
+	minBleedV = warmState.minBleedV;
+	stopChargeV = warmState.stopChargeV;
+	restartChargeV = warmState.restartChargeV;
+	restartDischV = warmState.restartDischV;
+	LEDthresh1 = warmState.LEDthresh1;
+	LEDthresh2 = warmState.LEDthresh2;
+	LEDthreshHyst = warmState.LEDthreshHyst;
+	for (char i = 0; i < 4; i++) {
+		av_ADC_values[i] = warmState.av_ADC_values[i];
+		dropped_bits[i] = warmState.dropped_bits[i];
+	}
+#ifdef enableIRCompensation
+	irRatio = warmState.irRatio;
+#endif
+	return true;
+}
+
+// Run by the start-up code before global variables are initialised (must return 1 for
+// them to be initialised). Nothing here may rely on a global variable having its value.
+extern "C" int _system_pre_init(void) {
+	// Same as the start of main()
+	patWatchdog();
+	initialisePre();
+	// If there's no PV this goes back to sleep and never returns
+	checkPV();
+	return 1;
+}
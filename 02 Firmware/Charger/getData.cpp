@@ -41,6 +41,13 @@ void getData(void) {
 	// Read the Battery Voltage
 	BatteryVoltage = readADCChannel(BATTV_PIN);
 
+#ifdef enableInputPowerLimit
+	// While the charge gate is shut (or the charge IC is still starting up
+	// again), STAT1 and STAT2 would only say it isn't charging, so keep them
+	if (!gateSettled)
+		return;
+#endif
+
 	// Save a static version of the P2IN register before checking for Stat1 and Stat2 (to avoid strange results in unlikely case of switching at the same time as checking)
 	char P2IN_saved = P2IN;
 
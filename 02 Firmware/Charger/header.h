@@ -45,6 +45,8 @@ void initialise(void);									// initialise.cpp
 void patWatchdog(void);									// initialise.cpp
 void getData(void);										// getData.cpp
 void refreshCharge(void);								// refreshCharge.cpp
+void chargeEnable(void);								// refreshCharge.cpp
+void chargeDisable(void);								// refreshCharge.cpp
 void refreshDischarge(void);							// refreshDischarge.cpp
 void refreshLEDs(void);									// refreshLEDs.cpp
 void flashLED(char, char, char, char, unsigned int);	// refreshLEDs.cpp
@@ -53,6 +55,130 @@ void refreshJouleCounter(void);							// refreshJouleCounter.cpp
 
 void initialFuseTrip(void);
 
+
+// The battery status state machine, laid out as tables in refreshBatteryStatus.cpp. BatteryStatus
+// is the number of the state (as listed there), each of which has a list of transitions, tried in
+// order until one's guard holds, an action run once on entering it, and a colour for the LEDs.
+#define BATTERY_STATES		7
+enum Guard {
+	GUARD_ALWAYS,			// "Dynamic mode": the entry action has been done, so move on
+	GUARD_RECOVERED,		// BatteryVoltage >= restartDischV
+	GUARD_DEEP_DISCHARGE,	// BatteryVoltage < minBattV
+	GUARD_CHARGING,			// Stat1
+	GUARD_NOT_CHARGING,		// !Stat1
+	GUARD_FULL,				// Stat2
+	GUARD_NOT_FULL			// !Stat2
+};
+struct Transition {
+	char guard;				// enum Guard
+	char next;				// BatteryStatus
+};
+struct BatteryState {
+	void (*entry)(void);	// Run once on entering the state, or 0
+	char firstTransition;	// Into batteryTransitions[]
+	char transitions;		// How many
+	char LEDs;				// Colour for setLEDs() while in the state
+	bool dynamic;			// Go round the loop again straight away (no sleepUntilEvent())
+	bool connected;			// The fuse should be closed, so a tripped one is a short-circuit (see refreshDischarge())
+};
+extern const struct BatteryState batteryStates[BATTERY_STATES];
+
+
+// Declaration of some things to help with sleeping between events, placed in header.h
+// Also have to remember to include or not include sleepBetweenEvents.cpp!
+// Rather than spinning round the loop at 1MHz, the loop runs once per event and then waits in LPM3 for the next:
+// a fuse or ground bus trip (port interrupt, the fuse is re-tripped straight away in the interrupt), a change on
+// STAT1/STAT2 (port interrupt, either edge), or a timer tick from ACLK (VLO) to sample the voltages again.
+//#define enableSleepBetweenEvents		// Comment this out to remove all the relevant code and variables throughout the project
+#define sampleTickPeriod	12000	// ACLK counts between voltage samples (about 1s on the VLO, which varies from 4 to 20kHz!). Must be well under the watchdog time
+#define REF_SETTLE_DELAY	30		// TIME Number of __delay_cycles() for the ADC reference to settle after waking up (30us at 1MHz)
+void initialiseEvents(void);							// sleepBetweenEvents.cpp
+void sleepUntilEvent(void);								// sleepBetweenEvents.cpp
+
+
+// Declaration of some things to help with a parameter block in flash, placed in header.h
+// Also have to remember to include or not include paramBlock.cpp!
+// As in the Battery 100 (see its header.h), the thresholds and the short circuit flashes can be given in a CRC checked
+// block in info segment D, with the thresholds already calibrated for this unit's ADC, made by
+// "02 Firmware/Tools/paramBlock/paramBlock.cpp". If it's missing or bad, the defines above are used as usual.
+//#define enableParamBlock				// Comment this out to remove all the relevant code and variables throughout the project
+#define paramVersion		1		// Bump when ParamBlock changes
+struct ParamBlock {
+	char version;					// paramVersion
+	char flags;						// None yet
+	unsigned int minBattV;			// Calibrated thresholds (see calibrateThresholds())
+	unsigned int restartDischV;
+	char flashTime;					// SHORT_FLASH_TIME
+	char flashNumber;				// SHORT_FLASH_NUMBER
+	unsigned int crc;				// CRC-16-CCITT (0x1021, from 0xFFFF) of the above, must be last
+};
+#ifdef enableParamBlock
+extern struct ParamBlock *paramBlock;
+extern bool paramsLoaded;
+extern char flashTime;
+extern char flashNumber;
+void loadParams(void);									// paramBlock.cpp
+#else
+#define flashTime			SHORT_FLASH_TIME
+#define flashNumber			SHORT_FLASH_NUMBER
+#endif
+
+// Declaration of some things to help with limiting the input power, placed in header.h
+// Also have to remember to include or not include inputPowerLimit.cpp!
+// From a weak source (small panel, long USB cable) the charge IC can pull the input down until it collapses, and
+// then it restarts, over and over. There's no ADC channel on the input, so a collapse is seen from the battery side:
+// STAT1 going off while the gate's been on a while, or the charging current falling below half its usual level.
+// The charge gate (P2.3) is then duty cycled, on for gateOnLoops of every gateCycleLoops main loops, so the source
+// only has to give what it can: each collapse cuts the on time by a quarter, and a while (gateRaiseCycles) without
+// one puts it back up a step. The on time it collapsed at is remembered, and getting back there takes much longer
+// (gateRetryCycles), so it settles just below rather than hunting around it. STAT1 staying off for gateGoneCycles
+// means the source has gone (or night), and a full battery needs the gate on to finish, so both go back to full on.
+// While the gate's cycling, the loop doesn't sleep (enableSleepBetweenEvents), and STAT1/STAT2 are only read once
+// the charge IC has had gateSettleLoops to start up again after the gate's opened. The constants can be checked on
+// the host against a weak source model with "02 Firmware/Tools/inputPowerBench/inputPowerBench.cpp".
+//#define enableInputPowerLimit			// Comment this out to remove all the relevant code and variables throughout the project
+#define gateCycleLoops		64		// Main loops per gate cycle (the loop runs at roughly 1kHz)
+#define gateMinOnLoops		8		// Never less on than this
+#define gateSettleLoops		6		// Loops after the gate opens before STAT1 and the current mean anything (charge IC soft start)
+#define gateRaiseStep		2		// Loops more on time after a quiet spell
+#define gateRaiseCycles		32		// Cycles without a collapse before raising the on time
+#define gateRetryCycles		512		// ...and before raising it to where it last collapsed
+#define gateGoneCycles		256		// Cycles with STAT1 off before taking it that the source has gone
+#define currentAverageShift	4		// Usual charging current is averaged over 2^currentAverageShift settled loops
+#ifdef enableInputPowerLimit
+extern char gateOnLoops;
+extern char gateCollapseLoops;
+extern char gateLoop;
+extern bool gateSettled;
+extern bool gateCollapsed;
+extern unsigned int gateQuietCycles;
+extern unsigned int gateOffCycles;
+extern unsigned int usualCurrent;
+void limitInputPower(void);								// inputPowerLimit.cpp
+#endif
+
+// Declaration of some things to help with timing the loop on the target with a logic analyser, placed in header.h
+// As in the Battery 100 (see its header.h), two unused pins are driven as markers: the stage pin (P1.1) toggles at
+// every stage boundary of main()'s loop, and the event pin (P1.2) is high for the whole of an interrupt. The start
+// of the loop is a stage pin toggle while the event pin is high, and a fuse trip is two (in tripFuse(), so it's
+// marked whether it's from the battery status or from a port interrupt). Capture both pins and analyse with
+// "02 Firmware/Tools/markerTiming.cpp -f charger". With enableSleepBetweenEvents the last stage includes the sleep.
+//#define enableTimingMarkers				// Comment this out to remove all the relevant code and variables throughout the project
+#ifdef enableTimingMarkers
+#define markStage()			(P1OUT ^= BIT1)
+#define markLoop()			do {P1OUT |= BIT2; P1OUT ^= BIT1; P1OUT &= ~BIT2;} while (0)
+// The event pin is put back as it was, as this is also called from the port interrupts
+#define markFault()			do {char eventMarked = P1OUT & BIT2; P1OUT |= BIT2; P1OUT ^= BIT1; P1OUT ^= BIT1; if (!eventMarked) P1OUT &= ~BIT2;} while (0)
+#define markInterruptEntry()	char eventMarked = P1OUT & BIT2; P1OUT |= BIT2
+#define markInterruptExit()		if (!eventMarked) P1OUT &= ~BIT2
+#else
+#define markStage()
+#define markLoop()
+#define markFault()
+#define markInterruptEntry()
+#define markInterruptExit()
+#endif
+
 // Prototypes for global variables that cross source files
 extern unsigned int ChargingCurrent;
 extern unsigned int BatteryVoltage;
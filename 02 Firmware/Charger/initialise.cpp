@@ -80,6 +80,10 @@ void initialiseIO(void) {
 	// Set port directions (1 means output, 0 means input), high-impedance digital outputs (pull-up/pull-down) stay defined as inputs.
 	P1DIR = BIT6 + BIT7;
 	P2DIR = BIT3;
+#ifdef enableTimingMarkers
+	// The unused P1.1 and P1.2 drive the timing markers (see header.h)
+	P1DIR |= BIT1 + BIT2;
+#endif
 }
 
 void initialiseADC(void) {
@@ -134,6 +138,11 @@ unsigned int secondStageCalibration(unsigned int uncalibratedThreshold, float _A
 // avoid doing this float multiplication too many times. The second step is to float multiply this
 // coefficients with each threshold, after applying the offset calibration.
 void calibrateThresholds(void) {
+#ifdef enableParamBlock
+	// The parameter block's thresholds were calibrated when it was made
+	if (paramsLoaded)
+		return;
+#endif
 	// Firstly calculate the two "factor" calibration coefficients. The division must be "float
 	// division", so the numerators are cast as such.
 	float ADC_coeff1 = (float) 32768 / *CAL_ADC_25VREF_FACTOR;
@@ -151,5 +160,13 @@ void initialise(void) {
 	initialiseClock();
 	initialiseIO();
 	initialiseADC();
+// Load the parameter block, if there's a good one, located in initialise() in initialise.cpp
+#ifdef enableParamBlock
+	loadParams();
+#endif
 	calibrateThresholds();
+// Set up the interrupts that will wake us, located in initialise() in initialise.cpp
+#ifdef enableSleepBetweenEvents
+	initialiseEvents();
+#endif
 }
@@ -0,0 +1,93 @@
+/*
+ * inputPowerLimit.cpp
+ *
+ *  Optional: duty cycle the charge gate (P2.3) when the source can't
+ *  keep up with the charge IC, rather than letting the input collapse
+ *  and the charge IC restart over and over (see header.h).
+ *
+ *  The on time is a hysteretic controller: cut by a quarter straight
+ *  away on a collapse, raised a step at a time only after a quiet
+ *  spell, and only after a much longer one to where it last collapsed.
+ *  So it sits just under the most the source can give, rather than
+ *  hunting around it.
+ */
+
+#include <msp430.h>
+#include "header.h"
+
+// Back to the gate always on, and forget what the source could give
+void gateFullOn(void) {
+	gateOnLoops = gateCycleLoops;
+	gateCollapseLoops = gateCycleLoops;
+	gateQuietCycles = 0;
+	gateOffCycles = 0;
+}
+
+// Look for a collapse in this loop's data (only called once the charge IC has
+// had time to start up with the gate open)
+void watchForCollapse(void) {
+	int current = ChargingCurrent;		// Negative if discharging
+	if (Stat1) {
+		gateOffCycles = 0;
+		// Learn the usual current again after a collapse
+		if (usualCurrent == 0)
+			usualCurrent = (current > 0) ? current : 0;
+		// The input's drooped so far that the charging current has fallen away
+		else if (current < (int) (usualCurrent >> 1)) {
+			gateCollapsed = true;
+			usualCurrent = 0;
+		}
+		else
+			usualCurrent += (current - (int) usualCurrent) >> currentAverageShift;
+	}
+	// The charge IC's stopped: if it was charging, that's a collapse. If it
+	// wasn't, it's still stopped, which gateOffCycles counts.
+	else if (usualCurrent != 0) {
+		gateCollapsed = true;
+		usualCurrent = 0;
+	}
+}
+
+// At the end of each gate cycle, pick the on time for the next one
+void setGateOnLoops(void) {
+	char raised;
+	if (gateCollapsed) {
+		gateCollapseLoops = gateOnLoops;
+		gateOnLoops -= gateOnLoops >> 2;
+		if (gateOnLoops < gateMinOnLoops)
+			gateOnLoops = gateMinOnLoops;
+		gateQuietCycles = 0;
+		gateCollapsed = false;
+	}
+	else if (gateOnLoops < gateCycleLoops) {
+		raised = (gateOnLoops + gateRaiseStep > gateCycleLoops) ? gateCycleLoops : gateOnLoops + gateRaiseStep;
+		if (++gateQuietCycles >= ((raised >= gateCollapseLoops) ? gateRetryCycles : gateRaiseCycles)) {
+			gateOnLoops = raised;
+			gateQuietCycles = 0;
+		}
+	}
+	// Nothing's been charging for a while: the source has gone, so start afresh when it's back
+	if (!Stat1 && (usualCurrent == 0) && (++gateOffCycles >= gateGoneCycles))
+		gateFullOn();
+}
+
+// Called by refreshCharge() on every loop. This loop's data was read with the gate as it was
+// set last loop; the gate is then set for the next loop.
+void limitInputPower(void) {
+	// Charge complete: the charge IC needs the gate open to finish, and there's not much power to limit
+	if (Stat2) {
+		gateFullOn();
+		gateCollapsed = false;
+	}
+	else if (gateSettled)
+		watchForCollapse();
+	if (++gateLoop >= gateCycleLoops) {
+		setGateOnLoops();
+		gateLoop = 0;
+	}
+	if (gateLoop < gateOnLoops)
+		chargeEnable();
+	else
+		chargeDisable();
+	gateSettled = (gateLoop < gateOnLoops) && ( (gateLoop >= gateSettleLoops) || (gateOnLoops == gateCycleLoops) );
+}
@@ -8,6 +8,7 @@
 /* TIME-CRITICAL THINGS TO CHECK BEFORE RELEASING!
  * 1.) Is there enough time between the quick fuse reset (setting the fuseTrip pin to low impedance, and the initialisation routine (setting the fuseTrip pin back to high impedance), for the fuse to have tripped? Otherwise need to insert a delay.
  * 2.) With a 1MHz clock time 100 cycles is a long enough pulse duration to trip/reset the fuse. So 200 is used. But if clock cycle is increased then this will also need to be increased proportionately!
+ * 3.) With enableSleepBetweenEvents, the same goes for REF_SETTLE_DELAY. Also check that sampleTickPeriod is still well under the watchdog time on a fast VLO.
  *
  *
  * */
@@ -35,6 +36,26 @@ unsigned int *CAL_ADC_25VREF_FACTOR = (unsigned int *) 0x10E6;
 unsigned int *CAL_ADC_GAIN_FACTOR = (unsigned int *) 0x10DC;
 int *CAL_ADC_OFFSET = (int *) 0x10DE;
 
+// Parameter block in information memory segment D, and the parameters that aren't thresholds
+#ifdef enableParamBlock
+struct ParamBlock *paramBlock = (struct ParamBlock *) 0x1000;
+bool paramsLoaded;
+char flashTime;
+char flashNumber;
+#endif
+
+// Duty cycling of the charge gate, to limit the input power
+#ifdef enableInputPowerLimit
+char gateOnLoops = gateCycleLoops;
+char gateCollapseLoops = gateCycleLoops;
+char gateLoop;
+bool gateSettled = true;
+bool gateCollapsed;
+unsigned int gateQuietCycles;
+unsigned int gateOffCycles;
+unsigned int usualCurrent;
+#endif
+
 int main(void) {
 
 	// Trip the fuse immediately, because if the contact
@@ -60,20 +81,39 @@ int main(void) {
 	 * */
 
 	for(;;) {
+		// Mark the start of the loop, and after each stage, for timing with a logic analyser (enableTimingMarkers)
+		markLoop();
 		// Pat watchdog to avoid unintentional reset
 		patWatchdog();
 		// Measure data from ADCs and digital inputs
 		getData();
+		markStage();
 		// Use battery voltage data to check for deep-
 		// discharge, or to check when deep-discharge
 		// protection can be safely switched off.
 		// Also, exit "dynamic modes" after a single
 		// cycle carries out all necessary activities.
 		refreshBatteryStatus();
+		markStage();
 		refreshJouleCounter();
+		markStage();
 		refreshCharge();
+		markStage();
 		refreshDischarge();
+		markStage();
 		refreshLEDs();
+		markStage();
+#ifdef enableSleepBetweenEvents
+		// Nothing more to do until something changes, unless we're
+		// in a "dynamic mode", which needs another loop straight away
+		// (or the charge gate is being cycled, which is counted in loops)
+#ifdef enableInputPowerLimit
+		if ( !batteryStates[BatteryStatus].dynamic && (gateOnLoops == gateCycleLoops) )
+#else
+		if (!batteryStates[BatteryStatus].dynamic)
+#endif
+			sleepUntilEvent();
+#endif
 	}
 
 	return 0;
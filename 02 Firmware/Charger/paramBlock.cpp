@@ -0,0 +1,41 @@
+/*
+ * Optional parameter block in info segment D, so that a unit can be
+ * retuned without a new build. As in the Battery 100, the block is made on a
+ * PC (Tools/paramBlock) with the unit's ADC calibration already applied, so
+ * loading it is only a CRC check and a copy. See header.h.
+ */
+
+#include <msp430.h>
+#include <stddef.h>
+#include "header.h"
+
+// CRC-16-CCITT (polynomial 0x1021, starting from 0xFFFF), a bit at a time
+unsigned int paramCRC(const char *data, char length) {
+	unsigned int crc = 0xFFFF;
+	while (length--) {
+		crc ^= (unsigned int) *data++ << 8;
+		for (char bit = 0; bit < 8; bit++) {
+			if (crc & 0x8000)
+				crc = (crc << 1) ^ 0x1021;
+			else
+				crc <<= 1;
+		}
+	}
+	return crc;
+}
+
+// Load the parameter block, if it's there and good, otherwise the defaults from header.h
+// (calibrateThresholds() does the thresholds then, and is skipped if paramsLoaded)
+void loadParams(void) {
+	paramsLoaded = (paramBlock->version == paramVersion)
+			&& (paramCRC((const char *) paramBlock, offsetof(struct ParamBlock, crc)) == paramBlock->crc);
+	if (!paramsLoaded) {
+		flashTime = SHORT_FLASH_TIME;
+		flashNumber = SHORT_FLASH_NUMBER;
+		return;
+	}
+	minBattV = paramBlock->minBattV;
+	restartDischV = paramBlock->restartDischV;
+	flashTime = paramBlock->flashTime;
+	flashNumber = paramBlock->flashNumber;
+}
@@ -26,49 +26,85 @@
  * BatteryStatus = 5  -> (Dynamic mode) Battery has reached full capacity, recalibrate joule-counter
  * BatteryStatus = 6  -> (Static mode) Battery is full, joule-counter has already recalibrated
  *
- * A tripped short-circuit fuse is handled directly in the refreshDischarge method.
+ * A tripped short-circuit fuse is handled directly in the refreshDischarge method, but only in the states
+ * where the fuse should be closed (connected in the table): in 0 and 1 it's been tripped on purpose.
+ *
+ * The states, their transitions and what's done on entering them are all in the tables below, so
+ * this is the one place to check what protects the battery. Each loop, the current state's
+ * transitions are tried in order, and the first whose guard holds is taken: the new state's entry
+ * action is run there and then, once, and its LED colour is shown by refreshLEDs() from then on.
+ * A dynamic mode's only transition is GUARD_ALWAYS, so it lasts the one loop.
  *
  * */
 
 #include <msp430.h>
 #include "header.h"
 
-void refreshBatteryStatus(void) {
+// Entry action of state 1
+void disconnectBattery(void) {
+	tripFuse();
+	flashLED(1, 0, flashTime, flashTime, flashNumber);
+}
+
+// Tried in order for each state, see batteryStates[]
+const struct Transition batteryTransitions[] = {
+	// 0: empty
+	{GUARD_RECOVERED, 4},
+	// 1: just emptied
+	{GUARD_ALWAYS, 0},
+	// 2: charging. Important to check for a full battery, before checking if stopped charging, as Stat1 will turn off once a full battery is reached!
+	{GUARD_DEEP_DISCHARGE, 1}, {GUARD_FULL, 5}, {GUARD_NOT_CHARGING, 3},
+	// 3: at rest
+	{GUARD_DEEP_DISCHARGE, 1}, {GUARD_CHARGING, 2},
+	// 4: just recovered
+	{GUARD_ALWAYS, 3},
+	// 5: just full
+	{GUARD_ALWAYS, 6},
+	// 6: full. Not charging and still full means staying here
+	{GUARD_CHARGING, 2}, {GUARD_NOT_FULL, 3}
+};
 
-	switch (BatteryStatus) {
-	case 0:		// Check if battery has recovered, and if so, upgrade level
-		if (BatteryVoltage >= restartDischV)
-			BatteryStatus = 4;
-		break;
-	case 1:		// One loop of the system has finished the tasks that needed doing, so now recede to ongoing status.
-		BatteryStatus--;
-		break;
-	case 2:		// Charging! Check if battery is either deeply discharged, full, or stopped charging and respond appropriately
-		if (BatteryVoltage < minBattV)
-			BatteryStatus = 1;
-		else if (Stat2) // Important to check for a full battery, before checking if stopped charging, as Stat1 will turn off once a full battery is reached!
-			BatteryStatus = 5;
-		else if (!Stat1)
-			BatteryStatus = 3;
-		break;
-	case 3:		// At rest. Check if battery is either deeply discharged, or started charging.
-		if (BatteryVoltage < minBattV)
-			BatteryStatus = 1;
-		else if (Stat1)
-			BatteryStatus = 2;
-		break;
-	case 4:		// One loop of the system has finished the tasks that needed doing, so now recede to ongoing status.
-		BatteryStatus--;
-		break;
-	case 5:		// One loop of the system has finished the tasks that needed doing, so now recede to ongoing status.
-		BatteryStatus++;
-		break;
-	case 6:		// Full battery. Check if battery returns to "at rest" mode or charging mode
-		if (Stat1)
-			BatteryStatus = 2;
-		else if (!Stat2)  // ...and Stat1 must be false as we've checked this already!
-			BatteryStatus = 3;
-		break;
+// Off if in deep discharge, red if at rest, orange if charging, green if fully charged
+const struct BatteryState batteryStates[BATTERY_STATES] = {
+	// entry				first	count	LEDs	dynamic	connected
+	{0,						0,		1,		0,		false,	false},		// 0: empty, gate closed
+	{disconnectBattery,		1,		1,		0,		true,	false},		// 1: close the gate and flash the LED
+	{0,						2,		3,		2,		false,	true},		// 2: charging
+	{0,						5,		2,		1,		false,	true},		// 3: at rest
+	{resetFuse,				7,		1,		0,		true,	true},		// 4: recovered from deep discharge, open the gate
+	{0,						8,		1,		3,		true,	true},		// 5: full, recalibrate the joule counter (when there is one)
+	{0,						9,		2,		3,		false,	true}		// 6: full
+};
+
+bool guardHolds(char guard) {
+	switch (guard) {
+	case GUARD_ALWAYS:
+		return true;
+	case GUARD_RECOVERED:
+		return BatteryVoltage >= restartDischV;
+	case GUARD_DEEP_DISCHARGE:
+		return BatteryVoltage < minBattV;
+	case GUARD_CHARGING:
+		return Stat1;
+	case GUARD_NOT_CHARGING:
+		return !Stat1;
+	case GUARD_FULL:
+		return Stat2;
+	case GUARD_NOT_FULL:
+		return !Stat2;
 	}
+	return false;
 }
 
+void refreshBatteryStatus(void) {
+	const struct BatteryState *state = &batteryStates[BatteryStatus];
+	const struct Transition *transition = &batteryTransitions[state->firstTransition];
+	for (char i = 0; i < state->transitions; i++, transition++) {
+		if (guardHolds(transition->guard)) {
+			BatteryStatus = transition->next;
+			if (batteryStates[BatteryStatus].entry)
+				batteryStates[BatteryStatus].entry();
+			return;
+		}
+	}
+}
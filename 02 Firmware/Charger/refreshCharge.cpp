@@ -20,7 +20,10 @@ void refreshCharge() {
 	// No reason yet to disable/enable charge, as
 	// this is all handled by the chip itself.
 	// Unless, maybe if the insides get too hot?
-	// Or if
+	// Or if the source can't keep up:
+#ifdef enableInputPowerLimit
+	limitInputPower();
+#endif
 }
 
 
@@ -25,6 +25,7 @@ void initialFuseTrip(void) {
 }
 
 void tripFuse(void) {
+	markFault();
 	// The pin output has already been set to zero during initialisation
 	// so just need to make it low impedance for a few cycles.
 	P2DIR |= BIT4;
@@ -44,20 +45,19 @@ void resetFuse(void) {
 
 void refreshDischarge(void) {
 
-	// Open or close gate according to battery status
-	switch (BatteryStatus) {
-		case 1:		// Low battery! Gate needs closing!
-			tripFuse();
-		case 4:		// Battery recovered from deep discharge! Lets open the gate.
-			resetFuse();
-	}
+	// The gate is opened and closed on entering the battery status
+	// that needs it, see batteryStates[] in refreshBatteryStatus.cpp
 
 	// Check for short-circuits (good to check straight after reseting a fuse, though it could also be too quick!)
 	// and if so (re-) trip the fuse (good to drain any remaining charge if already tripped by analog
 	// and immediately relevant if tripped by ground bus fuse) and flash some lights fast!
+	// Not while the battery's disconnected for deep discharge, as disconnectBattery() has tripped the
+	// fuse itself, and resetting it would connect the empty battery again.
+	if ( !batteryStates[BatteryStatus].connected )
+		return;
 	if ( !(P2IN & BIT0) || (P1IN & BIT0) ) {  // "FuseTripped" OR "GroundBusTripped"
 		tripFuse();
-		flashLED(1, 0, SHORT_FLASH_TIME / 4, SHORT_FLASH_TIME / 4, SHORT_FLASH_NUMBER * 4);
+		flashLED(1, 0, flashTime / 4, flashTime / 4, flashNumber * 4);
 		resetFuse();
 	}
 
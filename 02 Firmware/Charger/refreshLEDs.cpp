@@ -61,25 +61,8 @@ void flashLED(char colour_on, char colour_off, char blinkDuration_on, char blink
 
 
 
-// Off if in deep discharge
-// Red if at rest
-// Orange if charging
-// Green if fully charged
+// The colour for the battery status, see batteryStates[] in refreshBatteryStatus.cpp.
+// Set every loop, as a short circuit's flashes leave the LED off.
 void refreshLEDs(void) {
-	switch (BatteryStatus) {
-		case 1:		// Just reached deep discharge disconnect, flash the LED and turn it off!
-			flashLED(1, 0, SHORT_FLASH_TIME, SHORT_FLASH_TIME, SHORT_FLASH_NUMBER);
-			setLEDs(0);
-			break;
-		case 2:		// We're charging, turn orange LED on (this is a bit of an exception with regards to the "dynamic/static mode" paradigm as we're constantly checking this) sorry about that inconsistency.
-			setLEDs(2);
-			break;
-		case 3:		// We're at rest, turn red LED on (this is a bit of an exception with regards to the "dynamic/static mode" paradigm as we're constantly checking this) sorry about that inconsistency.
-			setLEDs(1);
-			break;
-		case 5:		// We've reached full capacity, switch to green
-			setLEDs(3);
-			break;
-		}
+	setLEDs(batteryStates[BatteryStatus].LEDs);
 }
-
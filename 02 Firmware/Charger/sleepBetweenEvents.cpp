@@ -0,0 +1,103 @@
+/*
+ * sleepBetweenEvents.cpp
+ *
+ *  Optional: instead of polling everything at 1MHz forever, sleep
+ *  in LPM3 between events, and let interrupts wake us up:
+ *  - Fuse tripped (P2.0 falling) or ground bus fuse tripped (P1.0
+ *    rising): the fuse is tripped again there and then in the
+ *    interrupt, so there's no waiting for the loop to come round.
+ *    The loop then handles it as usual (refreshDischarge()).
+ *  - STAT1 (P2.2) or STAT2 (P2.1) changed, either way.
+ *  - Timer_A tick from ACLK, every sampleTickPeriod, to sample the
+ *    battery voltage and current again (and pat the watchdog).
+ */
+
+#include <msp430.h>
+#include "header.h"
+
+// Set by the interrupts, so that an event that comes while we're
+// awake (interrupts stay enabled, for the fuse) isn't slept through
+volatile bool eventPending;
+
+// Set the STAT pins to interrupt on the opposite edge to their current level
+void armStatEdges(void) {
+	P2IES = (P2IES & ~(BIT1 + BIT2)) | (P2IN & (BIT1 + BIT2));
+}
+
+void initialiseEvents(void) {
+	/* Port interrupt settings:
+	 * P2.0 (FuseTripped, low when tripped)			- interrupt on falling edge
+	 * P1.0 (GroundBusTripped, high when tripped)	- interrupt on rising edge
+	 * P2.1, P2.2 (STAT2, STAT1)					- interrupt on the next change, see armStatEdges() */
+	P2IES |= BIT0;
+	P1IES &= ~BIT0;
+	armStatEdges();
+	// Changing the edge select can set the flags, so clear them before enabling
+	P1IFG = 0;
+	P2IFG = 0;
+	P1IE = BIT0;
+	P2IE = BIT0 + BIT1 + BIT2;
+	/* Timer_A settings, for the sampling tick:
+	 * TASSEL_1		- "Source select", ACLK (VLO), which keeps running in LPM3
+	 * MC_1			- "Mode control", up mode, counting up to TACCR0
+	 * CCIE			- interrupt when TACCR0 is reached */
+	TACCR0 = sampleTickPeriod - 1;
+	TACCTL0 = CCIE;
+	TACTL = TASSEL_1 + MC_1 + TACLR;
+	// Interrupts stay enabled from now on, so that fuse trips are
+	// handled straight away, whether we're asleep or not
+	__enable_interrupt();
+}
+
+void sleepUntilEvent(void) {
+	// Switch off the ADC and its reference while sleeping
+	ADC10CTL0 &= ~(ADC10ON + REFON);
+	// Pat the watchdog, the timer tick wakes us up well before it runs out
+	patWatchdog();
+	// Only sleep if nothing has happened since the last loop. Interrupts
+	// are disabled while checking, and enabled again in the same
+	// instruction as entering LPM3, so nothing can slip in between.
+	__disable_interrupt();
+	if (!eventPending)
+		__bis_SR_register(LPM3_bits + GIE);		// Woken up by one of the interrupts below
+	else
+		__enable_interrupt();
+	eventPending = false;
+	ADC10CTL0 |= ADC10ON + REFON;
+	__delay_cycles(REF_SETTLE_DELAY);
+}
+
+// Fuse trips and STAT changes on port 2
+#pragma vector = PORT2_VECTOR
+__interrupt void port2ISR(void) {
+	markInterruptEntry();
+	if (P2IFG & BIT0)
+		tripFuse();
+	if (P2IFG & (BIT1 + BIT2))
+		armStatEdges();
+	P2IFG = 0;
+	eventPending = true;
+	markInterruptExit();
+	__bic_SR_register_on_exit(LPM3_bits);
+}
+
+// Ground bus fuse trips on port 1
+#pragma vector = PORT1_VECTOR
+__interrupt void port1ISR(void) {
+	markInterruptEntry();
+	if (P1IFG & BIT0)
+		tripFuse();
+	P1IFG = 0;
+	eventPending = true;
+	markInterruptExit();
+	__bic_SR_register_on_exit(LPM3_bits);
+}
+
+// Sampling tick
+#pragma vector = TIMER0_A0_VECTOR
+__interrupt void sampleTickISR(void) {
+	markInterruptEntry();
+	eventPending = true;
+	markInterruptExit();
+	__bic_SR_register_on_exit(LPM3_bits);
+}
@@ -0,0 +1,230 @@
+/*
+ * battery100Host.cpp
+ *
+ * See battery100Host.h. The firmware sources are included here, rather than built
+ * separately, so that main() can be renamed and the optional ones left out the same way
+ * as in the real build.
+ */
+
+#include <cstring>
+#include "battery100Host.h"
+
+#define main battery100Main
+#include "../../Battery 100/main.cpp"
+#undef main
+#include "../../Battery 100/ADCs.cpp"
+#include "../../Battery 100/considerSleep.cpp"
+#include "../../Battery 100/initialise.cpp"
+#include "../../Battery 100/refreshBatteryStatus.cpp"
+#include "../../Battery 100/refreshCharge.cpp"
+#include "../../Battery 100/refreshDischarge.cpp"
+#include "../../Battery 100/refreshLEDs.cpp"
+#ifdef enableMaxTempLog
+#include "../../Battery 100/logTemp.cpp"
+#endif
+#ifdef enableFirstRunTest
+#include "../../Battery 100/firstRunTest.cpp"
+#endif
+#ifdef enableEventTrace
+#include "../../Battery 100/eventTrace.cpp"
+#endif
+#ifdef enableWarmBoot
+#include "../../Battery 100/warmBoot.cpp"
+#endif
+#ifdef enableClockGovernor
+#include "../../Battery 100/clockGovernor.cpp"
+#endif
+#ifdef enableDitheredPWM
+#include "../../Battery 100/ditheredPWM.cpp"
+#endif
+#ifdef enableSyncedADC
+#include "../../Battery 100/syncedADC.cpp"
+#endif
+#ifdef enableLEDDimming
+#include "../../Battery 100/dimLEDs.cpp"
+#endif
+#ifdef enableDividerCalibration
+#include "../../Battery 100/dividerCalibration.cpp"
+#endif
+#ifdef enableTempCompensation
+#include "../../Battery 100/tempCompensation.cpp"
+#endif
+#ifdef enableIRCompensation
+#include "../../Battery 100/irDrop.cpp"
+#endif
+#ifdef enableWakeScheduling
+#include "../../Battery 100/wakeSchedule.cpp"
+#endif
+#ifdef enableParamBlock
+#include "../../Battery 100/paramBlock.cpp"
+#endif
+#ifdef enableDailyStats
+#include "../../Battery 100/dailyStats.cpp"
+#endif
+#ifdef enableStateOfHealth
+#include "../../Battery 100/stateOfHealth.cpp"
+#endif
+#ifdef enableADCNoise
+#include "../../Battery 100/adcNoise.cpp"
+#endif
+
+unsigned int hostMaxTempFlash = 0xFFFF;
+char hostTestResult[64] = {0};
+unsigned int hostDividerCal[32] = {0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF};
+struct ParamBlock hostParamBlock = {(char) 0xFF, (char) 0xFF, 0xFFFF, 0xFFFF, (char) 0xFF, (char) 0xFF, (char) 0xFF, (char) 0xFF, (char) 0xFF, (char) 0xFF,
+		(char) 0xFF, (char) 0xFF, (char) 0xFF, (char) 0xFF, (char) 0xFF, (char) 0xFF, (char) 0xFF, (char) 0xFF, 0xFFFFFFFF, 0xFFFF};
+struct DayHistory hostDayHistory = {(char) 0xFF, (char) 0xFF, (char) 0xFF, (char) 0xFF, {{0}}, 0xFFFF};
+struct HealthLog hostHealthLog = {0xFFFF, {{0, 0, {0}}}, 0xFFFF};
+static unsigned int hostCALADC_25VREF_FACTOR = HOST_CALADC_25VREF_FACTOR;
+static unsigned int hostCALADC_GAIN_FACTOR = HOST_CALADC_GAIN_FACTOR;
+static int hostCALADC_OFFSET = HOST_CALADC_OFFSET;
+static unsigned int hostCALADC_15T30 = HOST_CALADC_15T30;
+static unsigned int hostCALADC_15T85 = HOST_CALADC_15T85;
+#ifdef enableTempCompensation
+static unsigned int hostCALADC_25T30 = HOST_CALADC_25T30;
+static unsigned int hostCALADC_25T85 = HOST_CALADC_25T85;
+#endif
+
+void battery100Reset(unsigned char resetCause) {
+	hostResetRegisters(resetCause);
+	// Globals in main.cpp, as the C start-up code leaves them (keep in step with main.cpp)
+	memset(av_ADC_values, 0, sizeof(av_ADC_values));
+	memset(av_cell_values, 0, sizeof(av_cell_values));
+	memset(cell_bleedingOn, 0, sizeof(cell_bleedingOn));
+	memset(dropped_bits, 0, sizeof(dropped_bits));
+	batteryStatus = minCell = maxCell = LEDStatus = 0;
+	timeSinceLastCharge = 0;
+	PVmpp = lowPV = 0;
+	maxCellV = minCellV = minFuse = minBleedV = stopChargeV = restartChargeV = restartDischV = 0;
+	LEDthresh1 = LEDthresh2 = LEDthreshHyst = 0;
+	const char channels[6] = {CELL1, CELL2, CELL3, CELL4, PV, DISCURRENT};
+	memcpy(ADC_CH_numbers, channels, sizeof(ADC_CH_numbers));
+	led_code = 1;
+	CALADC_25VREF_FACTOR = &hostCALADC_25VREF_FACTOR;
+	CALADC_GAIN_FACTOR = &hostCALADC_GAIN_FACTOR;
+	CALADC_OFFSET = &hostCALADC_OFFSET;
+#ifdef enableMaxTempLog
+	temp_dropped_bits = 0;
+	av_tempADC = maxTemp_RAM = flashReady = shutdownTemp = 0;
+	maxTemp_FLASH = &hostMaxTempFlash;
+	CALADC_15T85 = &hostCALADC_15T85;
+	CALADC_15T30 = &hostCALADC_15T30;
+#endif
+#ifdef enableFirstRunTest
+	testResult = hostTestResult;
+#endif
+#ifdef enableClockGovernor
+	clockSpeed = PWMshift = 0;
+	governorHold = 0;
+#endif
+#ifdef enableDitheredPWM
+	nudgeDuty = ditherAccumulator = 0;
+#endif
+#ifdef enableLEDDimming
+	LEDPhase = 0;
+#endif
+#ifdef enableDividerCalibration
+	dividerCal = (struct DividerCal *) hostDividerCal;
+	dividersCalibrated = false;
+#endif
+#ifdef enableTempCompensation
+	CALADC_25T85 = &hostCALADC_25T85;
+	CALADC_25T30 = &hostCALADC_25T30;
+	tempLoops = 0;
+	tempC = 0;
+	tempCompCharge = tempCompMinCell = 0;
+	tooColdToCharge = false;
+#endif
+#ifdef enableIRCompensation
+	irFuse = irDrop = irZero = 0;
+	irRatio = 0;
+	irSag = 0;
+#ifndef enableStateOfHealth
+	irLastDrop = 0;
+	irLastBattV = 0;
+	irLoops = 0;
+#endif
+#endif
+#ifdef enableParamBlock
+	paramBlock = &hostParamBlock;
+	paramsLoaded = false;
+	blinkCount = lowBattBlink = shortCircuitBlink = 0;
+	snoozeLimit = 0;
+#endif
+#ifdef enableDailyStats
+	dayHistory = &hostDayHistory;
+#endif
+#ifdef enableStateOfHealth
+	healthLog = &hostHealthLog;
+	testRecord_FLASH = (struct TestRecord *) hostTestResult;
+#ifndef enableIRCompensation
+	sohFuse = sohZero = 0;
+#endif
+	sohLastLoad = 0;
+	memset(sohLastCell, 0, sizeof(sohLastCell));
+	memset(sohRatio, 0, sizeof(sohRatio));
+	sohLastDuty = sohCapacity = sohCycles = sohPeriod = 0;
+	sohCharge = 0;
+	sohLoops = 0;
+	sohCounting = sohChanged = false;
+#endif
+	// NOINIT variables keep their values, unless this is a power-up
+	if (resetCause & PORIFG) {
+#ifdef enableEventTrace
+		memset(&traceLog, 0xA5, sizeof(traceLog));
+#endif
+#ifdef enableWarmBoot
+		memset(&warmState, 0xA5, sizeof(warmState));
+#endif
+#ifdef enableWakeScheduling
+		memset(&wakeSchedule, 0xA5, sizeof(wakeSchedule));
+#endif
+#ifdef enableDailyStats
+		memset(&dayStats, 0xA5, sizeof(dayStats));
+#endif
+	}
+}
+
+void battery100Boot(void) {
+	// As in main(), or _system_pre_init() with the warm boot
+	patWatchdog();
+	initialisePre();
+	checkPV();
+	initialiseFull();
+}
+
+void battery100Loop(void (*checkpoint)(void)) {
+	// As in main()'s loop
+	patWatchdog();
+#ifdef enableEventTrace
+	traceLog.ticks = (traceLog.ticks + 1) & 0xFFFF;		// int is 16 bits on the MSP430
+	if (traceLog.ticks == 0)
+		traceLog.epoch++;
+#endif
+#ifdef enableDailyStats
+	countStats();
+#endif
+	refreshADCs();
+	refreshBatteryStatus();
+#ifdef enableStateOfHealth
+	refreshHealth();
+#endif
+	if (checkpoint)
+		checkpoint();
+	refreshDischarge();
+	if (checkpoint)
+		checkpoint();
+	refreshCharge();
+	if (checkpoint)
+		checkpoint();
+	refreshLEDs();
+	if (checkpoint)
+		checkpoint();
+	considerSleep();
+	considerSnooze();
+#ifdef enableClockGovernor
+	governClock();
+#endif
+	if (checkpoint)
+		checkpoint();
+}
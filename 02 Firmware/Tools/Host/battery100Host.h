@@ -0,0 +1,45 @@
+/*
+ * battery100Host.h
+ *
+ * The Battery 100 firmware, built for the host (see msp430.h in this directory). Build
+ * battery100Host.cpp and hostMSP430.cpp into a tool, with this directory on the include
+ * path and -funsigned-char. The firmware's own globals (header.h) can be used directly.
+ *
+ * The optional features are included or not as set in "Battery 100/header.h".
+ */
+
+#ifndef BATTERY100_HOST_H_
+#define BATTERY100_HOST_H_
+
+#include <msp430.h>
+#include "../../Battery 100/header.h"
+
+// Reset the MCU: registers, and RAM as the C start-up code leaves it. A power-up (PORIFG)
+// also scrambles the NOINIT variables, as RAM is random then. The calibration pointers
+// are pointed at host copies of information memory, which survive resets.
+void battery100Reset(unsigned char resetCause);
+
+// Run main() up to its loop. Throws HostSleep if the firmware goes back to sleep.
+void battery100Boot(void);
+
+// Run one pass of main()'s loop. If given, checkpoint is called after each step, so that
+// states that only last part of a loop (e.g. batteryStatus 3) can be seen. Throws
+// HostSleep if the firmware goes to sleep.
+void battery100Loop(void (*checkpoint)(void));
+
+// Host copy of information memory segment C (0x1040, maxTemp_FLASH, and the history of days
+// at 0x1042), segment B (0x1080, the first run test record, and the state of health figures
+// at 0x1098) and segment D (0x1000, the divider calibration, and the parameter block at
+// 0x1020). Structs are kept separately, as the host's layouts are bigger. The test result
+// starts as 0 (passed), so that the test doesn't run. The divider calibration, parameter
+// block, history and state of health figures start erased (as much of them as is used),
+// i.e. not there. Segment erases aren't emulated, so don't rely on any more of them
+// reading as erased.
+extern unsigned int hostMaxTempFlash;
+extern char hostTestResult[64];
+extern unsigned int hostDividerCal[32];
+extern struct ParamBlock hostParamBlock;
+extern struct DayHistory hostDayHistory;
+extern struct HealthLog hostHealthLog;
+
+#endif /* BATTERY100_HOST_H_ */
@@ -0,0 +1,93 @@
+/*
+ * chargerHost.cpp
+ *
+ * See chargerHost.h. As in battery100Host.cpp, the firmware sources are included here,
+ * rather than built separately, so that main() can be renamed and the optional ones left
+ * out the same way as in the real build.
+ */
+
+#include "chargerHost.h"
+
+#define main chargerMain
+#include "../../Charger/main.cpp"
+#undef main
+#include "../../Charger/getData.cpp"
+#include "../../Charger/initialise.cpp"
+#include "../../Charger/refreshBatteryStatus.cpp"
+#include "../../Charger/refreshCharge.cpp"
+#include "../../Charger/refreshDischarge.cpp"
+#include "../../Charger/refreshJouleCounter.cpp"
+#include "../../Charger/refreshLEDs.cpp"
+#ifdef enableSleepBetweenEvents
+#include "../../Charger/sleepBetweenEvents.cpp"
+#endif
+#ifdef enableParamBlock
+#include "../../Charger/paramBlock.cpp"
+#endif
+#ifdef enableInputPowerLimit
+#include "../../Charger/inputPowerLimit.cpp"
+#endif
+
+static unsigned int hostCALADC_25VREF_FACTOR = HOST_CALADC_25VREF_FACTOR;
+static unsigned int hostCALADC_GAIN_FACTOR = HOST_CALADC_GAIN_FACTOR;
+static int hostCALADC_OFFSET = HOST_CALADC_OFFSET;
+struct ParamBlock hostParamBlock = {(char) 0xFF, (char) 0xFF, 0xFFFF, 0xFFFF, (char) 0xFF, (char) 0xFF, 0xFFFF};
+
+void chargerReset(unsigned char resetCause) {
+	hostResetRegisters(resetCause);
+	// Globals in main.cpp, as the C start-up code leaves them (keep in step with main.cpp)
+	ChargingCurrent = BatteryVoltage = 0;
+	Stat1 = Stat2 = false;
+	BatteryStatus = 0;
+	loop_counter = 0;
+	minBattV = restartDischV = 0;
+	CAL_ADC_25VREF_FACTOR = &hostCALADC_25VREF_FACTOR;
+	CAL_ADC_GAIN_FACTOR = &hostCALADC_GAIN_FACTOR;
+	CAL_ADC_OFFSET = &hostCALADC_OFFSET;
+#ifdef enableSleepBetweenEvents
+	eventPending = false;
+#endif
+#ifdef enableInputPowerLimit
+	gateOnLoops = gateCollapseLoops = gateCycleLoops;
+	gateLoop = 0;
+	gateSettled = true;
+	gateCollapsed = false;
+	gateQuietCycles = gateOffCycles = usualCurrent = 0;
+#endif
+#ifdef enableParamBlock
+	paramBlock = &hostParamBlock;
+	paramsLoaded = false;
+	flashTime = flashNumber = 0;
+#endif
+}
+
+void chargerIdleInputs(void) {
+	P1IN = 0;						// P1.0 low: ground bus fuse not tripped
+	P2IN = BIT0 + BIT1 + BIT2;		// P2.0 high: fuse not tripped. STAT2 and STAT1 pulled up
+}
+
+void chargerBoot(void) {
+	// As in main()
+	initialFuseTrip();
+	initialise();
+	flashLED(1,3,1,1,3);
+}
+
+void chargerLoop(void) {
+	// As in main()'s loop
+	patWatchdog();
+	getData();
+	refreshBatteryStatus();
+	refreshJouleCounter();
+	refreshCharge();
+	refreshDischarge();
+	refreshLEDs();
+#ifdef enableSleepBetweenEvents
+#ifdef enableInputPowerLimit
+	if ( !batteryStates[BatteryStatus].dynamic && (gateOnLoops == gateCycleLoops) )
+#else
+	if (!batteryStates[BatteryStatus].dynamic)
+#endif
+		sleepUntilEvent();
+#endif
+}
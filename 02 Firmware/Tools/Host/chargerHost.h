@@ -0,0 +1,37 @@
+/*
+ * chargerHost.h
+ *
+ * The Charger firmware, built for the host (see msp430.h in this directory), in the same
+ * way as battery100Host.h. Build chargerHost.cpp and hostMSP430.cpp into a tool, with this
+ * directory on the include path and -funsigned-char. The two firmwares share function
+ * names, so a tool can only have one of them.
+ *
+ * The optional features are included or not as set in "Charger/header.h".
+ */
+
+#ifndef CHARGER_HOST_H_
+#define CHARGER_HOST_H_
+
+#include <msp430.h>
+#include "../../Charger/header.h"
+
+// Reset the MCU: registers, and RAM as the C start-up code leaves it. The calibration
+// pointers are pointed at host copies of information memory. The inputs P1IN and P2IN are
+// left to the tool, see chargerIdleInputs().
+void chargerReset(unsigned char resetCause);
+
+// P1IN and P2IN with the fuses untripped and the charge controller idle (STAT1 and STAT2 high)
+void chargerIdleInputs(void);
+
+// Run main() up to its loop
+void chargerBoot(void);
+
+// Run one pass of main()'s loop. With enableSleepBetweenEvents, the wait for the next event
+// at the end returns straight away (see hostLPMWaits).
+void chargerLoop(void);
+
+// Host copy of information memory segment D (0x1000), the parameter block, which starts
+// erased (as much of it as is used), i.e. not there
+extern struct ParamBlock hostParamBlock;
+
+#endif /* CHARGER_HOST_H_ */
@@ -0,0 +1,143 @@
+/*
+ * hostMSP430.cpp
+ *
+ * Register storage and intrinsics for the host version of msp430.h
+ */
+
+#include <msp430.h>
+
+volatile unsigned char IE1, IFG1;
+volatile unsigned char P1IN, P1OUT, P1DIR, P1IFG, P1IES, P1IE, P1SEL, P1SEL2, P1REN;
+volatile unsigned char P2IN, P2OUT, P2DIR, P2IFG, P2IES, P2IE, P2SEL, P2SEL2, P2REN;
+volatile unsigned char DCOCTL, BCSCTL1, BCSCTL2, BCSCTL3;
+// Made up, but distinct and in the right ranges (RSEL in the low nibble of CALBC1)
+volatile unsigned char CALDCO_1MHZ = 0x52, CALBC1_1MHZ = 0x86, CALDCO_8MHZ = 0x8C, CALBC1_8MHZ = 0x8D;
+volatile unsigned char CALDCO_12MHZ = 0x7A, CALBC1_12MHZ = 0x8E, CALDCO_16MHZ = 0x95, CALBC1_16MHZ = 0x8F;
+volatile unsigned int ADC10CTL0, ADC10CTL1;
+volatile unsigned char ADC10AE0, ADC10DTC0, ADC10DTC1;
+volatile unsigned int ADC10SA;
+volatile unsigned int TACTL, TACCTL0, TACCTL1, TACCR0, TACCR1, TAR, TAIV;
+volatile unsigned int WDTCTL, FCTL1, FCTL2, FCTL3;
+
+unsigned int hostADCInput[16];
+double hostDelayedSeconds;
+void (*hostDelayHook)(double seconds);
+unsigned long hostADCConversions;
+double hostADCSeconds;
+unsigned long hostLPMWaits;
+
+unsigned long hostClockHz(void) {
+	unsigned char rsel = BCSCTL1 & 0x0f;
+	if (DCOCTL == CALDCO_1MHZ && rsel == (CALBC1_1MHZ & 0x0f))
+		return 1000000;
+	if (DCOCTL == CALDCO_8MHZ && rsel == (CALBC1_8MHZ & 0x0f))
+		return 8000000;
+	if (DCOCTL == CALDCO_12MHZ && rsel == (CALBC1_12MHZ & 0x0f))
+		return 12000000;
+	if (DCOCTL == CALDCO_16MHZ && rsel == (CALBC1_16MHZ & 0x0f))
+		return 16000000;
+	return 100000;		// DCOCTL = 0, RSEL = 0 is 0.06-0.14MHz
+}
+
+double hostACLKHz(void) {
+	return (double) HOST_VLO_HZ / (1 << ((BCSCTL1 >> 4) & 3));
+}
+
+double hostWatchdogSeconds(void) {
+	static const unsigned int counts[4] = {32768, 8192, 512, 64};		// WDTIS_x
+	double clockHz = (WDTCTL & WDTSSEL) ? hostACLKHz() : (double) hostClockHz() / (1 << ((BCSCTL2 >> 1) & 3));
+	return counts[WDTCTL & 3] / clockHz;
+}
+
+void hostTimerA(double seconds) {
+	static double remainder;		// Part of a count left over
+	double clockHz;
+	unsigned long period;
+	// TACLR clears TAR and then itself
+	if (TACTL & TACLR) {
+		TAR = 0;
+		TACTL &= ~TACLR;
+	}
+	switch (TACTL & MC_3) {
+	case MC_1:
+		period = (unsigned long) TACCR0 + 1;
+		break;
+	case MC_2:
+		period = 0x10000;
+		break;
+	default:
+		return;		// Stopped (or up/down mode, which nothing uses)
+	}
+	if ( (TACTL & (TASSEL_1 + TASSEL_2)) == TASSEL_1 )
+		clockHz = hostACLKHz();
+	else
+		clockHz = (double) hostClockHz() / (1 << ((BCSCTL2 >> 1) & 3));
+	clockHz /= 1 << ((TACTL >> 6) & 3);		// IDx
+	double counts = seconds * clockHz + remainder;
+	unsigned long whole = (unsigned long) counts;
+	remainder = counts - whole;
+	TAR = (TAR + whole) % period;
+}
+
+unsigned int hostADCRead(void) {
+	static const unsigned char sampleClocks[4] = {4, 8, 16, 64};		// ADC10SHT_x
+	double clockHz;
+	switch (ADC10CTL1 & ADC10SSEL_3) {
+	case ADC10SSEL_0:
+		clockHz = HOST_ADC10OSC_HZ;
+		break;
+	case ADC10SSEL_1:
+		clockHz = hostACLKHz();
+		break;
+	case ADC10SSEL_2:
+		clockHz = hostClockHz();
+		break;
+	default:
+		clockHz = (double) hostClockHz() / (1 << ((BCSCTL2 >> 1) & 3));		// SMCLK, divided by DIVS
+		break;
+	}
+	clockHz /= ((ADC10CTL1 >> 5) & 7) + 1;		// ADC10DIV_x
+	hostADCConversions++;
+	hostADCSeconds += (sampleClocks[(ADC10CTL0 >> 11) & 3] + 13) / clockHz;
+	return hostADCInput[ADC10CTL1 >> 12];
+}
+
+void hostResetRegisters(unsigned char resetCause) {
+	IE1 = 0;
+	IFG1 = resetCause;
+	P1OUT = P1DIR = P1IFG = P1IES = P1IE = P1SEL = P1SEL2 = P1REN = 0;
+	P2OUT = P2DIR = P2IFG = P2IES = P2IE = P2SEL2 = P2REN = 0;
+	P2SEL = BIT6 + BIT7;	// XIN/XOUT after reset
+	DCOCTL = 0x60;
+	BCSCTL1 = 0x87;
+	BCSCTL2 = 0;
+	BCSCTL3 = 0x05;
+	ADC10CTL0 = ADC10CTL1 = 0;
+	ADC10AE0 = ADC10DTC0 = ADC10DTC1 = 0;
+	ADC10SA = 0x200;
+	TACTL = TACCTL0 = TACCTL1 = TACCR0 = TACCR1 = TAR = TAIV = 0;
+	WDTCTL = 0x6900;
+	FCTL1 = 0x9600;
+	FCTL2 = 0x9642;
+	FCTL3 = 0x9618;
+}
+
+void hostLPM3(void) {
+	throw HostSleep();
+}
+
+void __delay_cycles(unsigned long cycles) {
+	double seconds = (double) cycles / hostClockHz();
+	if (hostDelayHook)
+		hostDelayHook(seconds);
+	hostDelayedSeconds += seconds;
+}
+
+void __no_operation(void) {}
+void __enable_interrupt(void) {}
+void __disable_interrupt(void) {}
+void __bis_SR_register(unsigned int bits) {	// Returns straight away, as if an interrupt had woken the CPU
+	if (bits & CPUOFF)
+		hostLPMWaits++;
+}
+void __bic_SR_register_on_exit(unsigned int) {}
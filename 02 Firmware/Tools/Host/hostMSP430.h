@@ -0,0 +1,74 @@
+/*
+ * hostMSP430.h
+ *
+ * The parts of the host version of msp430.h that a tool drives: ADC inputs, sleep, time
+ * spent in delays and ADC conversions, the clock speeds, and the calibration values in
+ * information memory.
+ * Included by msp430.h, so the firmware sources see it too.
+ */
+
+#ifndef HOST_MSP430_HOST_H_
+#define HOST_MSP430_HOST_H_
+
+// Thrown when the firmware enters LPM3. The MCU stays there until the watchdog resets it,
+// so a tool should catch this, let the watchdog period pass, and boot the firmware again.
+struct HostSleep {};
+
+// What each ADC channel (INCHx) reads, set by the tool before running the firmware.
+// Channel 10 is the internal temperature sensor.
+extern unsigned int hostADCInput[16];
+
+// Seconds spent in __delay_cycles() so far. Tools can read and reset this as they like.
+extern double hostDelayedSeconds;
+
+// If set, called by __delay_cycles() with the seconds it's about to add to hostDelayedSeconds,
+// so that a tool can see what the pins are doing during delays (e.g. LED flashes)
+extern void (*hostDelayHook)(double seconds);
+
+// Conversions read from ADC10MEM so far, and the seconds they took: the sample and hold
+// time plus 13 clocks each, at the ADC clock selected by ADC10CTL0 and ADC10CTL1. Tools can
+// read and reset these as they like.
+extern unsigned long hostADCConversions;
+extern double hostADCSeconds;
+
+// Times the firmware has waited in a low power mode for an interrupt (__bis_SR_register()
+// with CPUOFF), which returns straight away on the host. Tools can read and reset this.
+extern unsigned long hostLPMWaits;
+
+// MCLK in Hz, from DCOCTL and BCSCTL1 compared with the (host) calibration values. Any
+// other setting is taken as the DCO at its slowest, as in snooze mode.
+unsigned long hostClockHz(void);
+
+// ACLK in Hz: the VLO (typically 12kHz, see SLAS723) divided as set by DIVA in BCSCTL1
+#define HOST_VLO_HZ			12000
+#define HOST_ADC10OSC_HZ	5000000
+double hostACLKHz(void);
+
+// Seconds from the watchdog being cleared to it resetting the MCU: 32768, 8192, 512 or 64
+// counts (WDTISx) of ACLK or SMCLK (WDTSSEL)
+double hostWatchdogSeconds(void);
+
+// Let the given seconds go by for Timer_A, counting ACLK or SMCLK (TASSELx, divided by IDx)
+// up to TACCR0 (MC_1) or to 0xFFFF (MC_2), so that firmware reading TAR sees time pass.
+// Also does TACLR, if the firmware has set it since.
+void hostTimerA(double seconds);
+
+// ADC10MEM, accounting for the conversion as above
+unsigned int hostADCRead(void);
+
+// Registers as after a reset, with the reset cause flags (e.g. PORIFG, WDTIFG) in IFG1
+void hostResetRegisters(unsigned char resetCause);
+
+void hostLPM3(void);
+
+// Calibration values in information memory of an ideal part: no ADC gain or offset error,
+// and typical temperature sensor readings at 30C and 85C (1.5V and 2.5V references, see SLAS723).
+#define HOST_CALADC_25VREF_FACTOR	0x8000
+#define HOST_CALADC_GAIN_FACTOR		0x8000
+#define HOST_CALADC_OFFSET			0
+#define HOST_CALADC_15T30			745
+#define HOST_CALADC_15T85			878
+#define HOST_CALADC_25T30			447
+#define HOST_CALADC_25T85			527
+
+#endif /* HOST_MSP430_HOST_H_ */
@@ -0,0 +1,191 @@
+/*
+ * msp430.h (host version)
+ *
+ * Stands in for TI's msp430.h so that the firmware sources can be compiled and run on a PC
+ * by the tools in "02 Firmware/Tools". Put this directory on the include path ahead of any
+ * real MSP430 headers (-I"02 Firmware/Tools/Host").
+ *
+ * Registers are plain variables, defined in hostMSP430.cpp, with these exceptions:
+ *  - ADC10MEM returns hostADCInput[] for the channel selected in ADC10CTL1 (INCHx), so the
+ *    tool decides what each conversion returns, and counts the conversion and its time.
+ *    ADC10BUSY is never set, and nor is ADC10IFG by conversions that Timer_A should start
+ *    (SHS_1 to SHS_3), which never happen, so the firmware's waits for them time out.
+ *  - LPM3 throws HostSleep (the firmware only enters LPM3 to wait for the watchdog to
+ *    reset it), for the tool to catch and then boot the firmware again.
+ *  - __delay_cycles() adds the time it would have taken to hostDelayedSeconds, at the
+ *    clock speed that DCOCTL and BCSCTL1 are set to, rather than waiting.
+ *  - __bis_SR_register() returns straight away, as if an interrupt had woken the CPU, but
+ *    counts the waits in a low power mode.
+ * See hostMSP430.h for these and the calibration values in information memory.
+ * Only the registers and bits that the firmware uses are here; add more as needed, with
+ * the values from TI's msp430g2332.h.
+ *
+ * The firmware keeps thresholds above 127 in plain char variables, so host builds should
+ * use -funsigned-char. int is 32 bits on the host, rather than 16, which the firmware's
+ * arithmetic doesn't rely on.
+ */
+
+#ifndef HOST_MSP430_H_
+#define HOST_MSP430_H_
+
+// Special function registers
+extern volatile unsigned char IE1, IFG1;
+// Ports
+extern volatile unsigned char P1IN, P1OUT, P1DIR, P1IFG, P1IES, P1IE, P1SEL, P1SEL2, P1REN;
+extern volatile unsigned char P2IN, P2OUT, P2DIR, P2IFG, P2IES, P2IE, P2SEL, P2SEL2, P2REN;
+// Basic clock system, and its calibration values in information memory
+extern volatile unsigned char DCOCTL, BCSCTL1, BCSCTL2, BCSCTL3;
+extern volatile unsigned char CALDCO_1MHZ, CALBC1_1MHZ, CALDCO_8MHZ, CALBC1_8MHZ;
+extern volatile unsigned char CALDCO_12MHZ, CALBC1_12MHZ, CALDCO_16MHZ, CALBC1_16MHZ;
+// ADC10
+extern volatile unsigned int ADC10CTL0, ADC10CTL1;
+extern volatile unsigned char ADC10AE0, ADC10DTC0, ADC10DTC1;
+extern volatile unsigned int ADC10SA;
+#define ADC10MEM	hostADCRead()
+// Timer_A
+extern volatile unsigned int TACTL, TACCTL0, TACCTL1, TACCR0, TACCR1, TAR, TAIV;
+// Watchdog and flash controller
+extern volatile unsigned int WDTCTL, FCTL1, FCTL2, FCTL3;
+
+#define BIT0		0x0001
+#define BIT1		0x0002
+#define BIT2		0x0004
+#define BIT3		0x0008
+#define BIT4		0x0010
+#define BIT5		0x0020
+#define BIT6		0x0040
+#define BIT7		0x0080
+#define BIT8		0x0100
+#define BIT9		0x0200
+#define BITA		0x0400
+#define BITB		0x0800
+#define BITC		0x1000
+#define BITD		0x2000
+#define BITE		0x4000
+#define BITF		0x8000
+
+// Status register
+#define GIE			0x0008
+#define CPUOFF		0x0010
+#define OSCOFF		0x0020
+#define SCG0		0x0040
+#define SCG1		0x0080
+#define LPM0_bits	(CPUOFF)
+#define LPM3_bits	(SCG1 + SCG0 + CPUOFF)
+#define LPM3		hostLPM3()
+
+// IE1/IFG1
+#define WDTIE		0x01
+#define WDTIFG		0x01
+#define OFIFG		0x02
+#define PORIFG		0x04
+#define RSTIFG		0x08
+#define NMIIFG		0x10
+
+// Basic clock system
+#define XT2OFF		0x80
+#define DIVA_0		0x00
+#define DIVA_1		0x10
+#define DIVA_2		0x20
+#define DIVA_3		0x30
+#define SELM_0		0x00
+#define SELM_3		0xC0
+#define DIVM_0		0x00
+#define DIVS_0		0x00
+#define DIVS_1		0x02
+#define DIVS_2		0x04
+#define DIVS_3		0x06
+#define LFXT1S_2	0x20
+
+// ADC10CTL0
+#define ADC10SC		0x0001
+#define ENC			0x0002
+#define ADC10IFG	0x0004
+#define ADC10IE		0x0008
+#define ADC10ON		0x0010
+#define REFON		0x0020
+#define REF2_5V		0x0040
+#define MSC			0x0080
+#define REFBURST	0x0100
+#define REFOUT		0x0200
+#define ADC10SR		0x0400
+#define ADC10SHT_0	0x0000
+#define ADC10SHT_1	0x0800
+#define ADC10SHT_2	0x1000
+#define ADC10SHT_3	0x1800
+#define SREF_0		0x0000
+#define SREF_1		0x2000
+// ADC10CTL1
+#define ADC10BUSY	0x0001
+#define CONSEQ_0	0x0000
+#define CONSEQ_1	0x0002
+#define CONSEQ_2	0x0004
+#define CONSEQ_3	0x0006
+#define ADC10SSEL_0	0x0000
+#define ADC10SSEL_1	0x0008
+#define ADC10SSEL_2	0x0010
+#define ADC10SSEL_3	0x0018
+#define ADC10DIV_0	0x0000
+#define ADC10DIV_1	0x0020
+#define ADC10DIV_2	0x0040
+#define ADC10DIV_7	0x00E0
+#define ISSH		0x0100
+#define ADC10DF		0x0200
+#define SHS_0		0x0000
+#define SHS_1		0x0400
+#define SHS_2		0x0800
+#define SHS_3		0x0C00
+#define INCH_7		0x7000
+#define INCH_10		0xA000
+
+// Timer_A
+#define TAIFG		0x0001
+#define TAIE		0x0002
+#define TACLR		0x0004
+#define MC_0		0x0000
+#define MC_1		0x0010
+#define MC_2		0x0020
+#define MC_3		0x0030
+#define ID_0		0x0000
+#define ID_1		0x0040
+#define ID_2		0x0080
+#define ID_3		0x00C0
+#define TASSEL_1	0x0100
+#define TASSEL_2	0x0200
+#define CCIFG		0x0001
+#define OUT			0x0004
+#define CCIE		0x0010
+#define OUTMOD_0	0x0000
+#define OUTMOD_3	0x0060
+#define OUTMOD_7	0x00E0
+
+// Watchdog
+#define WDTPW		0x5A00
+#define WDTHOLD		0x0080
+#define WDTTMSEL	0x0010
+#define WDTCNTCL	0x0008
+#define WDTSSEL		0x0004
+#define WDTIS0		0x0001
+#define WDTIS1		0x0002
+
+// Flash controller
+#define FWKEY		0xA500
+#define ERASE		0x0002
+#define WRT			0x0040
+#define FSSEL_1		0x0040
+#define FSSEL_2		0x0080
+#define LOCK		0x0010
+#define BUSY		0x0001
+
+// Intrinsics
+#define __interrupt
+void __delay_cycles(unsigned long cycles);
+void __no_operation(void);
+void __enable_interrupt(void);
+void __disable_interrupt(void);
+void __bis_SR_register(unsigned int bits);
+void __bic_SR_register_on_exit(unsigned int bits);
+
+#include "hostMSP430.h"
+
+#endif /* HOST_MSP430_H_ */
@@ -0,0 +1,300 @@
+/*
+ * battery100Energy.cpp
+ *
+ * Energy profile of the Battery 100 firmware, built for the host (see Tools/Host): how much
+ * current each of its modes draws (awake at each clock speed, snoozing, asleep in LPM3 with
+ * the watchdog waking it, writing flash), and what that adds up to over a day. See
+ * energyModel.h for how the current is worked out.
+ *
+ * Build:	g++ -O2 -std=c++11 -funsigned-char -I../Host -o battery100Energy battery100Energy.cpp energyModel.cpp ../Host/battery100Host.cpp ../Host/hostMSP430.cpp
+ * Usage:	battery100Energy [-c loopCycles] [-b bootCycles] [-w seconds] [-v cellV] [-P PVV] [-p PVhours] [-e] [-n nights] [-s name=value ...] [-o profile.csv] [-k baseline.csv]
+ *
+ * The firmware runs through these windows, each for the given seconds of simulated time
+ * (-w, default 10) after some time to settle:
+ *  - day: PV at PVV volts (-P, default 18) and the cells at cellV volts (-v, default 3.30)
+ *  - night: no PV, so snoozing
+ *  - empty: no PV and the cells at 2.60V, so asleep and waking every watchdog period (from
+ *    the firmware's settings when it went to sleep, about 2.7s as usual) to check for PV, to
+ *    go straight back to sleep
+ * and the cold boot at the start gets a window of its own. A day is PVhours (-p, default 10)
+ * of the day window and the rest of the night window, or of the empty window with -e.
+ *
+ * With -n, the empty window is a whole night (24 - PVhours) instead, after that many nights
+ * asleep with empty cells, each ended by a dawn with PV for long enough to wake up. That's
+ * for enableWakeScheduling, which needs a night or two to learn from before it changes the
+ * watchdog period, and then changes it through the night. Timer_A is kept counting with the
+ * simulated time, as that's its clock while snoozing.
+ *
+ * The host doesn't count instructions, so the CPU is taken to run loopCycles (-c, default
+ * 1750) MCLK cycles per main loop, and bootCycles (-b, default 1000) per boot, besides
+ * waiting for the ADC and in __delay_cycles() (which the host does time). The defaults give
+ * the 4300 loops/s awake and 17 loops/s snoozing of the maxSnoozeTime comment in header.h;
+ * for a change to the firmware, take its cycles from msp430Bench, less readADCChannel()'s
+ * waits. Flash writes are found by comparing the host's information memory before and after.
+ *
+ * For a before and after, save a profile (-o) before the change, then build and run again
+ * with -k to compare against it. The firmware's optional features are as set in
+ * "Battery 100/header.h", so one of those can also be compared by building with -DenableX.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "battery100Host.h"
+#include "energyModel.h"
+
+#define settleSeconds	2.0		// Before accounting a window, for the averages to settle
+#define emptySettleSeconds	60.0	// ...and for the empty window, for the firmware to go to sleep
+#define emptyCellV		2.60
+
+static EnergyAccount *account;
+static std::string window;			// Empty while settling, so nothing is accounted
+static unsigned long loopCycles = 1750, bootCycles = 1000;
+static double cellV = 3.30, PVV = 18;
+static double now;					// Seconds of simulated time
+
+// What the pins are doing: the LEDs (P1.6 red, P2.7 green) and the bleed gates (P2.1 for
+// cell 1, active low, and P2.5, P2.4 and P2.2 for cells 2 to 4, through the pull resistors)
+static Outputs outputs(void) {
+	Outputs o;
+	o.leds = ( (P1DIR & P1OUT & BIT6) != 0 ) + ( (P2DIR & P2OUT & BIT7) != 0 );
+	o.bleeders = ( (P2DIR & BIT1) && !(P2OUT & BIT1) ) + ( (P2OUT & BIT5) != 0 ) + ( (P2OUT & BIT4) != 0 ) + ( (P2OUT & BIT2) != 0 );
+	return o;
+}
+
+static std::string awakeMode(void) {
+	if (P2SEL == 0 && hostClockHz() < 1000000)
+		return "snooze";
+	return awakeModeName(hostClockHz());
+}
+
+// Called by __delay_cycles(), so that LED flashes are accounted with the LEDs as they are
+static void delayHook(double seconds) {
+	now += seconds;
+	hostTimerA(seconds);
+	if (!window.empty())
+		account->awake(window, awakeMode(), hostClockHz(), seconds, 0, (ADC10CTL0 & REFON) != 0, outputs());
+}
+
+static void setInputs(double cell, double pv) {
+	for (int i = 0; i < 4; i++)
+		hostADCInput[(int) ADC_CH_numbers[i]] = (i + 1) * cell * 100 / C_CELL + 0.5;
+	hostADCInput[PV] = pv * 100 / C_PV + 0.5;
+	hostADCInput[DISCURRENT] = 4 * cell * 100 / C_CELL + 0.5;
+}
+
+// Information memory, to spot flash erases and writes
+struct InfoMemory {
+	unsigned int maxTemp;
+	char testResult[64];
+	unsigned int dividerCal[32];
+};
+
+static InfoMemory infoMemory(void) {
+	InfoMemory m;
+	m.maxTemp = hostMaxTempFlash;
+	memcpy(m.testResult, hostTestResult, sizeof(m.testResult));
+	memcpy(m.dividerCal, hostDividerCal, sizeof(m.dividerCal));
+	return m;
+}
+
+// Count the segments erased (a bit went from 0 to 1) and words written between before and after
+static void countSegment(const unsigned char *before, const unsigned char *after, size_t bytes, unsigned int &erases, unsigned int &words) {
+	bool erased = false;
+	unsigned int written = 0;
+	for (size_t i = 0; i < bytes; i += 2) {
+		unsigned int b = before[i] | before[i + 1] << 8, a = after[i] | after[i + 1] << 8;
+		if (~b & a)
+			erased = true;
+		if (a != b && a != 0xFFFF)
+			written++;
+	}
+	if (erased) {
+		erases++;
+		// Everything not left erased had to be written again
+		written = 0;
+		for (size_t i = 0; i < bytes; i += 2)
+			if ( (after[i] | after[i + 1] << 8) != 0xFFFF )
+				written++;
+	}
+	words += written;
+}
+
+static void accountFlash(const InfoMemory &before) {
+	InfoMemory after = infoMemory();
+	unsigned int erases = 0, words = 0;
+	countSegment((const unsigned char *) &before.maxTemp, (const unsigned char *) &after.maxTemp, sizeof(after.maxTemp), erases, words);
+	countSegment((const unsigned char *) before.testResult, (const unsigned char *) after.testResult, sizeof(after.testResult), erases, words);
+	countSegment((const unsigned char *) before.dividerCal, (const unsigned char *) after.dividerCal, sizeof(after.dividerCal), erases, words);
+	if ( (erases || words) && !window.empty() ) {
+		// The flash timing generator, from MCLK (FSSEL_1) or SMCLK (FSSEL_2) divided by FN0-5 + 1
+		double ftgHz = (double) hostClockHz() / ( (FCTL2 & 0x3F) + 1 );
+		if ( (FCTL2 & 0xC0) == FSSEL_2 )
+			ftgHz /= 1 << ((BCSCTL2 >> 1) & 3);
+		account->flash(window, hostClockHz(), ftgHz, erases, words);
+		now += (4819.0 * erases + 30.0 * words) / ftgHz;
+	}
+}
+
+// Account a stretch of firmware run with the CPU on, cycles at the clock it ended on, plus the
+// ADC waits. Delays have already been accounted by delayHook().
+static void accountAwake(unsigned long cycles, double adcSecondsBefore, bool refOn) {
+	double adcSeconds = hostADCSeconds - adcSecondsBefore;
+	double cpuSeconds = (double) cycles / hostClockHz() + adcSeconds;
+	now += cpuSeconds;
+	hostTimerA(cpuSeconds);
+	if (!window.empty())
+		account->awake(window, awakeMode(), hostClockHz(), cpuSeconds, adcSeconds, refOn, outputs());
+}
+
+// Sleep for the watchdog period, then boot until either back to sleep or in the main loop.
+// Returns true if asleep again.
+static bool sleepAndWake(void) {
+	double period = hostWatchdogSeconds();
+	if (!window.empty())
+		account->asleep(window, "sleep", period, outputs());
+	now += period;
+	battery100Reset(WDTIFG);
+	InfoMemory flashBefore = infoMemory();
+	double adcBefore = hostADCSeconds;
+	bool asleep = false;
+	try {
+		battery100Boot();
+	}
+	catch (HostSleep &) {
+		asleep = true;
+	}
+	// The reference is on from initialiseADC() until backToSleep()
+	accountAwake(bootCycles, adcBefore, true);
+	accountFlash(flashBefore);
+	return asleep;
+}
+
+// Run the firmware for the given seconds of simulated time, starting awake or asleep. Returns
+// whether it's asleep at the end.
+static bool run(double seconds, bool asleep) {
+	double end = now + seconds;
+	while (now < end) {
+		if (asleep) {
+			asleep = sleepAndWake();
+			continue;
+		}
+		InfoMemory flashBefore = infoMemory();
+		double adcBefore = hostADCSeconds;
+		try {
+			battery100Loop(0);
+		}
+		catch (HostSleep &) {
+			asleep = true;
+		}
+		accountAwake(loopCycles, adcBefore, (ADC10CTL0 & REFON) != 0);
+		accountFlash(flashBefore);
+	}
+	return asleep;
+}
+
+static bool runWindow(const char *name, double settle, double seconds, bool asleep) {
+	window.clear();
+	asleep = run(settle, asleep);
+	window = name;
+	return run(seconds, asleep);
+}
+
+int main(int argc, char *argv[]) {
+	CurrentFigures figures = defaultCurrentFigures();
+	double windowSeconds = 10, PVhours = 10;
+	bool emptyNights = false;
+	int learnNights = 0;
+	const char *outPath = NULL, *baselinePath = NULL;
+	bool usage = false;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-c") && i + 1 < argc)
+			loopCycles = strtoul(argv[++i], NULL, 0);
+		else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+			bootCycles = strtoul(argv[++i], NULL, 0);
+		else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+			windowSeconds = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-v") && i + 1 < argc)
+			cellV = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-P") && i + 1 < argc)
+			PVV = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+			PVhours = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-e"))
+			emptyNights = true;
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			learnNights = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc && setCurrentFigure(figures, argv[i + 1]))
+			i++;
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			outPath = argv[++i];
+		else if (!strcmp(argv[i], "-k") && i + 1 < argc)
+			baselinePath = argv[++i];
+		else
+			usage = true;
+	}
+	if (usage || windowSeconds <= 0 || PVhours < 0 || PVhours > 24 || loopCycles == 0 || learnNights < 0) {
+		fprintf(stderr, "Usage: %s [-c loopCycles] [-b bootCycles] [-w seconds] [-v cellV] [-P PVV] [-p PVhours] [-e] [-n nights] [-s name=value ...] [-o profile.csv] [-k baseline.csv]\n", argv[0]);
+		return 1;
+	}
+	EnergyAccount energy(figures);
+	account = &energy;
+	hostDelayHook = delayHook;
+
+	// Cold boot, with PV so that it wakes up fully
+	battery100Reset(PORIFG);
+	setInputs(cellV, PVV);
+	window = "boot";
+	InfoMemory flashBefore = infoMemory();
+	bool asleep = false;
+	try {
+		battery100Boot();
+	}
+	catch (HostSleep &) {
+		asleep = true;
+	}
+	accountAwake(bootCycles, 0, true);
+	accountFlash(flashBefore);
+
+	asleep = runWindow("day", settleSeconds, windowSeconds, asleep);
+	setInputs(cellV, 0);
+	asleep = runWindow("night", settleSeconds, windowSeconds, asleep);
+	setInputs(emptyCellV, 0);
+	if (learnNights) {
+		// Nights to learn from, each from dusk (PV gone, into the night window) to dawn
+		double nightSeconds = (24 - PVhours) * 3600;
+		window.clear();
+		for (int i = 0; i < learnNights; i++) {
+			asleep = run(nightSeconds, asleep);
+			setInputs(emptyCellV, PVV);
+			asleep = run(settleSeconds, asleep);
+			setInputs(emptyCellV, 0);
+		}
+		window = "empty";
+		run(nightSeconds, asleep);
+	}
+	else
+		runWindow("empty", emptySettleSeconds, windowSeconds < 30 ? 30 : windowSeconds, asleep);
+
+	printCurrentFigures(figures);
+	printf("Loop %lu cycles, boot %lu cycles, cells %.2fV, PV %.1fV, %lu ADC conversions, %.0fs simulated\n\n", loopCycles, bootCycles, cellV, PVV, hostADCConversions, now);
+	energy.printModes();
+	std::vector<DayPart> day;
+	DayPart part = {"day", PVhours};
+	day.push_back(part);
+	part.window = emptyNights ? "empty" : "night";
+	part.hours = 24 - PVhours;
+	day.push_back(part);
+	energy.printDay(day);
+	if (outPath && !energy.writeCSV(outPath, day)) {
+		fprintf(stderr, "Can't write %s\n", outPath);
+		return 1;
+	}
+	if (baselinePath && !energy.compare(baselinePath, day)) {
+		fprintf(stderr, "Can't read %s\n", baselinePath);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * chargerEnergy.cpp
+ *
+ * Energy profile of the Charger firmware, built for the host (see Tools/Host/chargerHost.h),
+ * as battery100Energy.cpp does for the Battery 100: how much current it draws at rest,
+ * charging and with the battery full, and what that adds up to over a day. See
+ * energyModel.h for how the current is worked out.
+ *
+ * Build:	g++ -O2 -std=c++11 -funsigned-char -I../Host -o chargerEnergy chargerEnergy.cpp energyModel.cpp ../Host/chargerHost.cpp ../Host/hostMSP430.cpp
+ * Usage:	chargerEnergy [-c loopCycles] [-w seconds] [-a batteryADC] [-p chargingHours] [-f fullHours] [-s name=value ...] [-o profile.csv] [-k baseline.csv]
+ *
+ * The firmware runs through these windows, each for the given seconds of simulated time
+ * (-w, default 10) after a second to settle, with the battery voltage reading batteryADC
+ * (-a, default 500, above restartDischV_uncalib) and the fuses untripped:
+ *  - rest: STAT1 and STAT2 high, the charge controller idle
+ *  - charging: STAT1 low
+ *  - full: STAT2 low
+ * and the boot at the start (with its LED flashes) gets a window of its own. A day is
+ * chargingHours (-p, default 6) of charging, fullHours (-f, default 2) full, and the rest
+ * at rest.
+ *
+ * As in battery100Energy.cpp, the CPU is taken to run loopCycles (-c, default 300) MCLK
+ * cycles per main loop besides waiting for the ADC and in __delay_cycles(); take the real
+ * figure from msp430Bench. With enableSleepBetweenEvents, each wait for an event is taken to
+ * last until the next timer tick (sampleTickPeriod ACLK counts), as nothing else happens.
+ * For a before and after, save a profile (-o) before the change, then run again with -k,
+ * e.g. built without and then with -DenableSleepBetweenEvents.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "chargerHost.h"
+#include "energyModel.h"
+
+#define settleSeconds	1.0		// Before accounting a window
+
+static EnergyAccount *account;
+static std::string window;			// Empty while settling, so nothing is accounted
+static unsigned long loopCycles = 300;
+static double now;					// Seconds of simulated time
+
+// What the pins are doing: the LEDs (P1.6 green, P1.7 red), and no bleeders
+static Outputs outputs(void) {
+	Outputs o;
+	o.leds = ( (P1DIR & P1OUT & BIT6) != 0 ) + ( (P1DIR & P1OUT & BIT7) != 0 );
+	o.bleeders = 0;
+	return o;
+}
+
+// Called by __delay_cycles(), so that LED flashes are accounted with the LEDs as they are
+static void delayHook(double seconds) {
+	now += seconds;
+	if (!window.empty())
+		account->awake(window, awakeModeName(hostClockHz()), hostClockHz(), seconds, 0, (ADC10CTL0 & REFON) != 0, outputs());
+}
+
+// Account a stretch of firmware run with the CPU on, as in battery100Energy.cpp
+static void accountAwake(unsigned long cycles, double adcSecondsBefore, bool refOn) {
+	double adcSeconds = hostADCSeconds - adcSecondsBefore;
+	double cpuSeconds = (double) cycles / hostClockHz() + adcSeconds;
+	now += cpuSeconds;
+	if (!window.empty())
+		account->awake(window, awakeModeName(hostClockHz()), hostClockHz(), cpuSeconds, adcSeconds, refOn, outputs());
+}
+
+static void run(double seconds) {
+	double end = now + seconds;
+	while (now < end) {
+		double adcBefore = hostADCSeconds;
+		unsigned long waitsBefore = hostLPMWaits;
+		// The reference is on for the loop's conversions, even if it's been switched off to sleep since
+		chargerLoop();
+		accountAwake(loopCycles, adcBefore, true);
+		if (hostLPMWaits != waitsBefore) {
+#ifdef enableSleepBetweenEvents
+			double tick = sampleTickPeriod / hostACLKHz();
+#else
+			double tick = 0;
+#endif
+			if (!window.empty())
+				account->asleep(window, "sleep", tick, outputs());
+			now += tick;
+		}
+	}
+}
+
+static void runWindow(const char *name, double seconds) {
+	window.clear();
+	run(settleSeconds);
+	window = name;
+	run(seconds);
+}
+
+int main(int argc, char *argv[]) {
+	CurrentFigures figures = defaultCurrentFigures();
+	double windowSeconds = 10, chargingHours = 6, fullHours = 2;
+	unsigned int batteryADC = 500;
+	const char *outPath = NULL, *baselinePath = NULL;
+	bool usage = false;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-c") && i + 1 < argc)
+			loopCycles = strtoul(argv[++i], NULL, 0);
+		else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+			windowSeconds = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-a") && i + 1 < argc)
+			batteryADC = strtoul(argv[++i], NULL, 0);
+		else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+			chargingHours = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+			fullHours = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc && setCurrentFigure(figures, argv[i + 1]))
+			i++;
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			outPath = argv[++i];
+		else if (!strcmp(argv[i], "-k") && i + 1 < argc)
+			baselinePath = argv[++i];
+		else
+			usage = true;
+	}
+	if (usage || windowSeconds <= 0 || chargingHours < 0 || fullHours < 0 || chargingHours + fullHours > 24 || loopCycles == 0) {
+		fprintf(stderr, "Usage: %s [-c loopCycles] [-w seconds] [-a batteryADC] [-p chargingHours] [-f fullHours] [-s name=value ...] [-o profile.csv] [-k baseline.csv]\n", argv[0]);
+		return 1;
+	}
+	EnergyAccount energy(figures);
+	account = &energy;
+	hostDelayHook = delayHook;
+
+	chargerReset(PORIFG);
+	chargerIdleInputs();
+	hostADCInput[BATTV_PIN] = batteryADC;
+	hostADCInput[REF1V_PIN] = hostADCInput[CURRENTV_PIN] = 1023 / 2.5;		// 1V, and no current
+	window = "boot";
+	chargerBoot();
+	accountAwake(loopCycles, 0, true);
+
+	runWindow("rest", windowSeconds);
+	P2IN &= ~BIT2;		// STAT1 low, charging
+	runWindow("charging", windowSeconds);
+	P2IN |= BIT2;
+	P2IN &= ~BIT1;		// STAT2 low, full
+	runWindow("full", windowSeconds);
+
+	printCurrentFigures(figures);
+	printf("Loop %lu cycles, battery %u, %lu ADC conversions, %.0fs simulated\n\n", loopCycles, batteryADC, hostADCConversions, now);
+	energy.printModes();
+	std::vector<DayPart> day;
+	DayPart part = {"charging", chargingHours};
+	day.push_back(part);
+	part.window = "full";
+	part.hours = fullHours;
+	day.push_back(part);
+	part.window = "rest";
+	part.hours = 24 - chargingHours - fullHours;
+	day.push_back(part);
+	energy.printDay(day);
+	if (outPath && !energy.writeCSV(outPath, day)) {
+		fprintf(stderr, "Can't write %s\n", outPath);
+		return 1;
+	}
+	if (baselinePath && !energy.compare(baselinePath, day)) {
+		fprintf(stderr, "Can't read %s\n", baselinePath);
+		return 1;
+	}
+	return 0;
+}
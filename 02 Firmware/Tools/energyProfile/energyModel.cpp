@@ -0,0 +1,233 @@
+/*
+ * energyModel.cpp
+ *
+ * See energyModel.h
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include "energyModel.h"
+
+static const char *componentNames[components] = {"mcu", "adc", "ref", "flash", "leds", "bleed", "board"};
+
+CurrentFigures defaultCurrentFigures(void) {
+	CurrentFigures figures;
+	figures.activeUAPerMHz = 300;		// SLAS723, 3V
+	figures.lpm3UA = 0.5;				// SLAS723, 3V
+	figures.adcUA = 600;				// SLAS723, ADC10ON, REFON = 0
+	figures.refUA = 250;				// SLAS723, REF2_5V
+	figures.flashUA = 1000;				// SLAS723, typical (up to 5mA programming, 7mA erasing)
+	figures.ledUA = 2000;				// As LEDCurrent in thresholdSweep/plantModel.cpp
+	figures.bleedUA = 100000;			// As bleedCurrent in thresholdSweep/plantModel.cpp
+	figures.boardUA = 20;				// The potential dividers, as sleepCurrent in thresholdSweep/plantModel.cpp
+	return figures;
+}
+
+struct FigureName {
+	const char *name;
+	double CurrentFigures::*figure;
+};
+
+static const FigureName figureNames[] = {
+	{"activeUAPerMHz", &CurrentFigures::activeUAPerMHz},
+	{"lpm3UA", &CurrentFigures::lpm3UA},
+	{"adcUA", &CurrentFigures::adcUA},
+	{"refUA", &CurrentFigures::refUA},
+	{"flashUA", &CurrentFigures::flashUA},
+	{"ledUA", &CurrentFigures::ledUA},
+	{"bleedUA", &CurrentFigures::bleedUA},
+	{"boardUA", &CurrentFigures::boardUA},
+};
+
+bool setCurrentFigure(CurrentFigures &figures, const char *assignment) {
+	const char *equals = strchr(assignment, '=');
+	if (!equals)
+		return false;
+	for (const FigureName &f : figureNames) {
+		if (strlen(f.name) == (size_t) (equals - assignment) && !strncmp(f.name, assignment, equals - assignment)) {
+			figures.*f.figure = atof(equals + 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+void printCurrentFigures(const CurrentFigures &figures) {
+	printf("Current figures (-s name=value to change):");
+	for (const FigureName &f : figureNames)
+		printf(" %s=%g", f.name, figures.*f.figure);
+	printf("\n\n");
+}
+
+std::string awakeModeName(unsigned long mclkHz) {
+	char mode[32];
+	if (mclkHz >= 1000000)
+		sprintf(mode, "awake %luMHz", mclkHz / 1000000);
+	else
+		sprintf(mode, "awake %lukHz", mclkHz / 1000);
+	return mode;
+}
+
+ModeTotals &EnergyAccount::totals(const std::string &window, const std::string &mode) {
+	for (ModeTotals &t : modes)
+		if (t.window == window && t.mode == mode)
+			return t;
+	ModeTotals t = {window, mode, 0, {0}};
+	modes.push_back(t);
+	return modes.back();
+}
+
+void EnergyAccount::addOutputs(ModeTotals &t, double seconds, const Outputs &outputs) {
+	t.charge[LEDS] += outputs.leds * figures.ledUA * seconds;
+	t.charge[BLEED] += outputs.bleeders * figures.bleedUA * seconds;
+	t.charge[BOARD] += figures.boardUA * seconds;
+	t.seconds += seconds;
+}
+
+void EnergyAccount::awake(const std::string &window, const std::string &mode, unsigned long mclkHz, double cpuSeconds, double adcSeconds, bool refOn, const Outputs &outputs) {
+	ModeTotals &t = totals(window, mode);
+	t.charge[MCU] += figures.activeUAPerMHz * mclkHz / 1e6 * cpuSeconds;
+	t.charge[ADC] += figures.adcUA * adcSeconds;
+	if (refOn)
+		t.charge[REF] += figures.refUA * cpuSeconds;
+	addOutputs(t, cpuSeconds, outputs);
+}
+
+void EnergyAccount::asleep(const std::string &window, const std::string &mode, double seconds, const Outputs &outputs) {
+	ModeTotals &t = totals(window, mode);
+	t.charge[MCU] += figures.lpm3UA * seconds;
+	addOutputs(t, seconds, outputs);
+}
+
+void EnergyAccount::flash(const std::string &window, unsigned long mclkHz, double ftgHz, unsigned int erases, unsigned int words) {
+	ModeTotals &t = totals(window, "flash");
+	double seconds = (4819.0 * erases + 30.0 * words) / ftgHz;
+	t.charge[MCU] += figures.activeUAPerMHz * mclkHz / 1e6 * seconds;
+	t.charge[FLASH] += figures.flashUA * seconds;
+	Outputs none = {0, 0};
+	addOutputs(t, seconds, none);
+}
+
+double EnergyAccount::windowSeconds(const std::string &window) const {
+	double seconds = 0;
+	for (const ModeTotals &t : modes)
+		if (t.window == window)
+			seconds += t.seconds;
+	return seconds;
+}
+
+static double totalCharge(const ModeTotals &t) {
+	double charge = 0;
+	for (int c = 0; c < components; c++)
+		charge += t.charge[c];
+	return charge;
+}
+
+void EnergyAccount::printModes(void) const {
+	printf("%-10s %-12s %10s %7s %10s", "window", "mode", "time (s)", "share", "avg (uA)");
+	for (int c = 0; c < components; c++)
+		printf(" %9s", componentNames[c]);
+	printf("\n");
+	for (const ModeTotals &t : modes) {
+		if (t.seconds <= 0)
+			continue;
+		printf("%-10s %-12s %10.4f %6.2f%% %10.2f", t.window.c_str(), t.mode.c_str(), t.seconds, 100 * t.seconds / windowSeconds(t.window), totalCharge(t) / t.seconds);
+		for (int c = 0; c < components; c++)
+			printf(" %9.2f", t.charge[c] / t.seconds);
+		printf("\n");
+	}
+	printf("\n");
+}
+
+double EnergyAccount::dayPartMAh(const DayPart &part) const {
+	double seconds = windowSeconds(part.window);
+	if (seconds <= 0)
+		return 0;
+	double charge = 0;
+	for (const ModeTotals &t : modes)
+		if (t.window == part.window)
+			charge += totalCharge(t);
+	return charge / seconds * part.hours / 1000;	// uA * hours -> mAh
+}
+
+double EnergyAccount::printDay(const std::vector<DayPart> &day) const {
+	printf("%-10s %8s %10s %12s\n", "window", "hours", "avg (uA)", "mAh per day");
+	double total = 0, hours = 0;
+	for (const DayPart &part : day) {
+		double mAh = dayPartMAh(part);
+		printf("%-10s %8.2f %10.2f %12.4f\n", part.window.c_str(), part.hours, part.hours > 0 ? mAh * 1000 / part.hours : 0, mAh);
+		total += mAh;
+		hours += part.hours;
+	}
+	printf("%-10s %8.2f %10.2f %12.4f\n\n", "total", hours, hours > 0 ? total * 1000 / hours : 0, total);
+	return total;
+}
+
+bool EnergyAccount::writeCSV(const char *path, const std::vector<DayPart> &day) const {
+	FILE *f = fopen(path, "w");
+	if (!f)
+		return false;
+	fprintf(f, "kind,window,mode,seconds,uA");
+	for (int c = 0; c < components; c++)
+		fprintf(f, ",%s", componentNames[c]);
+	fprintf(f, "\n");
+	for (const ModeTotals &t : modes) {
+		if (t.seconds <= 0)
+			continue;
+		fprintf(f, "mode,%s,%s,%.6f,%.6f", t.window.c_str(), t.mode.c_str(), t.seconds, totalCharge(t) / t.seconds);
+		for (int c = 0; c < components; c++)
+			fprintf(f, ",%.6f", t.charge[c] / t.seconds);
+		fprintf(f, "\n");
+	}
+	// For days, the hours go in the seconds column and the mAh in the uA column
+	for (const DayPart &part : day)
+		fprintf(f, "day,%s,,%.6f,%.6f\n", part.window.c_str(), part.hours, dayPartMAh(part));
+	fclose(f);
+	return true;
+}
+
+static void printChange(const char *window, const char *mode, double before, double after, const char *units) {
+	printf("%-10s %-12s %12.4f %12.4f %12.4f", window, mode, before, after, after - before);
+	if (before > 0)
+		printf(" %+8.1f%%", 100 * (after - before) / before);
+	printf(" %s\n", units);
+}
+
+bool EnergyAccount::compare(const char *baselinePath, const std::vector<DayPart> &day) const {
+	FILE *f = fopen(baselinePath, "r");
+	if (!f)
+		return false;
+	// window/mode -> uA, and window -> mAh per day
+	std::map<std::string, double> beforeModes, beforeDay;
+	char line[512];
+	while (fgets(line, sizeof(line), f)) {
+		char kind[16], window[64], mode[64];
+		double seconds, value;
+		if (sscanf(line, "%15[^,],%63[^,],%63[^,],%lf,%lf", kind, window, mode, &seconds, &value) == 5 && !strcmp(kind, "mode"))
+			beforeModes[std::string(window) + "/" + mode] = value;
+		else if (sscanf(line, "%15[^,],%63[^,],,%lf,%lf", kind, window, &seconds, &value) == 4 && !strcmp(kind, "day"))
+			beforeDay[window] = value;
+	}
+	fclose(f);
+	printf("Compared with %s:\n%-10s %-12s %12s %12s %12s\n", baselinePath, "window", "mode", "before", "after", "change");
+	for (const ModeTotals &t : modes) {
+		if (t.seconds <= 0)
+			continue;
+		std::map<std::string, double>::const_iterator b = beforeModes.find(t.window + "/" + t.mode);
+		printChange(t.window.c_str(), t.mode.c_str(), b == beforeModes.end() ? 0 : b->second, totalCharge(t) / t.seconds, "uA");
+	}
+	double totalBefore = 0, totalAfter = 0;
+	for (const DayPart &part : day) {
+		std::map<std::string, double>::const_iterator b = beforeDay.find(part.window);
+		double before = (b == beforeDay.end()) ? 0 : b->second;
+		double after = dayPartMAh(part);
+		printChange(part.window.c_str(), "(day)", before, after, "mAh");
+		totalBefore += before;
+		totalAfter += after;
+	}
+	printChange("total", "(day)", totalBefore, totalAfter, "mAh");
+	printf("\n");
+	return true;
+}
@@ -0,0 +1,101 @@
+/*
+ * energyModel.h
+ *
+ * Turns what the firmware did on the host (see Tools/Host) into current drawn: time awake
+ * at each clock speed, ADC conversions, the reference, time in LPM3, flash erases and
+ * writes, and the LED and bleed outputs, each multiplied by a typical figure from the
+ * datasheet (SLAS723, at 3V) or the board. The figures are only typical, so the absolute
+ * numbers are rough, but a change that saves power shows up in the before and after.
+ *
+ * Everything is accounted against a window (a stretch of simulated time in one situation,
+ * e.g. daytime charging) and a mode within it (e.g. awake at 8MHz, or asleep). A day is
+ * then made up of windows, each scaled to so many hours.
+ */
+
+#ifndef ENERGYMODEL_H_
+#define ENERGYMODEL_H_
+
+#include <string>
+#include <vector>
+
+struct CurrentFigures {
+	double activeUAPerMHz;		// CPU active, per MHz of MCLK (I_AM,1MHz)
+	double lpm3UA;				// LPM3 with ACLK from the VLO (I_LPM3,VLO)
+	double adcUA;				// ADC10 core while converting (I_ADC10)
+	double refUA;				// Reference while REFON is set (I_REF+)
+	double flashUA;				// Flash erase or program (I_ERASE, I_PGM), on top of the CPU
+	double ledUA;				// Each LED when lit (board)
+	double bleedUA;				// Each cell's bleed resistor when on (board)
+	double boardUA;				// Always drawn: the potential dividers etc. (board)
+};
+
+CurrentFigures defaultCurrentFigures(void);
+
+// Set a figure from "name=value" (e.g. "bleedUA=80000"), returning false if there's no such figure
+bool setCurrentFigure(CurrentFigures &figures, const char *assignment);
+
+void printCurrentFigures(const CurrentFigures &figures);
+
+// What the outputs are doing, from the pins
+struct Outputs {
+	int leds;					// Number lit
+	int bleeders;				// Number on
+};
+
+// "awake 8MHz", "awake 100kHz" etc.
+std::string awakeModeName(unsigned long mclkHz);
+
+enum Component {MCU, ADC, REF, FLASH, LEDS, BLEED, BOARD, components};
+
+struct ModeTotals {
+	std::string window;
+	std::string mode;
+	double seconds;
+	double charge[components];	// uA.s
+};
+
+// Part of a day: the window, scaled to so many hours
+struct DayPart {
+	std::string window;
+	double hours;
+};
+
+class EnergyAccount {
+public:
+	EnergyAccount(const CurrentFigures &figures) : figures(figures) {}
+
+	// Time awake at mclkHz: cpuSeconds with the CPU running (including waiting for the ADC
+	// and in delays), of which adcSeconds converting
+	void awake(const std::string &window, const std::string &mode, unsigned long mclkHz, double cpuSeconds, double adcSeconds, bool refOn, const Outputs &outputs);
+
+	// Time in LPM3
+	void asleep(const std::string &window, const std::string &mode, double seconds, const Outputs &outputs);
+
+	// Segment erases and word writes, with the flash timing generator at ftgHz and the CPU
+	// held (but clocked) at mclkHz meanwhile: 4819 and 30 cycles of the generator (SLAS723)
+	void flash(const std::string &window, unsigned long mclkHz, double ftgHz, unsigned int erases, unsigned int words);
+
+	double windowSeconds(const std::string &window) const;
+
+	// Per mode within each window: time, average current and what it's made of
+	void printModes(void) const;
+
+	// Per day, from the windows, returning the total mAh
+	double printDay(const std::vector<DayPart> &day) const;
+
+	// As CSV: a line per mode (average uA of each component), then per day part (mAh)
+	bool writeCSV(const char *path, const std::vector<DayPart> &day) const;
+
+	// Before (a CSV from an earlier run) and after (this run), per mode and per day
+	bool compare(const char *baselinePath, const std::vector<DayPart> &day) const;
+
+private:
+	ModeTotals &totals(const std::string &window, const std::string &mode);
+	void addOutputs(ModeTotals &t, double seconds, const Outputs &outputs);
+	double dayPartMAh(const DayPart &part) const;
+
+	CurrentFigures figures;
+	std::vector<ModeTotals> modes;		// In the order first seen
+};
+
+#endif /* ENERGYMODEL_H_ */
@@ -0,0 +1,204 @@
+/*
+ * csvToTrace.cpp
+ *
+ * Converts a CSV log from a field unit into a field trace (see fieldTrace.h) for replay.
+ *
+ * Build:	g++ -O2 -o csvToTrace csvToTrace.cpp fieldTrace.cpp
+ * Usage:	csvToTrace [-a] [-s startTime] [-u tickMicroseconds] log.csv trace.ioft
+ *
+ * The first line names the columns, in any order (case doesn't matter, unknown ones are
+ * ignored):
+ *	time			Seconds, increasing (e.g. since the log started, or Unix time)
+ *	cell1..cell4	Cell voltages (V), cell 1 at the bottom of the stack
+ *	pv				Panel voltage after the diode (V)
+ *	fuse			Voltage downstream of the PTC fuse (V), the pack voltage if missing
+ *	temp			MCU temperature (C), optional
+ * Time and the cells and pv are needed. With -a, the values are already ADC readings of
+ * each channel (cell columns are then the tap readings, as the firmware reads them), and
+ * temp is the temperature sensor reading.
+ *
+ * Volts are converted with C_CELL and C_PV from header.h, and temperature with the typical
+ * sensor readings in hostMSP430.h, which the replay also uses.
+ *
+ * Times are stored as ticks from the first sample: milliseconds unless the log is too long
+ * for 32 bits (49 days), in which case seconds, or as set with -u. -s gives the Unix time
+ * of the first sample, if known.
+ */
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../../Battery 100/header.h"
+#include "../Host/hostMSP430.h"
+#include "fieldTrace.h"
+
+enum Column {TIME, CELL_1, CELL_2, CELL_3, CELL_4, PV_V, FUSE_V, TEMP_C, COLUMNS};
+static const char *columnNames[COLUMNS] = {"time", "cell1", "cell2", "cell3", "cell4", "pv", "fuse", "temp"};
+
+static unsigned short toADC(double value) {
+	long reading = lround(value);
+	return reading < 0 ? 0 : reading > 1023 ? 1023 : reading;
+}
+
+int main(int argc, char *argv[]) {
+	bool raw = false;
+	long long startTime = 0;
+	unsigned long tickMicroseconds = 0;
+	const char *paths[2] = {NULL, NULL};
+	int nPaths = 0;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-a"))
+			raw = true;
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+			startTime = atoll(argv[++i]);
+		else if (!strcmp(argv[i], "-u") && i + 1 < argc)
+			tickMicroseconds = strtoul(argv[++i], NULL, 0);
+		else if (nPaths < 2 && argv[i][0] != '-')
+			paths[nPaths++] = argv[i];
+		else
+			nPaths = 3;
+	}
+	if (nPaths != 2) {
+		fprintf(stderr, "Usage: %s [-a] [-s startTime] [-u tickMicroseconds] log.csv trace.ioft\n", argv[0]);
+		return 1;
+	}
+
+	FILE *f = fopen(paths[0], "r");
+	if (!f) {
+		fprintf(stderr, "Can't open %s\n", paths[0]);
+		return 1;
+	}
+	// Header: find which field each column is in
+	int field[COLUMNS];
+	for (int c = 0; c < COLUMNS; c++)
+		field[c] = -1;
+	std::string line;
+	int ch;
+	while ((ch = fgetc(f)) != EOF && ch != '\n')
+		line += (char) tolower(ch);
+	int nFields = 0;
+	for (size_t start = 0; start <= line.size(); nFields++) {
+		size_t end = line.find(',', start);
+		if (end == std::string::npos)
+			end = line.size();
+		std::string name;
+		for (size_t i = start; i < end; i++) {
+			if (!isspace((unsigned char) line[i]) && line[i] != '"')
+				name += line[i];
+		}
+		for (int c = 0; c < COLUMNS; c++) {
+			if (name == columnNames[c])
+				field[c] = nFields;
+		}
+		start = end + 1;
+	}
+	for (int c = TIME; c <= PV_V; c++) {
+		if (field[c] < 0) {
+			fprintf(stderr, "%s: no \"%s\" column\n", paths[0], columnNames[c]);
+			fclose(f);
+			return 1;
+		}
+	}
+
+	// Samples
+	std::vector<double> time;
+	std::vector<unsigned short> adc[COLUMNS];
+	std::vector<double> values(nFields);
+	char buffer[1024];
+	int lineNumber = 1;
+	while (fgets(buffer, sizeof(buffer), f)) {
+		lineNumber++;
+		char *p = buffer;
+		int n = 0;
+		for (; n < nFields; n++) {
+			char *end;
+			values[n] = strtod(p, &end);
+			if (end == p)
+				break;
+			p = strchr(end, ',');
+			if (!p) {
+				n++;
+				break;
+			}
+			p++;
+		}
+		bool complete = true;
+		for (int c = 0; c < COLUMNS; c++) {
+			if (field[c] >= n)
+				complete = false;
+		}
+		if (!complete) {
+			if (n > 0)
+				fprintf(stderr, "%s:%d: skipped (missing values)\n", paths[0], lineNumber);
+			continue;
+		}
+		double t = values[field[TIME]];
+		if (!time.empty() && t <= time.back()) {
+			fprintf(stderr, "%s:%d: time must increase\n", paths[0], lineNumber);
+			fclose(f);
+			return 1;
+		}
+		time.push_back(t);
+		if (raw) {
+			for (int c = CELL_1; c < COLUMNS; c++) {
+				if (field[c] >= 0)
+					adc[c].push_back(toADC(values[field[c]]));
+			}
+			if (field[FUSE_V] < 0)
+				adc[FUSE_V].push_back(adc[CELL_4].back());
+		}
+		else {
+			// Cells are read at the taps, i.e. stacked
+			double tap = 0;
+			for (int c = CELL_1; c <= CELL_4; c++) {
+				tap += values[field[c]];
+				adc[c].push_back(toADC(tap * 100 / C_CELL));
+			}
+			adc[PV_V].push_back(toADC(values[field[PV_V]] * 100 / C_PV));
+			adc[FUSE_V].push_back(field[FUSE_V] >= 0 ? toADC(values[field[FUSE_V]] * 100 / C_CELL) : adc[CELL_4].back());
+			if (field[TEMP_C] >= 0)
+				adc[TEMP_C].push_back(toADC((values[field[TEMP_C]] - 30) * (HOST_CALADC_15T85 - HOST_CALADC_15T30) / (85 - 30) + HOST_CALADC_15T30));
+		}
+	}
+	fclose(f);
+	if (time.empty()) {
+		fprintf(stderr, "%s: no samples\n", paths[0]);
+		return 1;
+	}
+
+	// Time base
+	double span = time.back() - time.front();
+	if (!tickMicroseconds)
+		tickMicroseconds = span * 1e3 < 4e9 ? 1000 : 1000000;
+	if (span * 1e6 / tickMicroseconds >= 4294967295.0) {
+		fprintf(stderr, "%s: %g s is too long for ticks of %lu us\n", paths[0], span, tickMicroseconds);
+		return 1;
+	}
+	std::vector<uint32_t> ticks(time.size());
+	for (size_t i = 0; i < time.size(); i++)
+		ticks[i] = (uint32_t) llround((time[i] - time.front()) * 1e6 / tickMicroseconds);
+
+	FieldTraceHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, fieldTraceMagic, 4);
+	header.version = fieldTraceVersion;
+	header.samples = time.size();
+	header.tickMicroseconds = tickMicroseconds;
+	header.startTime = startTime;
+	static const int channelIds[COLUMNS] = {0, CELL1, CELL2, CELL3, CELL4, PV, DISCURRENT, fieldTraceTemperature};
+	const uint16_t *columns[fieldTraceMaxChannels];
+	for (int c = CELL_1; c < COLUMNS; c++) {
+		if (adc[c].empty())
+			continue;
+		header.channelIds[header.channels] = channelIds[c];
+		columns[header.channels++] = &adc[c][0];
+	}
+	if (!writeFieldTrace(paths[1], header, &ticks[0], columns))
+		return 1;
+	printf("%s: %zu samples over %.0f s, %d channels, %lu us ticks\n", paths[1], time.size(), span, header.channels, tickMicroseconds);
+	return 0;
+}
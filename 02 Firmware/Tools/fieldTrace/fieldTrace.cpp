@@ -0,0 +1,105 @@
+/*
+ * fieldTrace.cpp
+ *
+ * See fieldTrace.h
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "fieldTrace.h"
+
+static size_t align8(size_t n) {
+	return (n + 7) & ~(size_t) 7;
+}
+
+size_t fieldTraceColumnOffset(const FieldTraceHeader &header, int column) {
+	size_t offset = sizeof(FieldTraceHeader);
+	if (column > 0)
+		offset += align8(header.samples * sizeof(uint32_t)) + (column - 1) * align8(header.samples * sizeof(uint16_t));
+	return offset;
+}
+
+bool writeFieldTrace(const char *path, const FieldTraceHeader &header, const uint32_t *time, const uint16_t *const *channel) {
+	FILE *f = fopen(path, "wb");
+	if (!f) {
+		fprintf(stderr, "Can't create %s\n", path);
+		return false;
+	}
+	static const char padding[8] = {0};
+	size_t timeBytes = header.samples * sizeof(uint32_t);
+	size_t channelBytes = header.samples * sizeof(uint16_t);
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	ok = ok && fwrite(time, 1, timeBytes, f) == timeBytes;
+	ok = ok && fwrite(padding, 1, align8(timeBytes) - timeBytes, f) == align8(timeBytes) - timeBytes;
+	for (int c = 0; c < header.channels; c++) {
+		ok = ok && fwrite(channel[c], 1, channelBytes, f) == channelBytes;
+		ok = ok && fwrite(padding, 1, align8(channelBytes) - channelBytes, f) == align8(channelBytes) - channelBytes;
+	}
+	if (fclose(f) != 0)
+		ok = false;
+	if (!ok)
+		fprintf(stderr, "Error writing %s\n", path);
+	return ok;
+}
+
+bool openFieldTrace(const char *path, FieldTrace &trace) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Can't open %s\n", path);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(FieldTraceHeader)) {
+		fprintf(stderr, "%s: too short to be a field trace\n", path);
+		close(fd);
+		return false;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Can't map %s\n", path);
+		return false;
+	}
+	// It's read straight through, once
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	memcpy(&trace.header, map, sizeof(trace.header));
+	const FieldTraceHeader &header = trace.header;
+	const char *problem = NULL;
+	if (memcmp(header.magic, fieldTraceMagic, 4) != 0)
+		problem = "not a field trace";
+	else if (header.version != fieldTraceVersion)
+		problem = "unknown version";
+	else if (header.channels > fieldTraceMaxChannels || header.tickMicroseconds == 0)
+		problem = "bad header";
+	else if (fieldTraceColumnOffset(header, header.channels + 1) > (size_t) st.st_size)
+		problem = "truncated";
+	if (problem) {
+		fprintf(stderr, "%s: %s\n", path, problem);
+		munmap(map, st.st_size);
+		return false;
+	}
+	trace.map = map;
+	trace.mapSize = st.st_size;
+	trace.time = (const uint32_t *) ((const char *) map + fieldTraceColumnOffset(header, 0));
+	for (int c = 0; c < fieldTraceMaxChannels; c++)
+		trace.channel[c] = c < header.channels ? (const uint16_t *) ((const char *) map + fieldTraceColumnOffset(header, c + 1)) : NULL;
+	return true;
+}
+
+void closeFieldTrace(FieldTrace &trace) {
+	if (trace.map)
+		munmap(trace.map, trace.mapSize);
+	trace.map = NULL;
+}
+
+const uint16_t *fieldTraceChannel(const FieldTrace &trace, int channelId) {
+	for (int c = 0; c < trace.header.channels; c++) {
+		if (trace.header.channelIds[c] == channelId)
+			return trace.channel[c];
+	}
+	return NULL;
+}
@@ -0,0 +1,64 @@
+/*
+ * fieldTrace.h
+ *
+ * A compact binary format for long logs from field units, in the units that the firmware
+ * sees: ADC readings. The file is laid out in columns so that it can be memory mapped and
+ * read straight through:
+ *
+ *   FieldTraceHeader		(64 bytes)
+ *   uint32 time[samples]	Ticks of tickMicroseconds since startTime
+ *   uint16 channel[samples]	One column per channel, in the order of channelIds
+ *
+ * Each column starts on an 8 byte boundary (padded with zeros). Everything is little
+ * endian. Channel ids are the ADC input channels (INCHx) that the readings are from, as
+ * in header.h, e.g. CELL1 = 3, PV = 4, and 10 for the internal temperature sensor. Cell
+ * channels are the tap voltages, as read, not the cell voltages.
+ */
+
+#ifndef FIELDTRACE_H_
+#define FIELDTRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define fieldTraceMagic			"IOFT"
+#define fieldTraceVersion		1
+#define fieldTraceMaxChannels	16
+#define fieldTraceTemperature	10		// Channel id of the internal temperature sensor
+
+struct FieldTraceHeader {
+	char magic[4];
+	uint16_t version;
+	uint16_t channels;
+	uint64_t samples;
+	uint32_t tickMicroseconds;			// e.g. 1000 for milliseconds
+	uint32_t reserved;
+	int64_t startTime;					// Unix time of tick 0 (s), or 0 if not known
+	uint8_t channelIds[fieldTraceMaxChannels];
+	uint8_t reserved2[16];
+};
+
+struct FieldTrace {
+	FieldTraceHeader header;
+	const uint32_t *time;
+	const uint16_t *channel[fieldTraceMaxChannels];
+	// Mapping, for closeFieldTrace()
+	void *map;
+	size_t mapSize;
+};
+
+// Byte offset of each column: the time column, then each channel
+size_t fieldTraceColumnOffset(const FieldTraceHeader &header, int column);
+
+// Write a trace. channel[c] holds the samples for channelIds[c]. Returns false with a
+// message on stderr on failure.
+bool writeFieldTrace(const char *path, const FieldTraceHeader &header, const uint32_t *time, const uint16_t *const *channel);
+
+// Memory map a trace for reading. Returns false with a message on stderr on failure.
+bool openFieldTrace(const char *path, FieldTrace &trace);
+void closeFieldTrace(FieldTrace &trace);
+
+// Column for a channel id, or NULL if the trace doesn't have it
+const uint16_t *fieldTraceChannel(const FieldTrace &trace, int channelId);
+
+#endif /* FIELDTRACE_H_ */
@@ -0,0 +1,215 @@
+/*
+ * replay.cpp
+ *
+ * Replays a field trace (see fieldTrace.h) through the Battery 100 firmware itself, built
+ * for the host (see Tools/Host), and records every change of state: batteryStatus,
+ * LEDStatus, the discharge gate, cell bleeding, snoozing, sleeping and booting.
+ *
+ * Build:	g++ -O2 -funsigned-char -I../Host -o replay replay.cpp fieldTrace.cpp ../Host/battery100Host.cpp ../Host/hostMSP430.cpp
+ * Usage:	replay [-l loopsPerSample | -t] [-r awakeLoopRate,snoozeLoopRate] [-o transitions.csv] trace.ioft
+ *
+ * Each sample's readings are what the ADC returns until the next sample. By default the
+ * firmware runs one main loop per sample (-l to change), which is quick, but note that
+ * anything the firmware counts in loops then counts samples instead: the rolling averages
+ * settle over tens of samples rather than milliseconds, and snoozing times out after
+ * maxSnoozeTime samples rather than 48 hours. With -t, the firmware runs as many loops as
+ * fit between samples at its real loop rates (default 4300/s awake, 16.95/s snoozing),
+ * which is exact but far slower for daytime logs.
+ *
+ * Time is tracked either way: blocking LED flashes (__delay_cycles) skip the samples they
+ * cover, and going to sleep skips the watchdog period (hostWatchdogSeconds(), from WDTCTL and
+ * the ACLK divider as the firmware left them: 32768 VLO counts, about 2.7 s, unless it's
+ * stretched deep in the night with enableWakeSchedule) before booting again, with NOINIT RAM
+ * kept. The firmware's optional features are as set in "Battery 100/header.h".
+ *
+ * Transitions are written (-o) as CSV: time (s, Unix time if the trace has a start time),
+ * sample index, what changed, and the values from and to. bleeding is a bit per cell, and
+ * sleep goes from 0 to 1 on going to sleep and back to 0 when fully booted again (failed
+ * wake-ups, where checkPV() finds no PV, aren't listed). The state the first boot finishes
+ * in is where the transitions start from, so isn't one. A summary is printed at the end.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "battery100Host.h"
+#include "fieldTrace.h"
+
+struct State {
+	int batteryStatus;
+	int LEDStatus;
+	int gate;
+	int bleeding;		// Bit per cell
+	int snoozing;
+};
+
+static FILE *out;
+static double now;		// Seconds since the first sample
+static double timeOffset;
+static size_t sample;
+static State state;
+static bool haveState;	// Whether state has been taken yet, at the end of the first boot
+static bool awake;
+static unsigned long long transitions[6];
+static const char *eventNames[6] = {"batteryStatus", "LEDStatus", "gate", "bleeding", "snooze", "sleep"};
+
+static void record(int event, int from, int to) {
+	transitions[event]++;
+	if (out)
+		fprintf(out, "%.3f,%zu,%s,%d,%d\n", now + timeOffset, sample, eventNames[event], from, to);
+}
+
+// Called by battery100Loop() after each step
+static void checkpoint(void) {
+	State s;
+	s.batteryStatus = batteryStatus;
+	s.LEDStatus = LEDStatus;
+	s.gate = (P2OUT & BIT3) != 0;
+	s.bleeding = cell_bleedingOn[0] | cell_bleedingOn[1] << 1 | cell_bleedingOn[2] << 2 | cell_bleedingOn[3] << 3;
+	s.snoozing = P2SEL == 0;
+	if (!haveState) {
+		state = s;
+		haveState = true;
+		return;
+	}
+	if (s.batteryStatus != state.batteryStatus)
+		record(0, state.batteryStatus, s.batteryStatus);
+	if (s.LEDStatus != state.LEDStatus)
+		record(1, state.LEDStatus, s.LEDStatus);
+	if (s.gate != state.gate)
+		record(2, state.gate, s.gate);
+	if (s.bleeding != state.bleeding)
+		record(3, state.bleeding, s.bleeding);
+	if (s.snoozing != state.snoozing)
+		record(4, state.snoozing, s.snoozing);
+	state = s;
+}
+
+int main(int argc, char *argv[]) {
+	unsigned long loopsPerSample = 1;
+	bool timed = false;
+	double awakeLoopRate = 4300, snoozeLoopRate = 16.95;
+	const char *outPath = NULL, *path = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-l") && i + 1 < argc)
+			loopsPerSample = strtoul(argv[++i], NULL, 0);
+		else if (!strcmp(argv[i], "-t"))
+			timed = true;
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc && sscanf(argv[i + 1], "%lf,%lf", &awakeLoopRate, &snoozeLoopRate) == 2)
+			i++;
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			outPath = argv[++i];
+		else if (!path && argv[i][0] != '-')
+			path = argv[i];
+		else
+			path = NULL, i = argc;
+	}
+	if (!path || loopsPerSample == 0 || awakeLoopRate <= 0 || snoozeLoopRate <= 0) {
+		fprintf(stderr, "Usage: %s [-l loopsPerSample | -t] [-r awakeLoopRate,snoozeLoopRate] [-o transitions.csv] trace.ioft\n", argv[0]);
+		return 1;
+	}
+
+	FieldTrace trace;
+	if (!openFieldTrace(path, trace))
+		return 1;
+	const size_t samples = trace.header.samples;
+	if (samples == 0) {
+		fprintf(stderr, "%s: no samples\n", path);
+		return 1;
+	}
+	const double tick = trace.header.tickMicroseconds * 1e-6;
+	if (outPath) {
+		out = fopen(outPath, "w");
+		if (!out) {
+			fprintf(stderr, "Can't create %s\n", outPath);
+			return 1;
+		}
+		static char buffer[1 << 16];
+		setvbuf(out, buffer, _IOFBF, sizeof(buffer));
+		fprintf(out, "time,sample,event,from,to\n");
+	}
+	timeOffset = trace.header.startTime;
+	// Channels the trace doesn't have read as 0, except the temperature sensor (25C)
+	const uint16_t *inputs[16];
+	for (int c = 0; c < 16; c++)
+		inputs[c] = fieldTraceChannel(trace, c);
+	hostADCInput[fieldTraceTemperature] = (unsigned int) ((25.0 - 30) * (HOST_CALADC_15T85 - HOST_CALADC_15T30) / (85 - 30) + HOST_CALADC_15T30);
+	// The last sample lasts as long as the one before it
+	const double lastLength = samples > 1 ? (trace.time[samples - 1] - trace.time[samples - 2]) * tick : 1;
+	const double end = trace.time[samples - 1] * tick + lastLength;
+	const double span = end - trace.time[0] * tick;
+
+	std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+	unsigned long long loops = 0, boots = 0, wakeUps = 0;
+	double timeAwake = 0, timeSnoozing = 0;
+	battery100Reset(PORIFG);
+	memset(&state, 0, sizeof(state));
+	sample = 0;
+	now = trace.time[0] * tick;
+	while (now < end) {
+		// Catch up with the sample covering now, and read it in
+		while (sample + 1 < samples && trace.time[sample + 1] * tick <= now)
+			sample++;
+		for (int c = 0; c < 16; c++) {
+			if (inputs[c])
+				hostADCInput[c] = inputs[c][sample];
+		}
+		const double next = sample + 1 < samples ? trace.time[sample + 1] * tick : end;
+		const double start = now;
+		hostDelayedSeconds = 0;
+		try {
+			if (!awake) {
+				wakeUps++;
+				battery100Boot();
+				awake = true;
+				boots++;
+				if (haveState)
+					record(5, 1, 0);
+				checkpoint();
+				now += hostDelayedSeconds;
+			}
+			else if (timed) {
+				do {
+					double loopTime = P2SEL == 0 ? 1 / snoozeLoopRate : 1 / awakeLoopRate;
+					battery100Loop(checkpoint);
+					loops++;
+					now += loopTime + hostDelayedSeconds;
+					hostDelayedSeconds = 0;
+				} while (now < next);
+			}
+			else {
+				for (unsigned long i = 0; i < loopsPerSample; i++)
+					battery100Loop(checkpoint);
+				loops += loopsPerSample;
+				now = start + hostDelayedSeconds > next ? start + hostDelayedSeconds : next;
+			}
+		}
+		catch (HostSleep &) {
+			if (awake) {
+				checkpoint();
+				record(5, 0, 1);
+			}
+			awake = false;
+			now += hostDelayedSeconds + hostWatchdogSeconds();
+			battery100Reset(WDTIFG);
+		}
+		if (awake) {
+			timeAwake += now - start;
+			if (P2SEL == 0)
+				timeSnoozing += now - start;
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+	if (out)
+		fclose(out);
+	closeFieldTrace(trace);
+
+	printf("Replayed %zu samples (%.1f days) in %.2f s: %.3g samples/s, %.3g loops/s\n", samples, span / 86400, seconds,
+			samples / seconds, loops / seconds);
+	printf("Awake %.1f%% (snoozing %.1f%%), %llu boots from %llu wake-ups\n", 100 * timeAwake / span, 100 * timeSnoozing / span, boots, wakeUps);
+	for (int e = 0; e < 6; e++)
+		printf("  %-14s %llu transitions\n", eventNames[e], transitions[e]);
+	return 0;
+}
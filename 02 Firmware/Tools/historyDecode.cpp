@@ -0,0 +1,302 @@
+/*
+ * historyDecode.cpp
+ *
+ * Decodes the Battery 100's history of days (see dailyStats.cpp) from its information
+ * memory, oldest day first, as a table and a chart, and optionally as CSV for plotting.
+ * If the dump has segment B, the state of health figures (see stateOfHealth.cpp) are
+ * decoded first: the capacity's fade since the first full to empty, and each cell's
+ * resistance, with a pack that's faded below 70%, or has a cell of more than twice the
+ * others' average resistance, flagged as weak.
+ *
+ * The dump is TI-TXT ("@address" lines, then hex bytes, ending with "q"), read with the
+ * programmer, e.g. "MSP430Flasher -n MSP430G2332 -r [info.txt,INFO]". If it has segment A,
+ * that unit's temperature sensor calibration is used, otherwise typical values.
+ *
+ * Build:	g++ -O2 -IHost -o historyDecode historyDecode.cpp
+ * Usage:	historyDecode [-r loopsPerSecond] [-w secondsPerWake] [-c days.csv] info.txt
+ *
+ * Times are counted in main loops, so hours are only as good as loopsPerSecond (default
+ * 4300, the awake loop rate at 8MHz, which snoozing loops are weighted to match). Asleep
+ * is from the wake-ups, at secondsPerWake (default 2.73, the watchdog period from the VLO
+ * at 12kHz: give 21.8 for a unit with enableWakeScheduling, which mostly sleeps 8 times
+ * longer at night).
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <msp430.h>		// The host version, for the bit names
+#include "../Battery 100/header.h"
+
+typedef std::map<unsigned int, unsigned char> Memory;
+
+// In information memory, as laid out on the MSP430
+#define MAXTEMP_FLASH		0x1040
+#define HISTORY				0x1042
+#define HISTORY_RECORDS		(HISTORY + 4)
+#define HISTORY_UNUSED		(HISTORY_RECORDS + 6 * statsDays)
+#define HEALTH				0x1098
+#define HEALTH_RECORDS		(HEALTH + 2)
+#define HEALTH_UNUSED		(HEALTH_RECORDS + 8 * sohSlots)
+#define CAL_ADC_15T30		0x10E2
+#define CAL_ADC_15T85		0x10E4
+#define CAL_ADC_25T30		0x10E8
+#define CAL_ADC_25T85		0x10EA
+
+// Typical temperature sensor readings, if segment A isn't in the dump
+#define TYPICAL_15T30		745
+#define TYPICAL_15T85		878
+#define TYPICAL_25T30		447
+#define TYPICAL_25T85		527
+
+// TI-TXT: "@address" lines, then lines of hex bytes, ending with "q"
+bool readTIText(const char *path, Memory &memory) {
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return false;
+	char line[256];
+	unsigned int address = 0;
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '@')
+			address = strtoul(line + 1, NULL, 16);
+		else if (line[0] == 'q' || line[0] == 'Q')
+			break;
+		else {
+			char *p = line, *end;
+			for (;;) {
+				unsigned long byte = strtoul(p, &end, 16);
+				if (end == p)
+					break;
+				memory[address++] = byte & 0xFF;
+				p = end;
+			}
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+// A little endian word from memory, or false if it isn't there
+bool readWord(const Memory &memory, unsigned int address, unsigned int &word) {
+	Memory::const_iterator low = memory.find(address), high = memory.find(address + 1);
+	if (low == memory.end() || high == memory.end())
+		return false;
+	word = low->second | (high->second << 8);
+	return true;
+}
+
+// As deltaField() in dailyStats.cpp
+int deltaField(unsigned int word, int shift, int bits) {
+	int delta = (word >> shift) & ((1 << bits) - 1);
+	if (delta & (1 << (bits - 1)))
+		delta -= 1 << bits;
+	return delta;
+}
+
+struct Day {
+	double PVHours, fullHours, emptyHours, bleedHours, asleepHours;
+	int lowest, highest;		// ADC units
+	int temp;					// In 2^statsTempShift ADC units
+	int shorts;
+	bool reset;
+};
+
+// As the firmware works out shutdownTemp, the other way round
+double toCelsius(double ADC, unsigned int T30, unsigned int T85) {
+	return 30 + (ADC - T30) * (85 - 30) / (T85 - T30);
+}
+
+// A record's temperature, in the middle of its step
+double recordCelsius(int temp, unsigned int T30, unsigned int T85) {
+	return toCelsius((temp << statsTempShift) + (1 << statsTempShift) / 2.0, T30, T85);
+}
+
+// "#####     " scaled to width
+void bar(double value, double full, int width) {
+	int n = (int) (value / full * width + 0.5);
+	for (int i = 0; i < width; i++)
+		putchar(i < n ? '#' : ' ');
+}
+
+// The state of health figures in segment B, newest last, or false if they aren't in the dump
+bool printHealth(const Memory &info) {
+	unsigned int firstCapacity, unused;
+	if ( !readWord(info, HEALTH, firstCapacity) || !readWord(info, HEALTH_UNUSED, unused) )
+		return false;
+	int count = 0;
+	while ( count < sohSlots && !(unused & (1 << count)) )
+		count++;
+	if (count == 0) {
+		printf("No state of health figures (segment B erased after the first run test record)\n\n");
+		return true;
+	}
+	printf("State of health: capacity in relative units (the fuse drop added up from full to empty),\n"
+			"and each cell's resistance relative to the PTC fuse's.\n\n");
+	printf("%6s %8s %6s %6s   %6s %6s %6s %6s\n", "record", "capacity", "fade", "cycles", "cell 1", "cell 2", "cell 3", "cell 4");
+	bool weak = false;
+	for (int i = 0; i < count; i++) {
+		unsigned int capacity, cycles, cellsLow, cellsHigh;
+		if ( !readWord(info, HEALTH_RECORDS + 8 * i, capacity) || !readWord(info, HEALTH_RECORDS + 8 * i + 2, cycles)
+				|| !readWord(info, HEALTH_RECORDS + 8 * i + 4, cellsLow) || !readWord(info, HEALTH_RECORDS + 8 * i + 6, cellsHigh) ) {
+			printf("(segment B is missing part of record %d)\n", i + 1);
+			break;
+		}
+		// cellR[] is in 1/64ths
+		double R[4] = {(cellsLow & 0xFF) / 64.0, (cellsLow >> 8) / 64.0, (cellsHigh & 0xFF) / 64.0, (cellsHigh >> 8) / 64.0};
+		double mean = (R[0] + R[1] + R[2] + R[3]) / 4;
+		char fade[16] = "-";
+		bool faded = false;
+		if (firstCapacity != 0xFFFF && firstCapacity != 0 && capacity != 0) {
+			double percent = 100.0 * capacity / firstCapacity;
+			snprintf(fade, sizeof(fade), "%.0f%%", percent);
+			faded = percent < 70;
+		}
+		printf("%6d %8u %6s %6u  ", i - count + 1, capacity, fade, cycles);
+		bool highCell = false;
+		for (int j = 0; j < 4; j++) {
+			// Against the other three, so that one bad cell doesn't hide itself by raising the average
+			bool high = R[j] > 2 * (mean * 4 - R[j]) / 3;
+			printf(" %5.2f%s", R[j], high ? "!" : " ");
+			highCell |= high;
+		}
+		printf("%s\n", (faded || highCell) ? "  WEAK" : "");
+		if (i == count - 1)
+			weak = faded || highCell;
+	}
+	printf("\nPack is %s (weak: below 70%% of the first capacity, or a cell (!) over twice the others' resistance)\n\n",
+			weak ? "WEAK" : "OK");
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	double loopsPerSecond = 4300, secondsPerWake = 2.73;
+	const char *csvPath = NULL, *path = NULL;
+	bool usage = false;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			loopsPerSecond = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+			secondsPerWake = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+			csvPath = argv[++i];
+		else if (argv[i][0] != '-' && !path)
+			path = argv[i];
+		else
+			usage = true;
+	}
+	if (usage || !path || loopsPerSecond <= 0 || secondsPerWake <= 0) {
+		fprintf(stderr, "Usage: %s [-r loopsPerSecond] [-w secondsPerWake] [-c days.csv] info.txt\n", argv[0]);
+		return 1;
+	}
+	Memory info;
+	if (!readTIText(path, info)) {
+		fprintf(stderr, "Can't read %s\n", path);
+		return 1;
+	}
+
+	bool health = printHealth(info);
+
+	// Header: bases for the deltas, and the format
+	unsigned int baseCells, baseTempFormat, unused;
+	if ( !readWord(info, HISTORY, baseCells) || !readWord(info, HISTORY + 2, baseTempFormat) || !readWord(info, HISTORY_UNUSED, unused) ) {
+		if (health)
+			return 0;
+		fprintf(stderr, "%s doesn't have segment B (0x1080-0x10BF) or C (0x1040-0x107F)\n", path);
+		return 1;
+	}
+	unsigned int format = baseTempFormat >> 8;
+	if (format == 0xFF) {
+		printf("No history (segment C erased after maxTemp_FLASH)\n");
+		return 0;
+	}
+	if ( (format & 0x0F) != statsVersion ) {
+		fprintf(stderr, "History is version %u, this decoder is for version %u\n", format & 0x0F, statsVersion);
+		return 1;
+	}
+	bool hasTemp = !(format & STATS_NOTEMP), temp25 = (format & STATS_TEMP25) != 0;
+
+	// Temperature sensor calibration
+	unsigned int T30, T85;
+	bool typical = !readWord(info, temp25 ? CAL_ADC_25T30 : CAL_ADC_15T30, T30) || !readWord(info, temp25 ? CAL_ADC_25T85 : CAL_ADC_15T85, T85)
+			|| T30 == 0xFFFF || T85 <= T30;
+	if (typical) {
+		T30 = temp25 ? TYPICAL_25T30 : TYPICAL_15T30;
+		T85 = temp25 ? TYPICAL_25T85 : TYPICAL_15T85;
+	}
+	double secondsPerPeriod = (double) statsPeriodLoops * (1 << statsPeriodShift) / loopsPerSecond;
+	double secondsPerWakeUnit = secondsPerWake * (1 << statsWakeShift);
+
+	// Records, oldest first, up to the first one not written
+	int lowest = baseCells & 0xFF, highest = baseCells >> 8, temp = baseTempFormat & 0xFF;
+	Day days[statsDays];
+	int count = 0;
+	while ( count < statsDays && !(unused & (1 << count)) ) {
+		unsigned int w[3];
+		for (int j = 0; j < 3; j++)
+			if (!readWord(info, HISTORY_RECORDS + 6 * count + 2 * j, w[j])) {
+				fprintf(stderr, "%s is missing part of segment C\n", path);
+				return 1;
+			}
+		lowest += deltaField(w[2], 0, 5);
+		highest += deltaField(w[2], 5, 5);
+		temp += deltaField(w[1], 12, 4);
+		Day &d = days[count++];
+		d.PVHours = (w[0] & 0x3F) * secondsPerPeriod / 3600;
+		d.fullHours = ((w[0] >> 6) & 0x3F) * secondsPerPeriod / 3600;
+		d.shorts = (w[0] >> 12) & 0x07;
+		d.reset = (w[0] & 0x8000) != 0;
+		d.emptyHours = (w[1] & 0x3F) * secondsPerPeriod / 3600;
+		d.bleedHours = ((w[1] >> 6) & 0x3F) * secondsPerPeriod / 3600;
+		d.asleepHours = (w[2] >> 10) * secondsPerWakeUnit / 3600;
+		d.lowest = lowest;
+		d.highest = highest;
+		d.temp = temp;
+	}
+
+	unsigned int maxTemp;
+	if (hasTemp && readWord(info, MAXTEMP_FLASH, maxTemp) && maxTemp != 0xFFFF)
+		printf("Maximum temperature: %.0fC (ADC %u)\n", toCelsius(maxTemp, T30, T85), maxTemp);
+	if (hasTemp && typical)
+		printf("No temperature sensor calibration (segment A) in the dump, so taking typical values\n");
+	printf("%d day%s, oldest first. Hours are rough (loops at %.0f/s, wake-ups every %.2fs), and a\n"
+			"day is from dusk to dusk, with any day without an hour of PV added to the next.\n"
+			"Lowest and highest cells, and the temperature, move at most %d and %d ADC units a day.\n\n",
+			count, count == 1 ? "" : "s", loopsPerSecond, secondsPerWake, 15, 7 << statsTempShift);
+	printf("%4s %6s %6s %6s %6s %7s %7s %7s %6s %6s %5s   %-20s %s\n", "day", "PV h", "full h", "empty h", "bleed h",
+			"asleep h", "lowest", "highest", "peak C", "shorts", "reset", "PV", "cells 2.5V-3.8V");
+	for (int i = 0; i < count; i++) {
+		const Day &d = days[i];
+		double lowV = d.lowest * C_CELL / 100, highV = d.highest * C_CELL / 100;
+		char peak[16] = "-";
+		if (hasTemp)
+			snprintf(peak, sizeof(peak), "%.0f", recordCelsius(d.temp, T30, T85));
+		printf("%4d %6.1f %6.1f %7.1f %7.1f %8.1f %6.2fV %6.2fV %6s %5d%s %5s   |", i - count + 1, d.PVHours, d.fullHours,
+				d.emptyHours, d.bleedHours, d.asleepHours, lowV, highV, peak, d.shorts, d.shorts == 7 ? "+" : " ", d.reset ? "yes" : "");
+		bar(d.PVHours, 16, 18);
+		printf("| |");
+		// The cell range, from 2.5V to 3.8V in 0.05V steps
+		for (double v = 2.5; v < 3.8; v += 0.05)
+			putchar( (v + 0.05 > lowV && v <= highV) ? '=' : ' ' );
+		printf("|\n");
+	}
+
+	if (csvPath) {
+		FILE *f = fopen(csvPath, "w");
+		if (!f) {
+			fprintf(stderr, "Can't write %s\n", csvPath);
+			return 1;
+		}
+		fprintf(f, "day,PV hours,full hours,empty hours,bleed hours,asleep hours,lowest cell V,highest cell V,peak temperature C,short circuits,reset\n");
+		for (int i = 0; i < count; i++) {
+			const Day &d = days[i];
+			fprintf(f, "%d,%.2f,%.2f,%.2f,%.2f,%.2f,%.3f,%.3f,", i - count + 1, d.PVHours, d.fullHours, d.emptyHours,
+					d.bleedHours, d.asleepHours, d.lowest * C_CELL / 100, d.highest * C_CELL / 100);
+			if (hasTemp)
+				fprintf(f, "%.1f", recordCelsius(d.temp, T30, T85));
+			fprintf(f, ",%d,%d\n", d.shorts, d.reset ? 1 : 0);
+		}
+		fclose(f);
+	}
+	return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * inputPowerBench.cpp
+ *
+ * Runs the Charger firmware, built for the host (see Tools/Host/chargerHost.h), against a
+ * model of a weak source, to see what the input power limit (enableInputPowerLimit, see
+ * inputPowerLimit.cpp) does for it: build it without and then with -DenableInputPowerLimit,
+ * and compare.
+ *
+ * Build:	g++ -O2 -std=c++11 -funsigned-char -I../Host [-DenableInputPowerLimit] -o inputPowerBench inputPowerBench.cpp ../Host/chargerHost.cpp ../Host/hostMSP430.cpp
+ * Usage:	inputPowerBench [-s supply] [-c reservoir] [-r restartLoops] [-n loops] [-j jitter] [-p printEvery]
+ *
+ * The model is counted in main loops (roughly 1kHz), with the charge IC's demand as 1 a loop:
+ *  - the source gives supply (-s, default 0.6) a loop into a reservoir (its output and the
+ *    charge IC's input capacitance) of reservoir (-c, default 50), which is full to start with
+ *  - while the gate's on and the charge IC's charging, it takes 1 a loop. When the reservoir
+ *    runs dry that's a brown-out: the charge IC stops for restartLoops (-r, default 2000,
+ *    its restart with soft start) and then starts charging again, if the gate's on
+ *  - while the charge IC's charging, STAT1 is low and the current reads 100 ADC units (the
+ *    current sense 100 below the 1V reference), otherwise STAT1 is high and it reads 0. Each
+ *    reading has jitter (-j, default 0) added, uniform in +/- that many ADC units, to check
+ *    the collapse test (half the usual current, on one reading) against noise
+ *  - the battery's at rest voltage (BATTV 600), never full
+ * It runs for loops (-n, default 400000) and gives the energy delivered, as a share of what
+ * could have been (supply a loop, or 1 if the source is strong enough), the brown-outs, and
+ * (with the limit) how many times the firmware cut the gate's on time. A cut with no
+ * brown-out to go with it is a false alarm.
+ * With -p, the gate's on time is printed every printEvery loops, to see it settle.
+ *
+ * The figures for the defaults, without the limit then with it, were: 10% of the energy with
+ * 189 brown-outs, then 92% with 12 (and 12 cuts). The collapse test is on one current reading,
+ * so with -j 60 (a reading can fall below half the usual) there are cuts without brown-outs,
+ * and the on time is held down: 21%, with 9 cuts and no brown-outs.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "chargerHost.h"
+#include "hostMSP430.h"
+
+int main(int argc, char *argv[]) {
+	double supply = 0.6;
+	double reservoir = 50;
+	long restartLoops = 2000;
+	long loops = 400000;
+	int jitter = 0;
+	long printEvery = 0;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-s") && i + 1 < argc)
+			supply = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+			reservoir = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			restartLoops = atol(argv[++i]);
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			loops = atol(argv[++i]);
+		else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+			jitter = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+			printEvery = atol(argv[++i]);
+		else {
+			fprintf(stderr, "Usage: %s [-s supply] [-c reservoir] [-r restartLoops] [-n loops] [-j jitter] [-p printEvery]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (supply <= 0 || reservoir <= 0 || restartLoops < 0 || loops <= 0 || jitter < 0 || jitter > 99) {
+		fprintf(stderr, "Bad model parameters\n");
+		return 2;
+	}
+
+	chargerReset(PORIFG);
+	chargerIdleInputs();
+	chargerBoot();
+	srand(1);
+
+	double level = reservoir;
+	long restart = 0;
+	double delivered = 0;
+	long brownOuts = 0;
+#ifdef enableInputPowerLimit
+	long cuts = 0;
+#else
+	(void) printEvery;
+#endif
+	for (long loop = 0; loop < loops; loop++) {
+		bool gateOn = !(P2OUT & BIT3);
+		bool charging = gateOn && (restart == 0);
+		if (charging) {
+			level += supply - 1;
+			if (level < 0) {
+				level = 0;
+				restart = restartLoops;
+				charging = false;
+				brownOuts++;
+			}
+		}
+		else {
+			level += supply;
+			if (level > reservoir)
+				level = reservoir;
+			if (restart)
+				restart--;
+		}
+		if (charging)
+			delivered += 1;
+		int noise = jitter ? (rand() % (2 * jitter + 1)) - jitter : 0;
+		hostADCInput[BATTV_PIN] = 600;
+		hostADCInput[REF1V_PIN] = 400;
+		hostADCInput[CURRENTV_PIN] = (charging ? 300 : 400) + noise;
+		P2IN = BIT0 + BIT1 + (charging ? 0 : BIT2);		// Fuse untripped, STAT2 high (not full), STAT1 low if charging
+#ifdef enableInputPowerLimit
+		char onLoops = gateOnLoops;
+		chargerLoop();
+		if (gateOnLoops < onLoops)
+			cuts++;
+		if (printEvery && (loop % printEvery == 0))
+			printf("loop %8ld: on %2d of %d loops, last collapsed at %2d\n", loop, gateOnLoops, gateCycleLoops, gateCollapseLoops);
+#else
+		chargerLoop();
+#endif
+	}
+	// The most that could be delivered is the source's supply, or the charge IC's demand if that's less
+	double available = ( (supply < 1) ? supply : 1 ) * loops;
+	printf("Delivered %.0f of %.0f (%.1f%%), %ld brown-outs", delivered, available, 100 * delivered / available, brownOuts);
+#ifdef enableInputPowerLimit
+	printf(", %ld on time cuts\n", cuts);
+#else
+	printf(" (without enableInputPowerLimit)\n");
+#endif
+	return 0;
+}
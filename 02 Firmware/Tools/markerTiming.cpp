@@ -0,0 +1,651 @@
+/*
+ * markerTiming.cpp
+ *
+ * Times the main loop of either firmware from a logic analyser capture of its timing
+ * markers (see enableTimingMarkers in the header.h of each): the loop period and its jitter,
+ * each stage's duration, the interrupts, and the faults, with the worst case of each (and
+ * when in the capture it was, to find it again) and a histogram of each stage's durations.
+ *
+ * The capture can be either:
+ *  - CSV, as sigrok-cli ("-O csv") or PulseView's export writes it: ';' comment lines (the
+ *    "Samplerate:" one is used), an optional line of column labels, then one line per
+ *    sample, or per change. A "Time [unit]" column (as Saleae's export has) is used if
+ *    there is one, otherwise samples are counted at the sample rate (or "-r").
+ *  - VCD (".vcd", as sigrok-cli "-O vcd" or PulseView's export writes it)
+ * It's read a line (or a token) at a time, and only the statistics are kept, so there's no
+ * limit to the size of the capture, and a few GB takes a minute or so.
+ *
+ * Build:	g++ -O2 -o markerTiming markerTiming.cpp
+ * Usage:	markerTiming [-f battery|charger] [-s stage,stage,...] [-a stagePin] [-b eventPin]
+ *				[-r sampleRate] [-w width] capture.csv|capture.vcd
+ *
+ * The pins are channel names (e.g. "D0") or numbers (counting from 0, leaving out any time
+ * column), and default to the first two channels: wire the stage pin to the first. The
+ * stages are named in the order they're marked in main(), from "-f", or from "-s".
+ *
+ * The capture has to resolve single instructions, i.e. a sample rate of at least MCLK / 2,
+ * or the pulses of markLoop() and markFault() can be missed: 24MHz for 16MHz MCLK. Stage
+ * durations include any interrupts during them.
+ */
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+typedef long long Time;				// Picoseconds
+
+// The stages in the order they're marked in each firmware's main()
+const char *batteryStages[] = {"ADCs", "batteryStatus", "discharge", "charge", "LEDs", "sleep/snooze", "governor"};
+const char *chargerStages[] = {"getData", "batteryStatus", "jouleCounter", "charge", "discharge", "LEDs", "sleep"};
+
+// Histogram bins are an eighth of an octave of nanoseconds, up to about 70s
+#define BINS_PER_OCTAVE		8
+#define BINS				(36 * BINS_PER_OCTAVE)
+#define MAX_STAGES			32
+#define MAX_FAULTS_LISTED	10
+
+int binOf(Time t) {
+	double ns = t / 1000.0;
+	if (ns < 1)
+		return 0;
+	int bin = (int) (log2(ns) * BINS_PER_OCTAVE) + 1;
+	return bin < BINS ? bin : BINS - 1;
+}
+
+// The top of a bin, in picoseconds
+double binTop(int bin) {
+	return 1000.0 * pow(2.0, (double) bin / BINS_PER_OCTAVE);
+}
+
+struct Stats {
+	unsigned long long count;
+	Time min, max, maxAt;
+	double sum, sumSquares;
+	unsigned long long bins[BINS];
+
+	Stats() : count(0), min(0), max(0), maxAt(0), sum(0), sumSquares(0) {
+		memset(bins, 0, sizeof(bins));
+	}
+	void add(Time t, Time at) {
+		if (count == 0 || t < min)
+			min = t;
+		if (count == 0 || t > max) {
+			max = t;
+			maxAt = at;
+		}
+		count++;
+		sum += t;
+		sumSquares += (double) t * t;
+		bins[binOf(t)]++;
+	}
+	double mean(void) const {
+		return count ? sum / count : 0;
+	}
+	double deviation(void) const {
+		if (count < 2)
+			return 0;
+		double m = mean(), variance = sumSquares / count - m * m;
+		return variance > 0 ? sqrt(variance) : 0;
+	}
+	// From the histogram, so only to within a bin (9%), but never more than the maximum
+	double percentile(double p) const {
+		unsigned long long target = (unsigned long long) ceil(count * p / 100), seen = 0;
+		for (int i = 0; i < BINS; i++) {
+			seen += bins[i];
+			if (seen >= target && seen > 0)
+				return binTop(i) < max ? binTop(i) : max;
+		}
+		return max;
+	}
+};
+
+// A time (in picoseconds) in sensible units, right aligned in width
+void printTime(double t, int width) {
+	char text[32];
+	if (t < 1e6)
+		snprintf(text, sizeof(text), "%.2fus", t / 1e6);
+	else if (t < 1e9)
+		snprintf(text, sizeof(text), "%.1fus", t / 1e6);
+	else if (t < 1e12)
+		snprintf(text, sizeof(text), "%.2fms", t / 1e9);
+	else
+		snprintf(text, sizeof(text), "%.3fs", t / 1e12);
+	printf("%*s", width, text);
+}
+
+// count, mean, sd, min, p99, max (at)
+void printStats(const char *name, const Stats &s) {
+	printf("%-14s %9llu", name, s.count);
+	if (s.count) {
+		printTime(s.mean(), 10);
+		printTime(s.deviation(), 10);
+		printTime(s.min, 10);
+		printTime(s.percentile(99), 10);
+		printTime(s.max, 10);
+		printf("   %.6fs", s.maxAt / 1e12);
+	}
+	printf("\n");
+}
+
+void printHistogram(const char *name, const Stats &s, int width) {
+	int first = BINS, last = -1;
+	unsigned long long most = 0;
+	for (int i = 0; i < BINS; i++)
+		if (s.bins[i]) {
+			if (first == BINS)
+				first = i;
+			last = i;
+			if (s.bins[i] > most)
+				most = s.bins[i];
+		}
+	if (last < 0)
+		return;
+	printf("\n%s:\n", name);
+	for (int i = first; i <= last; i++) {
+		printf("  < ");
+		printTime(binTop(i), 9);
+		printf(" %10llu |", s.bins[i]);
+		// Anything there gets at least one '#', so the outliers show
+		int n = s.bins[i] ? (int) ((double) s.bins[i] / most * width + 0.999) : 0;
+		for (int j = 0; j < n; j++)
+			putchar('#');
+		putchar('\n');
+	}
+}
+
+// Decoding the markers from the levels of the two pins
+struct Markers {
+	std::vector<std::string> stageNames;
+	Stats loops, interrupts, interruptGaps, faultLatency;
+	Stats stages[MAX_STAGES];
+	unsigned long long faults, oddLoops, extraEdges;
+	Time faultTimes[MAX_FAULTS_LISTED];
+	int faultStages[MAX_FAULTS_LISTED];
+	bool started, stageLevel, eventLevel, inLoop;
+	Time first, last, eventStart, loopStart, stageStart, lastInterrupt;
+	int eventEdges, stage;
+	Time eventEdge;
+
+	Markers() : faults(0), oddLoops(0), extraEdges(0), started(false), stageLevel(false), eventLevel(false),
+			inLoop(false), first(0), last(0), eventStart(0), loopStart(0), stageStart(0), lastInterrupt(-1),
+			eventEdges(0), stage(0), eventEdge(0) {}
+
+	void endStage(Time t) {
+		if (!inLoop)
+			return;
+		if (stage < MAX_STAGES)
+			stages[stage].add(t - stageStart, stageStart);
+		else
+			extraEdges++;
+		stage++;
+		stageStart = t;
+	}
+
+	void startLoop(Time t) {
+		if (inLoop) {
+			endStage(t);
+			loops.add(t - loopStart, loopStart);
+			if (stage != (int) stageNames.size())
+				oddLoops++;
+		}
+		inLoop = true;
+		loopStart = stageStart = t;
+		stage = 0;
+	}
+
+	void fault(Time t) {
+		if (faults < MAX_FAULTS_LISTED) {
+			faultTimes[faults] = t;
+			faultStages[faults] = inLoop ? stage : -1;
+		}
+		faults++;
+		if (inLoop)
+			faultLatency.add(t - loopStart, t);
+	}
+
+	// An event pin pulse: an interrupt, the start of a loop, or a fault, from the stage pin edges in it
+	void endEvent(Time t) {
+		if (eventEdges == 0) {
+			interrupts.add(t - eventStart, eventStart);
+			if (lastInterrupt >= 0)
+				interruptGaps.add(eventStart - lastInterrupt, lastInterrupt);
+			lastInterrupt = eventStart;
+			return;
+		}
+		if (eventEdges & 1)
+			startLoop(eventEdge);
+		if (eventEdges >= 2)
+			fault(eventEdge);
+	}
+
+	// The levels of the pins from time t. If both have changed at once (the capture's too slow
+	// to tell), a stage edge is taken to be inside the event pulse.
+	void sample(Time t, bool newStage, bool newEvent) {
+		if (!started) {
+			started = true;
+			first = t;
+			stageLevel = newStage;
+			eventLevel = newEvent;
+		}
+		last = t;
+		if (newEvent && !eventLevel) {
+			eventStart = t;
+			eventEdges = 0;
+		}
+		if (newStage != stageLevel) {
+			if (newEvent || eventLevel) {
+				if (eventEdges++ == 0)
+					eventEdge = t;
+			}
+			else
+				endStage(t);
+		}
+		if (!newEvent && eventLevel)
+			endEvent(t);
+		stageLevel = newStage;
+		eventLevel = newEvent;
+	}
+
+	const char *stageName(int i, char *buffer, size_t size) const {
+		if (i < (int) stageNames.size())
+			return stageNames[i].c_str();
+		snprintf(buffer, size, "(stage %d)", i + 1);
+		return buffer;
+	}
+
+	void report(int width) const {
+		char name[32];
+		double seconds = (last - first) / 1e12;
+		printf("%.3fs captured: %llu loops (%.0f/s), %llu interrupts, %llu faults\n", seconds, loops.count,
+				seconds > 0 ? loops.count / seconds : 0, interrupts.count, faults);
+		if (oddLoops)
+			printf("%llu loops didn't have the %d stages expected (sleeping, a reset, or stages missed by the capture)\n",
+					oddLoops, (int) stageNames.size());
+		printf("\n%-14s %9s %10s %10s %10s %10s %10s   %s\n", "", "count", "mean", "sd", "min", "p99", "max", "max at");
+		printStats("loop period", loops);
+		for (int i = 0; i < MAX_STAGES; i++)
+			if (stages[i].count || i < (int) stageNames.size())
+				printStats(stageName(i, name, sizeof(name)), stages[i]);
+		printStats("interrupts", interrupts);
+		printStats("between them", interruptGaps);
+		if (faults)
+			printStats("fault latency", faultLatency);
+		if (extraEdges)
+			printf("(%llu more stage edges in loops with more than %d)\n", extraEdges, MAX_STAGES);
+		printf("\nLoop jitter (sd of the period) %.2fus, and it ranges over %.2fus. Fault latency is from\n"
+				"the start of the loop. Stage durations include any interrupts during them.\n",
+				loops.deviation() / 1e6, (loops.max - loops.min) / 1e6);
+
+		for (unsigned long long i = 0; i < faults && i < MAX_FAULTS_LISTED; i++)
+			printf("%s%.6fs: fault in %s\n", i == 0 ? "\n" : "", faultTimes[i] / 1e12,
+					faultStages[i] < 0 ? "(before the first loop)" : stageName(faultStages[i], name, sizeof(name)));
+		if (faults > MAX_FAULTS_LISTED)
+			printf("... and %llu more\n", faults - MAX_FAULTS_LISTED);
+
+		printHistogram("loop period", loops, width);
+		for (int i = 0; i < MAX_STAGES; i++)
+			if (stages[i].count)
+				printHistogram(stageName(i, name, sizeof(name)), stages[i], width);
+		printHistogram("interrupts", interrupts, width);
+	}
+};
+
+// Reads a file a line at a time into a buffer of its own, without limit on the file's size
+struct LineReader {
+	FILE *f;
+	std::vector<char> buffer;
+	size_t start, end;
+	bool eof;
+
+	LineReader(FILE *file) : f(file), buffer(1 << 20), start(0), end(0), eof(false) {}
+
+	// The next line, without its end, or NULL at the end of the file
+	char *next(void) {
+		for (;;) {
+			char *newline = (char *) memchr(&buffer[start], '\n', end - start);
+			if (newline || (eof && start < end)) {
+				char *line = &buffer[start];
+				if (newline) {
+					*newline = 0;
+					start = newline - &buffer[0] + 1;
+				}
+				else {
+					buffer[end] = 0;
+					start = end;
+				}
+				size_t n = strlen(line);
+				if (n && line[n - 1] == '\r')
+					line[n - 1] = 0;
+				return line;
+			}
+			if (eof)
+				return NULL;
+			// Move what's left to the front, and fill up the rest
+			memmove(&buffer[0], &buffer[start], end - start);
+			end -= start;
+			start = 0;
+			if (end + 1 >= buffer.size())
+				buffer.resize(buffer.size() * 2);
+			size_t n = fread(&buffer[end], 1, buffer.size() - end - 1, f);
+			end += n;
+			if (n == 0)
+				eof = true;
+		}
+	}
+};
+
+// A channel by name, or by number
+int findChannel(const std::vector<std::string> &names, const char *wanted, int fallback) {
+	if (!wanted)
+		return fallback;
+	for (size_t i = 0; i < names.size(); i++)
+		if (names[i] == wanted)
+			return i;
+	char *end;
+	long n = strtol(wanted, &end, 10);
+	if (*end == 0 && n >= 0 && n < (long) names.size())
+		return n;
+	return -1;
+}
+
+// "24 MHz", "1.5kHz", "1000000"
+double parseRate(const char *text) {
+	char *end;
+	double rate = strtod(text, &end);
+	while (*end == ' ')
+		end++;
+	if (*end == 'k' || *end == 'K')
+		rate *= 1e3;
+	else if (*end == 'M')
+		rate *= 1e6;
+	else if (*end == 'G')
+		rate *= 1e9;
+	return rate;
+}
+
+// Picoseconds per unit of "s", "ms", "us", "ns", "ps" (and "fs", for VCD)
+double unitPicoseconds(const char *unit) {
+	if (!strncmp(unit, "ms", 2))
+		return 1e9;
+	if (!strncmp(unit, "us", 2) || !strncmp(unit, "\xc2\xb5s", 3))
+		return 1e6;
+	if (!strncmp(unit, "ns", 2))
+		return 1e3;
+	if (!strncmp(unit, "ps", 2))
+		return 1;
+	if (!strncmp(unit, "fs", 2))
+		return 1e-3;
+	return 1e12;
+}
+
+// Splits a CSV line in place
+void splitCSV(char *line, std::vector<char *> &fields) {
+	fields.clear();
+	for (;;) {
+		while (*line == ' ' || *line == '"')
+			line++;
+		fields.push_back(line);
+		char *comma = strchr(line, ',');
+		char *end = comma ? comma : line + strlen(line);
+		while (end > line && (end[-1] == ' ' || end[-1] == '"'))
+			end--;
+		if (!comma) {
+			*end = 0;
+			return;
+		}
+		*end = 0;
+		line = comma + 1;
+	}
+}
+
+bool isNumber(const char *field) {
+	char *end;
+	strtod(field, &end);
+	return end != field && *end == 0;
+}
+
+bool readCSV(FILE *f, const char *stagePin, const char *eventPin, double sampleRate, Markers &markers) {
+	LineReader reader(f);
+	std::vector<char *> fields;
+	std::vector<std::string> names;		// Of the channels, not the time column
+	int timeColumn = -1, stageColumn = -1, eventColumn = -1;
+	double timeScale = 1e12;
+	unsigned long long samples = 0;
+	bool columnsKnown = false;
+	char *line;
+	while ((line = reader.next())) {
+		if (line[0] == ';' || line[0] == '#') {
+			const char *rate = strstr(line, "Samplerate:");
+			if (rate && sampleRate <= 0)
+				sampleRate = parseRate(rate + 11);
+			continue;
+		}
+		if (!line[0])
+			continue;
+		splitCSV(line, fields);
+		if (!columnsKnown) {
+			bool labels = false;
+			for (size_t i = 0; i < fields.size(); i++)
+				labels |= !isNumber(fields[i]);
+			std::vector<int> columns;
+			for (size_t i = 0; i < fields.size(); i++) {
+				if (labels && !strncasecmp(fields[i], "time", 4)) {
+					timeColumn = i;
+					const char *unit = strchr(fields[i], '[');
+					if (unit)
+						timeScale = unitPicoseconds(unit + 1);
+					continue;
+				}
+				columns.push_back(i);
+				names.push_back(labels ? fields[i] : std::to_string(names.size()));
+			}
+			int stage = findChannel(names, stagePin, 0), event = findChannel(names, eventPin, 1);
+			if (stage < 0 || event < 0 || stage >= (int) columns.size() || event >= (int) columns.size() || stage == event) {
+				fprintf(stderr, "Can't find the stage and event pins in the channels:");
+				for (size_t i = 0; i < names.size(); i++)
+					fprintf(stderr, " %s", names[i].c_str());
+				fprintf(stderr, "\n");
+				return false;
+			}
+			stageColumn = columns[stage];
+			eventColumn = columns[event];
+			if (timeColumn < 0 && sampleRate <= 0) {
+				fprintf(stderr, "No time column or sample rate in the capture: give it with -r\n");
+				return false;
+			}
+			printf("Stage pin %s, event pin %s\n", names[stage].c_str(), names[event].c_str());
+			columnsKnown = true;
+			if (labels)
+				continue;
+		}
+		if ((int) fields.size() <= stageColumn || (int) fields.size() <= eventColumn)
+			continue;
+		Time t = timeColumn >= 0 ? llround(strtod(fields[timeColumn], NULL) * timeScale) : llround(samples * 1e12 / sampleRate);
+		samples++;
+		markers.sample(t, atoi(fields[stageColumn]) != 0, atoi(fields[eventColumn]) != 0);
+	}
+	return columnsKnown;
+}
+
+// Reads VCD a whitespace separated token at a time
+struct TokenReader {
+	LineReader lines;
+	char *rest;
+
+	TokenReader(FILE *f) : lines(f), rest(NULL) {}
+
+	char *next(void) {
+		for (;;) {
+			while (rest && isspace((unsigned char) *rest))
+				rest++;
+			if (rest && *rest) {
+				char *token = rest;
+				while (*rest && !isspace((unsigned char) *rest))
+					rest++;
+				if (*rest)
+					*rest++ = 0;
+				return token;
+			}
+			if (!(rest = lines.next()))
+				return NULL;
+		}
+	}
+
+	// Skip to the "$end" of a section
+	void skipSection(void) {
+		char *token;
+		while ((token = next()) && strcmp(token, "$end"));
+	}
+};
+
+bool readVCD(FILE *f, const char *stagePin, const char *eventPin, Markers &markers) {
+	TokenReader reader(f);
+	std::vector<std::string> names, ids;
+	double timeScale = 1;
+	char *token;
+	// Header: the timescale, and the 1 bit variables
+	while ((token = reader.next()) && strcmp(token, "$enddefinitions")) {
+		if (!strcmp(token, "$timescale")) {
+			std::string scale;
+			while ((token = reader.next()) && strcmp(token, "$end"))
+				scale += token;
+			char *unit;
+			double n = strtod(scale.c_str(), &unit);
+			timeScale = n * unitPicoseconds(unit);
+		}
+		else if (!strcmp(token, "$var")) {
+			reader.next();								// Type
+			char *size = reader.next(), *id = reader.next(), *name = reader.next();
+			if (size && id && name && !strcmp(size, "1")) {
+				ids.push_back(id);
+				names.push_back(name);
+			}
+			reader.skipSection();
+		}
+		else if (token[0] == '$' && strcmp(token, "$end"))
+			reader.skipSection();						// $scope, $upscope, $date, $version, $comment...
+	}
+	if (!token) {
+		fprintf(stderr, "No $enddefinitions in the VCD\n");
+		return false;
+	}
+	int stage = findChannel(names, stagePin, 0), event = findChannel(names, eventPin, 1);
+	if (stage < 0 || event < 0 || stage >= (int) names.size() || event >= (int) names.size() || stage == event) {
+		fprintf(stderr, "Can't find the stage and event pins in the variables:");
+		for (size_t i = 0; i < names.size(); i++)
+			fprintf(stderr, " %s", names[i].c_str());
+		fprintf(stderr, "\n");
+		return false;
+	}
+	printf("Stage pin %s, event pin %s\n", names[stage].c_str(), names[event].c_str());
+	const std::string &stageId = ids[stage], &eventId = ids[event];
+
+	// Value changes, a timestamp at a time (so that changes at the same time are taken together)
+	bool stageLevel = false, eventLevel = false, pending = false;
+	Time t = 0;
+	while ((token = reader.next())) {
+		if (token[0] == '#') {
+			if (pending)
+				markers.sample(t, stageLevel, eventLevel);
+			t = llround(strtod(token + 1, NULL) * timeScale);
+			pending = false;
+			continue;
+		}
+		if (token[0] == '$') {
+			// $dumpvars etc. just hold value changes
+			if (!strcmp(token, "$comment"))
+				reader.skipSection();
+			continue;
+		}
+		const char *id;
+		char value;
+		if (token[0] == 'b' || token[0] == 'B' || token[0] == 'r' || token[0] == 'R') {
+			value = token[strlen(token) - 1];
+			if (!(id = reader.next()))
+				break;
+		}
+		else {
+			value = token[0];
+			id = token + 1;
+		}
+		if (stageId == id)
+			stageLevel = (value == '1');
+		else if (eventId == id)
+			eventLevel = (value == '1');
+		else
+			continue;
+		pending = true;
+	}
+	if (pending)
+		markers.sample(t, stageLevel, eventLevel);
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	const char *path = NULL, *stagePin = NULL, *eventPin = NULL, *stageList = NULL, *firmware = "battery";
+	double sampleRate = 0;
+	int width = 50;
+	bool usage = false;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-f") && i + 1 < argc)
+			firmware = argv[++i];
+		else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+			stageList = argv[++i];
+		else if (!strcmp(argv[i], "-a") && i + 1 < argc)
+			stagePin = argv[++i];
+		else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+			eventPin = argv[++i];
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			sampleRate = parseRate(argv[++i]);
+		else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+			width = atoi(argv[++i]);
+		else if (argv[i][0] != '-' && !path)
+			path = argv[i];
+		else
+			usage = true;
+	}
+	if (strcmp(firmware, "battery") && strcmp(firmware, "charger"))
+		usage = true;
+	if (usage || !path || width < 1) {
+		fprintf(stderr, "Usage: %s [-f battery|charger] [-s stage,stage,...] [-a stagePin] [-b eventPin]\n"
+				"\t\t[-r sampleRate] [-w width] capture.csv|capture.vcd\n", argv[0]);
+		return 1;
+	}
+
+	Markers markers;
+	if (stageList) {
+		std::string list = stageList;
+		size_t from = 0, comma;
+		while ((comma = list.find(',', from)) != std::string::npos) {
+			markers.stageNames.push_back(list.substr(from, comma - from));
+			from = comma + 1;
+		}
+		markers.stageNames.push_back(list.substr(from));
+	}
+	else if (!strcmp(firmware, "charger"))
+		markers.stageNames.assign(chargerStages, chargerStages + sizeof(chargerStages) / sizeof(chargerStages[0]));
+	else
+		markers.stageNames.assign(batteryStages, batteryStages + sizeof(batteryStages) / sizeof(batteryStages[0]));
+
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		fprintf(stderr, "Can't read %s\n", path);
+		return 1;
+	}
+	size_t length = strlen(path);
+	bool vcd = length > 4 && !strcasecmp(path + length - 4, ".vcd");
+	bool ok = vcd ? readVCD(f, stagePin, eventPin, markers) : readCSV(f, stagePin, eventPin, sampleRate, markers);
+	fclose(f);
+	if (!ok)
+		return 1;
+	if (markers.loops.count == 0) {
+		fprintf(stderr, "No complete loops in the capture: check the pins, and that it's fast enough (see markerTiming.cpp)\n");
+		return 1;
+	}
+	markers.report(width);
+	return 0;
+}
@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# crossBuild.sh
+#
+# Builds a firmware project with TI's msp430-gcc into an ELF file for msp430Bench, e.g.
+#	crossBuild.sh "02 Firmware/Battery 100" battery100.elf
+#	crossBuild.sh "02 Firmware/Charger" charger.elf
+# then
+#	msp430Bench -a 4=450 battery100.elf
+#
+# The optional sources (logTemp.cpp, eventTrace.cpp, ...) are built if their "#define enable..."
+# line in header.h isn't commented out, the same as you would have to remember to do in CCS,
+# or if CFLAGS turns them on (e.g. CFLAGS="-Os -DenableFirstRunTest").
+# Set MSP430_GCC to where msp430-gcc is installed (default /opt/ti/msp430-gcc), and
+# CFLAGS to change the optimisation (default -Os).
+#
+# The production builds are with CCS, so the cycle counts are for gcc's code rather than
+# TI's, which are close but not the same. Also, under gcc:
+#  - #pragma NOINIT is ignored, so the trace ring and warm boot state are cleared on every boot
+#  - _system_pre_init() isn't called by the start-up code, so enableWarmBoot builds do a cold
+#    boot every time
+# neither of which changes the cycle counts of the main loop.
+
+set -e
+
+if [ $# -ne 2 ]; then
+	echo "Usage: $0 <firmware directory> <output.elf>" >&2
+	exit 1
+fi
+source=$1
+output=$2
+gcc=${MSP430_GCC:-/opt/ti/msp430-gcc}
+cflags=${CFLAGS:--Os}
+
+# Every .cpp file, less the optional ones whose enable line is commented out (and not in CFLAGS)
+optional=$(awk -v cflags=" $cflags " '
+	/include or not include .*\.cpp!/ {match($0, /[A-Za-z0-9_]+\.cpp/); file = substr($0, RSTART, RLENGTH); next}
+	file != "" && /#define[ \t]+enable/ {
+		match($0, /enable[A-Za-z0-9_]+/)
+		if ($0 ~ /^[ \t]*\/\// && index(cflags, " -D" substr($0, RSTART, RLENGTH) " ") == 0) print file
+		file = ""
+	}
+' "$source/header.h")
+sources=""
+for f in "$source"/*.cpp; do
+	skip=0
+	for o in $optional; do
+		[ "$(basename "$f")" = "$o" ] && skip=1
+	done
+	[ $skip -eq 0 ] && sources="$sources \"$f\""
+done
+
+eval "\"$gcc/bin/msp430-elf-g++\" -mmcu=msp430g2332 $cflags -g -fno-exceptions -fno-rtti \
+	-Wno-unknown-pragmas -I\"$gcc/include\" -L\"$gcc/include\" -o \"$output\" $sources"
+"$gcc/bin/msp430-elf-size" "$output"
@@ -0,0 +1,126 @@
+/*
+ * elfImage.cpp
+ *
+ * See elfImage.h
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include "elfImage.h"
+
+#define EM_MSP430		105
+#define PT_LOAD			1
+#define SHT_SYMTAB		2
+#define SHT_NOBITS		8
+#define SHF_ALLOC		2
+#define STT_FUNC		2
+
+static uint16_t u16(const std::vector<uint8_t> &f, size_t o) {
+	return f[o] | f[o + 1] << 8;
+}
+
+static uint32_t u32(const std::vector<uint8_t> &f, size_t o) {
+	return f[o] | f[o + 1] << 8 | f[o + 2] << 16 | (uint32_t) f[o + 3] << 24;
+}
+
+static std::string demangle(const char *name) {
+	int status;
+	char *demangled = abi::__cxa_demangle(name, NULL, NULL, &status);
+	std::string result = status == 0 ? demangled : name;
+	free(demangled);
+	size_t bracket = result.find('(');
+	return bracket == std::string::npos ? result : result.substr(0, bracket);
+}
+
+const ElfFunction *ElfImage::function(uint16_t address) const {
+	std::vector<ElfFunction>::const_iterator i = std::lower_bound(functions.begin(), functions.end(), address,
+			[](const ElfFunction &f, uint16_t a) {return f.address < a;});
+	return i != functions.end() && i->address == address ? &*i : NULL;
+}
+
+const ElfFunction *ElfImage::function(const std::string &name) const {
+	for (size_t i = 0; i < functions.size(); i++) {
+		if (functions[i].name == name)
+			return &functions[i];
+	}
+	return NULL;
+}
+
+bool loadElf(const char *path, Msp430 &cpu, ElfImage &image) {
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		fprintf(stderr, "Can't open %s\n", path);
+		return false;
+	}
+	std::vector<uint8_t> f;
+	uint8_t buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		f.insert(f.end(), buffer, buffer + n);
+	fclose(file);
+	if (f.size() < 52 || memcmp(&f[0], "\177ELF", 4) != 0 || f[4] != 1 || f[5] != 1 || u16(f, 18) != EM_MSP430) {
+		fprintf(stderr, "%s: not a 32-bit little endian MSP430 ELF file\n", path);
+		return false;
+	}
+	uint32_t phoff = u32(f, 28), shoff = u32(f, 32);
+	uint16_t phentsize = u16(f, 42), phnum = u16(f, 44), shentsize = u16(f, 46), shnum = u16(f, 48), shstrndx = u16(f, 50);
+	if ((size_t) phoff + phnum * phentsize > f.size() || (size_t) shoff + shnum * shentsize > f.size() || shstrndx >= shnum) {
+		fprintf(stderr, "%s: truncated\n", path);
+		return false;
+	}
+
+	// Load segments at their load (physical) addresses: .data's initial values go to flash,
+	// for the start-up code to copy into RAM
+	image.flashBytes = 0;
+	for (int i = 0; i < phnum; i++) {
+		size_t h = phoff + i * phentsize;
+		uint32_t offset = u32(f, h + 4), paddr = u32(f, h + 12), filesz = u32(f, h + 16);
+		if (u32(f, h) != PT_LOAD || filesz == 0)
+			continue;
+		if (paddr + filesz > 0x10000 || offset + filesz > f.size()) {
+			fprintf(stderr, "%s: segment at 0x%X doesn't fit\n", path, paddr);
+			return false;
+		}
+		memcpy(&cpu.memory[paddr], &f[offset], filesz);
+		if (paddr >= 0x1100)		// Main flash (information memory isn't counted)
+			image.flashBytes += filesz;
+	}
+
+	// Sections and symbols
+	size_t shstr = u32(f, shoff + shstrndx * shentsize + 16);
+	image.ramBytes = 0;
+	image.stackTop = -1;
+	image.sections.clear();
+	image.functions.clear();
+	for (int i = 0; i < shnum; i++) {
+		size_t h = shoff + i * shentsize;
+		uint32_t type = u32(f, h + 4), flags = u32(f, h + 8), addr = u32(f, h + 12), offset = u32(f, h + 16), size = u32(f, h + 20);
+		uint32_t link = u32(f, h + 24), entsize = u32(f, h + 36);
+		const char *name = (const char *) &f[shstr + u32(f, h)];
+		if ((flags & SHF_ALLOC) && size) {
+			ElfSection section = {name, (uint16_t) addr, size};
+			image.sections.push_back(section);
+			if (addr >= 0x200 && addr < 0x1000 && strcmp(name, ".stack") && strcmp(name, ".heap"))
+				image.ramBytes += size;
+		}
+		if (type != SHT_SYMTAB || !entsize)
+			continue;
+		size_t strtab = u32(f, shoff + link * shentsize + 16);
+		for (size_t s = offset; s + entsize <= offset + size; s += entsize) {
+			const char *symbol = (const char *) &f[strtab + u32(f, s)];
+			uint32_t value = u32(f, s + 4), symbolSize = u32(f, s + 8);
+			if (!strcmp(symbol, "__stack"))
+				image.stackTop = value;
+			if ((f[s + 12] & 15) == STT_FUNC) {
+				ElfFunction function = {(uint16_t) value, (uint16_t) symbolSize, demangle(symbol)};
+				image.functions.push_back(function);
+			}
+		}
+	}
+	std::sort(image.functions.begin(), image.functions.end(),
+			[](const ElfFunction &a, const ElfFunction &b) {return a.address < b.address;});
+	return true;
+}
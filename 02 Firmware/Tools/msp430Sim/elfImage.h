@@ -0,0 +1,44 @@
+/*
+ * elfImage.h
+ *
+ * Loads an MSP430 ELF file (as linked by msp430-gcc) into the simulator's memory, and
+ * reads its function symbols and memory usage.
+ */
+
+#ifndef ELFIMAGE_H_
+#define ELFIMAGE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "msp430Sim.h"
+
+struct ElfFunction {
+	uint16_t address;
+	uint16_t size;
+	std::string name;			// Demangled, without the parameter list
+};
+
+struct ElfSection {
+	std::string name;
+	uint16_t address;
+	uint32_t size;
+};
+
+struct ElfImage {
+	std::vector<ElfFunction> functions;		// Sorted by address
+	std::vector<ElfSection> sections;		// Allocated sections, in file order
+	uint32_t flashBytes;		// Loaded into flash: code, constants, initial values of .data, vectors
+	uint32_t ramBytes;			// Static RAM: .data, .bss, .noinit
+	int stackTop;				// Address of __stack, or -1 if there isn't one
+
+	// Function starting at address, or NULL
+	const ElfFunction *function(uint16_t address) const;
+	// Function by name (e.g. "refreshADCs"), or NULL
+	const ElfFunction *function(const std::string &name) const;
+};
+
+// Returns false with a message on stderr on failure
+bool loadElf(const char *path, Msp430 &cpu, ElfImage &image);
+
+#endif /* ELFIMAGE_H_ */
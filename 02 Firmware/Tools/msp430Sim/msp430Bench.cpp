@@ -0,0 +1,331 @@
+/*
+ * msp430Bench.cpp
+ *
+ * Runs a firmware binary (Battery 100 or Charger, cross-compiled with msp430-gcc, see
+ * crossBuild.sh) in the MSP430 instruction set simulator with scripted ADC and port inputs,
+ * and reports exact cycle counts on the real instruction set, without a board:
+ *  - flash and RAM used, and the deepest the stack went
+ *  - cycles per main loop, and per call of every function (so per main loop step, per
+ *    readADCChannel(), ...), inclusive and exclusive of the functions it calls
+ *  - cycles per boot: from reset to the main loop, or back to sleep if there's no PV
+ *
+ * Build:	g++ -O2 -std=c++11 -o msp430Bench msp430Bench.cpp msp430Sim.cpp elfImage.cpp
+ * Usage:	msp430Bench [options] firmware.elf
+ *	-a channel=value	ADC reading for a channel (INCHx), e.g. -a 4=450 for PV on the Battery 100
+ *	-p port=value		Port input, e.g. -p p2=0x01
+ *	-i script			Timed inputs: lines of "seconds channel=value ... p1=value p2=value"
+ *	-m function			Function called once per main loop (default refreshBatteryStatus)
+ *	-n loops			Stop after this many main loops (default 10000)
+ *	-t seconds			Stop after this much simulated time (default none)
+ *	-w address=value	Write a byte of memory before powering up (e.g. information flash)
+ *	-F bytes -R bytes	Flash and RAM sizes to report against (default 4096 and 256)
+ *
+ * Cycles are MCLK cycles while the CPU is running, including where the flash controller
+ * holds the CPU. Interrupt service routines count towards the function they interrupted.
+ * Functions inlined or tail-called by the compiler don't show up on their own.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "elfImage.h"
+#include "msp430Sim.h"
+
+struct Stats {
+	uint64_t count, total, min, max;
+	Stats() : count(0), total(0), min(~(uint64_t) 0), max(0) {}
+	void add(uint64_t value) {
+		count++;
+		total += value;
+		if (value < min)
+			min = value;
+		if (value > max)
+			max = value;
+	}
+	void print(const char *name) const {
+		if (count)
+			printf("  %-26s %10llu  %10.1f %10llu %10llu\n", name, (unsigned long long) count, (double) total / count,
+					(unsigned long long) min, (unsigned long long) max);
+		else
+			printf("  %-26s %10d\n", name, 0);
+	}
+};
+
+struct FunctionStats {
+	Stats inclusive;
+	uint64_t exclusive;
+	FunctionStats() : exclusive(0) {}
+};
+
+class Profiler : public Msp430Observer {
+public:
+	Profiler(Msp430 &cpu, const ElfImage &image, int marker) : loops(0), cpu(cpu), image(image), marker(marker),
+			inBoot(false), lastLoop(0), haveLastLoop(false), bootStart(0), functions(image.functions.size() + 1) {}
+
+	void call(uint16_t target, uint16_t sp) {
+		enter(functionIndex(target), sp);
+		if (frames.back().function == marker) {
+			if (inBoot)
+				bootToLoop.add(cpu.cycles - bootStart);
+			else if (haveLastLoop)
+				loopCycles.add(cpu.cycles - lastLoop);
+			inBoot = false;
+			lastLoop = cpu.cycles;
+			haveLastLoop = true;
+			loops++;
+		}
+	}
+	void ret(uint16_t sp) {
+		leave(sp - 2);
+	}
+	void interrupt(uint16_t vector, uint16_t sp) {
+		enter(functionIndex(cpu.memory[vector] | cpu.memory[vector + 1] << 8), sp);
+	}
+	void reti(uint16_t sp) {
+		leave(sp - 4);
+	}
+	void reset(uint8_t) {
+		frames.clear();
+		inBoot = true;
+		haveLastLoop = false;
+		bootStart = cpu.cycles;
+	}
+	void sleep(void) {
+		if (inBoot)
+			bootToSleep.add(cpu.cycles - bootStart);
+		inBoot = false;
+		haveLastLoop = false;
+	}
+
+	void report(void) const {
+		printf("\nMain loop (%s calls)           count   average        min        max\n", name(marker).c_str());
+		loopCycles.print("cycles per loop");
+		printf("\nBoots (cycles from reset)\n");
+		bootToLoop.print("to the main loop");
+		bootToSleep.print("back to sleep");
+		// Functions, busiest first
+		std::vector<int> order;
+		for (size_t i = 0; i < functions.size(); i++) {
+			if (functions[i].inclusive.count)
+				order.push_back(i);
+		}
+		std::sort(order.begin(), order.end(), [this](int a, int b) {return functions[a].exclusive > functions[b].exclusive;});
+		uint64_t total = 0;
+		for (size_t i = 0; i < order.size(); i++)
+			total += functions[order[i]].exclusive;
+		printf("\nFunctions (cycles per call)        calls   average        min        max   exclusive\n");
+		for (size_t i = 0; i < order.size(); i++) {
+			const FunctionStats &f = functions[order[i]];
+			printf("  %-26s %10llu  %10.1f %10llu %10llu  %5.1f%%\n", name(order[i]).c_str(), (unsigned long long) f.inclusive.count,
+					(double) f.inclusive.total / f.inclusive.count, (unsigned long long) f.inclusive.min,
+					(unsigned long long) f.inclusive.max, total ? 100.0 * f.exclusive / total : 0);
+		}
+	}
+
+	uint64_t loops;
+
+private:
+	struct Frame {
+		int function;
+		uint64_t entry;
+		uint64_t children;
+		uint16_t sp;
+	};
+
+	int functionIndex(uint16_t address) const {
+		const ElfFunction *f = image.function(address);
+		return f ? f - &image.functions[0] : image.functions.size();
+	}
+	std::string name(int function) const {
+		return function < (int) image.functions.size() ? image.functions[function].name : std::string("(unknown)");
+	}
+	void enter(int function, uint16_t sp) {
+		Frame frame = {function, cpu.cycles, 0, sp};
+		frames.push_back(frame);
+	}
+	void leave(uint16_t sp) {
+		// Normally the top frame; anything above sp has been unwound without returning
+		while (!frames.empty() && frames.back().sp <= sp) {
+			Frame frame = frames.back();
+			frames.pop_back();
+			uint64_t inclusive = cpu.cycles - frame.entry;
+			functions[frame.function].inclusive.add(inclusive);
+			functions[frame.function].exclusive += inclusive - frame.children;
+			if (!frames.empty())
+				frames.back().children += inclusive;
+			if (frame.sp == sp)
+				break;
+		}
+	}
+
+	Msp430 &cpu;
+	const ElfImage &image;
+	int marker;
+	bool inBoot;
+	uint64_t lastLoop;
+	bool haveLastLoop;
+	uint64_t bootStart;
+	std::vector<Frame> frames;
+	std::vector<FunctionStats> functions;
+	Stats loopCycles, bootToLoop, bootToSleep;
+};
+
+struct ScriptEvent {
+	double time;
+	std::vector<std::pair<std::string, long> > settings;
+};
+
+static bool parseSetting(const char *text, std::pair<std::string, long> &setting) {
+	const char *equals = strchr(text, '=');
+	if (!equals || equals == text)
+		return false;
+	setting.first = std::string(text, equals - text);
+	char *end;
+	setting.second = strtol(equals + 1, &end, 0);
+	return *end == 0 && end != equals + 1;
+}
+
+static bool apply(Msp430 &cpu, const std::pair<std::string, long> &setting) {
+	if (setting.first == "p1" || setting.first == "p2") {
+		cpu.setPortInputs(setting.first == "p1" ? setting.second : cpu.p1In, setting.first == "p2" ? setting.second : cpu.p2In);
+		return true;
+	}
+	char *end;
+	long channel = strtol(setting.first.c_str(), &end, 0);
+	if (*end || channel < 0 || channel > 15)
+		return false;
+	cpu.adcInput[channel] = setting.second & 0x3FF;
+	return true;
+}
+
+static bool loadScript(const char *path, std::vector<ScriptEvent> &script) {
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "Can't open %s\n", path);
+		return false;
+	}
+	char line[1024];
+	int lineNumber = 0;
+	while (fgets(line, sizeof(line), f)) {
+		lineNumber++;
+		char *hash = strchr(line, '#');
+		if (hash)
+			*hash = 0;
+		char *token = strtok(line, " \t\r\n");
+		if (!token)
+			continue;
+		ScriptEvent event;
+		event.time = atof(token);
+		while ((token = strtok(NULL, " \t\r\n"))) {
+			std::pair<std::string, long> setting;
+			if (!parseSetting(token, setting)) {
+				fprintf(stderr, "%s:%d: can't read \"%s\"\n", path, lineNumber, token);
+				fclose(f);
+				return false;
+			}
+			event.settings.push_back(setting);
+		}
+		script.push_back(event);
+	}
+	fclose(f);
+	std::stable_sort(script.begin(), script.end(), [](const ScriptEvent &a, const ScriptEvent &b) {return a.time < b.time;});
+	return true;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "Usage: %s [-a channel=value] [-p port=value] [-i script] [-m function] [-n loops] [-t seconds]\n"
+			"          [-w address=value] [-F flashBytes] [-R ramBytes] firmware.elf\n", name);
+}
+
+int main(int argc, char *argv[]) {
+	static Msp430 cpu;
+	std::vector<std::pair<std::string, long> > inputs, writes;
+	std::vector<ScriptEvent> script;
+	std::string markerName = "refreshBatteryStatus";
+	unsigned long long maxLoops = 10000;
+	double maxTime = 1e30;
+	unsigned long flashSize = 4096, ramSize = 256;
+	const char *path = NULL;
+	for (int i = 1; i < argc; i++) {
+		std::pair<std::string, long> setting;
+		if ((!strcmp(argv[i], "-a") || !strcmp(argv[i], "-p")) && i + 1 < argc && parseSetting(argv[i + 1], setting))
+			inputs.push_back(setting), i++;
+		else if (!strcmp(argv[i], "-w") && i + 1 < argc && parseSetting(argv[i + 1], setting))
+			writes.push_back(setting), i++;
+		else if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+			if (!loadScript(argv[++i], script))
+				return 1;
+		}
+		else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+			markerName = argv[++i];
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			maxLoops = strtoull(argv[++i], NULL, 0);
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			maxTime = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-F") && i + 1 < argc)
+			flashSize = strtoul(argv[++i], NULL, 0);
+		else if (!strcmp(argv[i], "-R") && i + 1 < argc)
+			ramSize = strtoul(argv[++i], NULL, 0);
+		else if (!path && argv[i][0] != '-')
+			path = argv[i];
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (!path) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	ElfImage image;
+	if (!loadElf(path, cpu, image))
+		return 1;
+	const ElfFunction *marker = image.function(markerName);
+	if (!marker) {
+		fprintf(stderr, "%s: no function called %s\n", path, markerName.c_str());
+		return 1;
+	}
+	for (size_t i = 0; i < inputs.size(); i++) {
+		if (!apply(cpu, inputs[i])) {
+			fprintf(stderr, "Unknown input %s\n", inputs[i].first.c_str());
+			return 1;
+		}
+	}
+	for (size_t i = 0; i < writes.size(); i++)
+		cpu.memory[strtoul(writes[i].first.c_str(), NULL, 0) & 0xFFFF] = writes[i].second;
+
+	Profiler profiler(cpu, image, marker - &image.functions[0]);
+	cpu.observer = &profiler;
+	cpu.powerOn(1);
+	const uint16_t stackTop = image.stackTop >= 0 ? image.stackTop : 0x200 + ramSize;
+	uint16_t lowestSP = stackTop;
+	size_t nextEvent = 0;
+	while (profiler.loops < maxLoops && cpu.time < maxTime && !cpu.stuck) {
+		while (nextEvent < script.size() && script[nextEvent].time <= cpu.time) {
+			for (size_t i = 0; i < script[nextEvent].settings.size(); i++) {
+				if (!apply(cpu, script[nextEvent].settings[i]))
+					fprintf(stderr, "Unknown input %s\n", script[nextEvent].settings[i].first.c_str());
+			}
+			nextEvent++;
+		}
+		cpu.step(nextEvent < script.size() ? script[nextEvent].time : maxTime);
+		if (cpu.r[1] < lowestSP && cpu.r[1] >= 0x200)
+			lowestSP = cpu.r[1];
+	}
+	if (cpu.stuck)
+		printf("Stopped: the CPU %s (PC 0x%04X)\n", cpu.cpuOff() ? "is off with nothing to wake it" : "hit an illegal instruction", cpu.r[0]);
+
+	printf("%s\n", path);
+	printf("  flash %5u of %5lu bytes (%.1f%%)\n", image.flashBytes, flashSize, 100.0 * image.flashBytes / flashSize);
+	printf("  RAM   %5u of %5lu bytes (%.1f%%) static, %u more for the stack at its deepest, %ld free\n", image.ramBytes,
+			ramSize, 100.0 * image.ramBytes / ramSize, stackTop - lowestSP, (long) ramSize - image.ramBytes - (stackTop - lowestSP));
+	printf("  simulated %.3f s (CPU off %.1f%%), %llu cycles, %llu main loops, MCLK now %.2f MHz\n", cpu.time,
+			cpu.time > 0 ? 100 * cpu.timeCpuOff / cpu.time : 0, (unsigned long long) cpu.cycles,
+			(unsigned long long) profiler.loops, cpu.mclkHz() / 1e6);
+	profiler.report();
+	return 0;
+}
@@ -0,0 +1,907 @@
+/*
+ * msp430Sim.cpp
+ *
+ * See msp430Sim.h
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "msp430Sim.h"
+
+// Status register
+#define SR_C		0x0001
+#define SR_Z		0x0002
+#define SR_N		0x0004
+#define SR_GIE		0x0008
+#define SR_CPUOFF	0x0010
+#define SR_OSCOFF	0x0020
+#define SR_SCG0		0x0040
+#define SR_SCG1		0x0080
+#define SR_V		0x0100
+
+// Peripheral registers of the MSP430G2332
+#define IE1			0x0000
+#define IFG1		0x0002
+#define BCSCTL3		0x0053
+#define DCOCTL		0x0056
+#define BCSCTL1		0x0057
+#define BCSCTL2		0x0058
+#define P1IN		0x0020
+#define P1IFG		0x0023
+#define P1IES		0x0024
+#define P1IE		0x0025
+#define P2IN		0x0028
+#define P2IFG		0x002B
+#define P2IES		0x002C
+#define P2IE		0x002D
+#define TAIV		0x012E
+#define WDTCTL		0x0120
+#define FCTL1		0x0128
+#define FCTL2		0x012A
+#define FCTL3		0x012C
+#define TACTL		0x0160
+#define TACCTL0		0x0162
+#define TACCTL1		0x0164
+#define TAR			0x0170
+#define TACCR0		0x0172
+#define TACCR1		0x0174
+#define ADC10CTL0	0x01B0
+#define ADC10CTL1	0x01B2
+#define ADC10MEM	0x01B4
+
+// Interrupt vectors
+#define VECTOR_PORT1	0xFFE4
+#define VECTOR_PORT2	0xFFE6
+#define VECTOR_ADC10	0xFFEA
+#define VECTOR_TA1		0xFFF0
+#define VECTOR_TA0		0xFFF2
+#define VECTOR_WDT		0xFFF4
+#define VECTOR_RESET	0xFFFE
+
+// Reset causes (IFG1)
+#define CAUSE_WDT	0x01
+#define CAUSE_POR	0x04
+#define CAUSE_RST	0x08
+
+#define VLO_HZ		12000.0
+#define LFXT1_HZ	32768.0
+#define ADC10OSC_HZ	5000000.0
+#define FLASH_ERASE_FTG		4819	// Segment erase, in flash timing generator clocks
+#define FLASH_WRITE_FTG		30		// Byte or word write
+
+static const double never = 1e30;
+
+Msp430::Msp430() {
+	memset(memory, 0xFF, sizeof(memory));	// Erased flash
+	memset(r, 0, sizeof(r));
+	cycles = 0;
+	time = timeCpuOff = 0;
+	for (int i = 0; i < 16; i++)
+		adcInput[i] = 0;
+	p1In = p2In = 0;
+	stuck = false;
+	observer = NULL;
+	wdtCount = timerFraction = adcRemaining = 0;
+	pucPending = false;
+	pucCause = 0;
+	// Information memory segment A: ADC10 calibration for an ideal part (no gain or offset
+	// error, typical temperature sensor), and the DCO calibration for the clock model
+	setWord(0x10DA, 0x0810);		// TAG_ADC10_1, 16 bytes
+	setWord(0x10DC, 0x8000);		// CAL_ADC_GAIN_FACTOR
+	setWord(0x10DE, 0);				// CAL_ADC_OFFSET
+	setWord(0x10E0, 0x8000);		// CAL_ADC_15VREF_FACTOR
+	setWord(0x10E2, 745);			// CAL_ADC_15T30
+	setWord(0x10E4, 878);			// CAL_ADC_15T85
+	setWord(0x10E6, 0x8000);		// CAL_ADC_25VREF_FACTOR
+	setWord(0x10E8, 447);			// CAL_ADC_25T30
+	setWord(0x10EA, 527);			// CAL_ADC_25T85
+	setWord(0x10F6, 0x0801);		// TAG_DCO_30, 8 bytes
+	const double targets[4] = {16e6, 12e6, 8e6, 1e6};
+	for (int i = 0; i < 4; i++)
+		calibrateDCO(targets[i], memory[0x10F8 + 2 * i], memory[0x10F9 + 2 * i]);
+	// Temperature sensor at 25C, and Vcc/2 at 3V, on the 2.5V reference
+	adcInput[10] = 745 - (878 - 745) * 5 / 55;
+	adcInput[11] = 614;
+}
+
+double Msp430::dcoModelHz(int rsel, int dco, int mod) {
+	// Each RSEL step is about 1.35 times the last, and each DCO step 1.08 (SLAS723), with
+	// MOD mixing in the next DCO step. Lands on the datasheet's typical ranges.
+	double f = 135e3 * pow(1.35, rsel) * pow(1.08, dco);
+	if (dco == 7)
+		return f;
+	return f * (32 - mod) / 32 + f * 1.08 * mod / 32;
+}
+
+void Msp430::calibrateDCO(double hz, uint8_t &dcoctl, uint8_t &bcsctl1) {
+	double best = never;
+	for (int rsel = 0; rsel < 16; rsel++) {
+		for (int dco = 0; dco < 8; dco++) {
+			for (int mod = 0; mod < 32; mod++) {
+				double error = fabs(dcoModelHz(rsel, dco, mod) - hz);
+				if (error < best) {
+					best = error;
+					dcoctl = dco << 5 | mod;
+					bcsctl1 = 0x80 | rsel;		// XT2OFF, as the factory values have it
+				}
+			}
+		}
+	}
+}
+
+double Msp430::dcoHz(void) const {
+	return dcoModelHz(memory[BCSCTL1] & 0x0F, memory[DCOCTL] >> 5, memory[DCOCTL] & 0x1F);
+}
+
+double Msp430::aclkHz(void) const {
+	double source = ((memory[BCSCTL3] >> 4) & 3) == 2 ? VLO_HZ : LFXT1_HZ;
+	return source / (1 << ((memory[BCSCTL1] >> 4) & 3));
+}
+
+double Msp430::mclkHz(void) const {
+	uint8_t bcsctl2 = memory[BCSCTL2];
+	double source = (bcsctl2 >> 6) >= 2 ? aclkHz() * (1 << ((memory[BCSCTL1] >> 4) & 3)) : dcoHz();
+	return source / (1 << ((bcsctl2 >> 4) & 3));
+}
+
+double Msp430::smclkHz(void) const {
+	uint8_t bcsctl2 = memory[BCSCTL2];
+	double source = (bcsctl2 & 0x08) ? aclkHz() * (1 << ((memory[BCSCTL1] >> 4) & 3)) : dcoHz();
+	return source / (1 << ((bcsctl2 >> 1) & 3));
+}
+
+void Msp430::powerOn(uint32_t seed) {
+	// RAM is random at power up
+	for (int a = 0x200; a < 0x400; a++) {
+		seed = seed * 1103515245 + 12345;
+		memory[a] = seed >> 16;
+	}
+	memory[IFG1] = 0;
+	puc(CAUSE_POR);
+}
+
+void Msp430::resetPin(void) {
+	puc(CAUSE_RST);
+}
+
+void Msp430::puc(uint8_t cause) {
+	pucPending = false;
+	memory[IE1] = 0;
+	memory[IFG1] = (memory[IFG1] & (CAUSE_WDT | CAUSE_POR | CAUSE_RST)) | cause;
+	memory[DCOCTL] = 0x60;
+	memory[BCSCTL1] = 0x87;
+	memory[BCSCTL2] = 0;
+	memory[BCSCTL3] = 0x05;
+	// Ports (PxOUT is unchanged), the XIN/XOUT pins are selected
+	for (int port = 0; port < 2; port++) {
+		uint16_t base = port ? P2IN : P1IN;
+		for (int offset = 2; offset < 8; offset++)
+			memory[base + offset] = 0;
+	}
+	memory[0x41] = memory[0x42] = 0;		// PxSEL2
+	memory[0x2E] = 0xC0;					// P2SEL
+	// Watchdog on, sourced from SMCLK, 32768 counts
+	setWord(WDTCTL, 0x6900);
+	wdtCount = 0;
+	setWord(FCTL1, 0x9600);
+	setWord(FCTL2, 0x9642);
+	setWord(FCTL3, 0x9658);
+	for (uint16_t a = TACTL; a <= TACCR1; a += 2)
+		setWord(a, 0);
+	setWord(TAIV, 0);
+	timerFraction = 0;
+	setWord(ADC10CTL0, 0);
+	setWord(ADC10CTL1, 0);
+	memory[0x48] = memory[0x49] = memory[0x4A] = 0;
+	adcRemaining = 0;
+	r[2] = 0;
+	r[0] = word(VECTOR_RESET);
+	if (observer)
+		observer->reset(memory[IFG1]);
+}
+
+void Msp430::setPortInputs(uint8_t p1, uint8_t p2) {
+	uint8_t old[2] = {p1In, p2In}, now[2] = {p1, p2};
+	for (int port = 0; port < 2; port++) {
+		uint16_t ies = port ? P2IES : P1IES, ifg = port ? P2IFG : P1IFG;
+		uint8_t rising = ~old[port] & now[port], falling = old[port] & ~now[port];
+		memory[ifg] |= (rising & ~memory[ies]) | (falling & memory[ies]);
+	}
+	p1In = p1;
+	p2In = p2;
+}
+
+uint8_t Msp430::readPeripheral(uint16_t address) {
+	switch (address) {
+	case P1IN:
+		return p1In;
+	case P2IN:
+		return p2In;
+	case WDTCTL + 1:
+		return 0x69;
+	case FCTL1 + 1:
+	case FCTL2 + 1:
+	case FCTL3 + 1:
+		return 0x96;
+	}
+	return memory[address];
+}
+
+uint16_t Msp430::read(uint16_t address, bool byte) {
+	if (!byte)
+		address &= ~1;
+	if (address >= 0x200)
+		return byte ? memory[address] : word(address);
+	if (address == TAIV) {
+		// Reading TAIV gives the highest pending Timer_A1 source, and clears its flag
+		uint16_t value = 0;
+		if (memory[TACCTL1] & 0x01) {
+			value = 0x02;
+			memory[TACCTL1] &= ~0x01;
+		}
+		else if (memory[TACTL] & 0x01) {
+			value = 0x0A;
+			memory[TACTL] &= ~0x01;
+		}
+		return value;
+	}
+	if (byte)
+		return readPeripheral(address);
+	return readPeripheral(address) | readPeripheral(address + 1) << 8;
+}
+
+void Msp430::write(uint16_t address, uint16_t value, bool byte) {
+	if (!byte)
+		address &= ~1;
+	if (address < 0x200)
+		writePeripheral(address, value, byte);
+	else if (address >= 0x1000)
+		flashAccess(address, value, byte);
+	else if (byte)
+		memory[address] = value;
+	else
+		setWord(address, value);
+}
+
+void Msp430::writePeripheral(uint16_t address, uint16_t value, bool byte) {
+	uint16_t wordAddress = address & ~1;
+	// Password protected registers: a bad password (or a byte write) resets the MCU
+	if (wordAddress == WDTCTL || wordAddress == FCTL1 || wordAddress == FCTL2 || wordAddress == FCTL3) {
+		uint8_t password = wordAddress == WDTCTL ? 0x5A : 0xA5;
+		if (byte || (value >> 8) != password) {
+			if (wordAddress == WDTCTL)
+				pucCause = CAUSE_WDT;
+			else {
+				memory[FCTL3] |= 0x02;		// KEYV
+				pucCause = 0;
+			}
+			pucPending = true;
+			return;
+		}
+		if (wordAddress == WDTCTL) {
+			if (value & 0x08)				// WDTCNTCL
+				wdtCount = 0;
+			memory[WDTCTL] = value & ~0x08;
+		}
+		else if (wordAddress == FCTL3)
+			memory[FCTL3] = ((memory[FCTL3] & 0x41) ^ (value & 0x40)) | (value & 0x3E);	// BUSY is read only, LOCKA toggles
+		else
+			memory[wordAddress] = value;
+		return;
+	}
+	if (address == P1IN || address == P2IN || wordAddress == TAIV || wordAddress == ADC10MEM)
+		return;
+	if (byte)
+		memory[address] = value;
+	else
+		setWord(address, value);
+	switch (wordAddress) {
+	case ADC10CTL0:
+		if ((word(ADC10CTL0) & 0x13) == 0x13 && adcRemaining <= 0)		// ADC10ON, ENC and ADC10SC
+			startConversion();
+		if (!(word(ADC10CTL0) & 0x10))
+			adcRemaining = 0;
+		break;
+	case ADC10CTL1:
+		// ADC10BUSY is read only
+		memory[ADC10CTL1] = (memory[ADC10CTL1] & ~0x01) | (adcRemaining > 0);
+		break;
+	case TACTL:
+		if (memory[TACTL] & 0x04) {			// TACLR
+			setWord(TAR, 0);
+			timerFraction = 0;
+			memory[TACTL] &= ~0x04;
+		}
+		break;
+	}
+}
+
+void Msp430::startConversion(void) {
+	uint16_t ctl0 = word(ADC10CTL0), ctl1 = word(ADC10CTL1);
+	static const int sampleClocks[4] = {4, 8, 16, 64};
+	double clock;
+	switch ((ctl1 >> 3) & 3) {
+	case 0:
+		clock = ADC10OSC_HZ;
+		break;
+	case 1:
+		clock = aclkHz();
+		break;
+	case 2:
+		clock = mclkHz();
+		break;
+	default:
+		clock = smclkHz();
+		break;
+	}
+	clock /= ((ctl1 >> 5) & 7) + 1;
+	adcRemaining = (sampleClocks[(ctl0 >> 11) & 3] + 13) / clock;
+	setWord(ADC10CTL0, ctl0 & ~0x01);		// ADC10SC resets itself
+	setWord(ADC10CTL1, ctl1 | 0x01);		// ADC10BUSY
+}
+
+double Msp430::ftgHz(void) const {
+	uint8_t fctl2 = memory[FCTL2];
+	double source;
+	switch (fctl2 >> 6) {
+	case 0:
+		source = aclkHz();
+		break;
+	case 1:
+		source = mclkHz();
+		break;
+	default:
+		source = smclkHz();
+		break;
+	}
+	return source / ((fctl2 & 0x3F) + 1);
+}
+
+void Msp430::flashAccess(uint16_t address, uint16_t value, bool byte) {
+	uint8_t fctl1 = memory[FCTL1], fctl3 = memory[FCTL3];
+	if (fctl3 & 0x10) {						// LOCK: ignored, access violation
+		memory[FCTL3] |= 0x04;
+		return;
+	}
+	double hold;
+	if (fctl1 & 0x02) {						// ERASE: the whole segment
+		uint16_t size = address < 0x1100 ? 64 : 512;
+		uint16_t base = address & ~(size - 1);
+		if (base == 0x10C0 && (fctl3 & 0x40))	// Segment A is locked separately
+			return;
+		memset(&memory[base], 0xFF, size);
+		hold = FLASH_ERASE_FTG / ftgHz();
+	}
+	else if (fctl1 & 0x40) {				// WRT: bits can only be cleared
+		memory[address] &= value;
+		if (!byte)
+			memory[address + 1] &= value >> 8;
+		hold = FLASH_WRITE_FTG / ftgHz();
+	}
+	else {
+		memory[FCTL3] |= 0x04;
+		return;
+	}
+	// The CPU is held until the flash is done (MCLK keeps counting)
+	cycles += (uint64_t) (hold * mclkHz());
+	elapse(hold);
+}
+
+uint16_t Msp430::fetch(void) {
+	uint16_t value = word(r[0]);
+	r[0] += 2;
+	return value;
+}
+
+void Msp430::push(uint16_t value) {
+	r[1] -= 2;
+	write(r[1], value, false);
+}
+
+void Msp430::writeSR(uint16_t value) {
+	bool wasOff = cpuOff();
+	r[2] = value & 0x01FF;
+	if (!wasOff && cpuOff() && observer)
+		observer->sleep();
+}
+
+bool Msp430::serviceInterrupt(void) {
+	if (!(r[2] & SR_GIE))
+		return false;
+	uint16_t vector = 0;
+	if ((memory[IE1] & 0x01) && (memory[IFG1] & 0x01) && (memory[WDTCTL] & 0x10)) {
+		vector = VECTOR_WDT;
+		memory[IFG1] &= ~0x01;
+	}
+	else if ((memory[TACCTL0] & 0x11) == 0x11) {
+		vector = VECTOR_TA0;
+		memory[TACCTL0] &= ~0x01;
+	}
+	else if ((memory[TACCTL1] & 0x11) == 0x11 || (memory[TACTL] & 0x03) == 0x03)
+		vector = VECTOR_TA1;
+	else if ((memory[ADC10CTL0] & 0x0C) == 0x0C) {
+		vector = VECTOR_ADC10;
+		memory[ADC10CTL0] &= ~0x04;
+	}
+	else if (memory[P2IFG] & memory[P2IE])
+		vector = VECTOR_PORT2;
+	else if (memory[P1IFG] & memory[P1IE])
+		vector = VECTOR_PORT1;
+	else
+		return false;
+	push(r[0]);
+	push(r[2]);
+	r[2] &= SR_SCG0;
+	r[0] = word(vector);
+	if (observer)
+		observer->interrupt(vector, r[1]);
+	cycles += 6;
+	elapse(6 / mclkHz());
+	return true;
+}
+
+double Msp430::nextEvent(void) const {
+	double next = never;
+	uint8_t wdtctl = memory[WDTCTL];
+	bool smclkOn = !(r[2] & SR_SCG1);
+	if (!(wdtctl & 0x80)) {
+		double clock = (wdtctl & 0x04) ? aclkHz() : (smclkOn ? smclkHz() : 0);
+		static const double intervals[4] = {32768, 8192, 512, 64};
+		if (clock > 0)
+			next = (intervals[wdtctl & 3] - wdtCount) / clock;
+	}
+	if (adcRemaining > 0 && adcRemaining < next)
+		next = adcRemaining;
+	uint16_t tactl = word(TACTL);
+	bool timerInterrupts = (memory[TACCTL0] & 0x10) || (memory[TACCTL1] & 0x10) || (tactl & 0x02);
+	if ((tactl & 0x30) && timerInterrupts) {
+		double clock = ((tactl >> 8) & 3) == 1 ? aclkHz() : ((tactl >> 8) & 3) == 2 && smclkOn ? smclkHz() : 0;
+		clock /= 1 << ((tactl >> 6) & 3);
+		if (clock > 0) {
+			// Up to the next compare, or wrap
+			uint16_t tar = word(TAR);
+			uint32_t ticks = 0x10000 - tar;
+			uint16_t compare[2] = {word(TACCR0), word(TACCR1)};
+			for (int i = 0; i < 2; i++) {
+				if (compare[i] > tar && (uint32_t) (compare[i] - tar) < ticks)
+					ticks = compare[i] - tar;
+			}
+			if (((tactl >> 4) & 3) != 2 && compare[0] == tar)
+				ticks = 1;
+			double t = (ticks - timerFraction) / clock;
+			if (t < next)
+				next = t;
+		}
+	}
+	return next;
+}
+
+void Msp430::tickTimer(uint32_t ticks) {
+	uint16_t tactl = word(TACTL), tar = word(TAR), ccr0 = word(TACCR0), ccr1 = word(TACCR1);
+	int mode = (tactl >> 4) & 3;
+	uint32_t period = mode == 2 ? 0x10000 : ccr0 + 1;
+	if (ticks > 2 * period) {
+		// Long enough for every flag to have been set: skip whole periods
+		tactl |= 0x01;
+		memory[TACCTL0] |= 0x01;
+		if (mode == 2 || ccr1 <= ccr0)
+			memory[TACCTL1] |= 0x01;
+		ticks %= period;
+	}
+	for (uint32_t i = 0; i < ticks; i++) {
+		if (mode != 2 && tar == ccr0) {
+			tar = 0;
+			tactl |= 0x01;		// TAIFG
+		}
+		else if (++tar == 0)
+			tactl |= 0x01;
+		if (tar == ccr0)
+			memory[TACCTL0] |= 0x01;
+		if (tar == ccr1)
+			memory[TACCTL1] |= 0x01;
+	}
+	setWord(TACTL, tactl);
+	setWord(TAR, tar);
+}
+
+void Msp430::elapse(double seconds) {
+	time += seconds;
+	bool smclkOn = !(r[2] & SR_SCG1);
+	// Watchdog
+	uint8_t wdtctl = memory[WDTCTL];
+	if (!(wdtctl & 0x80)) {
+		double clock = (wdtctl & 0x04) ? aclkHz() : (smclkOn ? smclkHz() : 0);
+		static const double intervals[4] = {32768, 8192, 512, 64};
+		double interval = intervals[wdtctl & 3];
+		wdtCount += seconds * clock;
+		if (wdtCount >= interval - 1e-6) {
+			if (wdtctl & 0x10) {			// Interval timer mode
+				memory[IFG1] |= 0x01;
+				wdtCount = fmod(wdtCount + 1e-6, interval);
+			}
+			else if (!pucPending) {
+				pucPending = true;
+				pucCause = CAUSE_WDT;
+			}
+		}
+	}
+	// Timer_A
+	uint16_t tactl = word(TACTL);
+	if (tactl & 0x30) {
+		double clock = ((tactl >> 8) & 3) == 1 ? aclkHz() : ((tactl >> 8) & 3) == 2 && smclkOn ? smclkHz() : 0;
+		timerFraction += seconds * clock / (1 << ((tactl >> 6) & 3));
+		uint32_t ticks = (uint32_t) (timerFraction + 1e-9);
+		if (ticks) {
+			timerFraction -= ticks;
+			tickTimer(ticks);
+		}
+	}
+	// ADC10
+	if (adcRemaining > 0) {
+		adcRemaining -= seconds;
+		if (adcRemaining <= 1e-12) {
+			adcRemaining = 0;
+			uint16_t ctl1 = word(ADC10CTL1);
+			setWord(ADC10MEM, adcInput[ctl1 >> 12] & 0x3FF);
+			setWord(ADC10CTL1, ctl1 & ~0x01);
+			memory[ADC10CTL0] |= 0x04;		// ADC10IFG
+		}
+	}
+}
+
+void Msp430::step(double until) {
+	if (pucPending)
+		puc(pucCause);
+	if (serviceInterrupt())
+		return;
+	if (cpuOff()) {
+		double next = nextEvent();
+		if (next >= never && until - time >= never) {
+			stuck = true;
+			return;
+		}
+		double t = next + 1e-9 < until - time ? next + 1e-9 : until - time;
+		if (t < 0)
+			t = 0;
+		timeCpuOff += t;
+		elapse(t);
+		return;
+	}
+	execute();
+}
+
+// Source and destination addressing mode classes, for the cycle tables
+enum {MODE_REGISTER, MODE_INDIRECT, MODE_AUTOINCREMENT, MODE_IMMEDIATE, MODE_INDEXED};
+
+struct Operand {
+	int mode;
+	bool isRegister;
+	bool isConstant;
+	int reg;
+	uint16_t address;
+	uint16_t constant;
+};
+
+void Msp430::execute(void) {
+	uint16_t op = fetch();
+	if (op >> 12 >= 4)
+		executeFormatI(op);
+	else if (op >> 10 == 4)
+		executeFormatII(op);
+	else if (op >> 13 == 1) {
+		// Jumps: 2 cycles, taken or not
+		int offset = op & 0x3FF;
+		if (offset & 0x200)
+			offset -= 0x400;
+		uint16_t sr = r[2];
+		bool n = sr & SR_N, v = sr & SR_V;
+		bool take;
+		switch ((op >> 10) & 7) {
+		case 0:	take = !(sr & SR_Z);	break;	// JNE
+		case 1:	take = sr & SR_Z;		break;	// JEQ
+		case 2:	take = !(sr & SR_C);	break;	// JNC
+		case 3:	take = sr & SR_C;		break;	// JC
+		case 4:	take = n;				break;	// JN
+		case 5:	take = n == v;			break;	// JGE
+		case 6:	take = n != v;			break;	// JL
+		default: take = true;			break;	// JMP
+		}
+		if (take)
+			r[0] += offset * 2;
+		cycles += 2;
+		elapse(2 / mclkHz());
+	}
+	else {
+		fprintf(stderr, "Illegal instruction 0x%04X at 0x%04X\n", op, (uint16_t) (r[0] - 2));
+		stuck = true;
+	}
+}
+
+// Decode a source operand (or Format II operand), fetching any extension word
+static uint16_t fetchExtension(Msp430 &cpu) {
+	uint16_t value = cpu.memory[cpu.r[0]] | cpu.memory[(uint16_t) (cpu.r[0] + 1)] << 8;
+	cpu.r[0] += 2;
+	return value;
+}
+
+static Operand decodeSource(Msp430 &cpu, int reg, int as, bool byte) {
+	uint16_t extensionAddress = cpu.r[0];
+	Operand o;
+	o.reg = reg;
+	o.isRegister = o.isConstant = false;
+	o.address = 0;
+	o.constant = 0;
+	o.mode = MODE_REGISTER;
+	switch (as) {
+	case 0:
+		if (reg == 3)
+			o.isConstant = true;
+		else
+			o.isRegister = true;
+		break;
+	case 1:
+		if (reg == 3) {
+			o.isConstant = true;
+			o.constant = 1;
+		}
+		else {
+			int16_t x = fetchExtension(cpu);
+			o.mode = MODE_INDEXED;
+			o.address = x + (reg == 0 ? extensionAddress : reg == 2 ? 0 : cpu.r[reg]);
+		}
+		break;
+	case 2:
+		if (reg == 2 || reg == 3) {
+			o.isConstant = true;
+			o.constant = reg == 2 ? 4 : 2;
+		}
+		else {
+			o.mode = MODE_INDIRECT;
+			o.address = cpu.r[reg];
+		}
+		break;
+	default:
+		if (reg == 2 || reg == 3) {
+			o.isConstant = true;
+			o.constant = reg == 2 ? 8 : 0xFFFF;
+		}
+		else if (reg == 0) {
+			o.mode = MODE_IMMEDIATE;
+			o.address = cpu.r[0];
+			cpu.r[0] += 2;
+		}
+		else {
+			o.mode = MODE_AUTOINCREMENT;
+			o.address = cpu.r[reg];
+			cpu.r[reg] += (byte && reg != 1) ? 1 : 2;
+		}
+		break;
+	}
+	return o;
+}
+
+void Msp430::executeFormatI(uint16_t op) {
+	// SLAU144 table 3-16: cycles by source mode, and destination register/PC/memory
+	static const uint8_t cycleTable[5][3] = {
+		{1, 2, 4},		// Rn (and constants)
+		{2, 2, 5},		// @Rn
+		{2, 3, 5},		// @Rn+
+		{2, 3, 5},		// #N
+		{3, 3, 6},		// x(Rn), EDE, &EDE
+	};
+	int opcode = op >> 12, srcReg = (op >> 8) & 15, ad = (op >> 7) & 1, as = (op >> 4) & 3, dstReg = op & 15;
+	bool byte = op & 0x40;
+	uint32_t mask = byte ? 0xFF : 0xFFFF, msb = byte ? 0x80 : 0x8000;
+
+	Operand src = decodeSource(*this, srcReg, as, byte);
+	uint32_t s;
+	if (src.isConstant)
+		s = src.constant & mask;
+	else if (src.isRegister)
+		s = r[srcReg] & mask;
+	else
+		s = read(src.address, byte);
+	// Destination
+	uint16_t dstAddress = 0;
+	int dstClass;
+	if (ad) {
+		uint16_t extensionAddress = r[0];
+		int16_t x = fetch();
+		dstAddress = x + (dstReg == 0 ? extensionAddress : dstReg == 2 ? 0 : r[dstReg]);
+		dstClass = 2;
+	}
+	else
+		dstClass = dstReg == 0 ? 1 : 0;
+	int srcClass = src.isConstant || src.isRegister ? MODE_REGISTER : src.mode;
+	uint32_t d = 0;
+	if (opcode != 4)		// MOV doesn't read the destination
+		d = ad ? read(dstAddress, byte) : (dstReg == 3 ? 0 : r[dstReg] & mask);
+
+	uint32_t result = 0;
+	bool write = true, flags = true;
+	uint16_t sr = r[2] & ~(SR_C | SR_Z | SR_N | SR_V);
+	uint32_t carryIn = r[2] & SR_C;
+	switch (opcode) {
+	case 4:		// MOV
+		result = s;
+		flags = false;
+		break;
+	case 5:		// ADD
+	case 6:		// ADDC
+	case 7:		// SUBC
+	case 8:		// SUB
+	case 9: {	// CMP
+		uint32_t operand = opcode >= 7 ? (~s & mask) : s;
+		uint32_t carry = opcode == 5 ? 0 : (opcode == 8 || opcode == 9) ? 1 : carryIn;
+		result = d + operand + carry;
+		if (result > mask)
+			sr |= SR_C;
+		if ((operand ^ result) & (d ^ result) & msb)
+			sr |= SR_V;
+		write = opcode != 9;
+		break;
+	}
+	case 10: {	// DADD
+		uint32_t carry = carryIn;
+		for (int shift = 0; shift < (byte ? 8 : 16); shift += 4) {
+			uint32_t digit = ((d >> shift) & 15) + ((s >> shift) & 15) + carry;
+			carry = digit > 9;
+			if (carry)
+				digit -= 10;
+			result |= (digit & 15) << shift;
+		}
+		if (carry)
+			sr |= SR_C;
+		sr |= r[2] & SR_V;		// Undefined, left as it was
+		break;
+	}
+	case 11:	// BIT
+	case 15:	// AND
+		result = d & s;
+		if (result & mask)
+			sr |= SR_C;
+		write = opcode == 15;
+		break;
+	case 12:	// BIC
+		result = d & ~s;
+		flags = false;
+		break;
+	case 13:	// BIS
+		result = d | s;
+		flags = false;
+		break;
+	case 14:	// XOR
+		result = d ^ s;
+		if (result & mask)
+			sr |= SR_C;
+		if (d & s & msb)
+			sr |= SR_V;
+		break;
+	}
+	result &= mask;
+	if (flags) {
+		if (result & msb)
+			sr |= SR_N;
+		if (!result)
+			sr |= SR_Z;
+		r[2] = sr;
+	}
+	if (write) {
+		if (ad)
+			this->write(dstAddress, result, byte);
+		else if (dstReg == 2)
+			writeSR(result);
+		else if (dstReg == 0)
+			r[0] = result & ~1;
+		else if (dstReg != 3)
+			r[dstReg] = result;
+	}
+	int n = cycleTable[srcClass][dstClass];
+	cycles += n;
+	elapse(n / mclkHz());
+	// After its cycles, so that a function's cycles include its CALL and its RET
+	if (opcode == 4 && !ad && dstReg == 0 && srcReg == 1 && as == 3 && observer)
+		observer->ret(r[1]);		// RET (MOV @SP+,PC)
+}
+
+void Msp430::executeFormatII(uint16_t op) {
+	// SLAU144 table 3-15: cycles by operand mode, for RRA/RRC/SWPB/SXT, PUSH and CALL
+	static const uint8_t cycleTable[5][3] = {
+		{1, 3, 4},		// Rn (and constants)
+		{3, 4, 4},		// @Rn
+		{3, 5, 5},		// @Rn+
+		{3, 4, 5},		// #N
+		{4, 5, 5},		// x(Rn), EDE, &EDE
+	};
+	int opcode = (op >> 7) & 7, as = (op >> 4) & 3, reg = op & 15;
+	bool byte = op & 0x40;
+	uint32_t mask = byte ? 0xFF : 0xFFFF, msb = byte ? 0x80 : 0x8000;
+	if (opcode == 6) {		// RETI
+		r[2] = read(r[1], false) & 0x01FF;
+		r[1] += 2;
+		r[0] = read(r[1], false);
+		r[1] += 2;
+		cycles += 5;
+		elapse(5 / mclkHz());
+		if (observer)
+			observer->reti(r[1]);
+		return;
+	}
+	if (opcode == 7) {
+		fprintf(stderr, "Illegal instruction 0x%04X at 0x%04X\n", op, (uint16_t) (r[0] - 2));
+		stuck = true;
+		return;
+	}
+	Operand o = decodeSource(*this, reg, as, byte);
+	uint32_t v;
+	if (o.isConstant)
+		v = o.constant & mask;
+	else if (o.isRegister)
+		v = r[reg] & mask;
+	else
+		v = read(o.address, byte);
+	int mode = o.isConstant || o.isRegister ? MODE_REGISTER : o.mode;
+	int column = opcode == 4 ? 1 : opcode == 5 ? 2 : 0;
+	uint32_t result = 0;
+	uint16_t sr = r[2] & ~(SR_C | SR_Z | SR_N | SR_V);
+	bool write = true;
+	switch (opcode) {
+	case 0:		// RRC
+		result = (v >> 1) | ((r[2] & SR_C) ? msb : 0);
+		if (v & 1)
+			sr |= SR_C;
+		break;
+	case 1:		// SWPB
+		result = ((v >> 8) | (v << 8)) & 0xFFFF;
+		sr = r[2];
+		break;
+	case 2:		// RRA
+		result = (v >> 1) | (v & msb);
+		if (v & 1)
+			sr |= SR_C;
+		break;
+	case 3:		// SXT
+		result = (v & 0x80) ? (v | 0xFF00) : (v & 0xFF);
+		mask = 0xFFFF;
+		msb = 0x8000;
+		if (result)
+			sr |= SR_C;
+		break;
+	case 4:		// PUSH
+		r[1] -= 2;
+		this->write(r[1], v, byte);
+		write = false;
+		break;
+	case 5:		// CALL
+		push(r[0]);
+		r[0] = v & ~1;
+		if (observer)
+			observer->call(r[0], r[1]);
+		write = false;
+		break;
+	}
+	if (write) {
+		result &= mask;
+		if (opcode != 1) {
+			if (result & msb)
+				sr |= SR_N;
+			if (!result)
+				sr |= SR_Z;
+		}
+		r[2] = sr;
+		if (o.isRegister) {
+			if (reg == 2)
+				writeSR(result);
+			else if (reg == 0)
+				r[0] = result & ~1;
+			else
+				r[reg] = result;
+		}
+		else if (!o.isConstant)
+			this->write(o.address, result, opcode == 3 ? false : byte);
+	}
+	int n = cycleTable[mode][column];
+	cycles += n;
+	elapse(n / mclkHz());
+}
@@ -0,0 +1,99 @@
+/*
+ * msp430Sim.h
+ *
+ * Instruction set simulator for the MSP430G2332: the MSP430 CPU (not CPUX), with cycle
+ * counts from the instruction cycle tables in the family user's guide (SLAU144), and the
+ * peripherals that the firmware uses, modelled closely enough for their timing to show:
+ *  - Basic clock system: DCO frequency from DCOCTL/BCSCTL1 (a model of the DCO, with
+ *    calibration values in information memory to match), VLO or 32kHz for ACLK, dividers
+ *  - Watchdog: watchdog and interval modes, password violations
+ *  - ADC10: single conversions, taking the sample-and-hold plus 13 ADC10CLKs they really
+ *    take, of the values in adcInput[]
+ *  - Timer_A2: up and continuous modes, compare flags and interrupts (no outputs)
+ *  - Flash controller: erase and write, holding the CPU for the time they take
+ *  - Ports: plain registers, with inputs from p1In/p2In and edge interrupts
+ * Low power modes stop the clocks they should, and time is skipped to the next thing that
+ * can wake the CPU (a watchdog reset or an interrupt).
+ */
+
+#ifndef MSP430SIM_H_
+#define MSP430SIM_H_
+
+#include <stdint.h>
+
+// Told about calls, returns, interrupts and resets, for profiling
+class Msp430Observer {
+public:
+	virtual ~Msp430Observer() {}
+	virtual void call(uint16_t /*target*/, uint16_t /*sp*/) {}		// sp: with the return address pushed
+	virtual void ret(uint16_t /*sp*/) {}							// sp: with the return address popped
+	virtual void interrupt(uint16_t /*vector*/, uint16_t /*sp*/) {}	// sp: with PC and SR pushed
+	virtual void reti(uint16_t /*sp*/) {}
+	virtual void reset(uint8_t /*cause*/) {}						// Cause flags, as in IFG1
+	virtual void sleep(void) {}								// CPU turned off (LPMx)
+};
+
+class Msp430 {
+public:
+	Msp430();
+
+	// Power up (memory is loaded first, RAM is then filled from seed), or reset via the pin
+	void powerOn(uint32_t seed);
+	void resetPin(void);
+	// Run one instruction or interrupt, or if the CPU is off, let time pass until it wakes
+	// up or until the given time (s). Sets stuck if the CPU is off and nothing can wake it.
+	void step(double until);
+	// Change the port inputs, setting interrupt flags on the selected edges
+	void setPortInputs(uint8_t p1, uint8_t p2);
+
+	uint8_t memory[0x10000];
+	uint16_t r[16];				// r[0] is PC, r[1] SP, r[2] SR
+	uint64_t cycles;			// MCLK cycles since power up
+	double time;				// Seconds since power up, asleep or awake
+	double timeCpuOff;			// ...of which the CPU was off
+	uint16_t adcInput[16];		// What each ADC10 channel (INCHx) converts to
+	uint8_t p1In, p2In;
+	bool stuck;
+	Msp430Observer *observer;
+
+	bool cpuOff(void) const {return r[2] & 0x0010;}
+	double dcoHz(void) const;
+	double mclkHz(void) const;
+	double smclkHz(void) const;
+	double aclkHz(void) const;
+
+	// Clock model: DCO frequency for RSEL, DCO and MOD, and the calibration values for a
+	// target frequency (as the factory would find them), written into information memory
+	static double dcoModelHz(int rsel, int dco, int mod);
+	static void calibrateDCO(double hz, uint8_t &dcoctl, uint8_t &bcsctl1);
+
+private:
+	uint16_t read(uint16_t address, bool byte);
+	void write(uint16_t address, uint16_t value, bool byte);
+	uint8_t readPeripheral(uint16_t address);
+	void writePeripheral(uint16_t address, uint16_t value, bool byte);
+	uint16_t word(uint16_t address) const {return memory[address] | memory[(uint16_t) (address + 1)] << 8;}
+	void setWord(uint16_t address, uint16_t value) {memory[address] = value; memory[(uint16_t) (address + 1)] = value >> 8;}
+	uint16_t fetch(void);
+	void push(uint16_t value);
+	void execute(void);
+	void executeFormatI(uint16_t op);
+	void executeFormatII(uint16_t op);
+	bool serviceInterrupt(void);
+	void puc(uint8_t cause);
+	void writeSR(uint16_t value);
+	void elapse(double seconds);
+	double nextEvent(void) const;
+	void tickTimer(uint32_t ticks);
+	void startConversion(void);
+	void flashAccess(uint16_t address, uint16_t value, bool byte);
+	double ftgHz(void) const;
+
+	double wdtCount;			// ACLK or SMCLK counts since the watchdog was cleared
+	double timerFraction;		// Timer_A clocks not yet counted
+	double adcRemaining;		// Seconds until the conversion in progress completes
+	bool pucPending;
+	uint8_t pucCause;
+};
+
+#endif /* MSP430SIM_H_ */
@@ -0,0 +1,86 @@
+#!/bin/sh
+#
+# sizeBudget.sh
+#
+# Builds a firmware project with the size profile, and checks it against a budget of code
+# bytes for each function, failing if any function has grown (or is new) or if the whole
+# doesn't leave HEADROOM bytes of the MSP430G2332's 4kB of flash, e.g.
+#	sizeBudget.sh "02 Firmware/Battery 100" battery100.budget
+# Without a budget file only the headroom is checked (and it says so). The first time, or after
+# a change that's meant to grow the code, write the budget from the build instead with -u
+# (and commit it with the change, so that the growth is reviewed):
+#	sizeBudget.sh -u "02 Firmware/Battery 100" battery100.budget
+#
+# The size profile is msp430-gcc at -Os, with link time optimisation and unused functions
+# dropped, and both of the optional diagnostics (enableMaxTempLog, which header.h defines
+# anyway, and enableFirstRunTest) turned on, as they're what's had to be traded against each other to fit. FEATURES gives
+# other -Denable... flags to add (see crossBuild.sh), HEADROOM the flash to leave spare
+# (default 256), and MSP430_GCC where msp430-gcc is installed (default /opt/ti/msp430-gcc).
+#
+# The production builds are with CCS, whose code is close to gcc's but not the same, so
+# the budget is for catching growth, and the total only says roughly how much room is left.
+
+set -e
+
+update=0
+if [ "$1" = "-u" ]; then
+	update=1
+	shift
+fi
+if [ $# -ne 2 ]; then
+	echo "Usage: $0 [-u] <firmware directory> <budget file>" >&2
+	exit 1
+fi
+source=$1
+budget=$2
+gcc=${MSP430_GCC:-/opt/ti/msp430-gcc}
+headroom=${HEADROOM:-256}
+flash=4096
+
+elf=$(mktemp)
+sizes=$(mktemp)
+trap 'rm -f "$elf" "$sizes"' EXIT
+CFLAGS="-Os -flto -ffunction-sections -fdata-sections -Wl,--gc-sections -DenableFirstRunTest $FEATURES" \
+	MSP430_GCC="$gcc" "$(dirname "$0")/crossBuild.sh" "$source" "$elf" >/dev/null
+
+# "function bytes" for every function, biggest first, and the flash used (code, constants and
+# initialised data, the last of which is copied to RAM by the start-up code)
+"$gcc/bin/msp430-elf-nm" --print-size --size-sort --reverse-sort --radix=d "$elf" |
+	awk 'NF == 4 && $3 ~ /^[tT]$/ {print $4, $2 + 0}' > "$sizes"
+used=$("$gcc/bin/msp430-elf-size" "$elf" | awk 'NR == 2 {print $1 + $2}')
+
+if [ $update -eq 1 ]; then
+	cp "$sizes" "$budget"
+	echo "total $used" >> "$budget"
+	echo "Wrote $budget: $used bytes of $flash used"
+	exit 0
+fi
+if [ ! -f "$budget" ]; then
+	echo "$used bytes of $flash used (leaving $((flash - used)) spare), no budget $budget to check the functions against: make one with -u"
+	if [ "$used" -gt $((flash - headroom)) ]; then
+		echo "Less than the $headroom bytes of headroom left" >&2
+		exit 1
+	fi
+	exit 0
+fi
+
+# Every function against its budget, then the total
+awk -v used="$used" -v limit=$((flash - headroom)) -v flash=$flash '
+	FNR == NR {budget[$1] = $2; next}
+	{
+		if (!($1 in budget))
+			{printf("%-32s %5d bytes, new\n", $1, $2); failed = 1}
+		else if ($2 > budget[$1])
+			{printf("%-32s %5d bytes, was %d\n", $1, $2, budget[$1]); failed = 1}
+		else if ($2 < budget[$1])
+			shrunk = shrunk + budget[$1] - $2
+	}
+	END {
+		printf("%d bytes of %d used (budget %d, leaving %d spare)\n", used, flash, budget["total"], flash - used)
+		if (shrunk)
+			printf("%d bytes smaller than the budget: update it with -u to keep them\n", shrunk)
+		if (used > limit)
+			{printf("Less than the %d bytes of headroom left\n", flash - limit); failed = 1}
+		exit failed
+	}
+' "$budget" "$sizes" || { echo "Over budget" >&2; exit 1; }
@@ -0,0 +1,224 @@
+/*
+ * noiseDecode.cpp
+ *
+ * Works out the noise of each of the Battery 100's ADC channels from the reports of its
+ * noise measurement (see adcNoise.cpp): for each setting (sample time and reference) the
+ * standard deviation, in ADC units and millivolts, and the ENOB, then for each channel the
+ * best setting, how much averaging it needs, and how much the rolling average still moves.
+ *
+ * Each dump is of noiseReport (or the whole of RAM: the report is found by noiseMagic),
+ * taken at the noiseReportReady() breakpoint, so one dump per setting. Give as many as you
+ * like; reports of the same setting from different sweeps are pooled. The dumps can be either:
+ *  - raw binary (e.g. mspdebug "save_raw 0x200 256 ram.bin", or CCS "Save Memory" as binary)
+ *  - text, with "-x", as for traceDecode.cpp (mspdebug "md" bytes or CCS .dat words)
+ *
+ * Build:	g++ -O2 -o noiseDecode noiseDecode.cpp
+ * Usage:	noiseDecode [-x] [-a averageShift] dumpfile...
+ *
+ * A steady input read by a perfect 10-bit ADC gives the same code every time, so the
+ * quantisation noise (1/12 of an ADC unit squared) is added to what's measured, and
+ *	ENOB = 10 - log2(sqrt(12 * (variance + 1/12))) = 10 - log2(1 + 12 * variance) / 2
+ * The averaging needed is the number of samples that bring the noise of their mean down to
+ * the quantisation noise, i.e. 12 * variance. The rolling average (1/2^averageShift of each
+ * new sample, default averageShift from header.h) leaves 1 / (2^(averageShift + 1) - 1) of the
+ * variance, and 3 standard deviations of that is the least margin a threshold can be given.
+ */
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "../Battery 100/header.h"
+
+// Offsets (in bytes) of the NoiseReport members, as laid out on the MSP430
+#define BYTE_MAGIC			0
+#define BYTE_SETTING		2
+#define BYTE_SWEEP			3
+#define BYTE_RESULTS		4
+#define RESULT_BYTES		(4 + noiseBins)
+#define REPORT_BYTES		(BYTE_RESULTS + 6 * RESULT_BYTES)
+
+const char *channelNames[6] = {"cell 1", "cells 1-2", "cells 1-3", "battery", "PV", "fuse"};
+const int sampleClocks[4] = {4, 8, 16, 64};
+
+// Pooled over every report of a setting
+struct Pooled {
+	int reports;
+	double mean[6];
+	double variance[6];
+	unsigned long histogram[6][noiseBins];
+};
+
+// Read the whole file in as bytes
+bool readBinary(const char *path, std::vector<unsigned char> &bytes) {
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return false;
+	unsigned char buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+		bytes.insert(bytes.end(), buffer, buffer + n);
+	fclose(f);
+	return true;
+}
+
+// Read a text dump of hex bytes and/or 0x-prefixed hex words
+bool readText(const char *path, std::vector<unsigned char> &bytes) {
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return false;
+	char line[1024];
+	while (fgets(line, sizeof(line), f)) {
+		// Drop any ASCII column
+		char *bar = strchr(line, '|');
+		if (bar)
+			*bar = 0;
+		for (char *token = strtok(line, " \t\r\n,"); token; token = strtok(NULL, " \t\r\n,")) {
+			size_t length = strlen(token);
+			// Address column
+			if (token[length - 1] == ':')
+				continue;
+			char *end;
+			if (length == 6 && token[0] == '0' && (token[1] == 'x' || token[1] == 'X')) {
+				unsigned long word = strtoul(token + 2, &end, 16);
+				if (*end == 0) {
+					bytes.push_back(word & 0xFF);
+					bytes.push_back(word >> 8);
+				}
+			}
+			else if (length == 2 && isxdigit(token[0]) && isxdigit(token[1])) {
+				bytes.push_back(strtoul(token, &end, 16));
+			}
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+unsigned int word(const std::vector<unsigned char> &bytes, size_t at) {
+	return bytes[at] | (bytes[at + 1] << 8);
+}
+
+// Volts per ADC unit of a channel at a setting
+double voltsPerUnit(int channel, int setting) {
+	double reference = (setting & 4) ? 1.5 : 2.5;
+	return ( (channel == 4) ? C_PV : C_CELL ) / 100 * reference / 2.5;
+}
+
+double enob(double variance) {
+	return 10 - log2(1 + 12 * variance) / 2;
+}
+
+// Near either end of the range, where the noise is clipped off
+bool clipped(double mean) {
+	return (mean < 4) || (mean > 1019);
+}
+
+int main(int argc, char *argv[]) {
+	bool text = false;
+	int shift = averageShift;
+	std::vector<const char *> paths;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-x"))
+			text = true;
+		else if (!strcmp(argv[i], "-a") && i + 1 < argc)
+			shift = atoi(argv[++i]);
+		else
+			paths.push_back(argv[i]);
+	}
+	if (paths.empty() || shift < 0 || shift > 15) {
+		fprintf(stderr, "Usage: %s [-x] [-a averageShift] dumpfile...\n", argv[0]);
+		return 2;
+	}
+
+	Pooled pooled[noiseSettings];
+	memset(pooled, 0, sizeof(pooled));
+	for (size_t p = 0; p < paths.size(); p++) {
+		std::vector<unsigned char> bytes;
+		if ( !(text ? readText(paths[p], bytes) : readBinary(paths[p], bytes)) ) {
+			fprintf(stderr, "Can't read %s\n", paths[p]);
+			return 1;
+		}
+		// Find the report: noiseMagic, on a word boundary, followed by a sensible setting
+		size_t start;
+		for (start = 0; start + REPORT_BYTES <= bytes.size(); start += 2) {
+			if ( word(bytes, start + BYTE_MAGIC) == noiseMagic && bytes[start + BYTE_SETTING] < noiseSettings )
+				break;
+		}
+		if (start + REPORT_BYTES > bytes.size()) {
+			fprintf(stderr, "No noise report found in %s (is enableADCNoise defined, with noiseBins = %d?)\n", paths[p], noiseBins);
+			return 1;
+		}
+		int setting = bytes[start + BYTE_SETTING];
+		printf("%s: setting %d (sweep %d)\n", paths[p], setting, bytes[start + BYTE_SWEEP]);
+		Pooled &pool = pooled[setting];
+		for (int i = 0; i < 6; i++) {
+			size_t result = start + BYTE_RESULTS + i * RESULT_BYTES;
+			unsigned int variance = word(bytes, result + 2);
+			if (variance == 0xFFFF)
+				printf("  %s: the variance is too big to hold, so it's at least what's given\n", channelNames[i]);
+			pool.mean[i] += word(bytes, result) / 16.0;
+			pool.variance[i] += variance / 16.0;
+			// A bin stops counting at 255, but if it's the only one that has, the rest add up to what's left
+			unsigned long total = 0;
+			int full = -1;
+			for (int b = 0; b < noiseBins; b++) {
+				unsigned int count = bytes[result + 4 + b];
+				if (count == 0xFF)
+					full = (full == -1) ? b : -2;
+				else
+					total += count;
+				pool.histogram[i][b] += count;
+			}
+			if (full >= 0)
+				pool.histogram[i][full] += (1ul << noiseSampleShift) - total - 0xFF;
+		}
+		pool.reports++;
+	}
+
+	// Each setting
+	double best[6] = {0};
+	int bestSetting[6];
+	for (int setting = 0; setting < noiseSettings; setting++) {
+		Pooled &pool = pooled[setting];
+		if (pool.reports == 0)
+			continue;
+		printf("\nSetting %d: %d ADC clock sample time, %.1fV reference, %d report%s\n", setting, sampleClocks[setting & 3],
+				(setting & 4) ? 1.5 : 2.5, pool.reports, (pool.reports == 1) ? "" : "s");
+		printf("  %-9s %8s %8s %8s %8s %6s   histogram from -3 to +3 ADC units, then further out\n",
+				"channel", "mean", "volts", "sigma", "sigma mV", "ENOB");
+		for (int i = 0; i < 6; i++) {
+			double mean = pool.mean[i] / pool.reports;
+			double variance = pool.variance[i] / pool.reports;
+			double volts = voltsPerUnit(i, setting);
+			printf("  %-9s %8.2f %8.3f %8.3f %8.2f %6.2f  ", channelNames[i], mean, mean * volts, sqrt(variance),
+					sqrt(variance) * volts * 1000, enob(variance));
+			for (int b = 0; b < noiseBins; b++)
+				printf(" %4lu", pool.histogram[i][b]);
+			printf("%s\n", clipped(mean) ? "  (clipped)" : "");
+			if ( !clipped(mean) && (enob(variance) > best[i]) ) {
+				best[i] = enob(variance);
+				bestSetting[i] = setting;
+			}
+		}
+	}
+
+	// Each channel at its best setting
+	double share = 1.0 / ((2 << shift) - 1);
+	printf("\nBest settings (the rolling average takes 1/%d of each new sample):\n", 1 << shift);
+	printf("  %-9s %8s %6s %10s %12s %12s\n", "channel", "setting", "ENOB", "averaging", "average sigma", "3 sigma mV");
+	for (int i = 0; i < 6; i++) {
+		if (best[i] == 0) {
+			printf("  %-9s no unclipped readings\n", channelNames[i]);
+			continue;
+		}
+		Pooled &pool = pooled[bestSetting[i]];
+		double variance = pool.variance[i] / pool.reports;
+		double sigma = sqrt(variance * share);
+		printf("  %-9s %8d %6.2f %10.0f %13.3f %12.2f\n", channelNames[i], bestSetting[i], best[i], ceil(12 * variance) < 1 ? 1 : ceil(12 * variance),
+				sigma, 3 * sigma * voltsPerUnit(i, bestSetting[i]) * 1000);
+	}
+	return 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * battery100Params.cpp
+ *
+ * The Battery 100's parameter block (struct ParamBlock in its header.h), see paramLayout.h
+ */
+
+#include <msp430.h>		// The host version, for the bit names
+#include "../../Battery 100/header.h"
+#include "paramLayout.h"
+
+static const ParamField fields[] = {
+	{"PVmpp",				PARAM_PVV,		2,	2,	PVmpp_uncalib,				true},
+	{"lowPV",				PARAM_PVV,		4,	2,	lowPV_uncalib,				true},
+	{"maxCellV",			PARAM_CELLV,	6,	1,	maxCellV_uncalib,			true},
+	{"minCellV",			PARAM_CELLV,	7,	1,	minCellV_uncalib,			true},
+	{"minFuse",				PARAM_CELLV,	8,	1,	minFuse_uncalib,			true},
+	{"minBleedV",			PARAM_CELLV,	9,	1,	minBleedV_uncalib,			true},
+	{"stopChargeV",			PARAM_CELLV,	10,	1,	stopChargeV_uncalib,		true},
+	{"restartChargeV",		PARAM_CELLV,	11,	1,	restartChargeV_uncalib,		true},
+	{"restartDischV",		PARAM_CELLV,	12,	1,	restartDischV_uncalib,		true},
+	{"LEDthresh1",			PARAM_CELLV,	13,	1,	LEDthresh1_uncalib,			true},
+	{"LEDthresh2",			PARAM_CELLV,	14,	1,	LEDthresh2_uncalib,			true},
+	{"LEDthreshHyst",		PARAM_CELLV,	15,	1,	LEDthreshHyst_uncalib,		true},
+	{"blinkCount",			PARAM_NUMBER,	16,	1,	standardBlinkNumber,		false},
+	{"lowBattBlink",		PARAM_NUMBER,	17,	1,	lowBattBlinkDuration,		false},
+	{"shortCircuitBlink",	PARAM_NUMBER,	18,	1,	shortCircuitBlinkDuration,	false},
+	{"snoozeLimit",			PARAM_HOURS,	20,	4,	maxSnoozeTime,				false},
+};
+
+const ParamLayout battery100Layout = {
+	"Battery 100",
+	0x1020, 26, paramVersion, 1,
+	fields, sizeof(fields) / sizeof(fields[0]),
+	C_CELL, C_PV, maxSnoozeTime / 48.0,
+	2 * calChannels + 1, dividerCalCheckSeed, calChannels,
+	{"stopChargeV", "minCellV"}, {calibratedStopChargeV, calibratedMinCellV},
+	PARAM_DIVIDERCAL
+};
@@ -0,0 +1,26 @@
+/*
+ * chargerParams.cpp
+ *
+ * The Charger's parameter block (struct ParamBlock in its header.h), see paramLayout.h
+ */
+
+#include <msp430.h>		// The host version, for the bit names
+#include "../../Charger/header.h"
+#include "paramLayout.h"
+
+static const ParamField fields[] = {
+	{"minBattV",			PARAM_ADC,		2,	2,	minBattV_uncalib,			true},
+	{"restartDischV",		PARAM_ADC,		4,	2,	restartDischV_uncalib,		true},
+	{"flashTime",			PARAM_NUMBER,	6,	1,	SHORT_FLASH_TIME,			false},
+	{"flashNumber",			PARAM_NUMBER,	7,	1,	SHORT_FLASH_NUMBER,			false},
+};
+
+const ParamLayout chargerLayout = {
+	"Charger",
+	0x1000, 10, paramVersion, 1,
+	fields, sizeof(fields) / sizeof(fields[0]),
+	0, 0, 0,
+	0, 0, 0,
+	{0, 0}, {0, 0},
+	0
+};
@@ -0,0 +1,307 @@
+/*
+ * paramBlock.cpp
+ *
+ * Makes the parameter block for a unit (see enableParamBlock in the firmware's header.h),
+ * so that it can be retuned without a new build: thresholds in volts, blink numbers, and
+ * the snooze time in hours. The unit's own ADC calibration (info segment A) is applied
+ * here, once, the same way as calibrateThresholds() would, so the firmware only has to
+ * check the CRC and copy the block on a full wake-up. Anything not given keeps its default
+ * from header.h.
+ *
+ * Build:	g++ -O2 -I../Host -o paramBlock paramBlock.cpp battery100Params.cpp chargerParams.cpp
+ * Usage:	paramBlock [-C] [-i info.txt] [-o segmentD.txt] [name=value ...]
+ *
+ *  -C	the Charger (otherwise the Battery 100)
+ *  -i	the unit's information memory (0x1000-0x10FF), read with the programmer as TI-TXT,
+ *		e.g. "MSP430Flasher -n MSP430G2332 -r [info.txt,INFO]". Without it, the ADC is
+ *		taken to be ideal, so the block is only good for a unit with no calibration error.
+ *		Any block already on the unit is shown alongside.
+ *  -o	write segment D as TI-TXT, to program into the unit with segment erase, e.g.
+ *		"MSP430Flasher -n MSP430G2332 -w segmentD.txt -e ERASE_SEGMENT -z [VCC]". The
+ *		whole segment is written, so the Battery 100's divider calibration is copied from
+ *		the -i dump (it's in the same segment): always give -i for a calibrated unit.
+ *
+ * For the Battery 100, voltages are as on the cell taps (e.g. maxCellV=3.60) and PV
+ * (PVmpp=17.5), and snoozeLimit is in hours. The Charger's thresholds are in ADC units,
+ * as there's no divider figure in its header.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "paramLayout.h"
+
+#define segmentD			0x1000
+#define segmentBytes		64
+#define CALADC_GAIN_FACTOR	0x10DC		// In info segment A
+#define CALADC_OFFSET		0x10DE
+#define CALADC_25VREF_FACTOR	0x10E6
+
+typedef std::map<unsigned int, unsigned char> Memory;
+
+// TI-TXT: "@address" lines, then lines of hex bytes, ending with "q"
+static bool readTIText(const char *path, Memory &memory) {
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return false;
+	char line[256];
+	unsigned int address = 0;
+	bool ok = true;
+	while (ok && fgets(line, sizeof(line), f)) {
+		if (line[0] == '@')
+			address = strtoul(line + 1, NULL, 16);
+		else if (line[0] == 'q' || line[0] == 'Q')
+			break;
+		else {
+			char *p = line, *end;
+			for (;;) {
+				unsigned long byte = strtoul(p, &end, 16);
+				if (end == p)
+					break;
+				if (byte > 0xFF)
+					ok = false;
+				memory[address++] = byte;
+				p = end;
+			}
+		}
+	}
+	fclose(f);
+	return ok;
+}
+
+static bool writeTIText(const char *path, unsigned int address, const std::vector<unsigned char> &bytes) {
+	FILE *f = fopen(path, "w");
+	if (!f)
+		return false;
+	fprintf(f, "@%04X\n", address);
+	for (size_t i = 0; i < bytes.size(); i++)
+		fprintf(f, "%02X%s", bytes[i], (i % 16 == 15 || i + 1 == bytes.size()) ? "\n" : " ");
+	fprintf(f, "q\n");
+	return fclose(f) == 0;
+}
+
+// A little endian value from memory, or false if any of it isn't there
+static bool readValue(const Memory &memory, unsigned int address, int size, unsigned long &value) {
+	value = 0;
+	for (int i = 0; i < size; i++) {
+		Memory::const_iterator byte = memory.find(address + i);
+		if (byte == memory.end())
+			return false;
+		value |= (unsigned long) byte->second << (8 * i);
+	}
+	return true;
+}
+
+static void putValue(std::vector<unsigned char> &bytes, int offset, int size, unsigned long value) {
+	for (int i = 0; i < size; i++)
+		bytes[offset + i] = (value >> (8 * i)) & 0xFF;
+}
+
+// As paramCRC() in the firmware
+static unsigned int paramCRC(const unsigned char *data, int length) {
+	unsigned int crc = 0xFFFF;
+	while (length--) {
+		crc ^= (unsigned int) *data++ << 8;
+		for (int bit = 0; bit < 8; bit++)
+			crc = ( (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1 ) & 0xFFFF;
+	}
+	return crc;
+}
+
+// The unit's ADC calibration, as calibrateThresholds() uses it
+struct ADCCalibration {
+	unsigned int gainFactor;
+	int offset;
+	unsigned int refFactor;
+};
+
+// As calibrateThresholds() and secondStageCalibration() in the firmware, in 16-bit
+// unsigned ints. The Charger's is in single precision floats, and rounds. The Battery 100's
+// is in 32-bit fixed point (1/65536ths), and truncates, as its float version did (the 0.5
+// was added after the conversion to int, see its V2.00 TODO).
+static unsigned int calibrate(unsigned int uncalibrated, const ADCCalibration &cal, bool rounds) {
+	unsigned int threshold = (uncalibrated - cal.offset) & 0xFFFF;
+	if (rounds) {
+		float coeff = ( (float) 32768 / cal.refFactor ) * ( (float) 32768 / cal.gainFactor );
+		return (unsigned int) (threshold * coeff + 0.5f);
+	}
+	uint32_t coeff = 0x80000000u / cal.refFactor;
+	coeff = ( (coeff << 15) + (cal.gainFactor >> 1) ) / cal.gainFactor;
+	return ( ((uint32_t) threshold * coeff) >> 16 ) & 0xFFFF;
+}
+
+// A value as given, into what goes in the block (before any calibration)
+static double toBlockUnits(const ParamLayout &layout, const ParamField &field, double value) {
+	switch (field.kind) {
+	case PARAM_CELLV:
+		return floor(value * 100 / layout.cellScale + 0.5);
+	case PARAM_PVV:
+		return floor(value * 100 / layout.PVScale + 0.5);
+	case PARAM_HOURS:
+		return floor(value * layout.snoozeLoopsPerHour + 0.5);
+	default:
+		return floor(value + 0.5);
+	}
+}
+
+static const char *kindUnits(ParamKind kind) {
+	switch (kind) {
+	case PARAM_CELLV:
+	case PARAM_PVV:
+		return "V";
+	case PARAM_HOURS:
+		return "h";
+	default:
+		return "";
+	}
+}
+
+int main(int argc, char *argv[]) {
+	const ParamLayout *layout = &battery100Layout;
+	const char *infoPath = NULL, *outPath = NULL;
+	std::map<std::string, double> given;
+	bool usage = false;
+	for (int i = 1; i < argc; i++) {
+		const char *equals = strchr(argv[i], '=');
+		if (!strcmp(argv[i], "-C"))
+			layout = &chargerLayout;
+		else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+			infoPath = argv[++i];
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			outPath = argv[++i];
+		else if (equals && equals != argv[i])
+			given[std::string(argv[i], equals - argv[i])] = atof(equals + 1);
+		else
+			usage = true;
+	}
+	if (usage) {
+		fprintf(stderr, "Usage: %s [-C] [-i info.txt] [-o segmentD.txt] [name=value ...]\n", argv[0]);
+		return 1;
+	}
+	for (std::map<std::string, double>::const_iterator g = given.begin(); g != given.end(); ++g) {
+		bool found = false;
+		for (int f = 0; f < layout->fieldCount; f++)
+			found |= (g->first == layout->fields[f].name);
+		if (!found) {
+			fprintf(stderr, "The %s has no parameter %s, it has:", layout->firmware, g->first.c_str());
+			for (int f = 0; f < layout->fieldCount; f++)
+				fprintf(stderr, " %s", layout->fields[f].name);
+			fprintf(stderr, "\n");
+			return 1;
+		}
+	}
+
+	// The unit's calibration, or an ideal ADC
+	Memory info;
+	if (infoPath && !readTIText(infoPath, info)) {
+		fprintf(stderr, "Can't read %s as TI-TXT\n", infoPath);
+		return 1;
+	}
+	ADCCalibration cal = {0x8000, 0, 0x8000};
+	unsigned long value;
+	if (infoPath) {
+		unsigned long gain, offset, ref;
+		if ( !readValue(info, CALADC_GAIN_FACTOR, 2, gain) || !readValue(info, CALADC_OFFSET, 2, offset)
+				|| !readValue(info, CALADC_25VREF_FACTOR, 2, ref) || gain == 0 || ref == 0 || gain == 0xFFFF || ref == 0xFFFF ) {
+			fprintf(stderr, "%s doesn't have the ADC calibration (segment A, 0x10C0-0x10FF)\n", infoPath);
+			return 1;
+		}
+		cal.gainFactor = gain;
+		cal.offset = (short) offset;
+		cal.refFactor = ref;
+		printf("ADC calibration: gain factor 0x%04X, offset %d, 2.5V reference factor 0x%04X\n", cal.gainFactor, cal.offset, cal.refFactor);
+	}
+	else
+		printf("No information memory given (-i), so taking an ideal ADC\n");
+
+	// Divider calibration (the Battery 100's, in the same segment), checked as in
+	// initialiseDividerCalibration()
+	bool dividersCalibrated = false;
+	if (layout->dividerCalWords && infoPath) {
+		unsigned int check = layout->dividerCalSeed;
+		bool present = true;
+		for (int w = 0; w < layout->dividerCalWords - 1; w++) {
+			present &= readValue(info, segmentD + 2 * w, 2, value);
+			check -= value;
+		}
+		present &= readValue(info, segmentD + 2 * (layout->dividerCalWords - 1), 2, value);
+		dividersCalibrated = present && (check & 0xFFFF) == value;
+		printf("Divider calibration: %s\n", dividersCalibrated ? "yes, so the ADC calibration isn't applied" : "no");
+	}
+
+	// What's on the unit already
+	std::vector<unsigned char> old(layout->size);
+	bool oldGood = false;
+	if (infoPath) {
+		bool present = true;
+		for (int i = 0; i < layout->size; i++) {
+			present &= readValue(info, layout->address + i, 1, value);
+			old[i] = value;
+		}
+		unsigned long crc = old[layout->size - 2] | old[layout->size - 1] << 8;
+		oldGood = present && old[0] == layout->version && paramCRC(&old[0], layout->size - 2) == crc;
+		printf("Parameter block on the unit: %s\n", oldGood ? "good" : !present ? "not in the dump" : old[0] == 0xFF ? "none (erased)" : "bad (other version, or CRC)");
+	}
+
+	// The new block
+	std::vector<unsigned char> block(layout->size, 0);
+	block[0] = layout->version;
+	block[layout->flagsOffset] = dividersCalibrated ? layout->dividerCalFlag : 0;
+	printf("\n%-20s %10s %8s %8s %8s\n", "parameter", "given", "default", "block", "was");
+	for (int f = 0; f < layout->fieldCount; f++) {
+		const ParamField &field = layout->fields[f];
+		double def = field.defaultValue;
+		for (int o = 0; o < 2; o++)
+			if (dividersCalibrated && layout->dividerCalOverrideNames[o] && !strcmp(field.name, layout->dividerCalOverrideNames[o]))
+				def = layout->dividerCalOverrides[o];
+		std::map<std::string, double>::const_iterator g = given.find(field.name);
+		double units = (g != given.end()) ? toBlockUnits(*layout, field, g->second) : def;
+		if (units < 0) {
+			fprintf(stderr, "%s can't be negative\n", field.name);
+			return 1;
+		}
+		unsigned long stored = (unsigned long) units;
+		if (field.threshold && !dividersCalibrated && !(g == given.end() && def != field.defaultValue))
+			stored = calibrate(stored, cal, layout == &chargerLayout);
+		if (field.size < 4 && stored >= (1ul << (8 * field.size))) {
+			fprintf(stderr, "%s comes to %lu, which doesn't fit in %d byte%s\n", field.name, stored, field.size, field.size > 1 ? "s" : "");
+			return 1;
+		}
+		putValue(block, field.offset, field.size, stored);
+		char givenText[32] = "-";
+		if (g != given.end())
+			snprintf(givenText, sizeof(givenText), "%g%s", g->second, kindUnits(field.kind));
+		char wasText[16] = "-";
+		if (oldGood) {
+			unsigned long was = 0;
+			for (int i = 0; i < field.size; i++)
+				was |= (unsigned long) old[field.offset + i] << (8 * i);
+			snprintf(wasText, sizeof(wasText), "%lu", was);
+		}
+		printf("%-20s %10s %8.0f %8lu %8s\n", field.name, givenText, field.defaultValue, stored, wasText);
+	}
+	unsigned int crc = paramCRC(&block[0], layout->size - 2);
+	putValue(block, layout->size - 2, 2, crc);
+	printf("\nBlock (%s, 0x%04X, %d bytes): version %d, flags 0x%02X, CRC 0x%04X\n", layout->firmware, layout->address, layout->size, layout->version, block[layout->flagsOffset], crc);
+
+	if (outPath) {
+		// The whole of segment D, keeping what else is there (the divider calibration)
+		std::vector<unsigned char> segment(segmentBytes, 0xFF);
+		for (int i = 0; i < segmentBytes; i++)
+			if (readValue(info, segmentD + i, 1, value))
+				segment[i] = value;
+		for (int i = 0; i < layout->size; i++)
+			segment[layout->address - segmentD + i] = block[i];
+		if (!writeTIText(outPath, segmentD, segment)) {
+			fprintf(stderr, "Can't write %s\n", outPath);
+			return 1;
+		}
+		printf("Segment D written to %s\n", outPath);
+	}
+	return 0;
+}
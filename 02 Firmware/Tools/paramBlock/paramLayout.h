@@ -0,0 +1,55 @@
+/*
+ * paramLayout.h
+ *
+ * What's in each firmware's parameter block (see enableParamBlock in the header.h of
+ * "Battery 100" and of "Charger"), as laid out on the MSP430: little endian, ints 16 bits,
+ * longs 32 bits low word first. The two headers can't be included together (they share
+ * names), so each layout is in a file of its own, along with the defaults from its header.
+ */
+
+#ifndef PARAMLAYOUT_H_
+#define PARAMLAYOUT_H_
+
+enum ParamKind {
+	PARAM_CELLV,		// Voltage on a cell tap or after the fuse: given in volts, C_CELL to ADC units
+	PARAM_PVV,			// PV voltage: given in volts, C_PV to ADC units
+	PARAM_ADC,			// Threshold given in ADC units (there's no divider figure to convert from volts)
+	PARAM_HOURS,		// Snooze loops: given in hours, at maxSnoozeTime per 48 hours
+	PARAM_NUMBER		// As it is
+};
+
+struct ParamField {
+	const char *name;
+	ParamKind kind;
+	int offset;				// In the block (bytes)
+	int size;				// 1, 2 or 4 bytes
+	double defaultValue;	// The define, in ADC units for thresholds (so uncalibrated)
+	bool threshold;			// The unit's ADC calibration is applied
+};
+
+struct ParamLayout {
+	const char *firmware;
+	unsigned int address;		// Of the block, in segment D (0x1000)
+	int size;					// Bytes, including the CRC, which is last
+	int version;				// paramVersion
+	int flagsOffset;			// Of the flags byte (the version is at 0)
+	const ParamField *fields;
+	int fieldCount;
+	double cellScale;			// C_CELL and C_PV: cV per ADC unit
+	double PVScale;
+	double snoozeLoopsPerHour;
+	// Divider calibration in segment D (Battery 100 only, otherwise 0 words)
+	int dividerCalWords;		// Including the check word, which is last
+	unsigned int dividerCalSeed;
+	int dividerCalChannels;		// gain[], then offset[], then the check
+	// With the dividers calibrated, thresholds are compared with corrected readings, so the
+	// ADC calibration isn't applied, and these take the place of two of the defaults
+	const char *dividerCalOverrideNames[2];
+	double dividerCalOverrides[2];
+	int dividerCalFlag;			// PARAM_DIVIDERCAL, set in flags
+};
+
+extern const ParamLayout battery100Layout;
+extern const ParamLayout chargerLayout;
+
+#endif /* PARAMLAYOUT_H_ */
@@ -0,0 +1,86 @@
+/*
+ * chargePlant.cpp
+ *
+ * See chargePlant.h
+ */
+
+#include <cmath>
+#include "chargePlant.h"
+
+ChargePlantConfig defaultChargePlantConfig(void) {
+	ChargePlantConfig config;
+	config.base = defaultPlantConfig();
+	config.inputCapacitance = 470e-6;		// A typical buck converter input capacitor
+	config.converterDropout = 1.0;
+	config.nudgeFilterSeconds = 0.05;		// Well over the PWM period (8ms at PWMperiod, 8MHz)
+	config.maxStepSeconds = 20e-6;
+	return config;
+}
+
+void initChargePlant(ChargePlant &plant, const ChargePlantConfig &config, double soc, double duty) {
+	for (int i = 0; i < 4; i++)
+		plant.soc[i] = soc;
+	plant.filteredDuty = duty;
+	double T = panelTemperature(config.base, plant.ambient, plant.irradiance);
+	plant.nodeV = pvOpenCircuitVoltage(config.base, plant.irradiance, T) - config.base.diodeDrop;
+	if (plant.nodeV < 0)
+		plant.nodeV = 0;
+	bool none[4] = {false, false, false, false};
+	stepChargePlant(plant, config, duty, none, 0);
+}
+
+double availablePower(const ChargePlant &plant, const ChargePlantConfig &config) {
+	return pvMaxPower(config.base, plant.irradiance, panelTemperature(config.base, plant.ambient, plant.irradiance));
+}
+
+double stepChargePlant(ChargePlant &plant, const ChargePlantConfig &config, double duty, const bool bleeding[4], double seconds) {
+	const PlantConfig &base = config.base;
+	double T = panelTemperature(base, plant.ambient, plant.irradiance);
+	int steps = (int) ceil(seconds / config.maxStepSeconds);
+	double dt = steps ? seconds / steps : 0;
+	double energy = 0;
+	double bleed[4], ocv[4], ocvSum = 0, bleedSum = 0;
+	for (int i = 0; i < 4; i++) {
+		bleed[i] = bleeding[i] ? base.bleedCurrent : 0;
+		ocv[i] = cellOCV(plant.soc[i]);
+		ocvSum += ocv[i];
+		bleedSum += bleed[i];
+	}
+	// Do at least one pass, so that the outputs are up to date even for no time
+	for (int s = 0; s < (steps ? steps : 1); s++) {
+		plant.filteredDuty += (duty - plant.filteredDuty) * (1 - exp(-dt / config.nudgeFilterSeconds));
+		// The charge voltage the nudge asks for, unless the PV node is too low to give it
+		double chargeV = base.chargeVoltageOpen - base.nudgeVoltsPerDuty * plant.filteredDuty;
+		if (chargeV > plant.nodeV - config.converterDropout)
+			chargeV = plant.nodeV - config.converterDropout;
+		// Into the pack (OCV plus the cells' resistance) through the charge path, with the load
+		// and bleeding taken from the pack as well
+		double Rc = base.cellResistance;
+		double chargeI = (chargeV - ocvSum + 4 * Rc * plant.loadCurrent + Rc * bleedSum) / (base.chargePathResistance + 4 * Rc);
+		if (chargeI < 0)
+			chargeI = 0;
+		double packI = chargeI - plant.loadCurrent;
+		// The converter's input current, and the panel's through the diode
+		double inputI = (plant.nodeV > 0.1) ? chargeV * chargeI / (base.converterEfficiency * plant.nodeV) : 0;
+		double panelV = plant.nodeV + base.diodeDrop;
+		double panelI = pvCurrent(base, panelV, plant.irradiance, T);
+		if (panelI < 0)
+			panelI = 0;
+		plant.nodeV += (panelI - inputI) * dt / config.inputCapacitance;
+		if (plant.nodeV < 0)
+			plant.nodeV = 0;
+		energy += panelV * panelI * dt;
+		plant.panelV = panelV;
+		plant.panelI = panelI;
+		plant.chargeV = chargeI > 0 ? chargeV : 0;
+		plant.chargeI = chargeI;
+		plant.battV = 0;
+		for (int i = 0; i < 4; i++) {
+			plant.cellV[i] = ocv[i] + Rc * (packI - bleed[i]);
+			plant.battV += plant.cellV[i];
+		}
+		for (int i = 0; i < 4; i++)
+			plant.soc[i] += (packI - bleed[i]) * dt / (3600 * base.cellCapacityAh);
+	}
+	return energy;
+}
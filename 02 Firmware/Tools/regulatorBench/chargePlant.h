@@ -0,0 +1,59 @@
+/*
+ * chargePlant.h
+ *
+ * A dynamic model of the Battery 100's charge path, for running the firmware's charge
+ * regulator (refreshCharge()) in closed loop on the host. It builds on thresholdSweep's
+ * plantModel (the panel, cells and charge path figures), adding the parts that matter over
+ * milliseconds rather than hours:
+ *  - the PV node (after the blocking diode, where the PV ADC divider is) with the
+ *    converter's input capacitance on it, so it sags when more power is drawn than the
+ *    panel can give
+ *  - the RC filter between the nudge PWM pin and the converter's feedback
+ *  - the converter dropping out when the PV node falls to near its output voltage
+ * The capacitance, filter and dropout are assumed, typical values, so what a benchmark
+ * gives is for comparing regulators with each other, as with plantModel.
+ */
+
+#ifndef CHARGEPLANT_H_
+#define CHARGEPLANT_H_
+
+#include "../thresholdSweep/plantModel.h"
+
+struct ChargePlantConfig {
+	PlantConfig base;
+	double inputCapacitance;		// On the PV node (F)
+	double converterDropout;		// Least the PV node can be above the charge voltage (V)
+	double nudgeFilterSeconds;		// Time constant of the filter on the nudge PWM (s)
+	double maxStepSeconds;			// Longest integration step, for the PV node to stay stable (s)
+};
+
+ChargePlantConfig defaultChargePlantConfig(void);
+
+struct ChargePlant {
+	// Conditions, set by the tool
+	double irradiance;				// W/m^2
+	double ambient;					// C
+	double loadCurrent;				// Drawn from the pack (A)
+	// State
+	double soc[4];
+	double nodeV;					// PV node (V)
+	double filteredDuty;			// Nudge PWM duty after the filter (0..1)
+	// From the last step
+	double panelV, panelI;			// At the panel terminals
+	double chargeV, chargeI;		// Converter output
+	double cellV[4];				// Terminal voltages
+	double battV;
+};
+
+// Start with the cells all at soc, the nudge filter settled at duty, and the PV node at open
+// circuit, as if the panel had just been connected
+void initChargePlant(ChargePlant &plant, const ChargePlantConfig &config, double soc, double duty);
+
+// Run for the given time with the nudge PWM at duty (0..1, high throttles the charging) and
+// the given cells' bleed resistors on. Returns the energy the panel gave (J).
+double stepChargePlant(ChargePlant &plant, const ChargePlantConfig &config, double duty, const bool bleeding[4], double seconds);
+
+// Panel power available at the maximum power point now (W)
+double availablePower(const ChargePlant &plant, const ChargePlantConfig &config);
+
+#endif /* CHARGEPLANT_H_ */
@@ -0,0 +1,376 @@
+/*
+ * regulatorBench.cpp
+ *
+ * Benchmarks the Battery 100's charge regulator: the firmware itself, built for the host (see
+ * Tools/Host), runs in closed loop with a model of the panel, converter and cells (see
+ * chargePlant.h) through a set of standard scenarios, and each is scored on:
+ *  - settling time: from the scenario's event until the PV node stays within the band (-b,
+ *    default 0.25V) of where it ends up (the mean over the last quarter of the run), or -1
+ *    if it never does
+ *  - overshoot: how far the PV node goes past where it ends up, in the direction it was
+ *    heading from the event (V, and % of where it ends up)
+ *  - ripple: peak to peak and RMS of the PV node over the last quarter of the run
+ *  - capture: the panel's energy over what it could have given at its maximum power point
+ *  - the highest cell voltage, and how far it went over maxCellV
+ *
+ * Build:	g++ -O2 -std=c++11 -funsigned-char -I../Host -o regulatorBench regulatorBench.cpp chargePlant.cpp ../thresholdSweep/plantModel.cpp ../Host/battery100Host.cpp ../Host/hostMSP430.cpp
+ * Usage:	regulatorBench [-w seconds] [-b bandV] [-r loopRate] [-n scenario,...] [-o results.csv] [-k baseline.csv] [-t trace.csv]
+ *
+ * The scenarios (-n to run only some):
+ *  - coldStart: boot at 1000W/m^2 with the cells half charged, the duty starting at maxDuty
+ *  - cloudEdge: settled at 1000W/m^2, then a cloud cuts it to 300W/m^2
+ *  - cloudClear: settled at 300W/m^2, then back up to 1000W/m^2
+ *  - maxCellV: boot with cells 1 to 3 at 90% and cell 4 ahead of them, just full, so it
+ *    reaches maxCellV and the regulator has to hold it there, with its bleed resistor on
+ *    (capture is low here by design)
+ *  - loadStep: settled charging, then a 3A load comes on
+ *  - lowBattery: boot with the cells nearly empty (the pack below the charge voltage at maxDuty)
+ * Scenarios with a step run 20s to settle first, unscored. Each then runs for the given
+ * seconds (-w, default 30) after its event.
+ *
+ * The main loop runs loopRate times a second (-r, default 4300, as plantModel), scaled for
+ * the clock governor's clock speeds, and time spent in __delay_cycles() passes as well.
+ * Results are written (-o) as CSV, a line per scenario, and -k compares them with an earlier
+ * run's, so that a change to the regulator (refreshCharge(), or e.g. -DenableDitheredPWM)
+ * can be judged by the numbers. -t writes the PV node, duty, charge current and highest cell
+ * voltage at 100Hz, for plotting.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "battery100Host.h"
+#include "chargePlant.h"
+
+#define settleRunSeconds	20.0	// Before the event, for scenarios with a step
+#define steadyFraction		0.25	// Last part of the run taken as steady state
+#define traceRate			100		// Hz
+
+struct Scenario {
+	const char *name;
+	double soc;					// Cells' state of charge
+	double highCell;			// Added to cell 4's
+	double irradiance;			// W/m^2
+	double load;				// A
+	bool step;					// Settle, then step to the values below
+	double stepIrradiance;
+	double stepLoad;
+};
+
+static const Scenario scenarios[] = {
+	{"coldStart",	0.50,	0,		1000,	0,	false,	1000,	0},
+	{"cloudEdge",	0.50,	0,		1000,	0,	true,	300,	0},
+	{"cloudClear",	0.50,	0,		300,	0,	true,	1000,	0},
+	{"maxCellV",	0.90,	0.1005,	1000,	0,	false,	1000,	0},
+	{"loadStep",	0.50,	0,		1000,	0,	true,	1000,	3},
+	{"lowBattery",	0.03,	0,		1000,	0,	false,	1000,	0},
+};
+
+struct Result {
+	std::string scenario;
+	double settleS;
+	double overshootV, overshootPct;
+	double rippleV, rippleRmsV;
+	double capture;
+	double peakCellV, cellOverV;
+	double finalPVV, finalChargeA;
+};
+
+// Result columns, for the CSV and comparing
+struct Column {
+	const char *name;
+	double Result::*value;
+};
+
+static const Column columns[] = {
+	{"settleS", &Result::settleS},
+	{"overshootV", &Result::overshootV},
+	{"overshootPct", &Result::overshootPct},
+	{"rippleV", &Result::rippleV},
+	{"rippleRmsV", &Result::rippleRmsV},
+	{"capture", &Result::capture},
+	{"peakCellV", &Result::peakCellV},
+	{"cellOverV", &Result::cellOverV},
+	{"finalPVV", &Result::finalPVV},
+	{"finalChargeA", &Result::finalChargeA},
+};
+
+static ChargePlantConfig config;
+static double loopRate = 4300;
+static double bandV = 0.25;
+static FILE *trace;
+
+// The nudge PWM's duty (0..1), as the pin drives it
+static double pwmDuty(void) {
+	// With the PWM off (snoozing), the pin's high or pulled high, throttling the charging
+	if ( !(P2SEL & BIT6) )
+		return ( (P2DIR & BIT6) && !(P2OUT & BIT6) ) ? 0 : 1;
+#ifdef enableDitheredPWM
+	return nudgeDuty / 65536.0;
+#else
+	return (double) TACCR1 / (TACCR0 + 1);
+#endif
+}
+
+static unsigned int toADC(double volts, double coefficient) {
+	double reading = volts * 100 / coefficient + 0.5;
+	if (reading < 0)
+		return 0;
+	return reading > 1023 ? 1023 : (unsigned int) reading;
+}
+
+static void setInputs(const ChargePlant &plant) {
+	double terminal = 0;
+	for (int i = 0; i < 4; i++) {
+		terminal += plant.cellV[i];
+		hostADCInput[(int) ADC_CH_numbers[i]] = toADC(terminal, C_CELL);
+	}
+	hostADCInput[PV] = toADC(plant.nodeV, C_PV);
+	hostADCInput[DISCURRENT] = toADC(plant.battV, C_CELL);
+}
+
+static double highestCellV(const ChargePlant &plant) {
+	double v = plant.cellV[0];
+	for (int i = 1; i < 4; i++)
+		if (plant.cellV[i] > v)
+			v = plant.cellV[i];
+	return v;
+}
+
+struct Sample {
+	double t, pvV, maxCellV;
+};
+
+static bool runScenario(const Scenario &s, double seconds, Result &r) {
+	ChargePlant plant;
+	plant.irradiance = s.irradiance;
+	plant.ambient = 25;
+	plant.loadCurrent = s.load;
+	battery100Reset(PORIFG);
+	hostDelayedSeconds = 0;
+	initChargePlant(plant, config, s.soc, 1);
+	plant.soc[3] += s.highCell;
+	bool none[4] = {false, false, false, false};
+	stepChargePlant(plant, config, 1, none, 0);
+	setInputs(plant);
+
+	double now = 0, eventTime = s.step ? settleRunSeconds : 0, end = eventTime + seconds;
+	double nextTrace = 0, energy = 0, available = 0;
+	bool stepped = !s.step;
+	std::vector<Sample> samples;
+	try {
+		battery100Boot();
+		while (now < end) {
+			if (!stepped && now >= eventTime) {
+				plant.irradiance = s.stepIrradiance;
+				plant.loadCurrent = s.stepLoad;
+				stepped = true;
+			}
+			hostDelayedSeconds = 0;
+			battery100Loop(0);
+			// The loop's time at the clock speed it's running at, plus any delays in it
+			double dt = 8e6 / hostClockHz() / loopRate + hostDelayedSeconds;
+			bool bleeding[4];
+			for (int i = 0; i < 4; i++)
+				bleeding[i] = cell_bleedingOn[i];
+			double e = stepChargePlant(plant, config, pwmDuty(), bleeding, dt);
+			now += dt;
+			setInputs(plant);
+			if (stepped) {
+				energy += e;
+				available += availablePower(plant, config) * dt;
+				Sample sample = {now - eventTime, plant.nodeV, highestCellV(plant)};
+				samples.push_back(sample);
+			}
+			if (trace && now >= nextTrace) {
+				fprintf(trace, "%s,%.3f,%.3f,%.4f,%.3f,%.3f\n", s.name, now, plant.nodeV, plant.filteredDuty, plant.chargeI, highestCellV(plant));
+				nextTrace += 1.0 / traceRate;
+			}
+		}
+	}
+	catch (HostSleep &) {
+		fprintf(stderr, "%s: the firmware went to sleep at %.1fs\n", s.name, now);
+		return false;
+	}
+	if (samples.empty())
+		return false;
+
+	// Steady state: the last quarter of the run
+	size_t steadyStart = samples.size() * (1 - steadyFraction);
+	double sum = 0, sumSquares = 0, low = samples[steadyStart].pvV, high = low;
+	for (size_t i = steadyStart; i < samples.size(); i++) {
+		sum += samples[i].pvV;
+		low = fmin(low, samples[i].pvV);
+		high = fmax(high, samples[i].pvV);
+	}
+	double final = sum / (samples.size() - steadyStart);
+	for (size_t i = steadyStart; i < samples.size(); i++)
+		sumSquares += (samples[i].pvV - final) * (samples[i].pvV - final);
+	r.scenario = s.name;
+	r.finalPVV = final;
+	r.finalChargeA = plant.chargeI;
+	r.rippleV = high - low;
+	r.rippleRmsV = sqrt(sumSquares / (samples.size() - steadyStart));
+	r.capture = available > 0 ? energy / available : 0;
+
+	// Settling: the last time outside the band, unless that's in the steady state
+	size_t lastOutside = 0;
+	bool outside = false;
+	for (size_t i = 0; i < samples.size(); i++) {
+		if (fabs(samples[i].pvV - final) > bandV) {
+			lastOutside = i;
+			outside = true;
+		}
+	}
+	if (!outside)
+		r.settleS = 0;
+	else if (lastOutside >= steadyStart)
+		r.settleS = -1;
+	else
+		r.settleS = samples[lastOutside + 1].t;
+
+	// Overshoot, past the final value in the direction from the starting one
+	double start = samples[0].pvV;
+	double direction = (final >= start) ? 1 : -1;
+	r.overshootV = 0;
+	r.peakCellV = 0;
+	for (size_t i = 0; i < samples.size(); i++) {
+		r.overshootV = fmax(r.overshootV, direction * (samples[i].pvV - final));
+		r.peakCellV = fmax(r.peakCellV, samples[i].maxCellV);
+	}
+	r.overshootPct = final > 0 ? 100 * r.overshootV / final : 0;
+	r.cellOverV = fmax(0, r.peakCellV - maxCellV * C_CELL / 100);
+	return true;
+}
+
+static void printResults(const std::vector<Result> &results) {
+	printf("%-12s", "scenario");
+	for (const Column &c : columns)
+		printf(" %12s", c.name);
+	printf("\n");
+	for (const Result &r : results) {
+		printf("%-12s", r.scenario.c_str());
+		for (const Column &c : columns)
+			printf(" %12.4f", r.*c.value);
+		printf("\n");
+	}
+	printf("\n");
+}
+
+static bool writeResults(const char *path, const std::vector<Result> &results) {
+	FILE *f = fopen(path, "w");
+	if (!f)
+		return false;
+	fprintf(f, "scenario");
+	for (const Column &c : columns)
+		fprintf(f, ",%s", c.name);
+	fprintf(f, "\n");
+	for (const Result &r : results) {
+		fprintf(f, "%s", r.scenario.c_str());
+		for (const Column &c : columns)
+			fprintf(f, ",%.6f", r.*c.value);
+		fprintf(f, "\n");
+	}
+	fclose(f);
+	return true;
+}
+
+// Before (from an earlier run's CSV, in the same column order) and after, per scenario
+static bool compareResults(const char *path, const std::vector<Result> &results) {
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return false;
+	const size_t n = sizeof(columns) / sizeof(columns[0]);
+	std::vector<Result> baseline;
+	char line[512];
+	while (fgets(line, sizeof(line), f)) {
+		char *field = strtok(line, ",\r\n");
+		if (!field || !strcmp(field, "scenario"))
+			continue;
+		Result b;
+		b.scenario = field;
+		size_t i = 0;
+		for (; i < n && (field = strtok(NULL, ",\r\n")); i++)
+			b.*columns[i].value = atof(field);
+		if (i == n)
+			baseline.push_back(b);
+	}
+	fclose(f);
+	printf("Compared with %s (before -> after):\n", path);
+	for (const Result &r : results) {
+		const Result *b = NULL;
+		for (const Result &candidate : baseline)
+			if (candidate.scenario == r.scenario)
+				b = &candidate;
+		if (!b) {
+			printf("%-12s not in the baseline\n", r.scenario.c_str());
+			continue;
+		}
+		printf("%-12s\n", r.scenario.c_str());
+		for (const Column &c : columns)
+			printf("  %-14s %12.4f -> %12.4f  (%+.4f)\n", c.name, b->*c.value, r.*c.value, r.*c.value - b->*c.value);
+	}
+	printf("\n");
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	double seconds = 30;
+	const char *outPath = NULL, *baselinePath = NULL, *tracePath = NULL, *only = NULL;
+	bool usage = false;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-w") && i + 1 < argc)
+			seconds = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+			bandV = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			loopRate = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			only = argv[++i];
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			outPath = argv[++i];
+		else if (!strcmp(argv[i], "-k") && i + 1 < argc)
+			baselinePath = argv[++i];
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			tracePath = argv[++i];
+		else
+			usage = true;
+	}
+	if (usage || seconds <= 0 || bandV <= 0 || loopRate <= 0) {
+		fprintf(stderr, "Usage: %s [-w seconds] [-b bandV] [-r loopRate] [-n scenario,...] [-o results.csv] [-k baseline.csv] [-t trace.csv]\n", argv[0]);
+		return 1;
+	}
+	config = defaultChargePlantConfig();
+	if (tracePath) {
+		trace = fopen(tracePath, "w");
+		if (!trace) {
+			fprintf(stderr, "Can't write %s\n", tracePath);
+			return 1;
+		}
+		fprintf(trace, "scenario,t,pvV,duty,chargeA,maxCellV\n");
+	}
+
+	std::vector<Result> results;
+	for (const Scenario &s : scenarios) {
+		if (only && !strstr(only, s.name))
+			continue;
+		Result r;
+		if (runScenario(s, seconds, r))
+			results.push_back(r);
+	}
+	if (trace)
+		fclose(trace);
+	printResults(results);
+	if (outPath && !writeResults(outPath, results)) {
+		fprintf(stderr, "Can't write %s\n", outPath);
+		return 1;
+	}
+	if (baselinePath && !compareResults(baselinePath, results)) {
+		fprintf(stderr, "Can't read %s\n", baselinePath);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * plantModel.cpp
+ *
+ * See plantModel.h
+ */
+
+#include <cmath>
+#include "plantModel.h"
+
+PlantConfig defaultPlantConfig(void) {
+	PlantConfig config;
+	config.panelWp = 20;					// Assumed panel size for a 100Wh battery
+	config.panelVoc = 20.5;					// PVmax in header.h is 20.0V after the diode
+	config.panelVmp = 18.0;					// PVmpp_uncalib comment in header.h
+	config.panelVocTempCoeff = -0.0035;		// Typical for crystalline silicon
+	config.panelNOCTRise = 25;
+	config.diodeDrop = 0.5;
+	config.converterEfficiency = 0.9;
+	config.chargeVoltageOpen = 15.0;
+	config.nudgeVoltsPerDuty = 9.3;			// Pulls the charge voltage down to 11V (well below an empty pack) at the default maxDuty
+	config.chargePathResistance = 0.5;
+	config.huntingCounts = 2;
+	config.cellCapacityAh = 7.8;			// 100Wh / 12.8V
+	config.cellCapacitySpread = 0.03;
+	config.cellResistance = 0.03;
+	config.initialSoC = 0.5;
+	config.bleedCurrent = 0.1;
+	config.awakeCurrent = 3.5e-3;			// MSP430G2 at 8MHz, plus ADC, reference and dividers
+	config.snoozeCurrent = 0.2e-3;
+	config.sleepCurrent = 20e-6;			// Mostly the potential dividers
+	config.LEDCurrent = 2e-3;
+	config.loopRate = 4300;					// chargeTestLoops comment in header.h
+	config.snoozeLoopRate = 16.95;			// maxSnoozeTime comment in header.h: 2928814 loops is 48 hours
+	config.wakeUpPeriod = 32768 / 12000.0;	// 32768 VLO counts at 12kHz (DIVA_0, see initialiseClock())
+	config.wakeCheckTime = 130e-6;			// energyProfile's "empty" window: 1.4ms awake over 30s of sleep
+	finalisePlantConfig(config);
+	return config;
+}
+
+void finalisePlantConfig(PlantConfig &config) {
+	// At the maximum power point of I = Isc * (1 - exp((V - Voc) / a)), d(VI)/dV = 0 gives
+	// (Voc - Vmp) / a = ln(1 + Vmp / a). Solve for a by bisection (the left side falls faster).
+	double low = 0.01, high = 10;
+	for (int i = 0; i < 60; i++) {
+		double a = (low + high) / 2;
+		if ((config.panelVoc - config.panelVmp) / a > log(1 + config.panelVmp / a))
+			low = a;
+		else
+			high = a;
+	}
+	config.panelNVt = (low + high) / 2;
+	config.panelIsc = config.panelWp / (config.panelVmp * (1 - exp((config.panelVmp - config.panelVoc) / config.panelNVt)));
+}
+
+double pvOpenCircuitVoltage(const PlantConfig &config, double G, double T) {
+	if (G <= 1)
+		return 0;
+	double Voc = config.panelVoc * (1 + config.panelVocTempCoeff * (T - 25)) + config.panelNVt * log(G / 1000);
+	return Voc > 0 ? Voc : 0;
+}
+
+double pvCurrent(const PlantConfig &config, double V, double G, double T) {
+	double Voc = pvOpenCircuitVoltage(config, G, T);
+	if (V >= Voc)
+		return 0;
+	return config.panelIsc * (G / 1000) * (1 - exp((V - Voc) / config.panelNVt));
+}
+
+double pvMaxPower(const PlantConfig &config, double G, double T) {
+	double a = 0, b = pvOpenCircuitVoltage(config, G, T);
+	const double ratio = 0.6180339887;
+	for (int i = 0; i < 30; i++) {
+		double c = b - ratio * (b - a);
+		double d = a + ratio * (b - a);
+		if (c * pvCurrent(config, c, G, T) > d * pvCurrent(config, d, G, T))
+			b = d;
+		else
+			a = c;
+	}
+	double V = (a + b) / 2;
+	return V * pvCurrent(config, V, G, T);
+}
+
+double panelTemperature(const PlantConfig &config, double ambient, double G) {
+	return ambient + config.panelNOCTRise * G / 1000;
+}
+
+// Typical LiFePO4 curve: long flat plateau, steep at both ends
+static const double OCVTable[][2] = {
+	{0.00, 2.50}, {0.05, 2.90}, {0.10, 3.10}, {0.20, 3.20}, {0.30, 3.25}, {0.50, 3.28},
+	{0.70, 3.30}, {0.90, 3.33}, {0.95, 3.35}, {0.99, 3.45}, {1.00, 3.60}
+};
+
+double cellOCV(double soc) {
+	const int n = sizeof(OCVTable) / sizeof(OCVTable[0]);
+	// Beyond the ends, carry on steeply (over-charge and over-discharge)
+	if (soc <= 0)
+		return OCVTable[0][1] + 10 * soc;
+	if (soc >= 1)
+		return OCVTable[n - 1][1] + 40 * (soc - 1);
+	for (int i = 1; i < n; i++) {
+		if (soc <= OCVTable[i][0]) {
+			double f = (soc - OCVTable[i - 1][0]) / (OCVTable[i][0] - OCVTable[i - 1][0]);
+			return OCVTable[i - 1][1] + f * (OCVTable[i][1] - OCVTable[i - 1][1]);
+		}
+	}
+	return OCVTable[n - 1][1];
+}
@@ -0,0 +1,62 @@
+/*
+ * plantModel.h
+ *
+ * A simple model of the things the Battery 100 is connected to: the PV panel, the four
+ * LiFePO4 cells, and the charge path that the "voltage nudge" PWM throttles. It's meant to
+ * be good enough to compare threshold choices against each other, not to predict
+ * absolute numbers - see the notes against each figure in defaultPlantConfig().
+ */
+
+#ifndef PLANTMODEL_H_
+#define PLANTMODEL_H_
+
+struct PlantConfig {
+	// PV panel (single-diode approximation)
+	double panelWp;					// Peak power at 1000W/m^2, 25C (W)
+	double panelVoc;				// Open-circuit voltage at 1000W/m^2, 25C (V)
+	double panelVmp;				// Maximum power point voltage at 1000W/m^2, 25C (V)
+	double panelNVt;				// Diode ideality * series cells * thermal voltage (V), set by finalisePlantConfig()
+	double panelIsc;				// Short-circuit current at 1000W/m^2, 25C (A), set by finalisePlantConfig()
+	double panelVocTempCoeff;		// Fractional change in Voc per degree C
+	double panelNOCTRise;			// Panel temperature rise above ambient at 1000W/m^2 (C)
+	double diodeDrop;				// Blocking diode drop between panel and the PV ADC divider (V)
+	// Charge path
+	double converterEfficiency;		// PV power -> battery power
+	double chargeVoltageOpen;		// Charge voltage with the nudge PWM at zero duty (V)
+	double nudgeVoltsPerDuty;		// Drop in charge voltage per unit of duty fraction (TACCR1 / TACCR0) (V)
+	double chargePathResistance;	// Between the charge voltage and the pack (ohms)
+	double huntingCounts;			// Amplitude of the TACCR1 limit cycle about its equilibrium (counts)
+	// Cells
+	double cellCapacityAh;			// Nominal cell capacity (Ah)
+	double cellCapacitySpread;		// Fractional spread of capacities between cells (+/-)
+	double cellResistance;			// Internal resistance per cell (ohms)
+	double initialSoC;				// State of charge at the start of a run
+	double bleedCurrent;			// Current through a bleed resistor (A)
+	// Electronics self-consumption, from the pack (A)
+	double awakeCurrent;			// 8MHz, ADC and reference on
+	double snoozeCurrent;			// Lowest DCO, ADC in low power mode
+	double sleepCurrent;			// LPM3 with the watchdog on VLO
+	double LEDCurrent;
+	// Firmware timing
+	double loopRate;				// Main loops per second when awake
+	double snoozeLoopRate;			// Main loops per second when snoozing
+	double wakeUpPeriod;			// Seconds between watchdog wake-ups when asleep
+	double wakeCheckTime;			// Seconds awake at each of those wake-ups, if there's no PV (checkPV())
+};
+
+PlantConfig defaultPlantConfig(void);
+// Derive the panel diode parameters from Wp, Voc and Vmp. Call after changing any of them.
+void finalisePlantConfig(PlantConfig &config);
+
+// Panel current (A) at terminal voltage V (V), irradiance G (W/m^2) and panel temperature T (C)
+double pvCurrent(const PlantConfig &config, double V, double G, double T);
+// Open-circuit panel voltage (V), 0 if it's dark
+double pvOpenCircuitVoltage(const PlantConfig &config, double G, double T);
+// Maximum available panel power (W), found by golden section search
+double pvMaxPower(const PlantConfig &config, double G, double T);
+// Panel temperature (C) from ambient and irradiance
+double panelTemperature(const PlantConfig &config, double ambient, double G);
+// LiFePO4 open-circuit cell voltage at a state of charge (0..1, extrapolated beyond)
+double cellOCV(double soc);
+
+#endif /* PLANTMODEL_H_ */
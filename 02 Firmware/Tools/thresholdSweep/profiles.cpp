@@ -0,0 +1,157 @@
+/*
+ * profiles.cpp
+ *
+ * See profiles.h
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include "profiles.h"
+
+bool loadProfileCSV(const char *path, double dt, Profile &profile) {
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "Can't open profile %s\n", path);
+		return false;
+	}
+	std::vector<double> time, irradiance, load, ambient;
+	char line[512];
+	while (fgets(line, sizeof(line), f)) {
+		double values[4] = {0, 0, 0, 25};
+		int n = sscanf(line, "%lf ,%lf ,%lf ,%lf", &values[0], &values[1], &values[2], &values[3]);
+		if (n < 3)
+			continue;
+		if (!time.empty() && values[0] <= time.back()) {
+			fprintf(stderr, "%s: time must increase (at t = %g)\n", path, values[0]);
+			fclose(f);
+			return false;
+		}
+		time.push_back(values[0]);
+		irradiance.push_back(values[1]);
+		load.push_back(values[2]);
+		ambient.push_back(values[3]);
+	}
+	fclose(f);
+	if (time.size() < 2) {
+		fprintf(stderr, "%s: need at least two samples of time, irradiance, load\n", path);
+		return false;
+	}
+
+	profile.name = path;
+	profile.dt = dt;
+	profile.irradiance.clear();
+	profile.ambient.clear();
+	profile.load.clear();
+	size_t j = 0;
+	for (double t = time.front(); t <= time.back(); t += dt) {
+		while (time[j + 1] < t)
+			j++;
+		double f = (t - time[j]) / (time[j + 1] - time[j]);
+		profile.irradiance.push_back(irradiance[j] + f * (irradiance[j + 1] - irradiance[j]));
+		profile.load.push_back(load[j] + f * (load[j + 1] - load[j]));
+		profile.ambient.push_back(ambient[j] + f * (ambient[j + 1] - ambient[j]));
+	}
+	return true;
+}
+
+struct Climate {
+	const char *name;
+	double dayLength;			// Hours from sunrise to sunset
+	double peakIrradiance;		// Clear-sky irradiance at noon on the panel (W/m^2)
+	double cloudyDayChance;		// Chance of a day being cloudy
+	double cloudyDayPersistence;// Chance of a cloudy day following another cloudy day
+	double clearShadeFraction;	// Fraction of time spent under a cloud on a clear day
+	double cloudyShadeFraction;	// ...and on a cloudy day
+	double afternoonClouds;		// Extra shade fraction after 13:00 (convective clouds)
+	double shadeTransmission;	// Fraction of irradiance getting through a cloud
+	double minTemperature;		// Daily ambient range (C)
+	double maxTemperature;
+};
+
+static const Climate climates[] = {
+	// name			day		peak	cloudy	persist	clear	cloudy	pm		trans	min		max
+	{"sahel",		12.0,	1000,	0.05,	0.30,	0.02,	0.40,	0.00,	0.35,	25,		40},
+	{"equatorial",	12.1,	950,	0.20,	0.40,	0.10,	0.60,	0.30,	0.30,	23,		31},
+	{"monsoon",		12.8,	900,	0.55,	0.75,	0.20,	0.85,	0.10,	0.25,	24,		30},
+	{"highland",	11.8,	1050,	0.25,	0.50,	0.10,	0.60,	0.15,	0.30,	8,		22},
+};
+
+const char *syntheticClimates(void) {
+	return "sahel, equatorial, monsoon, highland";
+}
+
+bool syntheticProfile(const std::string &climateName, int days, unsigned int seed, double dt, Profile &profile) {
+	const Climate *climate = NULL;
+	for (size_t i = 0; i < sizeof(climates) / sizeof(climates[0]); i++) {
+		if (climateName == climates[i].name)
+			climate = &climates[i];
+	}
+	if (!climate)
+		return false;
+
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<double> uniform(0, 1);
+	profile.name = climateName;
+	profile.dt = dt;
+	profile.irradiance.clear();
+	profile.ambient.clear();
+	profile.load.clear();
+
+	const double meanCloudTime = 600;		// Seconds in and out of a passing cloud
+	const int stepsPerDay = (int) (86400 / dt);
+	const double sunrise = 12 - climate->dayLength / 2;
+	bool cloudyDay = false;
+	bool shaded = false;
+	for (int day = 0; day < days; day++) {
+		// Weather for the day
+		cloudyDay = uniform(random) < (cloudyDay ? climate->cloudyDayPersistence : climate->cloudyDayChance);
+		double dayTemperatureOffset = (uniform(random) - 0.5) * 4;
+		// Loads for the day: evening lights, phone charging, a morning light, maybe a radio
+		double lightsOff = 21.5 + uniform(random) * 1.5;
+		double phoneStart = 19 + uniform(random) * 2;
+		double phoneEnd = phoneStart + 1 + uniform(random);
+		bool radio = uniform(random) < 0.5;
+
+		for (int step = 0; step < stepsPerDay; step++) {
+			double hour = step * dt / 3600;
+			// Irradiance: clear-sky shape, then clouds coming and going
+			double G = 0;
+			if (hour > sunrise && hour < sunrise + climate->dayLength)
+				G = climate->peakIrradiance * pow(sin(M_PI * (hour - sunrise) / climate->dayLength), 1.2);
+			double shadeFraction = cloudyDay ? climate->cloudyShadeFraction : climate->clearShadeFraction;
+			if (hour > 13)
+				shadeFraction += climate->afternoonClouds;
+			if (shadeFraction > 0.95)
+				shadeFraction = 0.95;
+			// Two-state Markov chain, with the right fraction of time in each state
+			double leaveShade = dt / meanCloudTime;
+			double enterShade = leaveShade * shadeFraction / (1 - shadeFraction);
+			if (shaded ? uniform(random) < leaveShade : uniform(random) < enterShade)
+				shaded = !shaded;
+			if (shaded)
+				G *= climate->shadeTransmission * (0.8 + 0.4 * uniform(random));
+			// Ambient: coolest at sunrise, warmest at 15:00
+			double phase = (hour - 15) / 24 * 2 * M_PI;
+			double ambient = (climate->minTemperature + climate->maxTemperature) / 2 + dayTemperatureOffset
+					+ (climate->maxTemperature - climate->minTemperature) / 2 * cos(phase);
+			if (cloudyDay)
+				ambient -= 2;
+			// Load
+			double load = 0;
+			if (hour >= 18.5 && hour < lightsOff)
+				load += 3;
+			if (hour >= phoneStart && hour < phoneEnd)
+				load += 5;
+			if (hour >= 5.5 && hour < 6.5)
+				load += 1.5;
+			if (radio && hour >= 12 && hour < 14)
+				load += 2;
+			profile.irradiance.push_back(G);
+			profile.ambient.push_back(ambient);
+			profile.load.push_back(load);
+		}
+	}
+	return true;
+}
@@ -0,0 +1,35 @@
+/*
+ * profiles.h
+ *
+ * Irradiance, ambient temperature and load profiles to run the plant model against,
+ * either recorded (CSV) or synthetic (by climate).
+ */
+
+#ifndef PROFILES_H_
+#define PROFILES_H_
+
+#include <string>
+#include <vector>
+
+struct Profile {
+	std::string name;
+	double dt;							// Seconds between samples
+	std::vector<float> irradiance;		// On the panel (W/m^2)
+	std::vector<float> ambient;			// Air temperature (C)
+	std::vector<float> load;			// Demanded at the output sockets (W)
+};
+
+// Load a recorded profile from CSV with columns: time (s), irradiance (W/m^2), load (W),
+// and optionally ambient temperature (C, 25 if missing). Lines that don't start with a
+// number (e.g. a header) are skipped. Samples can be at any interval, and are linearly
+// interpolated onto a grid of dt seconds. Returns false with a message on stderr on failure.
+bool loadProfileCSV(const char *path, double dt, Profile &profile);
+
+// Generate days of synthetic weather and use for a named climate, with a seeded random
+// number generator so that runs are repeatable. Returns false if the climate isn't known.
+bool syntheticProfile(const std::string &climate, int days, unsigned int seed, double dt, Profile &profile);
+
+// Names of the synthetic climates, for help text
+const char *syntheticClimates(void);
+
+#endif /* PROFILES_H_ */
@@ -0,0 +1,672 @@
+/*
+ * thresholdSweep.cpp
+ *
+ * Sweeps the Battery 100 thresholds and timing (the *_uncalib thresholds, maxDuty, PWMperiod
+ * and maxSnoozeTime in header.h) over weeks of recorded or synthetic weather and use, and
+ * scores each combination on energy delivered, deep-discharge events and cell stress.
+ *
+ * The firmware's decisions (refreshBatteryStatus(), refreshDischarge(), refreshCharge() with
+ * balanceCells(), considerSleep() and considerSnooze()) are modelled here rather than run
+ * directly, because the firmware keeps its state in globals and has most of these as
+ * #defines. Each simulation step stands for many main loops, so the TACCR1 regulator is
+ * modelled by its equilibrium (PV held at PVmpp, or the highest cell held at maxCellV) plus
+ * its slew rate of one count per loop, which is where maxDuty and PWMperiod come in.
+ * If the firmware's decision logic changes, this needs to change with it.
+ *
+ * Combinations are run in batches of "lanes" with the plant and firmware state held as
+ * structure-of-arrays, and the batches (times each profile) are spread over all cores with
+ * a work-stealing pool.
+ *
+ * Build:	g++ -O2 -std=c++11 -pthread -o thresholdSweep thresholdSweep.cpp plantModel.cpp profiles.cpp
+ * Usage:	thresholdSweep -p maxCellV_uncalib=132:140:2 -p PVmpp_uncalib=420,442,460 -c sahel,monsoon -o results.csv
+ *			(thresholdSweep -h for all the options)
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../../Battery 100/header.h"
+#include "plantModel.h"
+#include "profiles.h"
+#include "workStealingPool.h"
+
+// Parameters that can be swept, in firmware units (ADC counts, timer counts and loops)
+enum {
+	P_PVMPP, P_LOWPV, P_MAXCELLV, P_MINCELLV, P_MINBLEEDV, P_STOPCHARGEV, P_RESTARTCHARGEV, P_RESTARTDISCHV,
+	P_MAXDUTY, P_PWMPERIOD, P_MAXSNOOZETIME, numParams
+};
+
+struct ParamInfo {
+	const char *name;
+	double defaultValue;
+};
+
+const ParamInfo paramInfo[numParams] = {
+	{"PVmpp_uncalib", PVmpp_uncalib},
+	{"lowPV_uncalib", lowPV_uncalib},
+	{"maxCellV_uncalib", maxCellV_uncalib},
+	{"minCellV_uncalib", minCellV_uncalib},
+	{"minBleedV_uncalib", minBleedV_uncalib},
+	{"stopChargeV_uncalib", stopChargeV_uncalib},
+	{"restartChargeV_uncalib", restartChargeV_uncalib},
+	{"restartDischV_uncalib", restartDischV_uncalib},
+	{"maxDuty", maxDuty},
+	{"PWMperiod", PWMperiod},
+	{"maxSnoozeTime", maxSnoozeTime},
+};
+
+struct Combination {
+	double values[numParams];
+};
+
+struct Metrics {
+	double harvestedWh;			// Into the battery
+	double demandWh;			// Asked for by the load
+	double deliveredWh;			// Actually delivered to the load
+	int cutoffs;				// Low-voltage disconnections (batteryStatus going to 2 whilst awake)
+	int deepDischarges;			// Times any cell's open-circuit voltage fell below deepDischargeV
+	double highVoltageHours;	// Hours with any cell above stressHighV
+	double lowChargeHours;		// Hours with any cell below stressLowSoC
+	double maxCellVoltage;
+	double minCellVoltage;
+	double sleepHours;
+	int wakeUps;				// Full wake-ups from sleep
+	double score;
+};
+
+struct Weights {
+	double deepDischarge;		// Wh per deep discharge
+	double cutoff;				// Wh per cutoff
+	double stress;				// Wh per hour of stress
+};
+
+const double deepDischargeV = 2.5;
+const double stressHighV = 3.60;
+const double stressLowSoC = 0.05;
+
+// Firmware modes
+enum { AWAKE, SNOOZE, SLEEP };
+
+const int lanes = 8;
+
+// A batch of combinations, run in lock-step through the same profile
+struct Batch {
+	int n;
+	// Parameters, converted to volts, duty fractions and seconds
+	double PVmppV[lanes];		// At the PV ADC divider (after the diode)
+	double lowPVV[lanes];
+	double maxCellV[lanes];
+	double minCellV[lanes];
+	double minBleedV[lanes];
+	double stopChargeV[lanes];
+	double restartChargeV[lanes];
+	double restartDischV[lanes];
+	double maxDutyFraction[lanes];
+	double dutySlew[lanes];		// Duty fraction per second
+	double huntingCurrent[lanes];// Charge current ripple from TACCR1 hunting (A)
+	double snoozeTime[lanes];
+	// Plant state
+	double soc[4][lanes];
+	double capacity[4][lanes];	// Coulombs
+	double terminalV[4][lanes];
+	// Firmware state
+	char mode[lanes];
+	char batteryStatus[lanes];
+	bool bleeding[4][lanes];
+	double duty[lanes];			// TACCR1 / TACCR0
+	double snoozeLeft[lanes];	// Seconds until snooze turns into sleep
+	double watchdogLeft[lanes];	// Seconds until the watchdog next wakes us, when asleep
+	bool deep[lanes];
+	Metrics metrics[lanes];
+};
+
+// The parts of each step that are the same for every combination, worked out once per profile
+struct Environment {
+	std::vector<float> panelT;			// Panel temperature (C)
+	std::vector<float> PVsense;			// Open-circuit PV voltage as seen by the ADC (after the diode)
+	std::vector<float> maxChargePower;	// Most power the charger could get out of the panel (W)
+};
+
+void prepareEnvironment(const Profile &profile, const PlantConfig &config, Environment &environment) {
+	for (size_t k = 0; k < profile.irradiance.size(); k++) {
+		double G = profile.irradiance[k];
+		double panelT = panelTemperature(config, profile.ambient[k], G);
+		double Voc = pvOpenCircuitVoltage(config, G, panelT);
+		environment.panelT.push_back(panelT);
+		environment.PVsense.push_back(Voc > config.diodeDrop ? Voc - config.diodeDrop : 0);
+		environment.maxChargePower.push_back(config.converterEfficiency * pvMaxPower(config, G, panelT));
+	}
+}
+
+void initialiseBatch(Batch &batch, const Combination *combinations, int n, const PlantConfig &config) {
+	memset(&batch, 0, sizeof(batch));
+	batch.n = n;
+	for (int l = 0; l < n; l++) {
+		const double *v = combinations[l].values;
+		batch.PVmppV[l] = v[P_PVMPP] * C_PV / 100;
+		batch.lowPVV[l] = v[P_LOWPV] * C_PV / 100;
+		batch.maxCellV[l] = v[P_MAXCELLV] * C_CELL / 100;
+		batch.minCellV[l] = v[P_MINCELLV] * C_CELL / 100;
+		batch.minBleedV[l] = v[P_MINBLEEDV] * C_CELL / 100;
+		batch.stopChargeV[l] = v[P_STOPCHARGEV] * C_CELL / 100;
+		batch.restartChargeV[l] = v[P_RESTARTCHARGEV] * C_CELL / 100;
+		batch.restartDischV[l] = v[P_RESTARTDISCHV] * C_CELL / 100;
+		batch.maxDutyFraction[l] = v[P_MAXDUTY] / v[P_PWMPERIOD];
+		batch.dutySlew[l] = config.loopRate / v[P_PWMPERIOD];
+		batch.huntingCurrent[l] = config.huntingCounts / v[P_PWMPERIOD] * config.nudgeVoltsPerDuty
+				/ (config.chargePathResistance + 4 * config.cellResistance);
+		batch.snoozeTime[l] = v[P_MAXSNOOZETIME] / config.snoozeLoopRate;
+		// Same cells in every lane, so that combinations are compared fairly
+		for (int c = 0; c < 4; c++) {
+			double spread = config.cellCapacitySpread * (c - 1.5) / 1.5;
+			batch.capacity[c][l] = config.cellCapacityAh * (1 + spread) * 3600;
+			batch.soc[c][l] = config.initialSoC;
+			batch.terminalV[c][l] = cellOCV(config.initialSoC);
+		}
+		// Starts as if just woken up by the first light
+		batch.mode[l] = SLEEP;
+		batch.batteryStatus[l] = 2;
+		batch.duty[l] = batch.maxDutyFraction[l];
+		batch.metrics[l].minCellVoltage = 10;
+	}
+}
+
+// Mirrors refreshBatteryStatus()
+static inline char batteryStatusFor(const Batch &b, int l, double minV, bool allAboveStop) {
+	char status = b.batteryStatus[l];
+	if (minV <= b.minCellV[l])
+		status = 2;
+	if (status == 2 && minV >= b.restartDischV[l])
+		status = 0;
+	if (allAboveStop)
+		status = 1;
+	if (status == 1 && minV < b.restartChargeV[l])
+		status = 0;
+	return status;
+}
+
+void runBatch(Batch &b, const Profile &profile, const Environment &environment, const PlantConfig &config, const Weights &weights) {
+	const double dt = profile.dt;
+	const double rTotal = config.chargePathResistance + 4 * config.cellResistance;
+	for (size_t k = 0; k < profile.irradiance.size(); k++) {
+		// Things that are the same for every lane
+		const double G = profile.irradiance[k];
+		const double load = profile.load[k];
+		const double panelT = environment.panelT[k];
+		const double PVsense = environment.PVsense[k];
+		const double maxChargePower = environment.maxChargePower[k];
+
+		for (int l = 0; l < b.n; l++) {
+			Metrics &m = b.metrics[l];
+			// What the firmware sees
+			double minV = b.terminalV[0][l], maxV = b.terminalV[0][l];
+			bool allAboveStop = true;
+			for (int c = 0; c < 4; c++) {
+				minV = std::min(minV, b.terminalV[c][l]);
+				maxV = std::max(maxV, b.terminalV[c][l]);
+				allAboveStop &= b.terminalV[c][l] >= b.stopChargeV[l];
+			}
+			const bool PVpresent = PVsense >= b.lowPVV[l];
+
+			// Sleeping: the watchdog wakes us every wakeUpPeriod to look for PV, and we stay
+			// awake if it's there (with steps longer than that, at the first step with PV)
+			if (b.mode[l] == SLEEP) {
+				b.watchdogLeft[l] -= dt;
+				if (b.watchdogLeft[l] <= 0) {
+					b.watchdogLeft[l] = fmod(b.watchdogLeft[l], config.wakeUpPeriod) + config.wakeUpPeriod;
+					if (PVpresent) {
+						b.mode[l] = AWAKE;
+						b.batteryStatus[l] = 2;		// initialiseGlobals()
+						b.duty[l] = b.maxDutyFraction[l];
+						m.wakeUps++;
+					}
+				}
+			}
+			if (b.mode[l] != SLEEP) {
+				char status = batteryStatusFor(b, l, minV, allAboveStop);
+				if (status == 2 && b.batteryStatus[l] != 2)
+					m.cutoffs++;
+				b.batteryStatus[l] = status;
+				// balanceCells()
+				for (int c = 0; c < 4; c++) {
+					if (!b.bleeding[c][l] && b.terminalV[c][l] >= b.maxCellV[l] && PVpresent)
+						b.bleeding[c][l] = true;
+					if (b.bleeding[c][l] && (b.terminalV[c][l] < b.minBleedV[l] || !PVpresent || status == 1))
+						b.bleeding[c][l] = false;
+				}
+				// considerSleep(), then considerSnooze()
+				if (!PVpresent && status == 2)
+					b.mode[l] = SLEEP;
+				else if (b.mode[l] == AWAKE && !PVpresent) {
+					b.mode[l] = SNOOZE;
+					b.snoozeLeft[l] = b.snoozeTime[l];
+				}
+				else if (b.mode[l] == SNOOZE) {
+					b.snoozeLeft[l] -= dt;
+					if (b.snoozeLeft[l] <= 0)
+						b.mode[l] = SLEEP;
+					else if (PVpresent)
+						b.mode[l] = AWAKE;
+				}
+				if (b.mode[l] == SLEEP) {
+					for (int c = 0; c < 4; c++)
+						b.bleeding[c][l] = false;
+					b.watchdogLeft[l] = config.wakeUpPeriod;
+				}
+			}
+
+			// Pack voltage without the charge/discharge drop
+			double packOCV = 0;
+			double OCV[4];
+			for (int c = 0; c < 4; c++) {
+				OCV[c] = cellOCV(b.soc[c][l]);
+				packOCV += OCV[c];
+			}
+
+			// Charge regulator (only when awake, snoozing disables the PWM pin)
+			double chargeCurrent = 0;
+			if (b.mode[l] == AWAKE) {
+				// Equilibrium current: the firmware throttles if PV is below PVmpp, if the
+				// highest cell is at maxCellV, or if the battery's full
+				double target = 0;
+				if (b.batteryStatus[l] != 1) {
+					double Vpv = b.PVmppV[l] + config.diodeDrop;
+					double PVlimited = config.converterEfficiency * Vpv * pvCurrent(config, Vpv, G, panelT) / packOCV;
+					double cellLimited = 1e9;
+					for (int c = 0; c < 4; c++)
+						cellLimited = std::min(cellLimited, (b.maxCellV[l] - OCV[c]) / config.cellResistance);
+					target = std::max(0.0, std::min(PVlimited, cellLimited));
+				}
+				double targetDuty = b.maxDutyFraction[l];
+				if (target > 0)
+					targetDuty = (config.chargeVoltageOpen - packOCV - target * rTotal) / config.nudgeVoltsPerDuty;
+				targetDuty = std::min(std::max(targetDuty, 0.0), b.maxDutyFraction[l]);
+				// Slew towards it at one count per loop, averaging over the step
+				double step = b.dutySlew[l] * dt;
+				double difference = targetDuty - b.duty[l];
+				double averageDuty;
+				if (fabs(difference) <= step) {
+					double reached = fabs(difference) / step;
+					averageDuty = (b.duty[l] + targetDuty) / 2 * reached + targetDuty * (1 - reached);
+					b.duty[l] = targetDuty;
+				}
+				else {
+					double next = b.duty[l] + (difference > 0 ? step : -step);
+					averageDuty = (b.duty[l] + next) / 2;
+					b.duty[l] = next;
+				}
+				chargeCurrent = (config.chargeVoltageOpen - config.nudgeVoltsPerDuty * averageDuty - packOCV) / rTotal;
+				chargeCurrent = std::max(0.0, std::min(chargeCurrent, maxChargePower / packOCV));
+				// Hunting about the equilibrium costs a little (second order in the ripple)
+				if (chargeCurrent > 0) {
+					double ripple = std::min(1.0, b.huntingCurrent[l] / chargeCurrent);
+					chargeCurrent *= 1 - 0.5 * ripple * ripple;
+				}
+			}
+
+			// Everything else coming out of the pack
+			bool gateOpen = b.mode[l] != SLEEP && b.batteryStatus[l] != 2;
+			double packCurrent = chargeCurrent;
+			if (gateOpen)
+				packCurrent -= load / packOCV;
+			if (b.mode[l] == AWAKE)
+				packCurrent -= config.awakeCurrent;
+			else if (b.mode[l] == SNOOZE)
+				packCurrent -= config.snoozeCurrent;
+			else
+				packCurrent -= config.sleepCurrent + config.awakeCurrent * config.wakeCheckTime / config.wakeUpPeriod;
+			if (gateOpen)
+				packCurrent -= config.LEDCurrent;
+
+			// Update the cells
+			bool anyHigh = false, anyLow = false, anyDeep = false;
+			for (int c = 0; c < 4; c++) {
+				double current = packCurrent - (b.bleeding[c][l] ? config.bleedCurrent : 0);
+				b.soc[c][l] += current * dt / b.capacity[c][l];
+				double ocv = cellOCV(b.soc[c][l]);
+				b.terminalV[c][l] = ocv + current * config.cellResistance;
+				anyHigh |= b.terminalV[c][l] > stressHighV;
+				anyLow |= b.soc[c][l] < stressLowSoC;
+				anyDeep |= ocv < deepDischargeV;
+				m.maxCellVoltage = std::max(m.maxCellVoltage, b.terminalV[c][l]);
+				m.minCellVoltage = std::min(m.minCellVoltage, b.terminalV[c][l]);
+			}
+
+			// Score
+			m.harvestedWh += chargeCurrent * packOCV * dt / 3600;
+			m.demandWh += load * dt / 3600;
+			if (gateOpen)
+				m.deliveredWh += load * dt / 3600;
+			if (anyHigh)
+				m.highVoltageHours += dt / 3600;
+			if (anyLow)
+				m.lowChargeHours += dt / 3600;
+			if (anyDeep && !b.deep[l])
+				m.deepDischarges++;
+			b.deep[l] = anyDeep;
+			if (b.mode[l] == SLEEP)
+				m.sleepHours += dt / 3600;
+		}
+	}
+	for (int l = 0; l < b.n; l++) {
+		Metrics &m = b.metrics[l];
+		m.score = m.deliveredWh - weights.deepDischarge * m.deepDischarges - weights.cutoff * m.cutoffs
+				- weights.stress * (m.highVoltageHours + m.lowChargeHours);
+	}
+}
+
+// Combinations that the firmware's logic can't work with
+bool validCombination(const Combination &combination) {
+	const double *v = combination.values;
+	return v[P_LOWPV] < v[P_PVMPP] && v[P_MINCELLV] < v[P_RESTARTDISCHV] && v[P_RESTARTCHARGEV] < v[P_STOPCHARGEV]
+			&& v[P_MINBLEEDV] <= v[P_MAXCELLV] && v[P_MAXDUTY] <= v[P_PWMPERIOD] && v[P_PWMPERIOD] <= 0xFFFF
+			&& v[P_MAXDUTY] > 0 && v[P_MAXSNOOZETIME] > 0;
+}
+
+// name=start:stop:step or name=v1,v2,...
+bool parseSweep(const char *spec, std::vector<double> *sweeps) {
+	const char *equals = strchr(spec, '=');
+	if (!equals)
+		return false;
+	std::string name(spec, equals - spec);
+	int index = -1;
+	for (int i = 0; i < numParams; i++) {
+		if (name == paramInfo[i].name)
+			index = i;
+	}
+	if (index < 0) {
+		fprintf(stderr, "Unknown parameter %s\n", name.c_str());
+		return false;
+	}
+	std::vector<double> &values = sweeps[index];
+	values.clear();
+	const char *text = equals + 1;
+	double start, stop, step;
+	if (strchr(text, ':')) {
+		if (sscanf(text, "%lf:%lf:%lf", &start, &stop, &step) != 3 || step <= 0 || stop < start)
+			return false;
+		for (double v = start; v <= stop + step / 1000; v += step)
+			values.push_back(v);
+	}
+	else {
+		std::string list(text);
+		size_t position = 0;
+		while (position <= list.size()) {
+			size_t comma = list.find(',', position);
+			if (comma == std::string::npos)
+				comma = list.size();
+			values.push_back(strtod(list.substr(position, comma - position).c_str(), NULL));
+			position = comma + 1;
+		}
+	}
+	return !values.empty();
+}
+
+// name=value for the plant configuration
+bool parsePlant(const char *spec, PlantConfig &config) {
+	struct { const char *name; double *value; } fields[] = {
+		{"panelWp", &config.panelWp}, {"panelVoc", &config.panelVoc}, {"panelVmp", &config.panelVmp},
+		{"panelVocTempCoeff", &config.panelVocTempCoeff}, {"panelNOCTRise", &config.panelNOCTRise},
+		{"diodeDrop", &config.diodeDrop}, {"converterEfficiency", &config.converterEfficiency},
+		{"chargeVoltageOpen", &config.chargeVoltageOpen}, {"nudgeVoltsPerDuty", &config.nudgeVoltsPerDuty},
+		{"chargePathResistance", &config.chargePathResistance}, {"huntingCounts", &config.huntingCounts},
+		{"cellCapacityAh", &config.cellCapacityAh}, {"cellCapacitySpread", &config.cellCapacitySpread},
+		{"cellResistance", &config.cellResistance}, {"initialSoC", &config.initialSoC},
+		{"bleedCurrent", &config.bleedCurrent}, {"awakeCurrent", &config.awakeCurrent},
+		{"snoozeCurrent", &config.snoozeCurrent}, {"sleepCurrent", &config.sleepCurrent},
+		{"LEDCurrent", &config.LEDCurrent}, {"loopRate", &config.loopRate},
+		{"snoozeLoopRate", &config.snoozeLoopRate}, {"wakeUpPeriod", &config.wakeUpPeriod},
+		{"wakeCheckTime", &config.wakeCheckTime},
+	};
+	const char *equals = strchr(spec, '=');
+	if (!equals)
+		return false;
+	std::string name(spec, equals - spec);
+	for (auto &field : fields) {
+		if (name == field.name) {
+			*field.value = strtod(equals + 1, NULL);
+			return true;
+		}
+	}
+	fprintf(stderr, "Unknown plant setting %s\n", name.c_str());
+	return false;
+}
+
+bool parseWeights(const char *spec, Weights &weights) {
+	std::string list(spec);
+	size_t position = 0;
+	while (position < list.size()) {
+		size_t comma = list.find(',', position);
+		if (comma == std::string::npos)
+			comma = list.size();
+		std::string item = list.substr(position, comma - position);
+		size_t equals = item.find('=');
+		if (equals == std::string::npos)
+			return false;
+		std::string name = item.substr(0, equals);
+		double value = strtod(item.c_str() + equals + 1, NULL);
+		if (name == "deep")
+			weights.deepDischarge = value;
+		else if (name == "cutoff")
+			weights.cutoff = value;
+		else if (name == "stress")
+			weights.stress = value;
+		else
+			return false;
+		position = comma + 1;
+	}
+	return true;
+}
+
+void usage(const char *program) {
+	fprintf(stderr,
+			"Usage: %s [options]\n"
+			"  -p name=start:stop:step   Sweep a parameter over a range (firmware units, repeatable)\n"
+			"  -p name=v1,v2,...         ...or over a list of values\n"
+			"  -c climate[,climate...]   Synthetic climates to run (default: all of %s)\n"
+			"  -f profile.csv            Recorded profile: time (s), irradiance (W/m^2), load (W)[, ambient (C)] (repeatable)\n"
+			"  -d days                   Days of synthetic weather (default 21)\n"
+			"  -s seed                   Seed for synthetic weather (default 1)\n"
+			"  -t seconds                Simulation step (default 5)\n"
+			"  -j threads                Worker threads (default: one per core)\n"
+			"  -o results.csv            Write every combination's results for every profile\n"
+			"  -n count                  Number of best combinations to list (default 10)\n"
+			"  -w deep=W,cutoff=W,stress=W   Score weights: Wh lost per deep discharge, per cutoff, per hour of stress\n"
+			"  -P name=value             Plant model setting (see plantModel.h), e.g. panelWp=30\n"
+			"Parameters:", program, syntheticClimates());
+	for (int i = 0; i < numParams; i++)
+		fprintf(stderr, " %s", paramInfo[i].name);
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[]) {
+	std::vector<double> sweeps[numParams];
+	std::vector<std::string> climates;
+	std::vector<const char *> profilePaths;
+	int days = 21;
+	unsigned int seed = 1;
+	double dt = 5;
+	unsigned int threads = 0;
+	const char *outputPath = NULL;
+	int top = 10;
+	Weights weights = {50, 1, 0.5};
+	PlantConfig config = defaultPlantConfig();
+
+	for (int i = 1; i < argc; i++) {
+		const char *option = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+		bool ok = value != NULL;
+		if (!strcmp(option, "-p"))
+			ok = ok && parseSweep(value, sweeps);
+		else if (!strcmp(option, "-c")) {
+			std::string list(value ? value : "");
+			for (size_t position = 0; ok && position < list.size();) {
+				size_t comma = list.find(',', position);
+				if (comma == std::string::npos)
+					comma = list.size();
+				climates.push_back(list.substr(position, comma - position));
+				position = comma + 1;
+			}
+		}
+		else if (!strcmp(option, "-f"))
+			profilePaths.push_back(value);
+		else if (!strcmp(option, "-d"))
+			ok = ok && (days = atoi(value)) > 0;
+		else if (!strcmp(option, "-s"))
+			seed = ok ? strtoul(value, NULL, 0) : 0;
+		else if (!strcmp(option, "-t"))
+			ok = ok && (dt = atof(value)) > 0;
+		else if (!strcmp(option, "-j"))
+			threads = ok ? atoi(value) : 0;
+		else if (!strcmp(option, "-o"))
+			outputPath = value;
+		else if (!strcmp(option, "-n"))
+			top = ok ? atoi(value) : 0;
+		else if (!strcmp(option, "-w"))
+			ok = ok && parseWeights(value, weights);
+		else if (!strcmp(option, "-P"))
+			ok = ok && parsePlant(value, config);
+		else
+			ok = false;
+		if (!ok) {
+			usage(argv[0]);
+			return 2;
+		}
+		i++;
+	}
+	finalisePlantConfig(config);
+
+	// Profiles
+	std::vector<Profile> profiles;
+	if (climates.empty() && profilePaths.empty())
+		climates = {"sahel", "equatorial", "monsoon", "highland"};
+	for (auto &climate : climates) {
+		Profile profile;
+		if (!syntheticProfile(climate, days, seed, dt, profile)) {
+			fprintf(stderr, "Unknown climate %s (try %s)\n", climate.c_str(), syntheticClimates());
+			return 2;
+		}
+		profiles.push_back(profile);
+	}
+	for (auto path : profilePaths) {
+		Profile profile;
+		if (!loadProfileCSV(path, dt, profile))
+			return 1;
+		profiles.push_back(profile);
+	}
+
+	// Every combination of the swept values, with the header.h defaults for everything
+	// else. The defaults on their own always go first, as the baseline, so they're left
+	// out if the grid comes to them again.
+	std::vector<Combination> combinations;
+	Combination baseline;
+	for (int i = 0; i < numParams; i++) {
+		baseline.values[i] = paramInfo[i].defaultValue;
+		if (sweeps[i].empty())
+			sweeps[i].push_back(paramInfo[i].defaultValue);
+	}
+	combinations.push_back(baseline);
+	size_t total = 1;
+	for (int i = 0; i < numParams; i++)
+		total *= sweeps[i].size();
+	size_t skipped = 0;
+	for (size_t index = 0; index < total; index++) {
+		Combination combination;
+		size_t rest = index;
+		for (int i = 0; i < numParams; i++) {
+			combination.values[i] = sweeps[i][rest % sweeps[i].size()];
+			rest /= sweeps[i].size();
+		}
+		if (!memcmp(combination.values, baseline.values, sizeof(baseline.values)))
+			continue;
+		if (validCombination(combination))
+			combinations.push_back(combination);
+		else
+			skipped++;
+	}
+
+	std::vector<Environment> environments(profiles.size());
+	for (size_t p = 0; p < profiles.size(); p++)
+		prepareEnvironment(profiles[p], config, environments[p]);
+
+	// Run every batch of lanes against every profile
+	size_t batches = (combinations.size() + lanes - 1) / lanes;
+	std::vector<Metrics> results(combinations.size() * profiles.size());
+	WorkStealingPool pool(threads);
+	fprintf(stderr, "%zu combinations (%zu invalid skipped) x %zu profiles of %zu steps, on %u threads\n",
+			combinations.size(), skipped, profiles.size(), profiles[0].irradiance.size(), pool.threads());
+	pool.run(batches * profiles.size(), [&](size_t task) {
+		size_t batchIndex = task % batches;
+		size_t profileIndex = task / batches;
+		size_t first = batchIndex * lanes;
+		int n = (int) std::min((size_t) lanes, combinations.size() - first);
+		Batch *batch = new Batch;
+		initialiseBatch(*batch, &combinations[first], n, config);
+		runBatch(*batch, profiles[profileIndex], environments[profileIndex], config, weights);
+		for (int l = 0; l < n; l++)
+			results[profileIndex * combinations.size() + first + l] = batch->metrics[l];
+		delete batch;
+	});
+
+	// Everything, for further analysis
+	if (outputPath) {
+		FILE *f = fopen(outputPath, "w");
+		if (!f) {
+			fprintf(stderr, "Can't write %s\n", outputPath);
+			return 1;
+		}
+		fprintf(f, "combination");
+		for (int i = 0; i < numParams; i++)
+			fprintf(f, ",%s", paramInfo[i].name);
+		fprintf(f, ",profile,harvestedWh,demandWh,deliveredWh,cutoffs,deepDischarges,highVoltageHours,lowChargeHours,"
+				"maxCellVoltage,minCellVoltage,sleepHours,wakeUps,score\n");
+		for (size_t p = 0; p < profiles.size(); p++) {
+			for (size_t c = 0; c < combinations.size(); c++) {
+				const Metrics &m = results[p * combinations.size() + c];
+				fprintf(f, "%zu", c);
+				for (int i = 0; i < numParams; i++)
+					fprintf(f, ",%g", combinations[c].values[i]);
+				fprintf(f, ",%s,%.2f,%.2f,%.2f,%d,%d,%.2f,%.2f,%.3f,%.3f,%.2f,%d,%.2f\n", profiles[p].name.c_str(),
+						m.harvestedWh, m.demandWh, m.deliveredWh, m.cutoffs, m.deepDischarges, m.highVoltageHours,
+						m.lowChargeHours, m.maxCellVoltage, m.minCellVoltage, m.sleepHours, m.wakeUps, m.score);
+			}
+		}
+		fclose(f);
+	}
+
+	// Rank by the worst score over all the profiles, so that choices have to hold up in every climate
+	std::vector<double> worst(combinations.size(), 1e30);
+	for (size_t p = 0; p < profiles.size(); p++) {
+		for (size_t c = 0; c < combinations.size(); c++)
+			worst[c] = std::min(worst[c], results[p * combinations.size() + c].score);
+	}
+	std::vector<size_t> order(combinations.size());
+	for (size_t c = 0; c < order.size(); c++)
+		order[c] = c;
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return worst[a] > worst[b]; });
+
+	printf("%-6s %-10s", "rank", "worst");
+	for (size_t p = 0; p < profiles.size(); p++)
+		printf(" %14.14s", profiles[p].name.c_str());
+	printf("  parameters (changed from header.h)\n");
+	for (size_t r = 0; r < order.size(); r++) {
+		size_t c = order[r];
+		if ((int) r >= top && c != 0)
+			continue;
+		printf("%-6zu %-10.1f", r + 1, worst[c]);
+		for (size_t p = 0; p < profiles.size(); p++)
+			printf(" %14.1f", results[p * combinations.size() + c].score);
+		if (c == 0)
+			printf("  (header.h defaults)");
+		for (int i = 0; i < numParams; i++) {
+			if (combinations[c].values[i] != paramInfo[i].defaultValue)
+				printf("  %s=%g", paramInfo[i].name, combinations[c].values[i]);
+		}
+		printf("\n");
+	}
+	return 0;
+}
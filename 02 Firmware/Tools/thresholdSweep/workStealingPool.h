@@ -0,0 +1,87 @@
+/*
+ * workStealingPool.h
+ *
+ * Runs a set of numbered tasks over all cores. Each worker starts with a contiguous share
+ * of the tasks in its own deque and works from the back of it; when it runs out it steals
+ * from the front of another worker's deque, so workers that get the quick tasks end up
+ * helping the ones that got the slow tasks.
+ */
+
+#ifndef WORKSTEALINGPOOL_H_
+#define WORKSTEALINGPOOL_H_
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool {
+public:
+	// 0 threads means one per core
+	explicit WorkStealingPool(unsigned int threads = 0) {
+		workerCount = threads ? threads : std::thread::hardware_concurrency();
+		if (workerCount == 0)
+			workerCount = 1;
+	}
+
+	unsigned int threads(void) const {
+		return workerCount;
+	}
+
+	// Run task(i) for every i in [0, count), and return when they're all done
+	void run(size_t count, const std::function<void(size_t)> &task) {
+		std::vector<Worker> workers(workerCount);
+		for (unsigned int w = 0; w < workerCount; w++) {
+			for (size_t i = count * w / workerCount; i < count * (w + 1) / workerCount; i++)
+				workers[w].tasks.push_back(i);
+		}
+		std::vector<std::thread> threads;
+		for (unsigned int w = 0; w < workerCount; w++)
+			threads.emplace_back(&WorkStealingPool::work, this, w, std::ref(workers), std::cref(task));
+		for (auto &thread : threads)
+			thread.join();
+	}
+
+private:
+	struct Worker {
+		std::mutex lock;
+		std::deque<size_t> tasks;
+	};
+
+	unsigned int workerCount;
+
+	static bool popBack(Worker &worker, size_t &task) {
+		std::lock_guard<std::mutex> guard(worker.lock);
+		if (worker.tasks.empty())
+			return false;
+		task = worker.tasks.back();
+		worker.tasks.pop_back();
+		return true;
+	}
+
+	static bool stealFront(Worker &worker, size_t &task) {
+		std::lock_guard<std::mutex> guard(worker.lock);
+		if (worker.tasks.empty())
+			return false;
+		task = worker.tasks.front();
+		worker.tasks.pop_front();
+		return true;
+	}
+
+	// No tasks are added once started, so when there's nothing left to steal
+	// anywhere, everything left is already being run and this worker is done.
+	void work(unsigned int self, std::vector<Worker> &workers, const std::function<void(size_t)> &task) {
+		size_t next;
+		for (;;) {
+			bool found = popBack(workers[self], next);
+			for (unsigned int i = 1; !found && i < workerCount; i++)
+				found = stealFront(workers[(self + i) % workerCount], next);
+			if (!found)
+				return;
+			task(next);
+		}
+	}
+};
+
+#endif /* WORKSTEALINGPOOL_H_ */
@@ -0,0 +1,205 @@
+/*
+ * traceDecode.cpp
+ *
+ * Decodes the Battery 100 event trace (see eventTrace.cpp) from a memory dump into a
+ * timeline, oldest event first.
+ *
+ * The dump can be either:
+ *  - raw binary (e.g. mspdebug "save_raw 0x200 256 ram.bin", or CCS "Save Memory" as binary)
+ *  - text, with "-x", which takes any mix of 2-digit hex bytes ("7a 0c ...", as in mspdebug
+ *    "md" output) and 0x-prefixed 4-digit hex words ("0x7ACE", as in a CCS .dat file).
+ *    Address columns ending in ':', and anything after a '|', are ignored.
+ * The dump can hold the whole of RAM; the trace is found by looking for traceMagic.
+ *
+ * Build:	g++ -O2 -o traceDecode traceDecode.cpp
+ * Usage:	traceDecode [-x] [-r loopsPerSecond] dumpfile
+ *
+ * Times are given in main loops since the trace was started, and in seconds assuming
+ * loopsPerSecond (default 4300, which is the awake loop rate at 8MHz). Loops are much
+ * slower while snoozing, and don't count at all whilst asleep, so treat the seconds as rough.
+ */
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../Battery 100/header.h"
+
+// Offsets (in 16-bit words) of the TraceLog members, as laid out on the MSP430
+#define WORD_MAGIC			0
+#define WORD_HEAD			1
+#define WORD_TICKS			2
+#define WORD_EPOCH			3
+#define WORD_LOGGEDEPOCH	4
+#define WORD_ENTRIES		5
+#define TRACE_WORDS			(WORD_ENTRIES + 2 * traceLength)
+
+const char *eventNames[16] = {
+	"boot", "batteryStatus", "LEDStatus", "gate open", "gate close", "bleed on", "bleed off", "snooze",
+	"wake", "sleep", "thermal shutdown", "fault", "(12)", "(13)", "epoch", "empty"
+};
+const char *batteryStatusNames[4] = {"normal", "full", "empty", "short-circuit"};
+const char *LEDStatusNames[4] = {"off", "red", "yellow", "green"};
+
+// Read the whole file in as bytes
+bool readBinary(const char *path, std::vector<unsigned char> &bytes) {
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return false;
+	unsigned char buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+		bytes.insert(bytes.end(), buffer, buffer + n);
+	fclose(f);
+	return true;
+}
+
+// Read a text dump of hex bytes and/or 0x-prefixed hex words
+bool readText(const char *path, std::vector<unsigned char> &bytes) {
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return false;
+	char line[1024];
+	while (fgets(line, sizeof(line), f)) {
+		// Drop any ASCII column
+		char *bar = strchr(line, '|');
+		if (bar)
+			*bar = 0;
+		for (char *token = strtok(line, " \t\r\n,"); token; token = strtok(NULL, " \t\r\n,")) {
+			size_t length = strlen(token);
+			// Address column
+			if (token[length - 1] == ':')
+				continue;
+			char *end;
+			if (length == 6 && token[0] == '0' && (token[1] == 'x' || token[1] == 'X')) {
+				unsigned long word = strtoul(token + 2, &end, 16);
+				if (*end == 0) {
+					bytes.push_back(word & 0xFF);
+					bytes.push_back(word >> 8);
+				}
+			}
+			else if (length == 2 && isxdigit(token[0]) && isxdigit(token[1])) {
+				bytes.push_back(strtoul(token, &end, 16));
+			}
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+// Describe the payload of an entry
+std::string describe(unsigned int id, unsigned int payload) {
+	char text[128];
+	unsigned int oldStatus = payload >> 8;
+	unsigned int newStatus = payload & 0xFF;
+	switch (id) {
+	case EV_BOOT:
+		snprintf(text, sizeof(text), "IFG1=0x%02X%s%s%s", payload, (payload & 0x01) ? " watchdog" : "",
+				(payload & 0x04) ? " power-on" : "", (payload & 0x08) ? " reset-pin" : "");
+		break;
+	case EV_BATTERYSTATUS:
+		snprintf(text, sizeof(text), "%s -> %s", oldStatus < 4 ? batteryStatusNames[oldStatus] : "?",
+				newStatus < 4 ? batteryStatusNames[newStatus] : "?");
+		break;
+	case EV_LEDSTATUS:
+		snprintf(text, sizeof(text), "%s -> %s", oldStatus < 4 ? LEDStatusNames[oldStatus] : "?",
+				newStatus < 4 ? LEDStatusNames[newStatus] : "?");
+		break;
+	case EV_GATEOPEN:
+	case EV_GATECLOSE:
+		snprintf(text, sizeof(text), "min cell %u (%.2fV)", payload, payload * C_CELL / 100);
+		break;
+	case EV_BLEEDON:
+	case EV_BLEEDOFF:
+		snprintf(text, sizeof(text), "cell %u at %u (%.2fV)", oldStatus + 1, newStatus, newStatus * C_CELL / 100);
+		break;
+	case EV_SNOOZE:
+	case EV_WAKE:
+		snprintf(text, sizeof(text), "PV %u (%.2fV)", payload, payload * C_PV / 100);
+		break;
+	case EV_SLEEP:
+		snprintf(text, sizeof(text), "batteryStatus %s", payload < 4 ? batteryStatusNames[payload] : "?");
+		break;
+	case EV_THERMALSHUTDOWN:
+		snprintf(text, sizeof(text), "temperature ADC %u", payload);
+		break;
+	case EV_FAULT:
+		snprintf(text, sizeof(text), "fuse %u (%.2fV)", payload, payload * C_CELL / 100);
+		break;
+	case EV_EPOCH:
+		snprintf(text, sizeof(text), "%u", payload);
+		break;
+	default:
+		snprintf(text, sizeof(text), "0x%04X", payload);
+	}
+	return text;
+}
+
+int main(int argc, char *argv[]) {
+	bool text = false;
+	double loopsPerSecond = 4300;
+	const char *path = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-x"))
+			text = true;
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			loopsPerSecond = atof(argv[++i]);
+		else
+			path = argv[i];
+	}
+	if (!path || loopsPerSecond <= 0) {
+		fprintf(stderr, "Usage: %s [-x] [-r loopsPerSecond] dumpfile\n", argv[0]);
+		return 2;
+	}
+
+	std::vector<unsigned char> bytes;
+	if ( !(text ? readText(path, bytes) : readBinary(path, bytes)) ) {
+		fprintf(stderr, "Can't read %s\n", path);
+		return 1;
+	}
+
+	// Find the trace: traceMagic, on a word boundary, followed by a sensible head
+	std::vector<unsigned int> words;
+	size_t start;
+	for (start = 0; start + 2 * TRACE_WORDS <= bytes.size(); start += 2) {
+		if ( (bytes[start] | (bytes[start + 1] << 8)) == traceMagic && (bytes[start + 2] | (bytes[start + 3] << 8)) < traceLength )
+			break;
+	}
+	if (start + 2 * TRACE_WORDS > bytes.size()) {
+		fprintf(stderr, "No event trace found in %s (is enableEventTrace defined, with traceLength = %d?)\n", path, traceLength);
+		return 1;
+	}
+	for (int i = 0; i < TRACE_WORDS; i++)
+		words.push_back(bytes[start + 2 * i] | (bytes[start + 2 * i + 1] << 8));
+
+	printf("Trace found at offset 0x%zX: %d entries, loop counter %u, epoch %u\n",
+			start, traceLength, words[WORD_TICKS], words[WORD_EPOCH]);
+	printf("%12s %10s  %-18s %s\n", "loops", "seconds", "event", "details");
+
+	// Walk from the oldest entry (at head) to the newest. Until we've seen an epoch
+	// entry we don't know which wrap of the loop counter we're in, so these are given
+	// as relative to the start of an unknown epoch.
+	unsigned int head = words[WORD_HEAD];
+	long epoch = -1;
+	for (int i = 0; i < traceLength; i++) {
+		unsigned int index = (head + i) & (traceLength - 1);
+		unsigned int stamp = words[WORD_ENTRIES + 2 * index];
+		unsigned int payload = words[WORD_ENTRIES + 2 * index + 1];
+		unsigned int id = stamp >> 12;
+		if (id == EV_EMPTY)
+			continue;
+		if (id == EV_EPOCH)
+			epoch = payload;
+		unsigned long loops = (unsigned long) (stamp & 0x0FFF) << traceStampShift;
+		if (epoch >= 0) {
+			loops += (unsigned long) epoch << 16;
+			printf("%12lu %10.1f  ", loops, loops / loopsPerSecond);
+		}
+		else
+			printf("%11s? %10s  ", std::to_string(loops).c_str(), "?");
+		printf("%-18s %s\n", eventNames[id], describe(id, payload).c_str());
+	}
+	return 0;
+}